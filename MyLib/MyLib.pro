@@ -19,13 +19,45 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     ctdataset.cpp \
     icpalgo.cpp \
-    mylib.cpp
+    mylib.cpp \
+    volumegeometry.cpp \
+    bitmask.cpp \
+    componentlabeler.cpp \
+    compactregion.cpp \
+    windowinglut.cpp \
+    displaycache.cpp \
+    computeexecutor.cpp \
+    processinggraph.cpp \
+    ctpipeline.cpp \
+    raymaxindex.cpp \
+    brickpyramid.cpp \
+    axisdepthmaps.cpp \
+    raycaster.cpp \
+    resliceengine.cpp \
+    brickedvolume.cpp
 
 HEADERS += \
     MyLib_global.h \
     ctdataset.h \
     icpalgo.h \
-    mylib.h
+    mylib.h \
+    volumegeometry.h \
+    bitmask.h \
+    componentlabeler.h \
+    compactregion.h \
+    windowinglut.h \
+    displaycache.h \
+    computeexecutor.h \
+    processinggraph.h \
+    ctpipeline.h \
+    raymaxindex.h \
+    brickpyramid.h \
+    axisdepthmaps.h \
+    raycaster.h \
+    resliceengine.h \
+    brickedvolume.h \
+    parallel.h \
+    volumeview.h
 
 CONFIG += warn_off
 INCLUDEPATH += $$PWD/../eigen
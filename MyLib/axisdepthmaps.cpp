@@ -0,0 +1,253 @@
+#include "axisdepthmaps.h"
+#include "parallel.h"
+#include <algorithm>
+
+AxisDepthMaps::AxisDepthMaps()
+    : m_geometry(0, 0, 0, 0, 0, 0), m_threshold(0)
+{
+}
+
+/**
+ * @brief pixelRay finds the ray through a pixel of a depth map
+ * @param geometry size of the volume
+ * @param direction direction of the map
+ * @param column column of the pixel
+ * @param row row of the pixel
+ * @param start receives the voxel where the ray enters the volume
+ * @param axis receives the axis of the ray (0 - x, 1 - y, 2 - z)
+ * @return false if the pixel lies outside the map or has no ray
+ */
+static bool pixelRay(const VolumeGeometry& geometry, AxisDepthMaps::Direction direction, int column, int row,
+                     Voxel& start, int& axis)
+{
+    const int WIDTH = geometry.width();
+    const int HEIGHT = geometry.height();
+    const int LAYERS = geometry.layers();
+    if (column < 0 || row < 0 || column >= AxisDepthMaps::width(geometry, direction)
+            || row >= AxisDepthMaps::height(geometry, direction)){
+        return false;
+    }
+    switch (direction){
+    case AxisDepthMaps::PositiveY:
+        if (column == 0){
+            return false; // column 0 would lie outside the volume
+        }
+        start = {WIDTH - column, 0, row};
+        axis = 1;
+        return true;
+    case AxisDepthMaps::NegativeY:
+        start = {column, HEIGHT - 1, row};
+        axis = 1;
+        return true;
+    case AxisDepthMaps::PositiveX:
+        start = {0, HEIGHT - 1 - column, row};
+        axis = 0;
+        return true;
+    case AxisDepthMaps::NegativeX:
+        start = {WIDTH - 1, column, row};
+        axis = 0;
+        return true;
+    case AxisDepthMaps::PositiveZ:
+        start = {WIDTH - 1 - column, row, 0};
+        axis = 2;
+        return true;
+    case AxisDepthMaps::NegativeZ:
+        start = {column, row, LAYERS - 1};
+        axis = 2;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief AxisDepthMaps::compute finds the first and last voxel at or above a threshold of every ray along x, y and z
+ *
+ * The volume is read once row by row in memory order. The rays along x are finished within a row and the rays along y
+ * within a layer. The layers are split between the threads, each thread keeps its own hits of the rays along z and
+ * they are joined in layer order afterwards.
+ * @param volume the volume, it has to be loaded completely
+ * @param threshold the HU threshold
+ * @param threadCount number of threads, 0 uses all cores
+ */
+void AxisDepthMaps::compute(const VolumeView& volume, int threshold, int threadCount)
+{
+    if (!volume.isValid()){
+        release();
+        return;
+    }
+    const VolumeGeometry& geometry = volume.geometry();
+    const int WIDTH = geometry.width();
+    const int HEIGHT = geometry.height();
+    const int LAYERS = geometry.layers();
+    const int THREADS = std::max(1, std::min(Parallel::threadCount(threadCount), LAYERS));
+    m_geometry = geometry;
+    m_threshold = threshold;
+    m_first[0].assign(size_t(LAYERS)*HEIGHT, -1);
+    m_last[0].assign(size_t(LAYERS)*HEIGHT, -1);
+    m_first[1].assign(size_t(LAYERS)*WIDTH, -1);
+    m_last[1].assign(size_t(LAYERS)*WIDTH, -1);
+
+    // hits along z of the layers of every chunk
+    std::vector<std::vector<short>> chunkFirst(THREADS);
+    std::vector<std::vector<short>> chunkLast(THREADS);
+    Parallel::forChunks(0, LAYERS, THREADS, [&](int firstLayer, int lastLayer, int chunk){
+        std::vector<short>& firstZ = chunkFirst[chunk];
+        std::vector<short>& lastZ = chunkLast[chunk];
+        firstZ.assign(size_t(HEIGHT)*WIDTH, -1);
+        lastZ.assign(size_t(HEIGHT)*WIDTH, -1);
+        std::vector<short> row(WIDTH);
+        for (int z = firstLayer; z < lastLayer; ++z){
+            short* firstY = m_first[1].data() + size_t(z)*WIDTH;
+            short* lastY = m_last[1].data() + size_t(z)*WIDTH;
+            for (int y = 0; y < HEIGHT; ++y){
+                volume.readRow(y, z, row.data());
+                short* rowFirstZ = firstZ.data() + size_t(y)*WIDTH;
+                short* rowLastZ = lastZ.data() + size_t(y)*WIDTH;
+                int firstX = -1;
+                int lastX = -1;
+                for (int x = 0; x < WIDTH; ++x){
+                    const bool hit = row[x] >= threshold;
+                    firstY[x] = hit && firstY[x] < 0 ? short(y) : firstY[x];
+                    lastY[x] = hit ? short(y) : lastY[x];
+                    rowFirstZ[x] = hit && rowFirstZ[x] < 0 ? short(z) : rowFirstZ[x];
+                    rowLastZ[x] = hit ? short(z) : rowLastZ[x];
+                    lastX = hit ? x : lastX;
+                }
+                if (lastX >= 0){
+                    firstX = int(std::find_if(row.begin(), row.end(), [threshold](short value){
+                        return value >= threshold;
+                    }) - row.begin());
+                }
+                m_first[0][size_t(z)*HEIGHT + y] = short(firstX);
+                m_last[0][size_t(z)*HEIGHT + y] = short(lastX);
+            }
+        }
+    });
+
+    // the first hit along z lies in the first chunk that has one, the last hit in the last
+    m_first[2] = std::move(chunkFirst[0]);
+    m_last[2] = std::move(chunkLast[0]);
+    for (int chunk = 1; chunk < THREADS; ++chunk){
+        for (size_t i = 0; i < m_first[2].size(); ++i){
+            if (m_first[2][i] < 0){
+                m_first[2][i] = chunkFirst[chunk][i];
+            }
+            if (chunkLast[chunk][i] >= 0){
+                m_last[2][i] = chunkLast[chunk][i];
+            }
+        }
+    }
+}
+
+/**
+ * @brief AxisDepthMaps::release frees the maps
+ */
+void AxisDepthMaps::release()
+{
+    for (int axis = 0; axis < 3; ++axis){
+        std::vector<short>().swap(m_first[axis]);
+        std::vector<short>().swap(m_last[axis]);
+    }
+    m_geometry = VolumeGeometry(0, 0, 0, 0, 0, 0);
+}
+
+int AxisDepthMaps::width(const VolumeGeometry& geometry, Direction direction)
+{
+    return direction == PositiveX || direction == NegativeX ? geometry.height() : geometry.width();
+}
+
+int AxisDepthMaps::height(const VolumeGeometry& geometry, Direction direction)
+{
+    return direction == PositiveZ || direction == NegativeZ ? geometry.height() : geometry.layers();
+}
+
+/**
+ * @brief AxisDepthMaps::voxelAt finds the voxel shown at a pixel of a depth map, e.g. to pick a seed in the 3D view
+ * @param geometry size of the volume
+ * @param direction direction of the map
+ * @param column column of the pixel
+ * @param row row of the pixel
+ * @param depth value of the map at the pixel
+ * @param voxel receives the voxel
+ * @return false if the pixel lies outside the map or shows no voxel
+ */
+bool AxisDepthMaps::voxelAt(const VolumeGeometry& geometry, Direction direction, int column, int row, int depth,
+                            Voxel& voxel)
+{
+    int axis;
+    Voxel start;
+    if (!pixelRay(geometry, direction, column, row, start, axis)){
+        return false;
+    }
+    const int sign = direction == PositiveX || direction == PositiveY || direction == PositiveZ ? 1 : -1;
+    voxel = start;
+    if (axis == 0){
+        voxel.x += sign*depth;
+    } else if (axis == 1){
+        voxel.y += sign*depth;
+    } else {
+        voxel.z += sign*depth;
+    }
+    return geometry.contains(voxel.x, voxel.y, voxel.z);
+}
+
+/**
+ * @brief AxisDepthMaps::depth finds the depth of the first hit of the ray through a pixel
+ * @param direction direction of the map
+ * @param column column of the pixel
+ * @param row row of the pixel
+ * @return the depth counted from the side the ray enters, -1 if the ray has no hit or the maps are not computed
+ */
+int AxisDepthMaps::depth(Direction direction, int column, int row) const
+{
+    int axis;
+    Voxel start;
+    if (!isValid() || !pixelRay(m_geometry, direction, column, row, start, axis)){
+        return -1;
+    }
+    size_t index;
+    int length;
+    if (axis == 0){
+        index = size_t(start.z)*m_geometry.height() + start.y;
+        length = m_geometry.width();
+    } else if (axis == 1){
+        index = size_t(start.z)*m_geometry.width() + start.x;
+        length = m_geometry.height();
+    } else {
+        index = size_t(start.y)*m_geometry.width() + start.x;
+        length = m_geometry.layers();
+    }
+    if (direction == PositiveX || direction == PositiveY || direction == PositiveZ){
+        return m_first[axis][index];
+    }
+    const int last = m_last[axis][index];
+    return last < 0 ? -1 : length - 1 - last;
+}
+
+/**
+ * @brief AxisDepthMaps::fillDepthMap writes the depth map of a direction, rays without a hit get depth 0
+ * @param direction direction of the map
+ * @param depthMap width(direction) x height(direction) values
+ */
+void AxisDepthMaps::fillDepthMap(Direction direction, short* depthMap) const
+{
+    if (!isValid()){
+        return;
+    }
+    const int WIDTH = width(m_geometry, direction);
+    const int HEIGHT = height(m_geometry, direction);
+    for (int row = 0; row < HEIGHT; ++row){
+        for (int column = 0; column < WIDTH; ++column){
+            depthMap[size_t(row)*WIDTH + column] = short(std::max(0, depth(direction, column, row)));
+        }
+    }
+}
+
+qint64 AxisDepthMaps::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (int axis = 0; axis < 3; ++axis){
+        bytes += qint64((m_first[axis].capacity() + m_last[axis].capacity())*sizeof(short));
+    }
+    return bytes;
+}
@@ -0,0 +1,76 @@
+#ifndef AXISDEPTHMAPS_H
+#define AXISDEPTHMAPS_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include "volumeview.h"
+#include <vector>
+
+/**
+ * @brief Depth maps of a threshold seen from both sides of all three axes, found in one sweep over the volume
+ *
+ * Every ray parallel to an axis keeps the first and the last voxel at or above the threshold. The first hit is the
+ * depth seen from the low side of the axis, the last hit gives the depth seen from the high side. All six maps come
+ * from these three pairs, so switching the direction doesn't read the volume again.
+ *
+ * Layout of the maps (columns x rows, depth counted from the side the rays enter):
+ *
+ *     PositiveY  width x layers   column c shows x = width - c (column 0 is empty), like CTDataset::calculateDepthBuffer
+ *     NegativeY  width x layers   column c shows x = c
+ *     PositiveX  height x layers  column c shows y = height - 1 - c
+ *     NegativeX  height x layers  column c shows y = c
+ *     PositiveZ  width x height   column c shows x = width - 1 - c
+ *     NegativeZ  width x height   column c shows x = c
+ *
+ * Opposite directions are mirrored, so each map is the picture seen from its side. Rays without a hit get depth 0.
+ */
+class MYLIB_EXPORT AxisDepthMaps
+{
+public:
+    /// Directions of the rays
+    enum Direction {
+        PositiveY,  ///< from y = 0 towards +y (the depth buffer of CTDataset)
+        NegativeY,  ///< from the last row towards -y
+        PositiveX,  ///< from x = 0 towards +x
+        NegativeX,  ///< from the last column towards -x
+        PositiveZ,  ///< from layer 0 towards +z
+        NegativeZ   ///< from the last layer towards -z
+    };
+
+    AxisDepthMaps();
+
+    /// Finds the first and last hit of all rays of a threshold, threadCount 0 uses all cores
+    void compute(const VolumeView& volume, int threshold, int threadCount = 0);
+    /// Frees the maps
+    void release();
+    /// Returns true if the maps have been computed
+    bool isValid() const { return !m_first[0].empty(); }
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Threshold of the last compute()
+    int threshold() const { return m_threshold; }
+
+    /// Columns of the map of a direction
+    static int width(const VolumeGeometry& geometry, Direction direction);
+    /// Rows of the map of a direction
+    static int height(const VolumeGeometry& geometry, Direction direction);
+    /// Voxel shown at a pixel of the map of a direction with the depth of that pixel, false if the pixel shows no voxel
+    static bool voxelAt(const VolumeGeometry& geometry, Direction direction, int column, int row, int depth, Voxel& voxel);
+
+    /// Writes the depth map of a direction, width(direction) x height(direction) values
+    void fillDepthMap(Direction direction, short* depthMap) const;
+    /// Depth of the first hit of the ray through a pixel of the map of a direction, -1 if the ray has none
+    int depth(Direction direction, int column, int row) const;
+
+    /// Bytes currently allocated
+    qint64 memoryUsage() const;
+
+private:
+    VolumeGeometry m_geometry;
+    int m_threshold;
+    /// First and last hit of the rays along x, y and z (-1 if none): x rays z*height + y, y rays z*width + x,
+    /// z rays y*width + x
+    std::vector<short> m_first[3];
+    std::vector<short> m_last[3];
+};
+
+#endif // AXISDEPTHMAPS_H
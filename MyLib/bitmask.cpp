@@ -0,0 +1,148 @@
+#include "bitmask.h"
+#include <algorithm>
+#include <cstring>
+
+BitMask::BitMask()
+    : m_size(0), m_dirtyBegin(0), m_dirtyEnd(0)
+{
+}
+
+BitMask::BitMask(qint64 size)
+    : m_size(0), m_dirtyBegin(0), m_dirtyEnd(0)
+{
+    resize(size);
+}
+
+/**
+ * @brief BitMask::resize changes the number of bits, all bits are cleared afterwards
+ * @param size number of bits
+ */
+void BitMask::resize(qint64 size)
+{
+    m_words.assign(size_t((size + 63) >> 6), 0);
+    m_size = size;
+    m_dirtyBegin = wordCount();
+    m_dirtyEnd = 0;
+}
+
+/**
+ * @brief BitMask::release frees the memory of the mask, its size becomes 0
+ */
+void BitMask::release()
+{
+    std::vector<quint64>().swap(m_words);
+    m_size = 0;
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+}
+
+/**
+ * @brief BitMask::setRange sets a range of bits, whole words are written at once
+ * @param begin first bit to set
+ * @param end one past the last bit to set
+ */
+void BitMask::setRange(qint64 begin, qint64 end)
+{
+    if (begin >= end){
+        return;
+    }
+    qint64 firstWord = begin >> 6;
+    qint64 lastWord = (end - 1) >> 6;
+    touch(firstWord, lastWord + 1);
+
+    quint64 firstMask = ~quint64(0) << (begin & 63);
+    quint64 lastMask = ~quint64(0) >> (63 - ((end - 1) & 63));
+    if (firstWord == lastWord){
+        m_words[firstWord] |= firstMask & lastMask;
+        return;
+    }
+    m_words[firstWord] |= firstMask;
+    std::fill(m_words.begin() + firstWord + 1, m_words.begin() + lastWord, ~quint64(0));
+    m_words[lastWord] |= lastMask;
+}
+
+/**
+ * @brief BitMask::setRangeAtomic sets a range of bits while other threads may set bits outside the range or test any
+ * bit. Only the first and the last word can hold bits of other threads, they are or-ed atomically, the words in between
+ * are simply stored.
+ * @param begin first bit to set
+ * @param end one past the last bit to set
+ */
+void BitMask::setRangeAtomic(qint64 begin, qint64 end)
+{
+    if (begin >= end){
+        return;
+    }
+    qint64 firstWord = begin >> 6;
+    qint64 lastWord = (end - 1) >> 6;
+    quint64 firstMask = ~quint64(0) << (begin & 63);
+    quint64 lastMask = ~quint64(0) >> (63 - ((end - 1) & 63));
+    if (firstWord == lastWord){
+        atomicWord(firstWord).fetch_or(firstMask & lastMask, std::memory_order_relaxed);
+        return;
+    }
+    atomicWord(firstWord).fetch_or(firstMask, std::memory_order_relaxed);
+    for (qint64 w = firstWord + 1; w < lastWord; ++w){
+        atomicWord(w).store(~quint64(0), std::memory_order_relaxed);
+    }
+    atomicWord(lastWord).fetch_or(lastMask, std::memory_order_relaxed);
+}
+
+/**
+ * @brief BitMask::anyInRange tests a range of bits, whole words are tested at once
+ * @param begin first bit to test
+ * @param end one past the last bit to test
+ * @return true if at least one bit in the range is set
+ */
+bool BitMask::anyInRange(qint64 begin, qint64 end) const
+{
+    if (begin >= end){
+        return false;
+    }
+    qint64 firstWord = begin >> 6;
+    qint64 lastWord = (end - 1) >> 6;
+    quint64 firstMask = ~quint64(0) << (begin & 63);
+    quint64 lastMask = ~quint64(0) >> (63 - ((end - 1) & 63));
+    if (firstWord == lastWord){
+        return m_words[firstWord] & firstMask & lastMask;
+    }
+    if (m_words[firstWord] & firstMask){
+        return true;
+    }
+    for (qint64 w = firstWord + 1; w < lastWord; ++w){
+        if (m_words[w]){
+            return true;
+        }
+    }
+    return m_words[lastWord] & lastMask;
+}
+
+/**
+ * @brief BitMask::clear clears all bits. Only the words written since the last clear are touched, so clearing after
+ * a small region costs almost nothing.
+ */
+void BitMask::clear()
+{
+    if (m_dirtyBegin < m_dirtyEnd){
+        std::memset(m_words.data() + m_dirtyBegin, 0, size_t(m_dirtyEnd - m_dirtyBegin)*sizeof(quint64));
+    }
+    m_dirtyBegin = wordCount();
+    m_dirtyEnd = 0;
+}
+
+/**
+ * @brief BitMask::count counts the set bits
+ * @return number of set bits
+ */
+qint64 BitMask::count() const
+{
+    qint64 bits = 0;
+    for (qint64 w = m_dirtyBegin; w < m_dirtyEnd; ++w){
+        quint64 word = m_words[w];
+        while (word){
+            word &= word - 1;
+            ++bits;
+        }
+    }
+    return bits;
+}
@@ -0,0 +1,113 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include "MyLib_global.h"
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief One bit per voxel, e.g. to mark visited voxels or the voxels of a region
+ *
+ * The bits are stored in 64 bit words. The mask remembers the range of words that have been written since the last
+ * clear(), so clearing after a small region only touches that range instead of the whole volume.
+ *
+ * The *Atomic functions may be called from several threads at once. They don't record the written range, the caller
+ * reports it with markWritten() afterwards.
+ */
+class MYLIB_EXPORT BitMask
+{
+public:
+    /// Constructs an empty mask
+    BitMask();
+    /// Constructs a mask of size cleared bits
+    explicit BitMask(qint64 size);
+
+    /// Resizes the mask, all bits are cleared
+    void resize(qint64 size);
+    /// Frees the memory of the mask
+    void release();
+
+    /// Number of bits
+    qint64 size() const { return m_size; }
+    /// Number of 64 bit words
+    qint64 wordCount() const { return qint64(m_words.size()); }
+    /// Bytes allocated for the bits
+    qint64 memoryUsage() const { return qint64(m_words.capacity()*sizeof(quint64)); }
+
+    /// Returns bit i
+    bool test(qint64 i) const { return (m_words[i >> 6] >> (i & 63)) & 1; }
+    /// Sets bit i
+    void set(qint64 i) {
+        qint64 w = i >> 6;
+        touch(w, w+1);
+        m_words[w] |= quint64(1) << (i & 63);
+    }
+    /// Clears bit i
+    void reset(qint64 i) { m_words[i >> 6] &= ~(quint64(1) << (i & 63)); }
+    /// Sets bit i and returns its previous value
+    bool testAndSet(qint64 i) {
+        qint64 w = i >> 6;
+        quint64 bit = quint64(1) << (i & 63);
+        if (m_words[w] & bit){
+            return true;
+        }
+        touch(w, w+1);
+        m_words[w] |= bit;
+        return false;
+    }
+
+    /// Returns bit i while other threads may set bits
+    bool testAtomic(qint64 i) const {
+        return (atomicWord(i >> 6).load(std::memory_order_relaxed) >> (i & 63)) & 1;
+    }
+    /// Sets bit i while other threads may set bits
+    void setAtomic(qint64 i) {
+        atomicWord(i >> 6).fetch_or(quint64(1) << (i & 63), std::memory_order_relaxed);
+    }
+    /// Sets bit i and returns its previous value, exactly one of several threads setting the same bit gets false
+    bool testAndSetAtomic(qint64 i) {
+        quint64 bit = quint64(1) << (i & 63);
+        return atomicWord(i >> 6).fetch_or(bit, std::memory_order_relaxed) & bit;
+    }
+    /// Sets the bits begin to end-1 while other threads may set bits outside the range
+    void setRangeAtomic(qint64 begin, qint64 end);
+    /// Records that bits begin to end-1 may have been set by the *Atomic functions
+    void markWritten(qint64 begin, qint64 end) {
+        if (begin < end) touch(begin >> 6, ((end - 1) >> 6) + 1);
+    }
+
+    /// Sets the bits begin to end-1
+    void setRange(qint64 begin, qint64 end);
+    /// Returns true if any of the bits begin to end-1 is set
+    bool anyInRange(qint64 begin, qint64 end) const;
+
+    /// Word w containing bits 64*w to 64*w+63
+    quint64 word(qint64 w) const { return m_words[w]; }
+    /// Pointer to the words
+    const quint64* words() const { return m_words.data(); }
+
+    /// Clears all bits, only the words written since the last clear are touched
+    void clear();
+    /// Number of set bits
+    qint64 count() const;
+
+private:
+    std::vector<quint64> m_words;
+    qint64 m_size;
+    /// Range of words written since the last clear
+    qint64 m_dirtyBegin;
+    qint64 m_dirtyEnd;
+
+    static_assert(sizeof(std::atomic<quint64>) == sizeof(quint64) && ATOMIC_LLONG_LOCK_FREE == 2,
+                  "words must be usable as lock-free atomics");
+    std::atomic<quint64>& atomicWord(qint64 w) const {
+        return *reinterpret_cast<std::atomic<quint64>*>(const_cast<quint64*>(m_words.data() + w));
+    }
+
+    void touch(qint64 beginWord, qint64 endWord) {
+        if (beginWord < m_dirtyBegin) m_dirtyBegin = beginWord;
+        if (endWord > m_dirtyEnd) m_dirtyEnd = endWord;
+    }
+};
+
+#endif // BITMASK_H
@@ -0,0 +1,86 @@
+#include "brickedvolume.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstring>
+
+BrickedVolume::BrickedVolume()
+    : m_geometry(0, 0, 0, 0, 0, 0), m_brickSize(8), m_brickShift(3)
+{
+}
+
+/**
+ * @brief BrickedVolume::build copies a volume into bricks
+ *
+ * The volume is read row by row in memory order of the source, each row is split into the rows of the bricks it
+ * crosses. The layers of bricks are split between the threads, so every thread writes its own bricks.
+ * @param volume the volume, it has to be loaded completely
+ * @param brickSize voxels per side of a brick, rounded up to a power of two of at least 2
+ * @param threadCount number of threads, 0 uses all cores
+ */
+void BrickedVolume::build(const VolumeView& volume, int brickSize, int threadCount)
+{
+    release();
+    if (!volume.isValid() || brickSize < 1){
+        return;
+    }
+    int shift = 1;
+    while ((1 << shift) < brickSize){
+        ++shift;
+    }
+    const int size = 1 << shift;
+    const VolumeGeometry& geometry = volume.geometry();
+    const int WIDTH = geometry.width();
+    const int HEIGHT = geometry.height();
+    const int LAYERS = geometry.layers();
+    const qint64 countX = (WIDTH + size - 1)/size;
+    const qint64 countY = (HEIGHT + size - 1)/size;
+    const qint64 countZ = (LAYERS + size - 1)/size;
+    const qint64 brickVoxels = qint64(size)*size*size;
+    m_geometry = geometry;
+    m_brickSize = size;
+    m_brickShift = shift;
+    // one voxel of padding behind the last brick, gathers of two voxels may read it
+    m_voxels.assign(size_t(countX*countY*countZ*brickVoxels + 1), 0);
+    const BrickedVoxels bricks = view().brickedVoxels();
+
+    Parallel::forChunks(0, int(countZ), Parallel::threadCount(threadCount), [&](int firstBrick, int lastBrick, int){
+        std::vector<short> row(WIDTH);
+        for (int z = firstBrick*size; z < std::min(lastBrick*size, LAYERS); ++z){
+            for (int y = 0; y < HEIGHT; ++y){
+                volume.readRow(y, z, row.data());
+                for (int x = 0; x < WIDTH; x += size){
+                    std::memcpy(m_voxels.data() + bricks.offset(x, y, z), row.data() + x, size_t(std::min(size, WIDTH - x))*sizeof(short));
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief BrickedVolume::release frees the bricks, views on them become invalid
+ */
+void BrickedVolume::release()
+{
+    std::vector<short>().swap(m_voxels);
+    m_geometry = VolumeGeometry(0, 0, 0, 0, 0, 0);
+}
+
+/**
+ * @brief BrickedVolume::view returns read access to the bricks
+ * @return the view, invalid if no bricks have been built
+ */
+VolumeView BrickedVolume::view() const
+{
+    if (!isValid()){
+        return VolumeView();
+    }
+    return VolumeView::bricked(m_voxels.data(), m_geometry, m_brickShift);
+}
+
+/**
+ * @brief BrickedVolume::memoryUsage returns the bytes allocated for the bricks
+ */
+qint64 BrickedVolume::memoryUsage() const
+{
+    return qint64(m_voxels.capacity())*qint64(sizeof(short));
+}
@@ -0,0 +1,47 @@
+#ifndef BRICKEDVOLUME_H
+#define BRICKEDVOLUME_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include "volumeview.h"
+#include <vector>
+
+/**
+ * @brief Copy of a volume stored in cubic bricks, so neighbours along y and z are as close in memory as along x
+ *
+ * The volume is split into bricks of brickSize() voxels per side, the bricks at the border are padded to full size.
+ * The voxels of a brick lie together in z-major order and the bricks follow each other in z-major order as well. A
+ * brick of 8^3 voxels takes 1 KB, so a walk in any direction reads 8 voxels per brick before it needs the next one,
+ * where a z-major volume needs a new cache line for every step along y or z.
+ *
+ * view() reads the bricks as a bricked VolumeView (see BrickedVoxels), so every function that takes a VolumeView works
+ * on the bricks.
+ */
+class MYLIB_EXPORT BrickedVolume
+{
+public:
+    BrickedVolume();
+
+    /// Copies a volume into bricks of brickSize^3 voxels (a power of two, e.g. 8 or 16), threadCount 0 uses all cores
+    void build(const VolumeView& volume, int brickSize = 8, int threadCount = 0);
+    /// Frees the bricks
+    void release();
+    /// Returns true if the bricks have been built
+    bool isValid() const { return !m_voxels.empty(); }
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Voxels per side of a brick
+    int brickSize() const { return m_brickSize; }
+    /// Read access to the bricks, valid until the next build() or release()
+    VolumeView view() const;
+
+    /// Bytes currently allocated, including the padding of the border bricks
+    qint64 memoryUsage() const;
+
+private:
+    VolumeGeometry m_geometry;
+    int m_brickSize;
+    int m_brickShift;
+    std::vector<short> m_voxels;
+};
+
+#endif // BRICKEDVOLUME_H
@@ -0,0 +1,180 @@
+#include "brickpyramid.h"
+#include "parallel.h"
+#include <algorithm>
+#include <climits>
+
+BrickPyramid::BrickPyramid()
+    : m_geometry(0, 0, 0, 0, 0, 0), m_brickSize(8)
+{
+}
+
+/**
+ * @brief BrickPyramid::build finds minimum and maximum of every brick and joins them level by level
+ *
+ * Level 0 is found in one pass over the volume in memory order, the layers of bricks are split between the threads.
+ * @param volume the volume, it has to be loaded completely
+ * @param brickSize voxels per side of a level 0 brick, e.g. 8 or 16
+ * @param threadCount number of threads, 0 uses all cores
+ */
+void BrickPyramid::build(const VolumeView& volume, int brickSize, int threadCount)
+{
+    release();
+    if (!volume.isValid() || brickSize < 1){
+        return;
+    }
+    const VolumeGeometry& geometry = volume.geometry();
+    const int WIDTH = geometry.width();
+    const int HEIGHT = geometry.height();
+    const int LAYERS = geometry.layers();
+    m_geometry = geometry;
+    m_brickSize = brickSize;
+
+    Level base;
+    base.countX = (WIDTH + brickSize - 1)/brickSize;
+    base.countY = (HEIGHT + brickSize - 1)/brickSize;
+    base.countZ = (LAYERS + brickSize - 1)/brickSize;
+    const size_t brickCount = size_t(base.countX)*base.countY*base.countZ;
+    base.minimum.assign(brickCount, SHRT_MAX);
+    base.maximum.assign(brickCount, SHRT_MIN);
+    Parallel::forChunks(0, base.countZ, Parallel::threadCount(threadCount), [&](int firstBrick, int lastBrick, int){
+        std::vector<short> row(WIDTH);
+        for (int z = firstBrick*brickSize; z < std::min(lastBrick*brickSize, LAYERS); ++z){
+            for (int y = 0; y < HEIGHT; ++y){
+                volume.readRow(y, z, row.data());
+                const size_t first = (size_t(z/brickSize)*base.countY + y/brickSize)*base.countX;
+                for (int bx = 0; bx < base.countX; ++bx){
+                    const auto range = std::minmax_element(row.begin() + bx*brickSize,
+                                                           row.begin() + std::min((bx+1)*brickSize, WIDTH));
+                    base.minimum[first + bx] = std::min(base.minimum[first + bx], *range.first);
+                    base.maximum[first + bx] = std::max(base.maximum[first + bx], *range.second);
+                }
+            }
+        }
+    });
+    m_levels.push_back(std::move(base));
+
+    // join 2x2x2 bricks until one brick is left
+    while (m_levels.back().countX > 1 || m_levels.back().countY > 1 || m_levels.back().countZ > 1){
+        const Level& fine = m_levels.back();
+        Level coarse;
+        coarse.countX = (fine.countX + 1)/2;
+        coarse.countY = (fine.countY + 1)/2;
+        coarse.countZ = (fine.countZ + 1)/2;
+        const size_t count = size_t(coarse.countX)*coarse.countY*coarse.countZ;
+        coarse.minimum.assign(count, SHRT_MAX);
+        coarse.maximum.assign(count, SHRT_MIN);
+        for (int bz = 0; bz < fine.countZ; ++bz){
+            for (int by = 0; by < fine.countY; ++by){
+                for (int bx = 0; bx < fine.countX; ++bx){
+                    const size_t source = (size_t(bz)*fine.countY + by)*fine.countX + bx;
+                    const size_t target = (size_t(bz/2)*coarse.countY + by/2)*coarse.countX + bx/2;
+                    coarse.minimum[target] = std::min(coarse.minimum[target], fine.minimum[source]);
+                    coarse.maximum[target] = std::max(coarse.maximum[target], fine.maximum[source]);
+                }
+            }
+        }
+        m_levels.push_back(std::move(coarse));
+    }
+}
+
+/**
+ * @brief BrickPyramid::release frees all levels
+ */
+void BrickPyramid::release()
+{
+    std::vector<Level>().swap(m_levels);
+    m_geometry = VolumeGeometry(0, 0, 0, 0, 0, 0);
+}
+
+/**
+ * @brief BrickPyramid::mayReach checks a box from the top level down, only bricks whose maximum reaches the threshold
+ * are looked at more closely
+ * @param x0 first x of the box
+ * @param y0 first y of the box
+ * @param z0 first z of the box
+ * @param x1 one past the last x of the box
+ * @param y1 one past the last y of the box
+ * @param z1 one past the last z of the box
+ * @param threshold the HU threshold
+ * @return false if no voxel of the box can be at or above threshold, true if one may be (or the pyramid isn't built)
+ */
+bool BrickPyramid::mayReach(int x0, int y0, int z0, int x1, int y1, int z1, int threshold) const
+{
+    if (!isValid()){
+        return true;
+    }
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    z0 = std::max(z0, 0);
+    x1 = std::min(x1, m_geometry.width());
+    y1 = std::min(y1, m_geometry.height());
+    z1 = std::min(z1, m_geometry.layers());
+    if (x0 >= x1 || y0 >= y1 || z0 >= z1){
+        return false;
+    }
+    return mayReach(levelCount() - 1, 0, 0, 0, x0, y0, z0, x1, y1, z1, threshold);
+}
+
+/**
+ * @brief BrickPyramid::mayReach checks one brick of a level and the bricks below it that overlap the box
+ */
+bool BrickPyramid::mayReach(int level, int bx, int by, int bz, int x0, int y0, int z0, int x1, int y1, int z1,
+                            int threshold) const
+{
+    if (maximum(bx, by, bz, level) < threshold){
+        return false;
+    }
+    if (level == 0){
+        return true;
+    }
+    // the children of the brick that overlap the box, in level - 1 bricks
+    const int side = m_brickSize << (level - 1);
+    const Level& fine = m_levels[level - 1];
+    const int fx0 = std::max(2*bx, x0/side);
+    const int fy0 = std::max(2*by, y0/side);
+    const int fz0 = std::max(2*bz, z0/side);
+    const int fx1 = std::min({2*bx + 2, (x1 - 1)/side + 1, fine.countX});
+    const int fy1 = std::min({2*by + 2, (y1 - 1)/side + 1, fine.countY});
+    const int fz1 = std::min({2*bz + 2, (z1 - 1)/side + 1, fine.countZ});
+    for (int fz = fz0; fz < fz1; ++fz){
+        for (int fy = fy0; fy < fy1; ++fy){
+            for (int fx = fx0; fx < fx1; ++fx){
+                if (mayReach(level - 1, fx, fy, fz, x0, y0, z0, x1, y1, z1, threshold)){
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief BrickPyramid::allReach checks whether the minimum of every level 0 brick overlapping the box reaches the
+ * threshold
+ * @return true if all voxels of the box are at or above threshold, false if one may be below (or the pyramid isn't built)
+ */
+bool BrickPyramid::allReach(int x0, int y0, int z0, int x1, int y1, int z1, int threshold) const
+{
+    if (!isValid() || x0 >= x1 || y0 >= y1 || z0 >= z1){
+        return false;
+    }
+    for (int bz = z0/m_brickSize; bz <= (z1 - 1)/m_brickSize; ++bz){
+        for (int by = y0/m_brickSize; by <= (y1 - 1)/m_brickSize; ++by){
+            for (int bx = x0/m_brickSize; bx <= (x1 - 1)/m_brickSize; ++bx){
+                if (minimum(bx, by, bz) < threshold){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+qint64 BrickPyramid::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (const Level& level : m_levels){
+        bytes += qint64((level.minimum.capacity() + level.maximum.capacity())*sizeof(short));
+    }
+    return bytes;
+}
@@ -0,0 +1,87 @@
+#ifndef BRICKPYRAMID_H
+#define BRICKPYRAMID_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include "volumeview.h"
+#include <vector>
+
+/**
+ * @brief Minimum and maximum HU value of every brick of a volume, for skipping parts that can't reach a threshold
+ *
+ * Level 0 splits the volume into bricks of brickSize() voxels per side (bricks at the border may be smaller). Every
+ * further level joins 2x2x2 bricks of the level below, up to a single brick. A pass that looks for voxels at or above
+ * a threshold can skip a whole brick whose maximum is below it, large boxes are checked from the top level down.
+ */
+class MYLIB_EXPORT BrickPyramid
+{
+public:
+    /// Voxels a pass had to look at and voxels it skipped
+    struct SkipStats {
+        qint64 voxels;          ///< voxels covered by the pass
+        qint64 skippedVoxels;   ///< voxels in skipped bricks
+
+        SkipStats() : voxels(0), skippedVoxels(0) {}
+        /// Part of the voxels that were skipped
+        double skippedFraction() const { return voxels > 0 ? double(skippedVoxels)/voxels : 0; }
+        SkipStats& operator+=(const SkipStats& other){
+            voxels += other.voxels;
+            skippedVoxels += other.skippedVoxels;
+            return *this;
+        }
+    };
+
+    BrickPyramid();
+
+    /// Builds all levels for a volume, threadCount 0 uses all cores
+    void build(const VolumeView& volume, int brickSize = 8, int threadCount = 0);
+    /// Frees the pyramid
+    void release();
+    /// Returns true if the pyramid has been built
+    bool isValid() const { return !m_levels.empty(); }
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Voxels per side of a level 0 brick
+    int brickSize() const { return m_brickSize; }
+    int levelCount() const { return int(m_levels.size()); }
+    /// Number of bricks along x, y and z of a level
+    int bricksX(int level = 0) const { return m_levels[level].countX; }
+    int bricksY(int level = 0) const { return m_levels[level].countY; }
+    int bricksZ(int level = 0) const { return m_levels[level].countZ; }
+    /// Smallest value in a brick
+    short minimum(int bx, int by, int bz, int level = 0) const { return m_levels[level].minimum[brick(level, bx, by, bz)]; }
+    /// Largest value in a brick
+    short maximum(int bx, int by, int bz, int level = 0) const { return m_levels[level].maximum[brick(level, bx, by, bz)]; }
+
+    /// Returns false if no voxel of the box [x0, x1) x [y0, y1) x [z0, z1) can be at or above threshold
+    bool mayReach(int x0, int y0, int z0, int x1, int y1, int z1, int threshold) const;
+    /// Returns true if all voxels of the box are at or above threshold
+    bool allReach(int x0, int y0, int z0, int x1, int y1, int z1, int threshold) const;
+    /// Returns false if no voxel of the level 0 brick containing voxel (x, y, z) can be at or above threshold
+    bool brickMayReach(int x, int y, int z, int threshold) const {
+        return maximum(x/m_brickSize, y/m_brickSize, z/m_brickSize) >= threshold;
+    }
+
+    /// Bytes currently allocated
+    qint64 memoryUsage() const;
+
+private:
+    struct Level {
+        int countX;
+        int countY;
+        int countZ;
+        std::vector<short> minimum;
+        std::vector<short> maximum;
+    };
+
+    VolumeGeometry m_geometry;
+    int m_brickSize;
+    std::vector<Level> m_levels;
+
+    size_t brick(int level, int bx, int by, int bz) const {
+        const Level& entry = m_levels[level];
+        return (size_t(bz)*entry.countY + by)*entry.countX + bx;
+    }
+    bool mayReach(int level, int bx, int by, int bz, int x0, int y0, int z0, int x1, int y1, int z1, int threshold) const;
+};
+
+#endif // BRICKPYRAMID_H
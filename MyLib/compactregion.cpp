@@ -0,0 +1,230 @@
+#include "compactregion.h"
+#include "componentlabeler.h"
+#include <algorithm>
+
+CompactRegion::CompactRegion()
+    : m_voxelCount(0)
+{
+}
+
+/**
+ * @brief CompactRegion::fromMask collects the set bits of a mask as runs
+ * @param mask a mask with one bit per voxel, e.g. CTDataset::region()
+ * @param geometry the geometry of the volume the mask belongs to
+ * @return the region, empty if the mask doesn't fit the geometry
+ */
+CompactRegion CompactRegion::fromMask(const BitMask& mask, const VolumeGeometry& geometry)
+{
+    CompactRegion region;
+    region.m_geometry = geometry;
+    if (mask.size() != geometry.voxelCount()){
+        return region;
+    }
+    const int WIDTH = geometry.width();
+    for (int z = 0; z < geometry.layers(); ++z){
+        for (int y = 0; y < geometry.height(); ++y){
+            const qint64 row = geometry.index(0, y, z);
+            if (!mask.anyInRange(row, row + WIDTH)){
+                continue;
+            }
+            int x = 0;
+            while (x < WIDTH){
+                if (!mask.test(row + x)){
+                    ++x;
+                    continue;
+                }
+                int begin = x;
+                while (x < WIDTH && mask.test(row + x)){
+                    ++x;
+                }
+                region.append(begin, x, y, z);
+            }
+        }
+    }
+    return region;
+}
+
+/**
+ * @brief CompactRegion::fromVoxels collects a list of voxels as runs, e.g. the result of CTDataset::regionGrowing
+ * @param voxels the voxels in any order, duplicates and voxels outside the volume are ignored
+ * @param geometry the geometry of the volume the voxels belong to
+ * @return the region
+ */
+CompactRegion CompactRegion::fromVoxels(const std::vector<Voxel>& voxels, const VolumeGeometry& geometry)
+{
+    CompactRegion region;
+    region.m_geometry = geometry;
+    std::vector<qint64> indices;
+    indices.reserve(voxels.size());
+    for (const Voxel& voxel : voxels){
+        if (geometry.contains(voxel.x, voxel.y, voxel.z)){
+            indices.push_back(geometry.index(voxel.x, voxel.y, voxel.z));
+        }
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    const int WIDTH = geometry.width();
+    size_t i = 0;
+    while (i < indices.size()){
+        // a run ends at a gap or at the end of a row
+        const qint64 row = indices[i]/WIDTH;
+        size_t j = i + 1;
+        while (j < indices.size() && indices[j] == indices[j-1] + 1 && indices[j]/WIDTH == row){
+            ++j;
+        }
+        const int begin = int(indices[i] - row*WIDTH);
+        region.append(begin, begin + int(j - i), int(row % geometry.height()), int(row / geometry.height()));
+        i = j;
+    }
+    return region;
+}
+
+/**
+ * @brief CompactRegion::fromComponent collects the runs of one connected component
+ * @param labeler a labeled volume
+ * @param component index into labeler.components()
+ * @return the region, empty if there is no such component
+ */
+CompactRegion CompactRegion::fromComponent(const ComponentLabeler& labeler, int component)
+{
+    CompactRegion region;
+    region.m_geometry = labeler.geometry();
+    if (component < 0 || component >= int(labeler.components().size())){
+        return region;
+    }
+    const ComponentLabeler::Component& stats = labeler.components()[component];
+    for (int z = stats.minZ; z <= stats.maxZ; ++z){
+        for (int y = stats.minY; y <= stats.maxY; ++y){
+            const qint64 first = labeler.firstRun(y, z);
+            const qint64 last = first + labeler.runCount(y, z);
+            for (qint64 r = first; r < last; ++r){
+                const ComponentLabeler::Run& run = labeler.runs()[r];
+                if (run.component == component){
+                    region.append(run.begin, run.end, y, z);
+                }
+            }
+        }
+    }
+    return region;
+}
+
+/**
+ * @brief CompactRegion::append adds a run at the end of the region
+ * @param begin first x of the run
+ * @param end one past the last x of the run
+ * @param y row
+ * @param z layer
+ */
+void CompactRegion::append(int begin, int end, int y, int z)
+{
+    if (begin >= end){
+        return;
+    }
+    m_spans.push_back({begin, end, y, z});
+    m_voxelCount += end - begin;
+}
+
+/**
+ * @brief CompactRegion::contains looks up a voxel by binary search over the runs
+ * @param x
+ * @param y
+ * @param z
+ * @return true if the voxel belongs to the region
+ */
+bool CompactRegion::contains(int x, int y, int z) const
+{
+    // first run behind (x, y, z) in scan order
+    auto it = std::upper_bound(m_spans.begin(), m_spans.end(), Span{x, x, y, z}, [](const Span& voxel, const Span& span){
+        if (voxel.z != span.z) return voxel.z < span.z;
+        if (voxel.y != span.y) return voxel.y < span.y;
+        return voxel.begin < span.begin;
+    });
+    if (it == m_spans.begin()){
+        return false;
+    }
+    --it;
+    return it->z == z && it->y == y && it->begin <= x && x < it->end;
+}
+
+/**
+ * @brief CompactRegion::minimum returns the smallest coordinates of the bounding box
+ * @return the corner of the bounding box, (0, 0, 0) for an empty region
+ */
+Voxel CompactRegion::minimum() const
+{
+    if (m_spans.empty()){
+        return {0, 0, 0};
+    }
+    Voxel result = {m_spans.front().begin, m_spans.front().y, m_spans.front().z};
+    for (const Span& span : m_spans){
+        result.x = std::min(result.x, span.begin);
+        result.y = std::min(result.y, span.y);
+    }
+    return result;
+}
+
+/**
+ * @brief CompactRegion::maximum returns the largest coordinates of the bounding box
+ * @return the corner of the bounding box, (-1, -1, -1) for an empty region
+ */
+Voxel CompactRegion::maximum() const
+{
+    if (m_spans.empty()){
+        return {-1, -1, -1};
+    }
+    Voxel result = {m_spans.back().end - 1, m_spans.back().y, m_spans.back().z};
+    for (const Span& span : m_spans){
+        result.x = std::max(result.x, span.end - 1);
+        result.y = std::max(result.y, span.y);
+    }
+    return result;
+}
+
+/**
+ * @brief CompactRegion::centroid calculates the mean position of the voxels
+ * @return the centroid, (0, 0, 0) for an empty region
+ */
+Eigen::Vector3d CompactRegion::centroid() const
+{
+    if (m_voxelCount == 0){
+        return Eigen::Vector3d::Zero();
+    }
+    qint64 sumX = 0;
+    qint64 sumY = 0;
+    qint64 sumZ = 0;
+    for (const Span& span : m_spans){
+        const qint64 length = span.length();
+        sumX += (qint64(span.begin) + span.end - 1)*length/2;
+        sumY += span.y*length;
+        sumZ += span.z*length;
+    }
+    return Eigen::Vector3d(double(sumX), double(sumY), double(sumZ))/double(m_voxelCount);
+}
+
+/**
+ * @brief CompactRegion::rasterize sets the bits of all voxels of the region, whole runs at once
+ * @param mask a mask with one bit per voxel of geometry(), bits outside the region are left unchanged
+ */
+void CompactRegion::rasterize(BitMask& mask) const
+{
+    if (mask.size() != m_geometry.voxelCount()){
+        return;
+    }
+    for (const Span& span : m_spans){
+        const qint64 row = m_geometry.index(0, span.y, span.z);
+        mask.setRange(row + span.begin, row + span.end);
+    }
+}
+
+CompactRegion::const_iterator CompactRegion::begin() const
+{
+    const Span* first = m_spans.data();
+    return const_iterator(first, first + m_spans.size());
+}
+
+CompactRegion::const_iterator CompactRegion::end() const
+{
+    const Span* last = m_spans.data() + m_spans.size();
+    return const_iterator(last, last);
+}
@@ -0,0 +1,109 @@
+#ifndef COMPACTREGION_H
+#define COMPACTREGION_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include "bitmask.h"
+#include <Eigen/Dense>
+#include <iterator>
+#include <vector>
+
+class ComponentLabeler;
+
+/**
+ * @brief A region of a volume stored as runs of voxels along x
+ *
+ * Each run takes 16 bytes no matter how long it is, so a region of a few thousand voxels needs some kilobytes instead
+ * of a full volume. The runs are sorted by layer, row and x. The region can be written to a BitMask when needed.
+ */
+class MYLIB_EXPORT CompactRegion
+{
+public:
+    /// Voxels begin to end-1 of row y in layer z
+    struct Span {
+        int begin;
+        int end;
+        int y;
+        int z;
+
+        int length() const { return end - begin; }
+    };
+
+    /// Iterates over all voxels of the region in scan order
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Voxel value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Voxel* pointer;
+        typedef Voxel reference;
+
+        const_iterator() : m_span(nullptr), m_last(nullptr), m_x(0) {}
+        /// Iterator at the first voxel of span, last is the end of the runs
+        const_iterator(const Span* span, const Span* last) : m_span(span), m_last(last), m_x(span != last ? span->begin : 0) {}
+
+        Voxel operator*() const { return {m_x, m_span->y, m_span->z}; }
+        const_iterator& operator++(){
+            if (++m_x == m_span->end){
+                ++m_span;
+                m_x = m_span != m_last ? m_span->begin : 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int){ const_iterator old = *this; ++(*this); return old; }
+        bool operator==(const const_iterator& other) const { return m_span == other.m_span && m_x == other.m_x; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        const Span* m_span;
+        const Span* m_last;
+        int m_x;
+    };
+
+    /// Constructs an empty region
+    CompactRegion();
+
+    /// Collects the set bits of a mask with one bit per voxel of geometry
+    static CompactRegion fromMask(const BitMask& mask, const VolumeGeometry& geometry);
+    /// Collects a list of voxels, duplicates are removed
+    static CompactRegion fromVoxels(const std::vector<Voxel>& voxels, const VolumeGeometry& geometry);
+    /// Collects the runs of one component of a labeled volume
+    static CompactRegion fromComponent(const ComponentLabeler& labeler, int component);
+
+    /// Adds a run, runs have to be added in scan order and must not overlap
+    void append(int begin, int end, int y, int z);
+
+    /// Geometry of the volume the region belongs to
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Runs of the region in scan order
+    const std::vector<Span>& spans() const { return m_spans; }
+    /// Returns true if the region has no voxels
+    bool isEmpty() const { return m_spans.empty(); }
+    /// Number of voxels
+    qint64 voxelCount() const { return m_voxelCount; }
+    /// Bytes used by the runs
+    qint64 memoryUsage() const { return qint64(m_spans.capacity()*sizeof(Span)); }
+
+    /// Returns true if voxel (x, y, z) belongs to the region
+    bool contains(int x, int y, int z) const;
+    /// Smallest coordinates of the region, (0, 0, 0) if it is empty
+    Voxel minimum() const;
+    /// Largest coordinates of the region, (-1, -1, -1) if it is empty
+    Voxel maximum() const;
+    /// Mean position of the voxels
+    Eigen::Vector3d centroid() const;
+
+    /// Sets the bits of the region in a mask with one bit per voxel of geometry()
+    void rasterize(BitMask& mask) const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    VolumeGeometry m_geometry;
+    std::vector<Span> m_spans;
+    qint64 m_voxelCount;
+};
+
+#endif // COMPACTREGION_H
@@ -0,0 +1,379 @@
+#include "componentlabeler.h"
+#include "parallel.h"
+#include <algorithm>
+
+ComponentLabeler::ComponentLabeler()
+{
+}
+
+/**
+ * @brief findRoot finds the representative run of a run, compressing the path on the way
+ * @param parent union-find parents of the runs
+ * @param run index of the run
+ * @return index of the root run
+ */
+static int findRoot(std::vector<int>& parent, int run)
+{
+    while (parent[run] != run){
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+/**
+ * @brief unite joins the components of two runs. The root is always the run found first, so every run has a parent
+ * with a lower or the same index.
+ * @param parent union-find parents of the runs
+ * @param a index of the first run
+ * @param b index of the second run
+ */
+static void unite(std::vector<int>& parent, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b){
+        parent[b] = a;
+    } else if (b < a){
+        parent[a] = b;
+    }
+}
+
+/**
+ * @brief uniteRows joins the runs of two rows that share at least one x position
+ * @param runs all runs
+ * @param parent union-find parents of the runs
+ * @param a index of the first run of the first row
+ * @param endA one past the last run of the first row
+ * @param b index of the first run of the second row
+ * @param endB one past the last run of the second row
+ */
+static void uniteRows(const std::vector<ComponentLabeler::Run>& runs, std::vector<int>& parent,
+                      qint64 a, qint64 endA, qint64 b, qint64 endB)
+{
+    // both rows are sorted by x, advance the run that ends first
+    while (a < endA && b < endB){
+        const ComponentLabeler::Run& runA = runs[a];
+        const ComponentLabeler::Run& runB = runs[b];
+        if (runA.begin < runB.end && runB.begin < runA.end){
+            unite(parent, int(a), int(b));
+        }
+        if (runA.end < runB.end){
+            ++a;
+        } else {
+            ++b;
+        }
+    }
+}
+
+/**
+ * @brief addStatistics adds the statistics of a part of a component to the statistics of the component
+ * @param component the component
+ * @param part statistics of some of its voxels
+ */
+static void addStatistics(ComponentLabeler::Component& component, const ComponentLabeler::Component& part)
+{
+    component.voxelCount += part.voxelCount;
+    component.minX = std::min(component.minX, part.minX);
+    component.minY = std::min(component.minY, part.minY);
+    component.minZ = std::min(component.minZ, part.minZ);
+    component.maxX = std::max(component.maxX, part.maxX);
+    component.maxY = std::max(component.maxY, part.maxY);
+    component.maxZ = std::max(component.maxZ, part.maxZ);
+    component.sumX += part.sumX;
+    component.sumY += part.sumY;
+    component.sumZ += part.sumZ;
+}
+
+/**
+ * @brief ComponentLabeler::label labels the connected components of all voxels at or above a threshold
+ *
+ * The layers are split into one slab per thread. Every slab is labeled on its own (see labelSlab()), then the slabs
+ * are joined (see mergeSlabs()). The result is the same for every thread count.
+ * @param volume the volume to label
+ * @param threshold minimum value of a voxel belonging to a component
+ * @param threadCount number of threads, 0 uses all cores
+ * @param bricks minimum and maximum of the bricks of the volume to skip empty parts, nullptr reads every voxel
+ * @param stats receives the voxels covered and skipped, may be nullptr
+ * @return number of components
+ */
+int ComponentLabeler::label(const VolumeView& volume, int threshold, int threadCount, const BrickPyramid* bricks,
+                            BrickPyramid::SkipStats* stats)
+{
+    clear();
+    if (!volume.isValid()){
+        return 0;
+    }
+    m_geometry = volume.geometry();
+    if (bricks && (!bricks->isValid() || bricks->geometry() != m_geometry)){
+        bricks = nullptr;
+    }
+
+    const int slabCount = std::min(Parallel::threadCount(threadCount), m_geometry.layers());
+    std::vector<Slab> slabs(slabCount);
+    std::vector<int> firstLayers(slabCount);
+    std::vector<BrickPyramid::SkipStats> slabStats(slabCount);
+    Parallel::forChunks(0, m_geometry.layers(), slabCount, [&](int firstLayer, int lastLayer, int slab){
+        firstLayers[slab] = firstLayer;
+        labelSlab(volume, threshold, firstLayer, lastLayer, slabs[slab], bricks, slabStats[slab]);
+        resolveSlab(slabs[slab]);
+    });
+    mergeSlabs(slabs, firstLayers);
+    if (stats){
+        *stats = BrickPyramid::SkipStats();
+        for (const BrickPyramid::SkipStats& part : slabStats){
+            *stats += part;
+        }
+    }
+    return int(m_components.size());
+}
+
+/**
+ * @brief ComponentLabeler::labelSlab splits every row of some layers into runs and joins each run with the
+ * overlapping runs of the row above and of the same row in the previous layer of the slab
+ *
+ * Bricks whose maximum is below the threshold can't contain a run, they are jumped over and rows without any other
+ * brick are not read.
+ * @param volume the volume to label
+ * @param threshold minimum value of a voxel belonging to a component
+ * @param firstLayer first layer of the slab
+ * @param lastLayer one past the last layer of the slab
+ * @param slab receives the runs of the slab
+ * @param bricks minimum and maximum of the bricks of the volume, may be nullptr
+ * @param stats receives the voxels covered and skipped
+ */
+void ComponentLabeler::labelSlab(const VolumeView& volume, int threshold, int firstLayer, int lastLayer, Slab& slab,
+                                 const BrickPyramid* bricks, BrickPyramid::SkipStats& stats)
+{
+    const int WIDTH = volume.geometry().width();
+    const int HEIGHT = volume.geometry().height();
+    const int BRICK = bricks ? bricks->brickSize() : std::max(WIDTH, 1);
+    const int COLUMNS = (WIDTH + BRICK - 1)/BRICK;
+
+    slab.rowStart.resize(size_t(lastLayer - firstLayer)*HEIGHT + 1);
+    std::vector<short> row(WIDTH);
+    // bricks of the current band of rows that may reach the threshold
+    std::vector<char> reachable(size_t(COLUMNS), 1);
+    int skippedColumns = 0;
+    stats.voxels += qint64(lastLayer - firstLayer)*HEIGHT*WIDTH;
+    for (int z = firstLayer; z < lastLayer; ++z){
+        for (int y = 0; y < HEIGHT; ++y){
+            const qint64 rowIndex = qint64(z - firstLayer)*HEIGHT + y;
+            slab.rowStart[rowIndex] = qint64(slab.runs.size());
+            if (bricks && y % BRICK == 0){
+                skippedColumns = 0;
+                for (int bx = 0; bx < COLUMNS; ++bx){
+                    reachable[bx] = bricks->maximum(bx, y/BRICK, z/BRICK) >= threshold;
+                    if (!reachable[bx]){
+                        skippedColumns += std::min(BRICK, WIDTH - bx*BRICK);
+                    }
+                }
+            }
+            stats.skippedVoxels += skippedColumns;
+            if (skippedColumns == WIDTH){
+                // no run in this row, so there is nothing to join either
+                slab.rowStart[rowIndex + 1] = qint64(slab.runs.size());
+                continue;
+            }
+            volume.readRow(y, z, row.data());
+            int x = 0;
+            while (x < WIDTH){
+                if (!reachable[x/BRICK]){
+                    x = (x/BRICK + 1)*BRICK;
+                    continue;
+                }
+                if (row[x] < threshold){
+                    ++x;
+                    continue;
+                }
+                int begin = x;
+                while (x < WIDTH && row[x] >= threshold){
+                    ++x;
+                }
+                slab.runs.push_back({begin, x, y, z, -1});
+                slab.parent.push_back(int(slab.parent.size()));
+            }
+            slab.rowStart[rowIndex + 1] = qint64(slab.runs.size());
+
+            if (y > 0){
+                uniteRows(slab.runs, slab.parent, slab.rowStart[rowIndex], slab.rowStart[rowIndex + 1],
+                          slab.rowStart[rowIndex - 1], slab.rowStart[rowIndex]);
+            }
+            if (z > firstLayer){
+                uniteRows(slab.runs, slab.parent, slab.rowStart[rowIndex], slab.rowStart[rowIndex + 1],
+                          slab.rowStart[rowIndex - HEIGHT], slab.rowStart[rowIndex - HEIGHT + 1]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief ComponentLabeler::resolveSlab numbers the components of a slab in scan order and collects their statistics
+ *
+ * Every run has a parent with a lower index, so going through the runs in order finds the component of the parent
+ * before the run itself.
+ * @param slab a labeled slab
+ */
+void ComponentLabeler::resolveSlab(Slab& slab)
+{
+    const int runCount = int(slab.runs.size());
+    for (int i = 0; i < runCount; ++i){
+        Run& run = slab.runs[i];
+        const int parent = slab.parent[i];
+        if (parent == i){
+            run.component = int(slab.components.size());
+            slab.components.push_back({0, run.begin, run.y, run.z, run.end - 1, run.y, run.z, 0, 0, 0});
+            slab.componentRoot.push_back(i);
+        } else {
+            run.component = slab.runs[parent].component;
+        }
+
+        const qint64 length = run.end - run.begin;
+        Component part = {length, run.begin, run.y, run.z, run.end - 1, run.y, run.z,
+                          (qint64(run.begin) + run.end - 1)*length/2, qint64(run.y)*length, qint64(run.z)*length};
+        addStatistics(slab.components[run.component], part);
+    }
+}
+
+/**
+ * @brief ComponentLabeler::mergeSlabs joins the labeled slabs
+ *
+ * The runs are appended in slab order, so they are in scan order again. Every run points to the first run of its
+ * component within its slab, then the runs on both sides of every slab border are united. Components are numbered in
+ * scan order and the statistics of their parts in the slabs are added up.
+ * @param slabs the labeled and resolved slabs
+ * @param firstLayers first layer of each slab
+ */
+void ComponentLabeler::mergeSlabs(std::vector<Slab>& slabs, const std::vector<int>& firstLayers)
+{
+    const int HEIGHT = m_geometry.height();
+    std::vector<qint64> offsets(slabs.size());
+    qint64 runCount = 0;
+    for (size_t k = 0; k < slabs.size(); ++k){
+        offsets[k] = runCount;
+        runCount += qint64(slabs[k].runs.size());
+    }
+
+    m_runs.reserve(size_t(runCount));
+    m_rowStart.reserve(size_t(qint64(HEIGHT)*m_geometry.layers() + 1));
+    std::vector<int> parent(static_cast<size_t>(runCount));
+    for (size_t k = 0; k < slabs.size(); ++k){
+        Slab& slab = slabs[k];
+        for (size_t i = 0; i < slab.runs.size(); ++i){
+            parent[offsets[k] + i] = int(offsets[k] + slab.componentRoot[slab.runs[i].component]);
+        }
+        m_runs.insert(m_runs.end(), slab.runs.begin(), slab.runs.end());
+        for (size_t r = 0; r + 1 < slab.rowStart.size(); ++r){
+            m_rowStart.push_back(offsets[k] + slab.rowStart[r]);
+        }
+        std::vector<Run>().swap(slab.runs);
+        std::vector<int>().swap(slab.parent);
+    }
+    m_rowStart.push_back(runCount);
+
+    for (size_t k = 1; k < slabs.size(); ++k){
+        const qint64 firstRow = qint64(firstLayers[k])*HEIGHT;
+        for (int y = 0; y < HEIGHT; ++y){
+            const qint64 row = firstRow + y;
+            uniteRows(m_runs, parent, m_rowStart[row], m_rowStart[row + 1], m_rowStart[row - HEIGHT], m_rowStart[row - HEIGHT + 1]);
+        }
+    }
+
+    // number the components in scan order, the parent of a run always comes first
+    for (qint64 i = 0; i < runCount; ++i){
+        if (parent[i] == i){
+            m_runs[i].component = int(m_components.size());
+            const Run& run = m_runs[i];
+            m_components.push_back({0, run.begin, run.y, run.z, run.end - 1, run.y, run.z, 0, 0, 0});
+        } else {
+            m_runs[i].component = m_runs[parent[i]].component;
+        }
+    }
+    for (size_t k = 0; k < slabs.size(); ++k){
+        const Slab& slab = slabs[k];
+        for (size_t c = 0; c < slab.components.size(); ++c){
+            addStatistics(m_components[m_runs[offsets[k] + slab.componentRoot[c]].component], slab.components[c]);
+        }
+    }
+}
+
+/**
+ * @brief ComponentLabeler::runCount returns the number of runs in a row
+ * @param y row
+ * @param z layer
+ * @return number of runs
+ */
+int ComponentLabeler::runCount(int y, int z) const
+{
+    const qint64 rowIndex = qint64(z)*m_geometry.height() + y;
+    return int(m_rowStart[rowIndex + 1] - m_rowStart[rowIndex]);
+}
+
+/**
+ * @brief ComponentLabeler::firstRun returns the index of the first run of a row in runs()
+ * @param y row
+ * @param z layer
+ * @return index of the first run
+ */
+qint64 ComponentLabeler::firstRun(int y, int z) const
+{
+    return m_rowStart[qint64(z)*m_geometry.height() + y];
+}
+
+/**
+ * @brief ComponentLabeler::componentAt looks up the component of a voxel
+ * @param x
+ * @param y
+ * @param z
+ * @return index into components(), -1 if the voxel is below the threshold or outside the volume
+ */
+int ComponentLabeler::componentAt(int x, int y, int z) const
+{
+    if (m_rowStart.empty() || !m_geometry.contains(x, y, z)){
+        return -1;
+    }
+    const qint64 first = firstRun(y, z);
+    const qint64 last = first + runCount(y, z);
+    // runs of a row are sorted, find the first run ending behind x
+    auto it = std::upper_bound(m_runs.begin() + first, m_runs.begin() + last, x,
+                               [](int value, const Run& run) { return value < run.end; });
+    if (it == m_runs.begin() + last || it->begin > x){
+        return -1;
+    }
+    return it->component;
+}
+
+/**
+ * @brief ComponentLabeler::fillMask sets the bits of all voxels of a component, whole runs are set at once
+ * @param component index into components()
+ * @param mask a mask with one bit per voxel of the labeled volume
+ */
+void ComponentLabeler::fillMask(int component, BitMask& mask) const
+{
+    if (component < 0 || component >= int(m_components.size()) || mask.size() != m_geometry.voxelCount()){
+        return;
+    }
+    const Component& stats = m_components[component];
+    for (int z = stats.minZ; z <= stats.maxZ; ++z){
+        for (int y = stats.minY; y <= stats.maxY; ++y){
+            const qint64 first = firstRun(y, z);
+            const qint64 last = first + runCount(y, z);
+            for (qint64 r = first; r < last; ++r){
+                const Run& run = m_runs[r];
+                if (run.component == component){
+                    mask.setRange(m_geometry.index(run.begin, y, z), m_geometry.index(run.end, y, z));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief ComponentLabeler::clear frees the runs and the component table
+ */
+void ComponentLabeler::clear()
+{
+    std::vector<Run>().swap(m_runs);
+    std::vector<qint64>().swap(m_rowStart);
+    m_components.clear();
+}
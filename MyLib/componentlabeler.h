@@ -0,0 +1,111 @@
+#ifndef COMPONENTLABELER_H
+#define COMPONENTLABELER_H
+
+#include "MyLib_global.h"
+#include "volumeview.h"
+#include "bitmask.h"
+#include "brickpyramid.h"
+#include <Eigen/Dense>
+#include <vector>
+
+/**
+ * @brief Connected-component labeling of all voxels above a threshold
+ *
+ * The volume is read row by row and every row is split into runs of voxels above the threshold. Runs that overlap a
+ * run in the previous row or the previous layer are joined by union-find (6-connectivity, like region growing), so
+ * the whole volume is labeled in one sweep. A second pass over the runs resolves the labels and collects the
+ * statistics of every component.
+ *
+ * The layers can be split into slabs that are labeled on separate threads. The slabs are joined afterwards by
+ * uniting the runs on both sides of every slab border and their statistics are added up. Components are numbered by
+ * their first voxel, so the component table doesn't depend on the number of threads.
+ *
+ * With a BrickPyramid of the volume, rows are only read where a brick may reach the threshold and runs are only
+ * searched inside such bricks.
+ */
+class MYLIB_EXPORT ComponentLabeler
+{
+public:
+    /// Statistics of one connected component
+    struct Component {
+        qint64 voxelCount;
+        int minX, minY, minZ;
+        int maxX, maxY, maxZ;
+        /// Sums of the voxel coordinates, divided by voxelCount they give the centroid
+        qint64 sumX, sumY, sumZ;
+
+        /// Extent in x-direction (maxX - minX)
+        int width() const { return maxX - minX; }
+        /// Extent in y-direction (maxY - minY)
+        int height() const { return maxY - minY; }
+        /// Extent in z-direction (maxZ - minZ)
+        int depth() const { return maxZ - minZ; }
+        /// Mean position of the voxels
+        Eigen::Vector3d centroid() const {
+            return Eigen::Vector3d(double(sumX), double(sumY), double(sumZ))/double(voxelCount);
+        }
+    };
+
+    /// A run of voxels above the threshold in one row
+    struct Run {
+        int begin;      ///< first x
+        int end;        ///< one past the last x
+        int y;
+        int z;
+        int component;  ///< index into components() after labeling
+    };
+
+    ComponentLabeler();
+
+    /// Labels all voxels of a volume that are at least threshold, threadCount 0 uses all cores
+    int label(const VolumeView& volume, int threshold, int threadCount = 0, const BrickPyramid* bricks = nullptr,
+              BrickPyramid::SkipStats* stats = nullptr);
+
+    /// Geometry of the labeled volume
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Components in order of their first voxel (z, then y, then x)
+    const std::vector<Component>& components() const { return m_components; }
+    /// Runs in scan order
+    const std::vector<Run>& runs() const { return m_runs; }
+    /// Number of runs in row y of layer z
+    int runCount(int y, int z) const;
+    /// Index of the first run in row y of layer z
+    qint64 firstRun(int y, int z) const;
+
+    /// Returns the component of voxel (x, y, z), -1 if the voxel is below the threshold
+    int componentAt(int x, int y, int z) const;
+    /// Sets the bits of all voxels of a component in a mask of the labeled volume
+    void fillMask(int component, BitMask& mask) const;
+
+    /// Frees the runs and the component table
+    void clear();
+
+private:
+    /// Runs and components of the layers labeled by one thread
+    struct Slab {
+        std::vector<Run> runs;
+        /// Index of the first run of every row of the slab, one more entry than rows
+        std::vector<qint64> rowStart;
+        /// Union-find parents of the runs
+        std::vector<int> parent;
+        std::vector<Component> components;
+        /// First run of every component
+        std::vector<int> componentRoot;
+    };
+
+    VolumeGeometry m_geometry;
+    std::vector<Run> m_runs;
+    /// Index of the first run of every row, one more entry than rows
+    std::vector<qint64> m_rowStart;
+    std::vector<Component> m_components;
+
+    /// Labels layers firstLayer to lastLayer-1 of a volume
+    static void labelSlab(const VolumeView& volume, int threshold, int firstLayer, int lastLayer, Slab& slab,
+                          const BrickPyramid* bricks, BrickPyramid::SkipStats& stats);
+    /// Numbers the components of a slab and collects their statistics
+    static void resolveSlab(Slab& slab);
+    /// Joins the slabs and adds up the statistics of components crossing slab borders
+    void mergeSlabs(std::vector<Slab>& slabs, const std::vector<int>& firstLayers);
+};
+
+#endif // COMPONENTLABELER_H
@@ -0,0 +1,164 @@
+#include "computeexecutor.h"
+
+ComputeExecutor::ComputeExecutor()
+    : m_nextVersion(0), m_running(false), m_stop(false), m_stats{0, 0, 0, 0}
+{
+    m_worker = std::thread(&ComputeExecutor::work, this);
+}
+
+ComputeExecutor::~ComputeExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_stats.dropped += qint64(m_pending.size());
+        m_pending.clear();
+        if (m_running){
+            *m_runningToken.m_flag = true;
+        }
+    }
+    m_wakeUp.notify_all();
+    m_worker.join();
+}
+
+/**
+ * @brief ComputeExecutor::submit queues a job, older requests of the same key are dropped or cancelled
+ * @param key the kind of request
+ * @param job the work, it gets the token of the request and should return early once it is cancelled
+ * @return the version of the request, see isCurrent()
+ */
+qint64 ComputeExecutor::submit(int key, Job job)
+{
+    qint64 version;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cancelLocked(key);
+        version = ++m_nextVersion;
+        m_versions[key] = version;
+        Request request;
+        request.job = std::move(job);
+        request.token.m_key = key;
+        request.token.m_version = version;
+        m_pending.push_back(std::move(request));
+        ++m_stats.submitted;
+    }
+    m_wakeUp.notify_one();
+    return version;
+}
+
+/**
+ * @brief ComputeExecutor::cancel drops the pending job of a key and asks the running one to stop
+ * @param key the kind of request
+ */
+void ComputeExecutor::cancel(int key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cancelLocked(key);
+    // results that are still on their way are stale now
+    m_versions[key] = ++m_nextVersion;
+}
+
+/**
+ * @brief ComputeExecutor::cancelAll drops all pending jobs and asks the running one to stop
+ */
+void ComputeExecutor::cancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.dropped += qint64(m_pending.size());
+    m_pending.clear();
+    if (m_running && !m_runningToken.isCancelled()){
+        *m_runningToken.m_flag = true;
+        ++m_stats.cancelled;
+    }
+    for (auto& version : m_versions){
+        version.second = ++m_nextVersion;
+    }
+}
+
+/**
+ * @brief ComputeExecutor::cancelLocked removes the pending request of a key and cancels the running one, m_mutex has to
+ * be locked
+ * @param key the kind of request
+ */
+void ComputeExecutor::cancelLocked(int key)
+{
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it){
+        if (it->token.key() == key){
+            m_pending.erase(it);
+            ++m_stats.dropped;
+            break;
+        }
+    }
+    if (m_running && m_runningToken.key() == key && !m_runningToken.isCancelled()){
+        *m_runningToken.m_flag = true;
+        ++m_stats.cancelled;
+    }
+}
+
+/**
+ * @brief ComputeExecutor::waitForIdle blocks until all queued jobs are done
+ */
+void ComputeExecutor::waitForIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this](){ return m_pending.empty() && !m_running; });
+}
+
+/**
+ * @brief ComputeExecutor::isCurrent checks whether a request is still the latest of its key
+ * @param key the kind of request
+ * @param version the version returned by submit() or CancelToken::version()
+ * @return true if no newer request of the key was submitted and it wasn't cancelled
+ */
+bool ComputeExecutor::isCurrent(int key, qint64 version) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_versions.find(key);
+    return it != m_versions.end() && it->second == version;
+}
+
+int ComputeExecutor::pendingCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return int(m_pending.size());
+}
+
+ComputeExecutor::Stats ComputeExecutor::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+/**
+ * @brief ComputeExecutor::work runs the queued jobs in order until the executor is destroyed
+ */
+void ComputeExecutor::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true){
+        m_wakeUp.wait(lock, [this](){ return m_stop || !m_pending.empty(); });
+        if (m_stop){
+            break;
+        }
+        Request request = std::move(m_pending.front());
+        m_pending.pop_front();
+        m_running = true;
+        m_runningToken = request.token;
+
+        lock.unlock();
+        request.job(request.token);
+        // the job is destroyed outside the lock, it may own large buffers
+        request.job = Job();
+        lock.lock();
+
+        if (!request.token.isCancelled()){
+            ++m_stats.completed;
+        }
+        m_running = false;
+        if (m_pending.empty()){
+            m_idle.notify_all();
+        }
+    }
+    m_running = false;
+    m_idle.notify_all();
+}
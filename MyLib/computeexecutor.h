@@ -0,0 +1,101 @@
+#ifndef COMPUTEEXECUTOR_H
+#define COMPUTEEXECUTOR_H
+
+#include "MyLib_global.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Runs versioned requests one after another on a background thread
+ *
+ * Every request has a key (e.g. "slice view" or "region growing") and gets a new version when it is submitted. Only
+ * the latest request of a key is kept: a pending request of the same key is dropped and a running one is cancelled.
+ * Jobs are cancelled cooperatively, they check their CancelToken between steps and return early. Results are not
+ * delivered by the executor; a job hands them to the thread that needs them and the receiver uses isCurrent() to drop
+ * results that were overtaken by a newer request.
+ *
+ * Jobs run in submission order on a single thread, so jobs of one executor may share state that is not thread-safe.
+ */
+class MYLIB_EXPORT ComputeExecutor
+{
+public:
+    /// Identifies a request and tells its job whether it should stop
+    class CancelToken
+    {
+    public:
+        CancelToken() : m_key(0), m_version(0), m_flag(std::make_shared<std::atomic<bool>>(false)) {}
+        int key() const { return m_key; }
+        qint64 version() const { return m_version; }
+        bool isCancelled() const { return m_flag->load(std::memory_order_relaxed); }
+        /// The flag itself, for functions taking a cancel flag
+        const std::atomic<bool>* flag() const { return m_flag.get(); }
+
+    private:
+        friend class ComputeExecutor;
+        int m_key;
+        qint64 m_version;
+        std::shared_ptr<std::atomic<bool>> m_flag;
+    };
+    typedef std::function<void(const CancelToken&)> Job;
+
+    /// Counts of requests since construction
+    struct Stats {
+        qint64 submitted;
+        /// replaced by a newer request before they started
+        qint64 dropped;
+        /// cancelled while running
+        qint64 cancelled;
+        /// ran to the end without being cancelled
+        qint64 completed;
+    };
+
+    ComputeExecutor();
+    ~ComputeExecutor();
+
+    /// Queues a job for key, replaces a pending and cancels a running job of the same key, returns the new version
+    qint64 submit(int key, Job job);
+    /// Drops the pending and cancels the running job of key, results of earlier versions become stale
+    void cancel(int key);
+    /// Cancels all jobs
+    void cancelAll();
+    /// Waits until no job is pending or running
+    void waitForIdle();
+
+    /// Returns true if version is the latest request of key, i.e. its result should be used
+    bool isCurrent(int key, qint64 version) const;
+    /// Number of jobs waiting to run
+    int pendingCount() const;
+    Stats stats() const;
+
+private:
+    struct Request {
+        Job job;
+        CancelToken token;
+    };
+
+    mutable std::mutex m_mutex;
+    /// Signals a new request or the end of the worker
+    std::condition_variable m_wakeUp;
+    /// Signals that the worker ran out of requests
+    std::condition_variable m_idle;
+    std::deque<Request> m_pending;
+    /// Latest version of every key
+    std::map<int, qint64> m_versions;
+    qint64 m_nextVersion;
+    bool m_running;
+    CancelToken m_runningToken;
+    bool m_stop;
+    Stats m_stats;
+    std::thread m_worker;
+
+    void work();
+    void cancelLocked(int key);
+};
+
+#endif // COMPUTEEXECUTOR_H
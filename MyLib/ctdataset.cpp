@@ -1,35 +1,71 @@
 #include "ctdataset.h"
 #include "icpalgo.h"
+#include "componentlabeler.h"
+#include "mylib.h"
+#include "parallel.h"
 #include <QFile>
 #include <cmath>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
+#include <algorithm>
 #include <QDebug>
 #include <QElapsedTimer>
 #include "Eigen/Core"
 #include "Eigen/Dense"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief hitMask16 compares 16 HU values with a threshold at once
+ * @param values 16 contiguous values
+ * @param limit the threshold minus one
+ * @return bit i is set if values[i] > limit
+ */
+static inline unsigned hitMask16(const short* values, short limit)
+{
+#ifdef __SSE2__
+    const __m128i bound = _mm_set1_epi16(limit);
+    const __m128i low = _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)), bound);
+    const __m128i high = _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 8)), bound);
+    // the comparison results are 0 or -1, packing them to bytes keeps one byte per value in order
+    return unsigned(_mm_movemask_epi8(_mm_packs_epi16(low, high)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < 16; ++i){
+        mask |= unsigned(values[i] > limit) << i;
+    }
+    return mask;
+#endif
+}
+
 
 CTDataset::CTDataset()
 {
-    m_pImageData = new short[WIDTH*HEIGHT*LAYERS];
-    m_pDepthBuffer = new short[WIDTH*HEIGHT];
-    m_pRegionData = new short[WIDTH*HEIGHT*LAYERS];
-    visited_voxel = new bool[WIDTH*HEIGHT*LAYERS];
-    crosssectionImageData = new short[WIDTH*HEIGHT*LAYERS];
+    // buffers are allocated when they are first needed
+    m_pImageData = nullptr;
+    m_pMappedFile = nullptr;
+    m_layersLoaded = 0;
+    m_loading = false;
+    m_cancelLoad = false;
+    m_pDepthBuffer = nullptr;
+    m_pCrosssectionImageData = nullptr;
+    m_interpolation = ResliceEngine::Nearest;
 }
 
 CTDataset::~CTDataset()
 {
-    delete[] m_pImageData;
-    delete[] m_pDepthBuffer;
-    delete[] m_pRegionData;
-    delete[] visited_voxel;
-    delete[] crosssectionImageData;
+    cancelLoad();
+    releaseWorkingBuffers();
+    releaseBuffer(ImageBuffer);
 }
 
 /**
  * @brief CTDataset::data: Returns the heap of the stored image
- * @return m_pImageData a representation of a multilayer image
+ * @return m_pImageData a representation of a multilayer image, nullptr if no image is loaded
  */
 short* CTDataset::data()
 {
@@ -37,83 +73,569 @@ short* CTDataset::data()
 }
 
 /**
- * @brief CTDataset::depthbuffer: Gets the depth buffer
- * @return m_pDepthBuffer a 2D depth map of a 3D picture as viewed from an axis
+ * @brief CTDataset::volume: Gives read access to the loaded volume independent of how it is stored
+ * @return m_volume a view on m_pImageData or on the memory-mapped file, invalid if no image is loaded
+ */
+const VolumeView& CTDataset::volume() const
+{
+    return m_volume;
+}
+
+/**
+ * @brief CTDataset::isMapped: Tells whether the volume is read directly from a memory-mapped file
+ * @return true after a successful load with MappedLoad
+ */
+bool CTDataset::isMapped() const
+{
+    return m_pMappedFile != nullptr;
+}
+
+/**
+ * @brief CTDataset::setVolumeLayout stores the loaded volume in another layout
+ *
+ * BrickedLayout copies the volume into bricks of brickSize^3 voxels and frees a copied volume, a memory-mapped volume
+ * stays mapped. LinearLayout copies the bricks back into m_pImageData, or returns to the mapped file. The working
+ * buffers stay valid, they don't depend on the layout. Views returned by volume() before are invalid afterwards.
+ * @param layout the new layout
+ * @param brickSize voxels per side of a brick, a power of two (e.g. 8 or 16)
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTDataset::setVolumeLayout(VolumeLayout layout, int brickSize, int threadCount)
+{
+    waitForLoad();
+    if (!m_volume.isValid()){
+        return 1;
+    }
+    if (layout == BrickedLayout){
+        BrickedVolume bricked;
+        bricked.build(m_volume, brickSize, threadCount);
+        m_bricked = std::move(bricked);
+        delete[] m_pImageData;
+        m_pImageData = nullptr;
+        m_volume = m_bricked.view();
+        return 0;
+    }
+    if (m_volume.isStrided()){
+        return 0; // linear already
+    }
+    if (m_mappedVolume.isValid()){
+        m_volume = m_mappedVolume;
+    } else {
+        const int WIDTH = m_geometry.width();
+        const int HEIGHT = m_geometry.height();
+        m_pImageData = new short[m_geometry.voxelCount()];
+        Parallel::forChunks(0, m_geometry.layers(), Parallel::threadCount(threadCount), [&](int first, int last, int){
+            for (int z = first; z < last; ++z){
+                for (int y = 0; y < HEIGHT; ++y){
+                    m_volume.readRow(y, z, m_pImageData + (qint64(z)*HEIGHT + y)*WIDTH);
+                }
+            }
+        });
+        m_volume = VolumeView::linear(m_pImageData, m_geometry);
+    }
+    m_bricked.release();
+    return 0;
+}
+
+/**
+ * @brief CTDataset::volumeLayout: Tells how the loaded volume is stored
+ * @return BrickedLayout after setVolumeLayout(BrickedLayout), LinearLayout otherwise
+ */
+CTDataset::VolumeLayout CTDataset::volumeLayout() const
+{
+    return m_volume.isStrided() ? LinearLayout : BrickedLayout;
+}
+
+/**
+ * @brief CTDataset::depthbuffer: Gets the depth buffer, allocates it on first use
+ * @return m_pDepthBuffer a 2D depth map (width x layers) of a 3D picture as viewed from the y-axis
  */
 short* CTDataset::depthbuffer()
 {
+    if (!m_pDepthBuffer){
+        m_pDepthBuffer = new short[bufferSize(DepthBuffer)]();
+    }
     return m_pDepthBuffer;
 }
 
 /**
- * @brief CTDataset::region: Gets the growing region
- * @return m_pRegionData a representation of a multilayer image
+ * @brief CTDataset::region: Gets the growing region, allocates it on first use
+ * @return m_regionMask one bit per voxel, set where a region was found
  */
-short* CTDataset::region()
+BitMask& CTDataset::region()
 {
-    return m_pRegionData;
+    if (m_regionMask.size() != bufferSize(RegionBuffer)){
+        m_regionMask.resize(bufferSize(RegionBuffer));
+    }
+    return m_regionMask;
 }
 
 /**
- * @brief CTDataset::load Opens an image file from a given path, checks it and loads it to the heap m_pImageData
- * @param imagePath Path of the image to load
- * @return 0 - no Error occured, 1 - file not found, 2 - file size is inconsistent
+ * @brief CTDataset::compactRegion: Converts the growing region into runs
+ * @return the voxels of region() as a CompactRegion, a few bytes per run instead of one bit per voxel of the volume
  */
-int CTDataset::load(QString imagePath)
+CompactRegion CTDataset::compactRegion()
 {
-    //QFile Dateiobjekt dataFile erstellen
-    QFile dataFile(imagePath);
+    return CompactRegion::fromMask(region(), m_geometry);
+}
+
+/**
+ * @brief CTDataset::visited: Gets the visited flags of region growing, allocates them on first use
+ * @return m_visitedMask one bit per voxel, initially cleared
+ */
+BitMask& CTDataset::visited()
+{
+    if (m_visitedMask.size() != bufferSize(VisitedBuffer)){
+        m_visitedMask.resize(bufferSize(VisitedBuffer));
+    }
+    return m_visitedMask;
+}
+
+/**
+ * @brief CTDataset::crosssection: Gets the last reconstructed layer, allocates it on first use
+ * @return m_pCrosssectionImageData a 2D image of width x height HU values
+ */
+short* CTDataset::crosssection()
+{
+    if (!m_pCrosssectionImageData){
+        m_pCrosssectionImageData = new short[bufferSize(CrosssectionBuffer)];
+        std::fill(m_pCrosssectionImageData, m_pCrosssectionImageData + bufferSize(CrosssectionBuffer), -1024);
+    }
+    return m_pCrosssectionImageData;
+}
+
+/**
+ * @brief CTDataset::rayIndex: Gets the running maxima along the depth buffer rays, builds them on first use
+ *
+ * Building reads the volume once, skipping the bricks that can't raise a running maximum (see bricks()), afterwards
+ * depth buffers for any threshold are found without reading it.
+ * @return m_rayIndex, empty if no image is loaded
+ */
+const RayMaxIndex& CTDataset::rayIndex()
+{
+    if (m_volume.isValid() && (!m_rayIndex.isValid() || m_rayIndex.geometry() != m_geometry)){
+        m_rayIndex.build(m_volume, 0, bricksFor(m_volume), &m_skipStats[RayIndexPass]);
+    }
+    return m_rayIndex;
+}
+
+/**
+ * @brief CTDataset::bricks: Gets the minimum and maximum of every 8x8x8 brick of the volume, builds them on first use
+ *
+ * Building reads the whole volume once, afterwards threshold passes skip the bricks that can't reach their threshold
+ * and the display cache fills uniform bricks. loadStreaming() builds them before it finishes.
+ * @return m_bricks, empty if no image is loaded
+ */
+const BrickPyramid& CTDataset::bricks()
+{
+    if (m_volume.isValid() && (!m_bricks.isValid() || m_bricks.geometry() != m_geometry)){
+        m_bricks.build(m_volume);
+    }
+    return m_bricks;
+}
+
+/**
+ * @brief CTDataset::bricksFor: Gets bricks() for a view of the loaded volume
+ * @param view the volume a pass reads
+ * @return the bricks, nullptr if the view reads another volume or the volume isn't loaded completely
+ */
+const BrickPyramid* CTDataset::bricksFor(const VolumeView& view)
+{
+    if (!m_volume.isValid() || view != m_volume || isLoading()){
+        return nullptr;
+    }
+    return &bricks();
+}
+
+/**
+ * @brief CTDataset::skipStats: Gets the voxels skipped by the last run of a pass
+ * @param pass the pass
+ * @return voxels covered and skipped, both 0 before the first run
+ */
+const BrickPyramid::SkipStats& CTDataset::skipStats(SkipPass pass) const
+{
+    return m_skipStats[pass];
+}
+
+/**
+ * @brief CTDataset::resetRegionGrowing clears the region data and the visited flags. Only the words touched by the
+ * previous run are cleared, so resetting after a small region is cheap.
+ */
+void CTDataset::resetRegionGrowing()
+{
+    region().clear();
+    visited().clear();
+}
+
+/**
+ * @brief CTDataset::releaseBuffer frees a buffer. Working buffers are allocated again the next time they are used,
+ * releasing the ImageBuffer unloads the image.
+ * @param buffer the buffer to free
+ */
+void CTDataset::releaseBuffer(Buffer buffer)
+{
+    switch (buffer){
+    case ImageBuffer:
+        cancelLoad();
+        m_layersLoaded = 0;
+        delete[] m_pImageData;
+        m_pImageData = nullptr;
+        delete m_pMappedFile; // unmaps the file
+        m_pMappedFile = nullptr;
+        m_bricked.release();
+        m_mappedVolume = VolumeView();
+        m_volume = VolumeView();
+        break;
+    case DepthBuffer:
+        delete[] m_pDepthBuffer;
+        m_pDepthBuffer = nullptr;
+        break;
+    case RegionBuffer:
+        m_regionMask.release();
+        break;
+    case VisitedBuffer:
+        m_visitedMask.release();
+        break;
+    case CrosssectionBuffer:
+        delete[] m_pCrosssectionImageData;
+        m_pCrosssectionImageData = nullptr;
+        break;
+    case RayIndexBuffer:
+        m_rayIndex.release();
+        break;
+    case BrickBuffer:
+        m_bricks.release();
+        break;
+    }
+}
+
+/**
+ * @brief CTDataset::releaseWorkingBuffers frees all buffers except the loaded image, e.g. when the dataset is idle
+ */
+void CTDataset::releaseWorkingBuffers()
+{
+    releaseBuffer(DepthBuffer);
+    releaseBuffer(RegionBuffer);
+    releaseBuffer(VisitedBuffer);
+    releaseBuffer(CrosssectionBuffer);
+    releaseBuffer(RayIndexBuffer);
+    releaseBuffer(BrickBuffer);
+}
+
+/**
+ * @brief CTDataset::bufferSize returns the number of elements of a buffer for the current geometry
+ * @param buffer the buffer
+ * @return number of elements
+ */
+qint64 CTDataset::bufferSize(Buffer buffer) const
+{
+    switch (buffer){
+    case DepthBuffer:
+        return qint64(m_geometry.width())*m_geometry.layers();
+    case CrosssectionBuffer:
+        return m_geometry.sliceSize();
+    default:
+        return m_geometry.voxelCount();
+    }
+}
+
+/**
+ * @brief CTDataset::memoryUsage returns the memory currently allocated for a buffer
+ * @param buffer the buffer
+ * @return size in bytes, 0 if the buffer is not allocated
+ */
+qint64 CTDataset::memoryUsage(Buffer buffer) const
+{
+    switch (buffer){
+    case ImageBuffer:
+        // memory-mapped volumes live in the page cache and are not counted
+        return (m_pImageData ? bufferSize(buffer)*qint64(sizeof(short)) : 0) + m_bricked.memoryUsage();
+    case DepthBuffer:
+        return m_pDepthBuffer ? bufferSize(buffer)*qint64(sizeof(short)) : 0;
+    case RegionBuffer:
+        return m_regionMask.memoryUsage();
+    case VisitedBuffer:
+        return m_visitedMask.memoryUsage();
+    case CrosssectionBuffer:
+        return m_pCrosssectionImageData ? bufferSize(buffer)*qint64(sizeof(short)) : 0;
+    case RayIndexBuffer:
+        return m_rayIndex.memoryUsage();
+    case BrickBuffer:
+        return m_bricks.memoryUsage();
+    }
+    return 0;
+}
+
+/**
+ * @brief CTDataset::memoryUsage returns the memory currently allocated for all buffers
+ * @return size in bytes
+ */
+qint64 CTDataset::memoryUsage() const
+{
+    return memoryUsage(ImageBuffer) + memoryUsage(DepthBuffer) + memoryUsage(RegionBuffer)
+            + memoryUsage(VisitedBuffer) + memoryUsage(CrosssectionBuffer) + memoryUsage(RayIndexBuffer)
+            + memoryUsage(BrickBuffer);
+}
+
+/**
+ * @brief CTDataset::geometry: Gets size and voxel spacing of the volume
+ * @return m_geometry the geometry of the loaded volume (defaults to 400x400x400 before loading)
+ */
+const VolumeGeometry& CTDataset::geometry() const
+{
+    return m_geometry;
+}
 
+/**
+ * @brief CTDataset::openImage opens an image file and checks that its size matches the geometry given by file name or header
+ * @param imagePath Path of the image to open
+ * @param dataFile the file object to open
+ * @param geometry the geometry of the image
+ * @return 0 - no Error occured, 1 - file not found, 2 - file size is inconsistent
+ */
+int CTDataset::openImage(const QString& imagePath, QFile* dataFile, VolumeGeometry& geometry)
+{
     //datafile im Lesemodus öffnen
-    bool bFileOpen = dataFile.open(QIODevice::ReadOnly);
+    bool bFileOpen = dataFile->open(QIODevice::ReadOnly);
     if (!bFileOpen){
         return 1; //File not found
     }
 
-    //Überprüfen, ob das Öffnen geklappt hat (iFileSize gleich iNumberBytesRead?) ansonsten Fehlermeldung anzeigen
-    int iFileSize = dataFile.size();
-    int iNumberBytesRead = dataFile.read((char*)m_pImageData, WIDTH*HEIGHT*LAYERS*sizeof(short));
-    if (iFileSize != iNumberBytesRead){
+    // Determine size and spacing of the volume
+    VolumeGeometry::fromImagePath(imagePath, geometry);
+
+    //Überprüfen, ob die Dateigröße zur Geometrie passt, ansonsten Fehlermeldung anzeigen
+    if (dataFile->size() != geometry.byteSize()){
         return 2; //inconsistent File size
     }
+    return 0;
+}
+
+/**
+ * @brief CTDataset::allocateImage frees the buffers of the previous study and allocates m_pImageData for a new one
+ * @param geometry the geometry of the new study
+ */
+void CTDataset::allocateImage(const VolumeGeometry& geometry)
+{
+    // Buffers of a previous study don't fit anymore; allocate only as much memory as the study needs
+    cancelLoad();
+    releaseWorkingBuffers();
+    if (!m_pImageData || geometry.voxelCount() != m_geometry.voxelCount()){
+        releaseBuffer(ImageBuffer);
+        m_pImageData = new short[geometry.voxelCount()];
+    }
+    m_geometry = geometry;
+    m_volume = VolumeView::linear(m_pImageData, geometry);
+    m_layersLoaded = 0;
+}
+
+/**
+ * @brief CTDataset::mapImage maps an opened image file into memory and makes it the volume of the dataset
+ * @param dataFile the opened file, owned by the dataset if mapping succeeds
+ * @param geometry the geometry of the image
+ * @return true if the file could be mapped
+ */
+bool CTDataset::mapImage(QFile* dataFile, const VolumeGeometry& geometry)
+{
+    uchar* mappedData = dataFile->map(0, geometry.byteSize());
+    if (!mappedData){
+        return false;
+    }
+    releaseWorkingBuffers();
+    releaseBuffer(ImageBuffer);
+    m_pMappedFile = dataFile;
+    m_geometry = geometry;
+    //Mirrors x and y-axis to rotate ImageData
+    m_mappedVolume = VolumeView::mirroredXY((const short*)mappedData, geometry);
+    m_volume = m_mappedVolume;
+    return true;
+}
+
+/**
+ * @brief CTDataset::load Opens an image file from a given path, checks it and loads it to the heap m_pImageData
+ *
+ * Size and voxel spacing are taken from the file name (e.g. SpineModel_0.365_0.325_1_400_400_400.raw) or from a sidecar
+ * header, see VolumeGeometry. Files without either are assumed to be 400x400x400.
+ *
+ * With MappedLoad nothing is copied: the file is mapped into memory and volume() reads it directly, mirroring x and y
+ * by its strides. Only the pages that are accessed are read from disk. If the file can't be mapped it is copied.
+ * @param imagePath Path of the image to load
+ * @param mode whether to copy the file to memory or to map it
+ * @return 0 - no Error occured, 1 - file not found, 2 - file size is inconsistent, 3 - unexpected count of read bytes
+ */
+int CTDataset::load(QString imagePath, LoadMode mode)
+{
+    //QFile Dateiobjekt dataFile erstellen
+    QFile* dataFile = new QFile(imagePath);
+    VolumeGeometry geometry;
+    int iErrorCode = openImage(imagePath, dataFile, geometry);
+    if (iErrorCode != 0){
+        delete dataFile;
+        return iErrorCode;
+    }
+
+    if (mode == MappedLoad && mapImage(dataFile, geometry)){
+        m_layersLoaded = geometry.layers();
+        return 0; // No Error occured
+    }
+
+    allocateImage(geometry);
 
     //Inhalt der ausgewählten Datei in Variable imageData einlesen
-    dataFile.read((char*)m_pImageData, WIDTH*HEIGHT*LAYERS*sizeof(short));
+    qint64 iNumberBytesRead = dataFile->read((char*)m_pImageData, geometry.byteSize());
 
-    // Überprüfen, ob Anzahl eingelesener Bytes der erwarteten Anzahl entsprechen (512*512)
-    if (iNumberBytesRead == WIDTH*HEIGHT*LAYERS){
+    //dataFile wieder schließen
+    dataFile->close();
+    delete dataFile;
+
+    // Überprüfen, ob Anzahl eingelesener Bytes der erwarteten Anzahl entsprechen
+    if (iNumberBytesRead != geometry.byteSize()){
         return 3; //Unexpected count of read bytes
     }
-    //dataFile wieder schließen
-    dataFile.close();
 
     //Mirrors x and y-axis to rotate ImageData
     rotateImage();
+    m_layersLoaded = geometry.layers();
 
     return 0; // No Error occured
 }
 
 /**
- * @brief CTDataset::rotateImage rotates the m_pImageData by 90 degrees
+ * @brief CTDataset::loadStreaming Loads an image file on a background thread
+ *
+ * The file is opened and checked right away, the layers are read and rotated in chunks afterwards. After each chunk
+ * layersReady is called, layers below layersLoaded() can be read while the rest is still loading. With MappedLoad the
+ * file is mapped and the thread only faults in the pages of each chunk, so nothing is copied. At the end the thread
+ * builds bricks(), so other threads can share them read-only afterwards. All other functions of the dataset must not
+ * be used before finished has been called.
+ * Both callbacks are called from the loading thread.
+ * @param imagePath Path of the image to load
+ * @param layersReady called after each chunk with the range of layers that became readable
+ * @param finished called at the end with 0 - no Error occured, 3 - unexpected count of read bytes, 4 - cancelled
+ * @param mode whether to copy the file to memory or to map it
+ * @param chunkLayers number of layers read at once
+ * @return 0 - loading started, 1 - file not found, 2 - file size is inconsistent
  */
-void CTDataset::rotateImage(){
-    short* tmpBuffer = new short[WIDTH*HEIGHT*LAYERS];
-    //In einer Doppelschleife über y und x jeweils den zugehörigen index des Speichers berechnen
-    for (int l = 0; l < LAYERS; ++l){
-        for (int y = 0; y < HEIGHT; ++y) {
-            for (int x = 0; x < WIDTH; ++x) {
-                tmpBuffer[l*WIDTH*HEIGHT + y*WIDTH + x] = m_pImageData[l*WIDTH*HEIGHT + (HEIGHT-y-1)*WIDTH + (WIDTH-x-1)];
-            }
-        }
+int CTDataset::loadStreaming(QString imagePath, LayersReadyCallback layersReady, LoadFinishedCallback finished, LoadMode mode, int chunkLayers)
+{
+    QFile* dataFile = new QFile(imagePath);
+    VolumeGeometry geometry;
+    int iErrorCode = openImage(imagePath, dataFile, geometry);
+    if (iErrorCode != 0){
+        delete dataFile;
+        return iErrorCode;
+    }
+
+    bool mapped = mode == MappedLoad && mapImage(dataFile, geometry);
+    if (!mapped){
+        allocateImage(geometry);
     }
-    for (int l = 0; l < LAYERS; ++l){
-        for (int y = 0; y < HEIGHT; ++y) {
-            for (int x = 0; x < WIDTH; ++x) {
-                m_pImageData[l*WIDTH*HEIGHT + y*WIDTH + x] = tmpBuffer[l*WIDTH*HEIGHT + y*WIDTH + x];
+    m_layersLoaded = 0;
+    chunkLayers = std::max(1, chunkLayers);
+    m_cancelLoad = false;
+    m_loading = true;
+
+    m_loadThread = std::thread([this, dataFile, mapped, layersReady, finished, chunkLayers](){
+        const qint64 sliceSize = m_geometry.sliceSize();
+        const int layers = m_geometry.layers();
+        const qint64 pageSize = 4096/sizeof(short);
+        int iErrorCode = 0;
+        for (int first = 0; first < layers; first += chunkLayers){
+            if (m_cancelLoad){
+                iErrorCode = 4; // cancelled
+                break;
+            }
+            int count = std::min(chunkLayers, layers - first);
+            if (mapped){
+                // touch every page of the chunk so the GUI thread doesn't wait for the disk
+                // voxel (width-1, height-1) is the first one of a layer in the mirrored file
+                const short* chunk = m_volume.pointer(m_geometry.width()-1, m_geometry.height()-1, first);
+                volatile short sink = 0;
+                for (qint64 i = 0; i < count*sliceSize; i += pageSize){
+                    sink = chunk[i];
+                }
+                (void)sink;
+            }
+            else {
+                short* chunk = m_pImageData + first*sliceSize;
+                qint64 bytes = count*sliceSize*qint64(sizeof(short));
+                if (dataFile->read((char*)chunk, bytes) != bytes){
+                    iErrorCode = 3; // Unexpected count of read bytes
+                    break;
+                }
+                //Mirrors x and y-axis to rotate the layers of this chunk
+                for (int l = 0; l < count; ++l){
+                    std::reverse(chunk + l*sliceSize, chunk + (l+1)*sliceSize);
+                }
+            }
+            m_layersLoaded = first + count;
+            if (layersReady){
+                layersReady(first, first + count - 1);
             }
         }
+        if (!mapped){
+            dataFile->close();
+            delete dataFile;
+        }
+        if (iErrorCode == 0){
+            m_bricks.build(m_volume);
+        }
+        m_loading = false;
+        if (finished){
+            finished(iErrorCode);
+        }
+    });
+    return 0;
+}
+
+/**
+ * @brief CTDataset::layersLoaded: Number of layers that can be read while a streaming load is running
+ * @return all layers once an image is loaded, 0 if no image is loaded
+ */
+int CTDataset::layersLoaded() const
+{
+    return m_layersLoaded;
+}
+
+/**
+ * @brief CTDataset::isLoading: Tells whether a streaming load is running
+ * @return true until all layers have been read or loading stopped
+ */
+bool CTDataset::isLoading() const
+{
+    return m_loading;
+}
+
+/**
+ * @brief CTDataset::cancelLoad stops a running streaming load after the current chunk and waits for it
+ */
+void CTDataset::cancelLoad()
+{
+    m_cancelLoad = true;
+    waitForLoad();
+    m_cancelLoad = false;
+}
+
+/**
+ * @brief CTDataset::waitForLoad waits until a running streaming load has finished
+ */
+void CTDataset::waitForLoad()
+{
+    if (m_loadThread.joinable() && m_loadThread.get_id() != std::this_thread::get_id()){
+        m_loadThread.join();
+    }
+}
+
+/**
+ * @brief CTDataset::rotateImage rotates the m_pImageData by 180 degrees (mirrors x and y) in place
+ */
+void CTDataset::rotateImage(){
+    // mirroring x and y of a layer reverses the order of its voxels
+    for (int l = 0; l < m_geometry.layers(); ++l){
+        short* layer = m_pImageData + l*m_geometry.sliceSize();
+        std::reverse(layer, layer + m_geometry.sliceSize());
     }
-    delete [] tmpBuffer;
 }
 
 /**
@@ -147,43 +669,231 @@ int CTDataset::windowing(int HU_value, int startValue, int windowWIDTH, int &gra
  * @brief CTDataset::calculateDepthBuffer: Creates or updates a depth map m_pDepthBuffer that displays all voxels over a certain threshold
  * @param iThreshold the minimum intensity of a voxel to be displayed in the depth buffer
  * @param imageData an arbitrary set of 3D imageData (e.g. m_pImageData)
- * @return 0
+ * @return 0 - if successful, 1 - if imageData is missing
  */
 int CTDataset::calculateDepthBuffer(const int& iThreshold, short* imageData){
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            for (int l = 0; l < LAYERS; ++l) {
-                if (imageData[y*WIDTH*HEIGHT + l*WIDTH + (WIDTH-x)] >= iThreshold){
-                    m_pDepthBuffer[y*WIDTH + x] = l;
-                    break;
+    return calculateDepthBuffer(iThreshold, VolumeView::linear(imageData, m_geometry));
+}
+
+/**
+ * @brief CTDataset::calculateDepthBuffer: Creates or updates a depth map m_pDepthBuffer that displays all voxels over a certain threshold
+ *
+ * The rays run along the y-axis, so all rays of a layer are followed together: the layer is read row by row in memory
+ * order, 16 rays are compared per step and a bit per ray tells which rays haven't hit yet. A layer is done when all its
+ * rays hit. The layers are split between the threads.
+ *
+ * For the loaded volume the rays skip the bricks whose maximum is below the threshold (see bricks()), layers without
+ * such a brick are not read at all.
+ * @param iThreshold the minimum intensity of a voxel to be displayed in the depth buffer
+ * @param imageData an arbitrary volume (e.g. volume())
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if imageData is missing
+ */
+int CTDataset::calculateDepthBuffer(const int& iThreshold, const VolumeView& imageData, int threadCount){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int LAYERS = m_geometry.layers();
+    short* depthBuffer = depthbuffer();
+    if (!imageData.isValid()){
+        return 1;
+    }
+    BrickPyramid::SkipStats& stats = m_skipStats[DepthBufferPass];
+    stats = BrickPyramid::SkipStats();
+    stats.voxels = m_geometry.voxelCount();
+    if (iThreshold <= SHRT_MIN || iThreshold > SHRT_MAX){
+        // every ray hits in its first voxel or none hits, both are drawn as 0
+        std::fill(depthBuffer, depthBuffer + bufferSize(DepthBuffer), 0);
+        stats.skippedVoxels = stats.voxels;
+        return 0;
+    }
+    const short limit = short(iThreshold - 1);
+    const int GROUPS = (WIDTH + 15)/16;
+    // rows stored in descending x (the raw file layout) are walked in memory order as well
+    const bool descending = imageData.strideX() == -1;
+    const bool direct = descending || imageData.hasContiguousRows();
+    const BrickPyramid* bricks = bricksFor(imageData);
+    const int BRICK = bricks ? bricks->brickSize() : HEIGHT;
+
+    const int THREADS = std::min(Parallel::threadCount(threadCount), LAYERS);
+    std::vector<qint64> skipped(size_t(std::max(THREADS, 1)), 0);
+    Parallel::forChunks(0, LAYERS, THREADS, [&](int firstLayer, int lastLayer, int chunk){
+        std::vector<short> row(direct ? 0 : WIDTH);
+        // depth and open rays in memory order of the rows
+        std::vector<short> depth(WIDTH);
+        std::vector<quint16> active(GROUPS);
+        // groups with a brick that may reach the threshold in the current band of rows
+        std::vector<char> reachable(GROUPS, 1);
+        for (int z = firstLayer; z < lastLayer; ++z){
+            std::fill(depth.begin(), depth.end(), 0);
+            std::fill(active.begin(), active.end(), quint16(0xffff));
+            if (WIDTH % 16 != 0){
+                active[GROUPS-1] = quint16((1u << (WIDTH % 16)) - 1);
+            }
+            int openGroups = GROUPS;
+            if (bricks && !bricks->mayReach(0, 0, z, WIDTH, HEIGHT, z + 1, iThreshold)){
+                openGroups = 0;
+                skipped[chunk] += qint64(WIDTH)*HEIGHT;
+            }
+            for (int l = 0; l < HEIGHT && openGroups > 0; ++l){
+                if (bricks && l % BRICK == 0){
+                    const int rows = std::min(BRICK, HEIGHT - l);
+                    int skippedLanes = 0;
+                    bool anyReachable = false;
+                    for (int g = 0; g < GROUPS; ++g){
+                        if (!active[g]){
+                            continue;
+                        }
+                        const int lanes = std::min(16, WIDTH - 16*g);
+                        const int firstColumn = descending ? WIDTH - 16*g - lanes : 16*g;
+                        reachable[g] = 0;
+                        for (int bx = firstColumn/BRICK; bx <= (firstColumn + lanes - 1)/BRICK; ++bx){
+                            if (bricks->maximum(bx, l/BRICK, z/BRICK) >= iThreshold){
+                                reachable[g] = 1;
+                                break;
+                            }
+                        }
+                        if (reachable[g]){
+                            anyReachable = true;
+                        } else {
+                            skippedLanes += lanes;
+                        }
+                    }
+                    skipped[chunk] += qint64(skippedLanes)*rows;
+                    if (!anyReachable){
+                        l += rows - 1;
+                        continue;
+                    }
+                }
+                const short* values;
+                if (descending){
+                    values = imageData.pointer(WIDTH-1, l, z);
+                } else if (direct){
+                    values = imageData.pointer(0, l, z);
+                } else {
+                    imageData.readRow(l, z, row.data());
+                    values = row.data();
                 }
-                else {
-                    m_pDepthBuffer[y*WIDTH + x] = 0;
+                for (int g = 0; g < GROUPS; ++g){
+                    if (!active[g] || !reachable[g]){
+                        continue;
+                    }
+                    const short* group = values + 16*g;
+                    unsigned hits = 0;
+                    if (16*g + 16 <= WIDTH){
+                        hits = hitMask16(group, limit);
+                    } else {
+                        for (int i = 0; i < WIDTH - 16*g; ++i){
+                            hits |= unsigned(group[i] > limit) << i;
+                        }
+                    }
+                    hits &= active[g];
+                    if (!hits){
+                        continue;
+                    }
+                    active[g] = quint16(active[g] & ~hits);
+                    if (!active[g]){
+                        --openGroups;
+                    }
+                    for (int lane = 16*g; hits; ++lane, hits >>= 1){
+                        if (hits & 1){
+                            depth[lane] = short(l);
+                        }
+                    }
                 }
             }
+            // the depth buffer has one row per layer and is mirrored in x
+            short* out = depthBuffer + qint64(z)*WIDTH;
+            out[0] = 0; // column 0 would lie outside the volume
+            for (int x = 1; x < WIDTH; ++x){
+                out[x] = depth[descending ? x - 1 : WIDTH - x];
+            }
         }
+    });
+    for (qint64 count : skipped){
+        stats.skippedVoxels += count;
     }
     return 0;
 }
 
+/**
+ * @brief CTDataset::calculateDepthBuffer: Creates or updates a depth map m_pDepthBuffer that displays the voxels of a mask over a certain threshold
+ * @param iThreshold the minimum intensity of a voxel to be displayed in the depth buffer
+ * @param mask the voxels to display (e.g. region())
+ * @return 0 - if successful, 1 - if no image is loaded or the mask doesn't fit the volume
+ */
+int CTDataset::calculateDepthBuffer(const int& iThreshold, const BitMask& mask){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int LAYERS = m_geometry.layers();
+    short* depthBuffer = depthbuffer();
+    if (!m_volume.isValid() || mask.size() != m_geometry.voxelCount()){
+        return 1;
+    }
+    BrickPyramid::SkipStats& stats = m_skipStats[DepthBufferPass];
+    stats = BrickPyramid::SkipStats();
+    stats.voxels = m_geometry.voxelCount();
+    // rays jump over the bricks that can't reach the threshold
+    const BrickPyramid* bricks = bricksFor(m_volume);
+    const int BRICK = bricks ? bricks->brickSize() : HEIGHT;
+    m_volume.visit([&](const auto& voxels){
+        // same ray layout as for a whole volume, voxels outside the mask count as background
+        for (int y = 0; y < LAYERS; ++y) {
+            depthBuffer[y*WIDTH] = 0;
+            for (int x = 1; x < WIDTH; ++x) {
+                depthBuffer[y*WIDTH + x] = 0;
+                for (int l = 0; l < HEIGHT; ++l) {
+                    if (bricks && l % BRICK == 0 && !bricks->brickMayReach(WIDTH-x, l, y, iThreshold)){
+                        stats.skippedVoxels += std::min(BRICK, HEIGHT - l);
+                        l += BRICK - 1;
+                        continue;
+                    }
+                    if (mask.test(m_geometry.index(WIDTH-x, l, y)) && voxels.at(WIDTH-x, l, y) >= iThreshold){
+                        depthBuffer[y*WIDTH + x] = l;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+    return 0;
+}
+
+/**
+ * @brief CTDataset::calculateDepthBuffer: Creates or updates a depth map m_pDepthBuffer from the running maxima of the
+ * rays, the same as from the volume but by a binary search per ray instead of marching through the volume
+ * @param iThreshold the minimum intensity of a voxel to be displayed in the depth buffer
+ * @param index the running maxima of the volume (e.g. rayIndex())
+ * @return 0 - if successful, 1 - if the index is missing or doesn't fit the volume
+ */
+int CTDataset::calculateDepthBuffer(const int& iThreshold, const RayMaxIndex& index){
+    if (!index.isValid() || index.geometry() != m_geometry){
+        return 1;
+    }
+    index.fillDepthBuffer(iThreshold, depthbuffer());
+    return 0;
+}
+
 /**
  * @brief CTDataset::renderDepthBuffer: Renders the depth buffer to a lighting model, using the angle of the surface to the lightsource
  * @param shadedBuffer a 2D lighting model displaying the topography of a 3D object from a certain direction
  * @return 0
  */
 int CTDataset::renderDepthBuffer(short* shadedBuffer){
-    float incidence_angle;
-    float T_x;
-    float T_y;
-    for (int y=1; y < HEIGHT-1; ++y){
-        for (int x=1; x < WIDTH-1; ++x){
-            T_x = m_pDepthBuffer[y*WIDTH + (x-1)] - m_pDepthBuffer[y*WIDTH + (x+1)];
-            T_y = m_pDepthBuffer[(y-1)*WIDTH + x] - m_pDepthBuffer[(y+1)*WIDTH + x];
-            incidence_angle = (2*2)/(sqrt(pow(2*T_x, 2) + pow(2*T_y, 2) + pow(2*2, 2) ));
-            shadedBuffer[y*WIDTH + x] = 255 * incidence_angle;
-        }
-    }
-    return 0;
+    // the depth buffer has one row per layer
+    return renderDepthBuffer(depthbuffer(), m_geometry.width(), m_geometry.layers(), shadedBuffer);
+}
+
+/**
+ * @brief CTDataset::renderDepthBuffer: Renders any depth map to a lighting model, e.g. the maps of AxisDepthMaps
+ * @param depthBuffer the depth map, width x height values
+ * @param width columns of the depth map
+ * @param height rows of the depth map
+ * @param shadedBuffer receives the lighting model, the border pixels are not written
+ * @return 0 - if successful, 1 - if a buffer is missing
+ */
+int CTDataset::renderDepthBuffer(const short* depthBuffer, int width, int height, short* shadedBuffer){
+    // looked up from the depth gradient, see MyLib::renderDepthBuffer
+    return MyLib::renderDepthBuffer(depthBuffer, width, height, shadedBuffer);
 }
 
 /**
@@ -191,211 +901,430 @@ int CTDataset::renderDepthBuffer(short* shadedBuffer){
  * @param seed the voxel from which to start region growing
  * @param threshold the threshold at which region growing stops
  * @param iRegion a list of all voxels that are found to be in the created region
+ * @param stats receives the figures of the run if not nullptr
  * @return 0 - if successful, 1 - if seed is invalid, 2 - if seed is below threshold
  */
-int CTDataset::regionGrowing(Voxel seed, int threshold, std::vector <Voxel>& iRegion){
+int CTDataset::regionGrowing(Voxel seed, int threshold, std::vector <Voxel>& iRegion, GrowingStats* stats){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int LAYERS = m_geometry.layers();
     std::vector <Voxel> Searchlist;
     Voxel voxel;
+    BitMask& visited_voxel = visited();
+    BitMask& regionData = region();
 
-    // 1: seed out of bounds
-    if (seed.x < 0 || seed.y < 0 || seed.z < 0){
+    // 1: seed out of bounds or no image loaded
+    if (!m_geometry.contains(seed.x, seed.y, seed.z) || !m_volume.isValid()){
         return 1; //seed invalid
     }
 
     // Set seed on searchlist if above threshold
-    if (m_pImageData[seed.z*WIDTH*HEIGHT + seed.y*WIDTH + seed.x] >= threshold){
+    if (m_volume.at(seed.x, seed.y, seed.z) >= threshold){
         Searchlist.push_back(seed);
     }
     else {
         return 2; // 2: seed below threshold
     }
 
-    while (!Searchlist.empty()){
-        // Read last voxel in searchlist and delete it from list
-        voxel = Searchlist.back();
-        Searchlist.pop_back();
-        iRegion.push_back(voxel);
+    QElapsedTimer timer;
+    timer.start();
+    size_t peakFrontier = Searchlist.size();
+    const size_t firstVoxel = iRegion.size();
+    m_volume.visit([&](const auto& voxels){
+        while (!Searchlist.empty()){
+            // Read last voxel in searchlist and delete it from list
+            voxel = Searchlist.back();
+            Searchlist.pop_back();
+            iRegion.push_back(voxel);
 
-        visited_voxel[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] = true;
+            visited_voxel.set(m_geometry.index(voxel.x, voxel.y, voxel.z));
 
-        // Only look at voxels in scope of frame
-        if (0 < voxel.x & voxel.x < WIDTH & 0 < voxel.y & voxel.y < HEIGHT & 0 < voxel.z & voxel.z < LAYERS-1){
-            m_pRegionData[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] = m_pImageData[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x];
+            // Only look at voxels in scope of frame (all neighbours inside the volume)
+            if (0 < voxel.x & voxel.x < WIDTH-1 & 0 < voxel.y & voxel.y < HEIGHT-1 & 0 < voxel.z & voxel.z < LAYERS-1){
+                const qint64 index = m_geometry.index(voxel.x, voxel.y, voxel.z);
+                const qint64 slice = m_geometry.sliceSize();
+                regionData.set(index);
 
-            // Add neighbors to searchlist if not visited and above threshold
-            if (!visited_voxel[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + (voxel.x+1)] && m_pImageData[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + (voxel.x+1)] >= threshold){ Searchlist.push_back({voxel.x+1, voxel.y, voxel.z}); }
-            if (!visited_voxel[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + (voxel.x-1)] && m_pImageData[voxel.z*WIDTH*HEIGHT + voxel.y*WIDTH + (voxel.x-1)] >= threshold){ Searchlist.push_back({voxel.x-1, voxel.y, voxel.z}); }
-            if (!visited_voxel[voxel.z*WIDTH*HEIGHT + (voxel.y+1)*WIDTH + voxel.x] && m_pImageData[voxel.z*WIDTH*HEIGHT + (voxel.y+1)*WIDTH + voxel.x] >= threshold){ Searchlist.push_back({voxel.x, voxel.y+1, voxel.z}); }
-            if (!visited_voxel[voxel.z*WIDTH*HEIGHT + (voxel.y-1)*WIDTH + voxel.x] && m_pImageData[voxel.z*WIDTH*HEIGHT + (voxel.y-1)*WIDTH + voxel.x] >= threshold){ Searchlist.push_back({voxel.x, voxel.y-1, voxel.z}); }
-            if (!visited_voxel[(voxel.z+1)*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] && m_pImageData[(voxel.z+1)*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] >= threshold){ Searchlist.push_back({voxel.x, voxel.y, voxel.z+1}); }
-            if (!visited_voxel[(voxel.z-1)*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] && m_pImageData[(voxel.z-1)*WIDTH*HEIGHT + voxel.y*WIDTH + voxel.x] >= threshold){ Searchlist.push_back({voxel.x, voxel.y, voxel.z-1}); }
+                // Add neighbors to searchlist if not visited and above threshold
+                if (!visited_voxel.test(index+1) && voxels.at(voxel.x+1, voxel.y, voxel.z) >= threshold){ Searchlist.push_back({voxel.x+1, voxel.y, voxel.z}); }
+                if (!visited_voxel.test(index-1) && voxels.at(voxel.x-1, voxel.y, voxel.z) >= threshold){ Searchlist.push_back({voxel.x-1, voxel.y, voxel.z}); }
+                if (!visited_voxel.test(index+WIDTH) && voxels.at(voxel.x, voxel.y+1, voxel.z) >= threshold){ Searchlist.push_back({voxel.x, voxel.y+1, voxel.z}); }
+                if (!visited_voxel.test(index-WIDTH) && voxels.at(voxel.x, voxel.y-1, voxel.z) >= threshold){ Searchlist.push_back({voxel.x, voxel.y-1, voxel.z}); }
+                if (!visited_voxel.test(index+slice) && voxels.at(voxel.x, voxel.y, voxel.z+1) >= threshold){ Searchlist.push_back({voxel.x, voxel.y, voxel.z+1}); }
+                if (!visited_voxel.test(index-slice) && voxels.at(voxel.x, voxel.y, voxel.z-1) >= threshold){ Searchlist.push_back({voxel.x, voxel.y, voxel.z-1}); }
+                peakFrontier = std::max(peakFrontier, Searchlist.size());
+            }
         }
+    });
+    if (stats){
+        stats->voxelCount = qint64(iRegion.size() - firstVoxel);
+        stats->peakFrontier = qint64(peakFrontier);
+        stats->peakFrontierBytes = qint64(peakFrontier*sizeof(Voxel));
+        stats->elapsedNs = timer.nsecsElapsed();
+        stats->threadCount = 1;
     }
     return 0;
 }
 
 /**
- * @brief CTDataset::getRegistrationMarkers determines all registration markers and saves them to m_pRegionData
- * @param threshold the threshold chosen to single out the markers
+ * @brief CTDataset::regionGrowingSpans performs region growing on whole runs of voxels
+ *
+ * Every entry of the search stack starts a run that is extended along x as far as the voxels are above the threshold.
+ * The run is marked at once, then the rows next to it in y and z are scanned and one entry is pushed for every piece of
+ * them that belongs to the region. The stack holds runs instead of single voxels, so it stays small even for whole
+ * bones. Voxels on the border of the volume are grown like all others.
+ * @param seed the voxel from which to start region growing
+ * @param threshold the threshold at which region growing stops
+ * @param stats receives the figures of the run if not nullptr
+ * @param cancel checked every 1024 runs if not nullptr, the growing stops once it is set and the region is incomplete
+ * @return 0 - if successful, 1 - if seed is invalid, 2 - if seed is below threshold, 4 - if cancelled
  */
-void CTDataset::getRegistrationMarkers(int threshold){
-    Voxel seed;
-    std::vector<std::vector<Voxel>> regions;
+int CTDataset::regionGrowingSpans(Voxel seed, int threshold, GrowingStats* stats, const std::atomic<bool>* cancel){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int LAYERS = m_geometry.layers();
+    BitMask& visited_voxel = visited();
+    BitMask& regionData = region();
 
-    // Clean visited_voxel array
-    for (int i=0; i<WIDTH*HEIGHT*LAYERS; i++) {
-        visited_voxel[i] = false;
+    if (!m_geometry.contains(seed.x, seed.y, seed.z) || !m_volume.isValid()){
+        return 1; //seed invalid
+    }
+    if (m_volume.at(seed.x, seed.y, seed.z) < threshold){
+        return 2; // 2: seed below threshold
     }
 
-    // get regions
     QElapsedTimer timer;
     timer.start();
-    for (int z=0; z<LAYERS; z+=2){
-        for (int y=0; y<HEIGHT; y+=2){
-            for (int x=0; x<WIDTH; x+=2){
-                std::vector <Voxel> region;
-                seed.x = x;
-                seed.y = y;
-                seed.z = z;
-                regionGrowing(seed, threshold, region);
-                if (250 < region.size() && region.size() < 1000) {
-                    // version as specified by the instructions (120<x<200 and 230<x<400 but rotated)
-                    /*if ((280 >= getMaxX(region) && getMinX(region) >= 200) || (170 >= getMaxX(region) && getMinX(region) >= 0)){
-                        regions.push_back(region);
-                    }*/
-                    // version that works better
-                    if (getWidth(region) > 5 && getWidth(region) < 20 && getWidth(region) > 5 && getWidth(region) < 20){
-                        regions.push_back(region);
-                        getCentroid(region);
-                    }
+    std::vector<Voxel> Searchlist;
+    Searchlist.push_back(seed);
+    size_t peakFrontier = 1;
+    qint64 voxelCount = 0;
+    qint64 runs = 0;
+    bool cancelled = false;
+
+    m_volume.visit([&](const auto& voxels){
+        // pushes one entry for every piece of row (y, z) between left and right that belongs to the region
+        auto scanRow = [&](int left, int right, int y, int z){
+            if (y < 0 || y >= HEIGHT || z < 0 || z >= LAYERS){
+                return;
+            }
+            const qint64 row = m_geometry.index(0, y, z);
+            int x = left;
+            while (x <= right){
+                while (x <= right && (visited_voxel.test(row + x) || voxels.at(x, y, z) < threshold)){
+                    ++x;
+                }
+                if (x > right){
+                    break;
+                }
+                Searchlist.push_back({x, y, z});
+                while (x <= right && !visited_voxel.test(row + x) && voxels.at(x, y, z) >= threshold){
+                    ++x;
                 }
             }
-        }
-    }
+        };
 
-    // Empty the region data
-    for (int i=0; i<LAYERS*HEIGHT*WIDTH; i++) {
-        m_pRegionData[i] = -1024;
-    }
-    // Iterate over regions and write them to region data
-    int index;
-    for (unsigned long int i = 0; i < regions.size(); i++) {
-        for (unsigned long int j = 0; j < regions[i].size(); j++) {
-            index = regions[i][j].z*HEIGHT*WIDTH + regions[i][j].y*WIDTH + regions[i][j].x;
-            m_pRegionData[index] = m_pImageData[index];
+        while (!Searchlist.empty()){
+            Voxel voxel = Searchlist.back();
+            Searchlist.pop_back();
+            const qint64 row = m_geometry.index(0, voxel.y, voxel.z);
+            if (visited_voxel.test(row + voxel.x)){
+                continue; // reached by another run already
+            }
+            if (cancel && (runs++ & 1023) == 0 && cancel->load(std::memory_order_relaxed)){
+                cancelled = true;
+                break;
+            }
+
+            // extend the run in both directions
+            int left = voxel.x;
+            int right = voxel.x;
+            while (left > 0 && !visited_voxel.test(row + left - 1) && voxels.at(left - 1, voxel.y, voxel.z) >= threshold){
+                --left;
+            }
+            while (right < WIDTH - 1 && !visited_voxel.test(row + right + 1) && voxels.at(right + 1, voxel.y, voxel.z) >= threshold){
+                ++right;
+            }
+            visited_voxel.setRange(row + left, row + right + 1);
+            regionData.setRange(row + left, row + right + 1);
+            voxelCount += right - left + 1;
+
+            scanRow(left, right, voxel.y - 1, voxel.z);
+            scanRow(left, right, voxel.y + 1, voxel.z);
+            scanRow(left, right, voxel.y, voxel.z - 1);
+            scanRow(left, right, voxel.y, voxel.z + 1);
+            peakFrontier = std::max(peakFrontier, Searchlist.size());
         }
+    });
+
+    if (stats){
+        stats->voxelCount = voxelCount;
+        stats->peakFrontier = qint64(peakFrontier);
+        stats->peakFrontierBytes = qint64(peakFrontier*sizeof(Voxel));
+        stats->elapsedNs = timer.nsecsElapsed();
+        stats->threadCount = 1;
     }
+    return cancelled ? 4 : 0;
 }
 
 /**
- * @brief CTDataset::getCentroid calculates the average of all vectors in a region and saves it to markerCentroids
- * @param region the region of which the centroid is computed
+ * @brief CTDataset::regionGrowingParallel performs region growing on whole runs of voxels on several threads
+ *
+ * The volume is split into one slab of layers per thread and each thread fills the runs of its slab like
+ * regionGrowingSpans(). The pieces of rows found in a neighbouring slab are sent to the inbox of its thread, which
+ * starts on them as soon as they arrive. Only the thread of a slab sets the bits of its voxels, the words shared with
+ * a neighbouring slab are written atomically. The growing ends when no thread is at work and all inboxes are empty.
+ * The region is the same as with regionGrowingSpans(), independent of the number of threads.
+ * @param seed the voxel from which to start region growing
+ * @param threshold the threshold at which region growing stops
+ * @param threadCount number of threads, 0 uses all cores
+ * @param stats receives the figures of the run if not nullptr, peakFrontier is the sum of the largest stacks
+ * @param cancel checked every 1024 runs if not nullptr, the growing stops once it is set and the region is incomplete
+ * @return 0 - if successful, 1 - if seed is invalid, 2 - if seed is below threshold, 4 - if cancelled
  */
-void CTDataset::getCentroid(std::vector<Voxel> region){
-    Voxel voxel;
-    Voxel centroid = {0, 0, 0};
+int CTDataset::regionGrowingParallel(Voxel seed, int threshold, int threadCount, GrowingStats* stats,
+                                     const std::atomic<bool>* cancel){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int LAYERS = m_geometry.layers();
+    BitMask& visited_voxel = visited();
+    BitMask& regionData = region();
 
-    int i = 0;
-    while (!region.empty()){
-        voxel = region.back();
-        region.pop_back();
-        centroid.x += voxel.x;
-        centroid.y += voxel.y;
-        centroid.z += voxel.z;
-        i++;
+    if (!m_geometry.contains(seed.x, seed.y, seed.z) || !m_volume.isValid()){
+        return 1; //seed invalid
+    }
+    if (m_volume.at(seed.x, seed.y, seed.z) < threshold){
+        return 2; // 2: seed below threshold
     }
-    centroid.x /= i;
-    centroid.y /= i;
-    centroid.z /= i;
 
-    markerCentroids.push_back(centroid);
-}
+    QElapsedTimer timer;
+    timer.start();
+    const int THREADS = std::min(Parallel::threadCount(threadCount), LAYERS);
+    // slab t holds the layers LAYERS*t/THREADS to LAYERS*(t+1)/THREADS - 1
+    auto slabOf = [&](int z){ return int(((qint64(z) + 1)*THREADS + LAYERS - 1)/LAYERS) - 1; };
 
-/**
- * @brief CTDataset::getMaxX
- * @param region
- * @return value of maximal x-coordinate in the region
- */
-int CTDataset::getMaxX(std::vector <Voxel> region){
-    int max = 0;
-    Voxel voxel;
-    while (!region.empty()){
-        voxel = region.back();
-        region.pop_back();
-        if (max < voxel.x)
-            max = voxel.x;
+    // guarded by mutex: the inboxes and the number of threads at work plus pieces waiting in the inboxes
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::vector<Voxel>> inbox(THREADS);
+    inbox[slabOf(seed.z)].push_back(seed);
+    int outstanding = 1;
+    bool cancelled = false;
+
+    std::vector<qint64> voxelCount(THREADS, 0);
+    std::vector<qint64> minIndex(THREADS, LLONG_MAX);
+    std::vector<qint64> maxIndex(THREADS, -1);
+    std::vector<size_t> peakFrontier(THREADS, 0);
+
+    m_volume.visit([&](const auto& voxels){
+        Parallel::forChunks(0, THREADS, THREADS, [&](int t, int, int){
+            const int FIRST_LAYER = int(qint64(LAYERS)*t/THREADS);
+            const int LAST_LAYER = int(qint64(LAYERS)*(t+1)/THREADS) - 1;
+            std::vector<Voxel> Searchlist;
+            // pieces found in the slab before and after this one
+            std::vector<Voxel> outgoing[2];
+            qint64 count = 0;
+            qint64 lowest = LLONG_MAX;
+            qint64 highest = -1;
+            size_t peak = 0;
+            qint64 runs = 0;
+
+            // hands the pieces found in the neighbouring slabs to their threads
+            auto send = [&](){
+                if (outgoing[0].empty() && outgoing[1].empty()){
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int side = 0; side < 2; ++side){
+                    if (outgoing[side].empty()){
+                        continue;
+                    }
+                    std::vector<Voxel>& target = inbox[side == 0 ? t - 1 : t + 1];
+                    target.insert(target.end(), outgoing[side].begin(), outgoing[side].end());
+                    outstanding += int(outgoing[side].size());
+                    outgoing[side].clear();
+                }
+                wake.notify_all();
+            };
+
+            // pushes one entry for every piece of row (y, z) between left and right that belongs to the region, the bits
+            // of other slabs may change meanwhile, their threads drop pieces that were reached already
+            auto scanRow = [&](int left, int right, int y, int z){
+                if (y < 0 || y >= HEIGHT || z < 0 || z >= LAYERS){
+                    return;
+                }
+                std::vector<Voxel>& target = z < FIRST_LAYER ? outgoing[0] : z > LAST_LAYER ? outgoing[1] : Searchlist;
+                const qint64 row = m_geometry.index(0, y, z);
+                int x = left;
+                while (x <= right){
+                    while (x <= right && (visited_voxel.testAtomic(row + x) || voxels.at(x, y, z) < threshold)){
+                        ++x;
+                    }
+                    if (x > right){
+                        break;
+                    }
+                    target.push_back({x, y, z});
+                    while (x <= right && !visited_voxel.testAtomic(row + x) && voxels.at(x, y, z) >= threshold){
+                        ++x;
+                    }
+                }
+            };
+
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true){
+                wake.wait(lock, [&](){ return !inbox[t].empty() || outstanding == 0 || cancelled; });
+                if (inbox[t].empty() || cancelled){
+                    break;
+                }
+                // at work from now on, the pieces taken are no longer waiting
+                Searchlist.swap(inbox[t]);
+                outstanding += 1 - int(Searchlist.size());
+                lock.unlock();
+
+                while (!Searchlist.empty()){
+                    Voxel voxel = Searchlist.back();
+                    Searchlist.pop_back();
+                    const qint64 row = m_geometry.index(0, voxel.y, voxel.z);
+                    if (visited_voxel.testAtomic(row + voxel.x)){
+                        continue; // reached by another run already
+                    }
+                    if (cancel && (runs++ & 1023) == 0 && cancel->load(std::memory_order_relaxed)){
+                        Searchlist.clear();
+                        outgoing[0].clear();
+                        outgoing[1].clear();
+                        std::lock_guard<std::mutex> stop(mutex);
+                        cancelled = true;
+                        wake.notify_all();
+                        break;
+                    }
+
+                    // extend the run in both directions
+                    int left = voxel.x;
+                    int right = voxel.x;
+                    while (left > 0 && !visited_voxel.testAtomic(row + left - 1)
+                           && voxels.at(left - 1, voxel.y, voxel.z) >= threshold){
+                        --left;
+                    }
+                    while (right < WIDTH - 1 && !visited_voxel.testAtomic(row + right + 1)
+                           && voxels.at(right + 1, voxel.y, voxel.z) >= threshold){
+                        ++right;
+                    }
+                    visited_voxel.setRangeAtomic(row + left, row + right + 1);
+                    regionData.setRangeAtomic(row + left, row + right + 1);
+                    count += right - left + 1;
+                    lowest = std::min(lowest, row + left);
+                    highest = std::max(highest, row + right);
+
+                    scanRow(left, right, voxel.y - 1, voxel.z);
+                    scanRow(left, right, voxel.y + 1, voxel.z);
+                    scanRow(left, right, voxel.y, voxel.z - 1);
+                    scanRow(left, right, voxel.y, voxel.z + 1);
+                    peak = std::max(peak, Searchlist.size());
+                    // the neighbours get their pieces in batches, or at once when this thread runs out of work
+                    if (outgoing[0].size() + outgoing[1].size() >= 64 || Searchlist.empty()){
+                        send();
+                    }
+                }
+                send();
+
+                lock.lock();
+                if (--outstanding == 0){
+                    wake.notify_all();
+                }
+            }
+            lock.unlock();
+            voxelCount[t] = count;
+            minIndex[t] = lowest;
+            maxIndex[t] = highest;
+            peakFrontier[t] = peak;
+        });
+    });
+
+    qint64 totalCount = 0;
+    qint64 firstIndex = LLONG_MAX;
+    qint64 lastIndex = -1;
+    size_t totalPeak = 0;
+    for (int t = 0; t < THREADS; ++t){
+        totalCount += voxelCount[t];
+        firstIndex = std::min(firstIndex, minIndex[t]);
+        lastIndex = std::max(lastIndex, maxIndex[t]);
+        totalPeak += peakFrontier[t];
     }
-    return max;
-}
+    visited_voxel.markWritten(firstIndex, lastIndex + 1);
+    regionData.markWritten(firstIndex, lastIndex + 1);
 
-/**
- * @brief CTDataset::getMinX
- * @param region
- * @return value of minimal x-coordinate in the region
- */
-int CTDataset::getMinX(std::vector <Voxel> region){
-    int min = WIDTH;
-    Voxel voxel;
-    while (!region.empty()){
-        voxel = region.back();
-        region.pop_back();
-        if (min > voxel.x)
-            min = voxel.x;
+    if (stats){
+        stats->voxelCount = totalCount;
+        stats->peakFrontier = qint64(totalPeak);
+        stats->peakFrontierBytes = qint64(totalPeak*sizeof(Voxel));
+        stats->elapsedNs = timer.nsecsElapsed();
+        stats->threadCount = THREADS;
     }
-    return min;
+    return cancelled ? 4 : 0;
 }
 
 /**
- * @brief CTDataset::getWIDTH
- * @param region
- * @return WIDTH of the region
+ * @brief CTDataset::getRegistrationMarkers determines all registration markers, saves their centroids to markerCentroids
+ * and their voxels to markerRegions and region()
+ *
+ * All voxels above the threshold are labeled in one sweep, markers are the components whose size and width fit.
+ * Bricks that can't reach the threshold are skipped (see bricks()).
+ * @param threshold the threshold chosen to single out the markers
+ * @param stats receives the figures of the run if not nullptr
  */
-int CTDataset::getWidth(std::vector <Voxel> region){
-    int maxX = 0;
-    int minX = WIDTH;
-    Voxel voxel;
-    while (!region.empty()){
-        voxel = region.back();
-        region.pop_back();
-        if (maxX < voxel.x)
-            maxX = voxel.x;
-        if (voxel.x < minX)
-            minX = voxel.x;
+void CTDataset::getRegistrationMarkers(int threshold, MarkerStats* stats){
+    if (!m_volume.isValid()){
+        return; // no image loaded
     }
-    return maxX-minX;
-}
 
-/**
- * @brief CTDataset::getHEIGHT
- * @param region
- * @return HEIGHT of the region
- */
-int CTDataset::getHeight(std::vector<Voxel> region){
-    int maxY = 0;
-    int minY = HEIGHT;
-    Voxel voxel;
-    while (!region.empty()){
-        voxel = region.back();
-        region.pop_back();
-        if (maxY < voxel.y)
-            maxY = voxel.y;
-        if (voxel.y < minY)
-            minY = voxel.y;
+    // get regions
+    QElapsedTimer timer;
+    timer.start();
+    ComponentLabeler labeler;
+    labeler.label(m_volume, threshold, 0, bricksFor(m_volume), &m_skipStats[MarkerPass]);
+
+    markerCentroids.clear();
+    markerRegions.clear();
+    BitMask& regionData = region();
+    regionData.clear();
+    const std::vector<ComponentLabeler::Component>& components = labeler.components();
+    for (int i = 0; i < int(components.size()); ++i) {
+        const ComponentLabeler::Component& component = components[i];
+        if (250 < component.voxelCount && component.voxelCount < 1000) {
+            // version as specified by the instructions (120<x<200 and 230<x<400 but rotated)
+            /*if ((280 >= component.maxX && component.minX >= 200) || (170 >= component.maxX && component.minX >= 0)){
+                labeler.fillMask(i, regionData);
+            }*/
+            // version that works better
+            if (component.width() > 5 && component.width() < 20){
+                Eigen::Vector3d centroid = component.centroid();
+                markerCentroids.push_back({int(centroid.x()), int(centroid.y()), int(centroid.z())});
+                // keep the marker and write it to region data
+                markerRegions.push_back(CompactRegion::fromComponent(labeler, i));
+                markerRegions.back().rasterize(regionData);
+            }
+        }
+    }
+    if (stats){
+        stats->markerCount = int(markerCentroids.size());
+        stats->componentCount = int(components.size());
+        stats->elapsedNs = timer.nsecsElapsed();
     }
-    return maxY-minY;
 }
 
 /**
  * @brief CTDataset::registerMarkers Enters source points (found centroids) into sourcePoints list, performs calculate and stores resulting transformation matrix
  */
 void CTDataset::registerMarkers(){
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
     IcpAlgo icp;
     Voxel voxel;
     for (unsigned long int i=0; i<markerCentroids.size(); i++){
         voxel = markerCentroids[i];
 
         //revert rotations back to original
-        Eigen::Vector3d a((WIDTH-voxel.x-2)*0.3625, (HEIGHT-voxel.y)*0.325, voxel.z*0.35);
+        Eigen::Vector3d a((WIDTH-voxel.x-2)*m_geometry.spacingX(), (HEIGHT-voxel.y)*m_geometry.spacingY(), voxel.z*m_geometry.spacingZ());
         icp.sourcePoints.push_back(a);
     }
 
@@ -411,6 +1340,9 @@ void CTDataset::registerMarkers(){
  * @param xdir Vorzugsachse (soll entweder (1,0,0) oder (0,0,1) sein)
  */
 void CTDataset::reconstructLayer(Voxel posVoxel, Voxel axisVoxel, Voxel xdirVoxel){
+    if (!m_volume.isValid()){
+        return; // no image loaded
+    }
     // Convert Voxels to Eigen
     Eigen::Vector3d pos(posVoxel.x, posVoxel.y, posVoxel.z);
     Eigen::Vector3d axis(axisVoxel.x, axisVoxel.y, axisVoxel.z);
@@ -422,23 +1354,7 @@ void CTDataset::reconstructLayer(Voxel posVoxel, Voxel axisVoxel, Voxel xdirVoxe
     Eigen::Vector3d yImDir = axis;
     xImDir.normalize();
 
-    int h = HEIGHT/2;
-    int w = WIDTH/2;
-    for (int y = -h; y < h; y++){
-        for (int x = -w; x < w; x++){
-            Eigen::Vector3d pos3d = pos + x*xImDir + y*yImDir;
-            pos3d.x() = (int)std::round(pos3d.x());
-            pos3d.y() = (int)std::round(pos3d.y());
-            pos3d.z() = (int)std::round(pos3d.z());
-            if (0 <= pos3d.x() && pos3d.x() < WIDTH && 0 <= pos3d.y() && pos3d.y() < HEIGHT && 0 <= pos3d.z() && pos3d.z() < LAYERS){
-                crosssectionImageData[(y+h)*WIDTH + (x+w)] =
-                        m_pImageData[(int)pos3d.z()*HEIGHT*WIDTH + (HEIGHT-(int)pos3d.y())*WIDTH + (WIDTH-(int)pos3d.x())];
-            }
-            else {
-                crosssectionImageData[(y+h)*WIDTH + (x+w)] = -1024;
-            }
-        }
-    }
+    resliceCrosssection(pos, xImDir, yImDir);
 }
 
 /**
@@ -446,43 +1362,233 @@ void CTDataset::reconstructLayer(Voxel posVoxel, Voxel axisVoxel, Voxel xdirVoxe
  * @param worldPos tip of instrument in world coordinates
  * @param worldAxis vector of instrument handle in world coordinates
  * @param xdir Vorzugsachse
+ * @param slabThickness thickness of the slab around the layer in mm, 0 samples the layer only
+ * @param projection how the slab is projected into the layer
  */
-void CTDataset::reconstructLayer_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, Voxel xdir){
-    IcpAlgo icp;
-    Eigen::Vector3d voxellengths3d(0.3625, 0.325, 0.35);
-    Eigen::Vector4d voxellengths4d(0.3625, 0.325, 0.35, 1);
+void CTDataset::reconstructLayer_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, Voxel xdir,
+                                       double slabThickness, ResliceEngine::SlabProjection projection){
+    if (!m_volume.isValid()){
+        return; // no image loaded
+    }
+    Eigen::Vector3d pos;
+    Eigen::Vector3d axis;
+    instrumentToVoxels(worldPos, worldAxis, pos, axis);
+
+    Eigen::Vector3d dir(xdir.x, xdir.y, xdir.z);
+
+    Eigen::Vector3d tmpDir = axis.cross(dir);
+    Eigen::Vector3d xImDir = tmpDir.cross(axis);
+    Eigen::Vector3d yImDir = axis;
+    xImDir.normalize();
+
+    resliceCrosssection(pos, xImDir, yImDir, slabThickness, projection);
+}
+
+/**
+ * @brief CTDataset::instrumentToVoxels transforms the instrument into voxel coordinates with the registration
+ * @param worldPos tip of instrument in world coordinates
+ * @param worldAxis vector of instrument handle in world coordinates
+ * @param pos receives the tip in voxel coordinates
+ * @param axis receives the axis in voxel coordinates, normalized
+ */
+void CTDataset::instrumentToVoxels(const Eigen::Vector3d& worldPos, const Eigen::Vector3d& worldAxis, Eigen::Vector3d& pos,
+                                   Eigen::Vector3d& axis) const
+{
+    Eigen::Vector3d voxellengths3d = m_geometry.spacing();
+    Eigen::Vector4d voxellengths4d(m_geometry.spacingX(), m_geometry.spacingY(), m_geometry.spacingZ(), 1);
 
     Eigen::Vector4d tmp(worldPos.x(), worldPos.y(), worldPos.z(), 1);
     tmp = resultMatrixInverse*tmp;
     tmp = tmp.cwiseQuotient(voxellengths4d);
-    Eigen::Vector3d pos(tmp.x(), tmp.y(), tmp.z());
+    pos = Eigen::Vector3d(tmp.x(), tmp.y(), tmp.z());
 
-    Eigen::Vector3d axis = resultMatrixRotation*worldAxis;
+    axis = resultMatrixRotation*worldAxis;
     axis = axis.cwiseQuotient(voxellengths3d).normalized();
+}
 
-    Eigen::Vector3d dir(xdir.x, xdir.y, xdir.z);
+/**
+ * @brief CTDataset::resliceCrosssection samples a plane into the cross section buffer
+ *
+ * Pixel (x + WIDTH/2, y + HEIGHT/2) shows pos + x*xImDir + y*yImDir for x in [-WIDTH/2, WIDTH/2) and y in
+ * [-HEIGHT/2, HEIGHT/2). The layer is sampled mirrored in x and y, i.e. the point p lies in voxel
+ * (WIDTH - p.x, HEIGHT - p.y, p.z). Pixels outside the volume get -1024, the others are sampled with interpolation().
+ * Nearest samples round the mirrored coordinates like ResliceEngine, halfway points go to the larger index: x and y
+ * round towards the lower index of p and z = -0.5 lies in layer 0, where WIDTH - std::round(p.x) etc. went the other
+ * way. Only points exactly halfway between two voxels are affected.
+ *
+ * A slab consists of parallel layers one smallest voxel spacing apart along the normal in mm, an odd number of them
+ * so the layer itself is one of them.
+ * @param pos center of the image
+ * @param xImDir step from one column to the next
+ * @param yImDir step from one row to the next
+ * @param slabThickness thickness of the slab in mm, layers are added once it reaches twice the smallest spacing
+ * @param projection how the layers of the slab are combined
+ */
+void CTDataset::resliceCrosssection(const Eigen::Vector3d& pos, const Eigen::Vector3d& xImDir, const Eigen::Vector3d& yImDir,
+                                    double slabThickness, ResliceEngine::SlabProjection projection)
+{
+    ResliceEngine engine;
+    setupCrosssection(engine, pos, xImDir, yImDir, slabThickness, projection);
+    engine.reslice(m_geometry.width()/2*2, m_geometry.height()/2*2, crosssection(), m_geometry.width());
+}
 
-    Eigen::Vector3d tmpDir = axis.cross(dir);
-    Eigen::Vector3d xImDir = tmpDir.cross(axis);
-    Eigen::Vector3d yImDir = axis;
-    xImDir.normalize();
+void CTDataset::setupCrosssection(ResliceEngine& engine, const Eigen::Vector3d& pos, const Eigen::Vector3d& xImDir,
+                                  const Eigen::Vector3d& yImDir, double slabThickness,
+                                  ResliceEngine::SlabProjection projection) const
+{
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int h = HEIGHT/2;
+    const int w = WIDTH/2;
+    const Eigen::Vector3d mirror(-1, -1, 1);
+    const Eigen::Vector3d corner = pos - w*xImDir - h*yImDir;
+    engine.setVolume(m_volume);
+    engine.setInterpolation(m_interpolation);
+    engine.setPlane(Eigen::Vector3d(WIDTH, HEIGHT, 0) + corner.cwiseProduct(mirror), xImDir.cwiseProduct(mirror),
+                    yImDir.cwiseProduct(mirror));
+    const Eigen::Vector3d spacing = m_geometry.spacing();
+    const Eigen::Vector3d normal = xImDir.cwiseProduct(spacing).cross(yImDir.cwiseProduct(spacing));
+    const double planeDistance = spacing.minCoeff();
+    if (slabThickness > 0 && normal.norm() > 0){
+        const int halfPlanes = int(std::floor(slabThickness/2/planeDistance));
+        const Eigen::Vector3d planeStep = (normal.normalized()*planeDistance).cwiseQuotient(spacing);
+        engine.setSlab(2*halfPlanes + 1, planeStep.cwiseProduct(mirror), projection);
+    }
+}
 
-    int h = HEIGHT/2;
-    int w = WIDTH/2;
-    for (int y = -h; y < h; y++){
-        for (int x = -w; x < w; x++){
-            Eigen::Vector3d pos3d = pos + x*xImDir + y*yImDir;
-            //qDebug() << pos3d.x() << ", " << pos3d.y() << ", " << pos3d.z();
-            pos3d.x() = (int)std::round(pos3d.x());
-            pos3d.y() = (int)std::round(pos3d.y());
-            pos3d.z() = (int)std::round(pos3d.z());
-            if (0 <= pos3d.x() && pos3d.x() < WIDTH && 0 <= pos3d.y() && pos3d.y() < HEIGHT && 0 <= pos3d.z() && pos3d.z() < LAYERS){
-                crosssectionImageData[(y+h)*WIDTH + (x+w)] =
-                        m_pImageData[(int)pos3d.z()*HEIGHT*WIDTH + (HEIGHT-(int)pos3d.y())*WIDTH + (WIDTH-(int)pos3d.x())];
-            }
-            else {
-                crosssectionImageData[(y+h)*WIDTH + (x+w)] = -1024;
+namespace {
+
+/**
+ * @brief windowLayerRow converts row y of a layer into colors and draws the instrument overlay on it: a solid line
+ * above the center (the handle) and a dashed line below it (the trajectory ahead of the tip)
+ */
+void windowLayerRow(const short* layer, int y, int width, int height, const WindowingLut& lut, quint32* pixels)
+{
+    const quint32 OVERLAY = 0xffff0000u;
+    lut.apply(layer, pixels, width);
+    int first = width/2 - 2;
+    int last = width/2 + 2;
+    if (y >= height/2){
+        if ((y/8) % 2 != 0){
+            return;
+        }
+        first = width/2 - 1;
+        last = width/2 + 1;
+    }
+    for (int x = std::max(first, 0); x <= std::min(last, width - 1); ++x){
+        pixels[x] = OVERLAY;
+    }
+}
+
+}
+
+/**
+ * @brief CTDataset::windowLayer converts a layer into colors with the instrument overlay
+ * @param layer HU values, width x height
+ * @param width columns
+ * @param height rows
+ * @param lut windowing
+ * @param image receives the colors
+ * @param bytesPerLine distance of two rows of image in bytes
+ */
+void CTDataset::windowLayer(const short* layer, int width, int height, const WindowingLut& lut, quint32* image,
+                            int bytesPerLine)
+{
+    for (int y = 0; y < height; ++y){
+        windowLayerRow(layer + qint64(y)*width, y, width, height, lut,
+                       reinterpret_cast<quint32*>(reinterpret_cast<uchar*>(image) + qint64(y)*bytesPerLine));
+    }
+}
+
+/**
+ * @brief CTDataset::reconstructLayers reconstructs the layers of reconstructLayer() along x and z in one call
+ * @param pos center of image
+ * @param axis
+ * @param target buffers of the layers and optionally of their images
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if no image is loaded or a layer buffer is missing
+ */
+int CTDataset::reconstructLayers(Voxel pos, Voxel axis, const LayerPair& target, int threadCount)
+{
+    return reslicePair(Eigen::Vector3d(pos.x, pos.y, pos.z), Eigen::Vector3d(axis.x, axis.y, axis.z).normalized(), target,
+                       0, ResliceEngine::MaximumIntensity, threadCount);
+}
+
+/**
+ * @brief CTDataset::reconstructLayers_world reconstructs the layers of reconstructLayer_world() along x and z in one call
+ * @param worldPos tip of instrument in world coordinates
+ * @param worldAxis vector of instrument handle in world coordinates
+ * @param target buffers of the layers and optionally of their images
+ * @param slabThickness thickness of the slab around the layers in mm, 0 samples the layers only
+ * @param projection how the slabs are projected into the layers
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if no image is loaded or a layer buffer is missing
+ */
+int CTDataset::reconstructLayers_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, const LayerPair& target,
+                                       double slabThickness, ResliceEngine::SlabProjection projection, int threadCount)
+{
+    Eigen::Vector3d pos;
+    Eigen::Vector3d axis;
+    instrumentToVoxels(worldPos, worldAxis, pos, axis);
+    return reslicePair(pos, axis, target, slabThickness, projection, threadCount);
+}
+
+/**
+ * @brief CTDataset::reslicePair reslices both layers in one parallel loop over the rows of both
+ *
+ * The rows of both layers are handed out together, so both layers are computed at the same time on all cores. If
+ * images are requested, each row is windowed and gets the instrument overlay right after it was sampled, while it is
+ * still cached. Column and row that reconstructLayer() leaves out for odd sizes are set to -1024.
+ * @param pos center of the layers in voxels
+ * @param axis unit axis of the instrument in voxels, the rows of both layers run along it
+ * @param target buffers of the layers and optionally of their images
+ * @param slabThickness thickness of the slabs in mm, 0 samples the layers only
+ * @param projection how the slabs are projected
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if no image is loaded or a layer buffer is missing
+ */
+int CTDataset::reslicePair(const Eigen::Vector3d& pos, const Eigen::Vector3d& axis, const LayerPair& target,
+                           double slabThickness, ResliceEngine::SlabProjection projection, int threadCount)
+{
+    if (!m_volume.isValid() || !target.layers[0] || !target.layers[1]){
+        return 1;
+    }
+    const int WIDTH = m_geometry.width();
+    const int HEIGHT = m_geometry.height();
+    const int COLUMNS = WIDTH/2*2;
+    const int ROWS = HEIGHT/2*2;
+    const bool windowed = target.lut && target.images[0] && target.images[1];
+    const Eigen::Vector3d directions[2] = {Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 0, 1)};
+    ResliceEngine engines[2];
+    for (int d = 0; d < 2; ++d){
+        const Eigen::Vector3d xImDir = axis.cross(directions[d]).cross(axis).normalized();
+        setupCrosssection(engines[d], pos, xImDir, axis, slabThickness, projection);
+    }
+    auto finishRow = [&](int d, int y){
+        short* row = target.layers[d] + qint64(y)*WIDTH;
+        std::fill(row + COLUMNS, row + WIDTH, short(ResliceEngine::Background));
+        if (windowed){
+            windowLayerRow(row, y, WIDTH, HEIGHT, *target.lut,
+                           reinterpret_cast<quint32*>(reinterpret_cast<uchar*>(target.images[d]) + qint64(y)*target.bytesPerLine));
+        }
+    };
+
+    const int THREADS = std::max(1, std::min(Parallel::threadCount(threadCount), 2*ROWS/ResliceEngine::MinRowsPerThread));
+    Parallel::forChunks(0, 2*ROWS, THREADS, [&](int first, int last, int){
+        // a chunk may hold the last rows of layer 0 and the first rows of layer 1
+        for (int d = 0; d < 2; ++d){
+            const int firstRow = std::max(first - d*ROWS, 0);
+            const int lastRow = std::min(last - d*ROWS, ROWS);
+            if (firstRow < lastRow){
+                engines[d].resliceRows(firstRow, lastRow, COLUMNS, target.layers[d], WIDTH, [&](int y){ finishRow(d, y); });
             }
         }
+    });
+    for (int d = 0; d < 2; ++d){
+        for (int y = ROWS; y < HEIGHT; ++y){
+            std::fill(target.layers[d] + qint64(y)*WIDTH, target.layers[d] + qint64(y + 1)*WIDTH, short(ResliceEngine::Background));
+            finishRow(d, y);
+        }
     }
+    return 0;
 }
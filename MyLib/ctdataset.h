@@ -3,13 +3,21 @@
 
 #include "MyLib_global.h"
 #include "icpalgo.h"
+#include "volumegeometry.h"
+#include "volumeview.h"
+#include "bitmask.h"
+#include "compactregion.h"
+#include "raymaxindex.h"
+#include "brickpyramid.h"
+#include "brickedvolume.h"
+#include "resliceengine.h"
+#include "windowinglut.h"
 #include <vector>
+#include <atomic>
+#include <functional>
+#include <thread>
 
-typedef struct {
-    int x;
-    int y;
-    int z;
-} Voxel;
+class QFile;
 
 /**
  * @brief Functions and Infrastructure to work with datasets from CT scans
@@ -17,6 +25,71 @@ typedef struct {
 class MYLIB_EXPORT CTDataset
 {
 public:
+    /// Buffers held by a CTDataset
+    enum Buffer {
+        ImageBuffer,        ///< the loaded volume
+        DepthBuffer,        ///< depth map, width x layers
+        RegionBuffer,       ///< voxels found by region growing and marker detection, one bit per voxel
+        VisitedBuffer,      ///< visited flags of region growing, one bit per voxel
+        CrosssectionBuffer, ///< one reconstructed layer, width x height
+        RayIndexBuffer,     ///< running maxima along the depth buffer rays, a few breakpoints per ray
+        BrickBuffer         ///< minimum and maximum of every brick of the volume
+    };
+
+    /// Passes that skip bricks which can't reach their threshold, see skipStats()
+    enum SkipPass {
+        DepthBufferPass,    ///< calculateDepthBuffer with the volume or a mask
+        MarkerPass,         ///< component labeling in getRegistrationMarkers
+        RayIndexPass        ///< building rayIndex()
+    };
+
+    /// Ways to load an image file
+    enum LoadMode {
+        CopyLoad,   ///< read the file into m_pImageData
+        MappedLoad  ///< map the file into memory, the volume is read directly from the file
+    };
+
+    /// Ways to store the loaded volume in memory
+    enum VolumeLayout {
+        LinearLayout,   ///< z-major rows of voxels, fast along x only
+        BrickedLayout   ///< cubic bricks, see BrickedVolume, about as fast along y and z as along x
+    };
+
+    /// Figures of one region growing run
+    struct GrowingStats {
+        qint64 voxelCount;          ///< voxels added to the region
+        qint64 peakFrontier;        ///< largest number of entries on the search stack
+        qint64 peakFrontierBytes;   ///< memory of the search stack at its largest
+        qint64 elapsedNs;           ///< run time in nanoseconds
+        int threadCount;            ///< threads used
+
+        /// Throughput of the run
+        double voxelsPerSecond() const { return elapsedNs > 0 ? voxelCount*1e9/elapsedNs : 0; }
+    };
+
+    /// Figures of one marker detection run, the skipped bricks are in skipStats(MarkerPass)
+    struct MarkerStats {
+        int markerCount;            ///< markers found
+        int componentCount;         ///< components above the threshold
+        qint64 elapsedNs;           ///< run time in nanoseconds
+    };
+
+    /// Buffers of the caller that reconstructLayers() and reconstructLayers_world() write to, index 0 is the layer along
+    /// x and index 1 the layer along z
+    struct LayerPair {
+        LayerPair() : layers{nullptr, nullptr}, images{nullptr, nullptr}, bytesPerLine(0), lut(nullptr) {}
+
+        short* layers[2];       ///< HU values, width x height
+        quint32* images[2];     ///< windowed colors with the instrument overlay (QImage::Format_RGB32), or nullptr
+        int bytesPerLine;       ///< distance of two rows of images in bytes
+        const WindowingLut* lut;///< windowing of images
+    };
+
+    /// Called from the loading thread when layers firstLayer to lastLayer (inclusive) can be read
+    typedef std::function<void(int firstLayer, int lastLayer)> LayersReadyCallback;
+    /// Called from the loading thread when streaming finished, with the error code of load()
+    typedef std::function<void(int errorCode)> LoadFinishedCallback;
+
     /// Constructor for CTDataset
     CTDataset();
     /// Destructor for CTDataset
@@ -24,66 +97,173 @@ public:
 
     /// List of marker centroids
     std::vector<Voxel> markerCentroids;
-    /// Array containing information which voxels have been visited already
-    bool* visited_voxel;
+    /// Voxels of the markers found by getRegistrationMarkers, in the same order as markerCentroids
+    std::vector<CompactRegion> markerRegions;
 
-    short* crosssectionImageData;
-
-    /// Returns the m_pImageData
+    /// Returns the m_pImageData (nullptr before loading, for memory-mapped volumes and in BrickedLayout)
     short* data();
-    /// Returns the m_pDepthBuffer
+    /// Returns read access to the loaded volume, works for copied and memory-mapped volumes
+    const VolumeView& volume() const;
+    /// Returns true if the volume is read directly from a memory-mapped file
+    bool isMapped() const;
+    /// Stores the loaded volume in another layout, volume() and all algorithms read the new one afterwards
+    int setVolumeLayout(VolumeLayout layout, int brickSize = 8, int threadCount = 0);
+    /// Returns how the loaded volume is stored
+    VolumeLayout volumeLayout() const;
+    /// Returns the m_pDepthBuffer, allocated on first use
     short* depthbuffer();
-    /// Returns the m_pRegionData
-    short* region();
+    /// Returns the mask of the grown region, allocated on first use
+    BitMask& region();
+    /// Returns the voxels of region() as runs, e.g. to keep a region after the next region growing
+    CompactRegion compactRegion();
+    /// Returns the mask of voxels that have been visited already, allocated on first use
+    BitMask& visited();
+    /// Returns the last reconstructed layer, allocated on first use
+    short* crosssection();
+    /// Returns the running maxima along the depth buffer rays, built on first use
+    const RayMaxIndex& rayIndex();
+    /// Returns the minimum and maximum of every brick of the volume, built on first use
+    const BrickPyramid& bricks();
+    /// Returns how many voxels the last run of a pass skipped
+    const BrickPyramid::SkipStats& skipStats(SkipPass pass) const;
+
+    /// Clears region data and visited flags before a new region growing run
+    void resetRegionGrowing();
+    /// Frees a buffer; working buffers are allocated again on their next use
+    void releaseBuffer(Buffer buffer);
+    /// Frees all buffers except the loaded volume
+    void releaseWorkingBuffers();
+    /// Returns the number of bytes currently allocated for a buffer
+    qint64 memoryUsage(Buffer buffer) const;
+    /// Returns the number of bytes currently allocated for all buffers
+    qint64 memoryUsage() const;
+    /// Returns size and voxel spacing of the loaded volume
+    const VolumeGeometry& geometry() const;
 
     /// Loads an image file
-    int load(QString imagePath);
+    int load(QString imagePath, LoadMode mode = CopyLoad);
+    /// Loads an image file on a background thread in chunks of layers
+    int loadStreaming(QString imagePath, LayersReadyCallback layersReady, LoadFinishedCallback finished,
+                      LoadMode mode = CopyLoad, int chunkLayers = 16);
+    /// Returns the number of layers that can be read, counted from layer 0
+    int layersLoaded() const;
+    /// Returns true while a streaming load is running
+    bool isLoading() const;
+    /// Stops a running streaming load and waits for it
+    void cancelLoad();
+    /// Waits until a running streaming load has finished
+    void waitForLoad();
 
     /// Windowing function
     static int windowing(int HU_value, int startValue, int windowWidth, int &grayValue);
 
     /// Calculates the depth buffer for a given threshold
     int calculateDepthBuffer(const int& iThreshold, short* imageData);
+    /// Calculates the depth buffer for a given threshold
+    int calculateDepthBuffer(const int& iThreshold, const VolumeView& imageData, int threadCount = 0);
+    /// Calculates the depth buffer for a given threshold, only voxels inside the mask are displayed
+    int calculateDepthBuffer(const int& iThreshold, const BitMask& mask);
+    /// Calculates the depth buffer for a given threshold from the running maxima of the rays, e.g. rayIndex()
+    int calculateDepthBuffer(const int& iThreshold, const RayMaxIndex& index);
     /// Renders a 3D shaded buffer from a given depth buffer
     int renderDepthBuffer(short* shadedBuffer);
+    /// Renders a 3D shaded buffer from any depth map
+    static int renderDepthBuffer(const short* depthBuffer, int width, int height, short* shadedBuffer);
 
     /// Performs region growing
-    int regionGrowing(Voxel seed, int threshold, std::vector <Voxel>& iRegion);
+    int regionGrowing(Voxel seed, int threshold, std::vector <Voxel>& iRegion, GrowingStats* stats = nullptr);
+    /// Performs region growing by filling whole runs along x, the result is written to region() only
+    int regionGrowingSpans(Voxel seed, int threshold, GrowingStats* stats = nullptr,
+                           const std::atomic<bool>* cancel = nullptr);
+    /// Performs region growing by filling runs in one z-slab per thread, the result is written to region() only
+    int regionGrowingParallel(Voxel seed, int threshold, int threadCount = 0, GrowingStats* stats = nullptr,
+                              const std::atomic<bool>* cancel = nullptr);
     /// Determines registration marker regions
-    void getRegistrationMarkers(int threshold);
+    void getRegistrationMarkers(int threshold, MarkerStats* stats = nullptr);
 
     void registerMarkers();
     void reconstructLayer(Voxel pos, Voxel axis, Voxel xdir);
-    void reconstructLayer_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, Voxel xdir);
+    void reconstructLayer_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, Voxel xdir, double slabThickness = 0,
+                                ResliceEngine::SlabProjection projection = ResliceEngine::MaximumIntensity);
+    /// Reconstructs the layers along x and z through a voxel at once
+    int reconstructLayers(Voxel pos, Voxel axis, const LayerPair& target, int threadCount = 0);
+    /// Reconstructs the layers along x and z through the instrument tip at once
+    int reconstructLayers_world(Eigen::Vector3d worldPos, Eigen::Vector3d worldAxis, const LayerPair& target,
+                                double slabThickness = 0,
+                                ResliceEngine::SlabProjection projection = ResliceEngine::MaximumIntensity,
+                                int threadCount = 0);
+    /// Converts a layer into colors and draws the instrument overlay, e.g. a layer of reconstructLayers() into a QImage
+    static void windowLayer(const short* layer, int width, int height, const WindowingLut& lut, quint32* image,
+                            int bytesPerLine);
+    /// Sampling of the cross sections of reconstructLayer() and reconstructLayer_world()
+    void setInterpolation(ResliceEngine::Interpolation interpolation) { m_interpolation = interpolation; }
+    ResliceEngine::Interpolation interpolation() const { return m_interpolation; }
 
 private:
+    /// Samples the plane through pos spanned by xImDir and yImDir into the cross section buffer
+    void resliceCrosssection(const Eigen::Vector3d& pos, const Eigen::Vector3d& xImDir, const Eigen::Vector3d& yImDir,
+                             double slabThickness = 0, ResliceEngine::SlabProjection projection = ResliceEngine::MaximumIntensity);
+    /// Sets up an engine for the plane through pos spanned by xImDir and yImDir, see resliceCrosssection()
+    void setupCrosssection(ResliceEngine& engine, const Eigen::Vector3d& pos, const Eigen::Vector3d& xImDir,
+                           const Eigen::Vector3d& yImDir, double slabThickness, ResliceEngine::SlabProjection projection) const;
+    /// Reslices the layers along x and z through pos into target on all cores
+    int reslicePair(const Eigen::Vector3d& pos, const Eigen::Vector3d& axis, const LayerPair& target,
+                    double slabThickness, ResliceEngine::SlabProjection projection, int threadCount);
+    /// Position and unit axis of the instrument in voxel coordinates
+    void instrumentToVoxels(const Eigen::Vector3d& worldPos, const Eigen::Vector3d& worldAxis, Eigen::Vector3d& pos,
+                            Eigen::Vector3d& axis) const;
     /// A representation of the original multilayer image
     short* m_pImageData;
+    /// Memory-mapped image file (MappedLoad only)
+    QFile* m_pMappedFile;
+    /// Read access to m_pImageData, the memory-mapped file or m_bricked
+    VolumeView m_volume;
+    /// Read access to the memory-mapped file, also while m_volume reads m_bricked
+    VolumeView m_mappedVolume;
+    /// The volume in BrickedLayout
+    BrickedVolume m_bricked;
+    /// Thread of a streaming load
+    std::thread m_loadThread;
+    /// Number of layers of m_pImageData that have been loaded
+    std::atomic<int> m_layersLoaded;
+    /// True while the streaming load thread reads the file
+    std::atomic<bool> m_loading;
+    /// Requests the streaming load to stop
+    std::atomic<bool> m_cancelLoad;
     /// A depth map for a multilayer image
     short* m_pDepthBuffer;
     /// 3D object created during region growing
-    short* m_pRegionData;
+    BitMask m_regionMask;
+    /// Visited flags used during region growing
+    BitMask m_visitedMask;
+    /// One reconstructed layer
+    short* m_pCrosssectionImageData;
+    /// Sampling of the cross sections
+    ResliceEngine::Interpolation m_interpolation;
+    /// Running maxima along the depth buffer rays
+    RayMaxIndex m_rayIndex;
+    /// Minimum and maximum of every brick of the volume
+    BrickPyramid m_bricks;
+    /// Skipped voxels of the last run of every SkipPass
+    BrickPyramid::SkipStats m_skipStats[3];
+
+    /// Size and voxel spacing of the volume
+    VolumeGeometry m_geometry;
 
-    // Size constants
-    int WIDTH = 400;
-    int HEIGHT = 400;
-    int LAYERS = 400;
+    /// Number of elements of a buffer for the current geometry
+    qint64 bufferSize(Buffer buffer) const;
+    /// Opens an image file and determines its geometry
+    int openImage(const QString& imagePath, QFile* dataFile, VolumeGeometry& geometry);
+    /// Allocates m_pImageData for a geometry and frees the buffers of the previous study
+    void allocateImage(const VolumeGeometry& geometry);
+    /// Maps an opened image file and frees the buffers of the previous study
+    bool mapImage(QFile* dataFile, const VolumeGeometry& geometry);
+    /// Returns bricks() if they describe a view, nullptr otherwise (e.g. for other volumes or while loading)
+    const BrickPyramid* bricksFor(const VolumeView& view);
 
     /// Rotates m_pImageData by 90 degrees
     void rotateImage();
 
-    /// Saves centroid of a given region to markerCentroids
-    void getCentroid(std::vector<Voxel> region);
-
-    /// Gets height of region
-    int getHeight(std::vector <Voxel> region);
-    /// Gets width of region
-    int getWidth(std::vector <Voxel> region);
-    /// Gets maximum x-value of region
-    int getMaxX(std::vector <Voxel> region);
-    /// Gets minimum x-value of region
-    int getMinX(std::vector <Voxel> region);
-
     ///speichert die Gesamttransformationsmatrix
     Eigen::Matrix4d resultMatrixInverse;
     Eigen::Matrix3d resultMatrixRotation;
@@ -0,0 +1,267 @@
+#include "ctpipeline.h"
+#include <algorithm>
+
+CTPipeline::CTPipeline(CTDataset& dataset)
+    : m_dataset(dataset)
+{
+    m_threshold = m_graph.addParameter(0);
+    m_markerThreshold = m_graph.addParameter(1500);
+    m_viewDirection = m_graph.addParameter(AxisDepthMaps::PositiveY);
+    m_interpolation = m_graph.addParameter(ResliceEngine::Nearest);
+    m_slabThickness = m_graph.addParameter(0);
+    m_slabProjection = m_graph.addParameter(ResliceEngine::MaximumIntensity);
+    for (int i = 0; i < 6; ++i){
+        m_worldParameters[i] = m_graph.addParameter(0);
+        m_localParameters[i] = m_graph.addParameter(0);
+    }
+    std::vector<int> world(m_worldParameters, m_worldParameters + 6);
+    std::vector<int> local(m_localParameters, m_localParameters + 6);
+    world.push_back(m_interpolation);
+    world.push_back(m_slabThickness);
+    world.push_back(m_slabProjection);
+    local.push_back(m_interpolation);
+
+    // added in the order of Node
+    m_graph.addSource();
+    m_graph.addNode([this](){ return computeDepthMap(); }, {Volume}, {m_threshold});
+    m_graph.addNode([this](){ return computeShadedView(); }, {DepthMap});
+    m_graph.addNode([this](){ return computeMarkers(); }, {Volume}, {m_markerThreshold});
+    m_graph.addNode([this](){ return computeRegistration(); }, {Markers});
+    m_graph.addNode([this](){ return computeWorldReslices(CTDataset::LayerPair()); }, {Registration}, world);
+    m_graph.addNode([this](){ return computeLocalReslices(CTDataset::LayerPair()); }, {Volume}, local);
+    m_graph.addNode([this](){ return computeDirectionalMaps(); }, {Volume}, {m_threshold});
+    m_graph.addNode([this](){ return computeDirectionalView(); }, {DirectionalMaps}, {m_viewDirection});
+}
+
+/**
+ * @brief CTPipeline::volumeChanged marks all stages as out of date, e.g. after loading a new volume
+ */
+void CTPipeline::volumeChanged()
+{
+    m_graph.touch(Volume);
+}
+
+void CTPipeline::setThreshold(int threshold)
+{
+    m_graph.setParameter(m_threshold, threshold);
+}
+
+void CTPipeline::setViewDirection(AxisDepthMaps::Direction direction)
+{
+    m_graph.setParameter(m_viewDirection, direction);
+}
+
+void CTPipeline::setInterpolation(ResliceEngine::Interpolation interpolation)
+{
+    m_graph.setParameter(m_interpolation, interpolation);
+}
+
+void CTPipeline::setSlab(double thickness, ResliceEngine::SlabProjection projection)
+{
+    m_graph.setParameter(m_slabThickness, thickness);
+    m_graph.setParameter(m_slabProjection, projection);
+}
+
+void CTPipeline::setMarkerThreshold(int threshold)
+{
+    m_graph.setParameter(m_markerThreshold, threshold);
+}
+
+void CTPipeline::setWorldReslice(const Eigen::Vector3d& position, const Eigen::Vector3d& axis)
+{
+    for (int i = 0; i < 3; ++i){
+        m_graph.setParameter(m_worldParameters[i], position[i]);
+        m_graph.setParameter(m_worldParameters[i+3], axis[i]);
+    }
+}
+
+void CTPipeline::setLocalReslice(Voxel position, Voxel axis)
+{
+    const int values[6] = {position.x, position.y, position.z, axis.x, axis.y, axis.z};
+    for (int i = 0; i < 6; ++i){
+        m_graph.setParameter(m_localParameters[i], values[i]);
+    }
+}
+
+/**
+ * @brief CTPipeline::computeDepthMap calculates the depth buffer of the threshold from the running maxima of the rays,
+ * only the first call after loading reads the volume
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTPipeline::computeDepthMap()
+{
+    const RayMaxIndex& index = m_dataset.rayIndex();
+    if (!index.isValid()){
+        return 1;
+    }
+    m_depthMap.resize(size_t(qint64(m_dataset.geometry().width())*m_dataset.geometry().layers()));
+    index.fillDepthBuffer(int(m_graph.parameter(m_threshold)), m_depthMap.data());
+    return 0;
+}
+
+/**
+ * @brief CTPipeline::computeShadedView shades the cached depth map
+ * @return 0
+ */
+int CTPipeline::computeShadedView()
+{
+    m_shadedView.assign(m_depthMap.size(), 0);
+    return CTDataset::renderDepthBuffer(m_depthMap.data(), m_dataset.geometry().width(), m_dataset.geometry().layers(),
+                                        m_shadedView.data());
+}
+
+/**
+ * @brief CTPipeline::computeMarkers detects the markers and shades their depth map, the region buffer of the dataset is
+ * released afterwards
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTPipeline::computeMarkers()
+{
+    if (!m_dataset.volume().isValid()){
+        return 1;
+    }
+    const int threshold = int(m_graph.parameter(m_markerThreshold));
+    m_dataset.getRegistrationMarkers(threshold);
+    m_markerCentroids = m_dataset.markerCentroids;
+
+    // get depth map of marker regions
+    const qint64 size = qint64(m_dataset.geometry().width())*m_dataset.geometry().layers();
+    m_dataset.calculateDepthBuffer(threshold, m_dataset.region());
+    m_markerDepthMap.assign(m_dataset.depthbuffer(), m_dataset.depthbuffer() + size);
+    m_markerView.assign(size_t(size), 0);
+    m_dataset.renderDepthBuffer(m_markerView.data());
+    m_dataset.releaseBuffer(CTDataset::RegionBuffer);
+    return 0;
+}
+
+/**
+ * @brief CTPipeline::computeRegistration registers the detected markers
+ * @return 0
+ */
+int CTPipeline::computeRegistration()
+{
+    // registerMarkers() reads the centroids of the dataset, they may belong to a later detection by now
+    m_dataset.markerCentroids = m_markerCentroids;
+    m_dataset.registerMarkers();
+    return 0;
+}
+
+/**
+ * @brief CTPipeline::computeWorldReslices reconstructs the layers or slabs along x and z through the instrument tip at
+ * once
+ * @param images images to window the layers into while they are sampled, no images if they are nullptr
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTPipeline::computeWorldReslices(const CTDataset::LayerPair& images)
+{
+    if (!m_dataset.volume().isValid()){
+        return 1;
+    }
+    Eigen::Vector3d position;
+    Eigen::Vector3d axis;
+    for (int i = 0; i < 3; ++i){
+        position[i] = m_graph.parameter(m_worldParameters[i]);
+        axis[i] = m_graph.parameter(m_worldParameters[i+3]);
+    }
+    const double slabThickness = m_graph.parameter(m_slabThickness);
+    const ResliceEngine::SlabProjection projection = ResliceEngine::SlabProjection(int(m_graph.parameter(m_slabProjection)));
+    m_dataset.setInterpolation(ResliceEngine::Interpolation(int(m_graph.parameter(m_interpolation))));
+    return m_dataset.reconstructLayers_world(position, axis, crosssectionTarget(m_worldReslices, images), slabThickness, projection);
+}
+
+/**
+ * @brief CTPipeline::computeLocalReslices reconstructs the layers along x and z through a voxel at once
+ * @param images images to window the layers into while they are sampled, no images if they are nullptr
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTPipeline::computeLocalReslices(const CTDataset::LayerPair& images)
+{
+    if (!m_dataset.volume().isValid()){
+        return 1;
+    }
+    Voxel position = {int(m_graph.parameter(m_localParameters[0])), int(m_graph.parameter(m_localParameters[1])),
+                      int(m_graph.parameter(m_localParameters[2]))};
+    Voxel axis = {int(m_graph.parameter(m_localParameters[3])), int(m_graph.parameter(m_localParameters[4])),
+                  int(m_graph.parameter(m_localParameters[5]))};
+    m_dataset.setInterpolation(ResliceEngine::Interpolation(int(m_graph.parameter(m_interpolation))));
+    return m_dataset.reconstructLayers(position, axis, crosssectionTarget(m_localReslices, images));
+}
+
+/**
+ * @brief CTPipeline::crosssectionTarget sizes the cached reslices and pairs them with the images to window into
+ */
+CTDataset::LayerPair CTPipeline::crosssectionTarget(std::vector<short> (&reslices)[2], const CTDataset::LayerPair& images)
+{
+    CTDataset::LayerPair target = images;
+    for (int d = 0; d < 2; ++d){
+        reslices[d].resize(size_t(qint64(m_dataset.geometry().width())*m_dataset.geometry().height()));
+        target.layers[d] = reslices[d].data();
+    }
+    return target;
+}
+
+/**
+ * @brief CTPipeline::updateCrosssections brings the world or local reslices up to date and shows them in two images
+ *
+ * Reslices computed anew are windowed straight into the images while they are sampled, reslices that are up to date
+ * (e.g. after a new windowing) are converted from the cached layers.
+ * @param node WorldReslices or LocalReslices
+ * @param imageX receives the layer along x, QImage::Format_RGB32 of width x height
+ * @param imageZ receives the layer along z, same size as imageX
+ * @param bytesPerLine distance of two rows of the images in bytes
+ * @param lut windowing
+ * @return 0 - if successful, otherwise the error code of update()
+ */
+int CTPipeline::updateCrosssections(Node node, quint32* imageX, quint32* imageZ, int bytesPerLine, const WindowingLut& lut)
+{
+    CTDataset::LayerPair images;
+    images.images[0] = imageX;
+    images.images[1] = imageZ;
+    images.bytesPerLine = bytesPerLine;
+    images.lut = &lut;
+    bool windowed = false;
+    const int errorCode = m_graph.update(node, [this, node, &images, &windowed](){
+        windowed = true;
+        return node == WorldReslices ? computeWorldReslices(images) : computeLocalReslices(images);
+    });
+    if (errorCode != 0 || windowed){
+        return errorCode;
+    }
+    const std::vector<short>* reslices = node == WorldReslices ? m_worldReslices : m_localReslices;
+    const int width = m_dataset.geometry().width();
+    const int height = m_dataset.geometry().height();
+    for (int d = 0; d < 2; ++d){
+        CTDataset::windowLayer(reslices[d].data(), width, height, lut, images.images[d], bytesPerLine);
+    }
+    return 0;
+}
+
+/**
+ * @brief CTPipeline::computeDirectionalMaps finds the depth maps of the threshold from all six axis directions in one
+ * sweep over the volume
+ * @return 0 - if successful, 1 - if no image is loaded
+ */
+int CTPipeline::computeDirectionalMaps()
+{
+    if (!m_dataset.volume().isValid()){
+        return 1;
+    }
+    m_axisDepthMaps.compute(m_dataset.volume(), int(m_graph.parameter(m_threshold)));
+    return 0;
+}
+
+/**
+ * @brief CTPipeline::computeDirectionalView takes the depth map of the view direction from the cached maps and shades it
+ * @return 0
+ */
+int CTPipeline::computeDirectionalView()
+{
+    const AxisDepthMaps::Direction direction = viewDirection();
+    const VolumeGeometry& geometry = m_axisDepthMaps.geometry();
+    const int width = AxisDepthMaps::width(geometry, direction);
+    const int height = AxisDepthMaps::height(geometry, direction);
+    m_directionalDepthMap.resize(size_t(width)*height);
+    m_axisDepthMaps.fillDepthMap(direction, m_directionalDepthMap.data());
+    m_directionalView.assign(m_directionalDepthMap.size(), 0);
+    return CTDataset::renderDepthBuffer(m_directionalDepthMap.data(), width, height, m_directionalView.data());
+}
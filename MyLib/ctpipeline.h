@@ -0,0 +1,122 @@
+#ifndef CTPIPELINE_H
+#define CTPIPELINE_H
+
+#include "MyLib_global.h"
+#include "ctdataset.h"
+#include "processinggraph.h"
+#include "axisdepthmaps.h"
+#include <vector>
+
+/**
+ * @brief Processing stages of the application as a ProcessingGraph
+ *
+ *     Volume -> DepthMap -> ShadedView
+ *     Volume -> Markers -> Registration -> WorldReslices
+ *     Volume -> LocalReslices
+ *     Volume -> DirectionalMaps -> DirectionalView
+ *
+ * Every stage keeps its output, so e.g. a new windowing only converts the cached reslices again and moving the tip
+ * only reslices without detecting the markers. A new threshold doesn't read the volume, the depth map comes from
+ * CTDataset::rayIndex(). The dataset's own depth and cross section buffers are only used as scratch space while a
+ * stage is computed.
+ *
+ * DirectionalMaps finds the depth maps of all six axis directions in one sweep, so a new view direction only shades
+ * the cached map of that direction.
+ *
+ * The pipeline is not thread-safe, all calls have to come from the same thread (e.g. one ComputeExecutor).
+ */
+class MYLIB_EXPORT CTPipeline
+{
+public:
+    /// Stages of the pipeline, also the node ids in graph()
+    enum Node {
+        Volume,         ///< the loaded volume (source)
+        DepthMap,       ///< depth buffer of the threshold, width x layers
+        ShadedView,     ///< shaded depth map, width x layers
+        Markers,        ///< marker centroids and the shaded depth map of the markers
+        Registration,   ///< transformation from world to volume coordinates
+        WorldReslices,  ///< two cross sections at the instrument tip in world coordinates
+        LocalReslices,  ///< two cross sections at a position in voxel coordinates
+        DirectionalMaps, ///< first and last hits of the threshold along all three axes
+        DirectionalView  ///< depth map and shaded view of the view direction
+    };
+
+    explicit CTPipeline(CTDataset& dataset);
+
+    /// Marks the volume as changed, call it after loading
+    void volumeChanged();
+    /// Sets the threshold of the 3D view
+    void setThreshold(int threshold);
+    /// Sets the threshold of the marker detection
+    void setMarkerThreshold(int threshold);
+    /// Sets tip and axis of the instrument in world coordinates
+    void setWorldReslice(const Eigen::Vector3d& position, const Eigen::Vector3d& axis);
+    /// Sets center and axis of the local cross sections in voxel coordinates
+    void setLocalReslice(Voxel position, Voxel axis);
+    /// Sets the sampling of the world and local cross sections
+    void setInterpolation(ResliceEngine::Interpolation interpolation);
+    /// Sets thickness in mm and projection of the slab of the world cross sections, thickness 0 shows the layer only
+    void setSlab(double thickness, ResliceEngine::SlabProjection projection);
+    /// Sets the direction of the directional view
+    void setViewDirection(AxisDepthMaps::Direction direction);
+
+    /// Computes a stage and all out of date stages it depends on
+    int update(Node node) { return m_graph.update(node); }
+    /// Returns true if update(node) would compute anything
+    bool isDirty(Node node) const { return m_graph.isDirty(node); }
+    /// Computes the world or local reslices like update() and windows both layers into imageX and imageZ with the
+    /// instrument overlay, while they are sampled if they are out of date and from the cached layers otherwise
+    int updateCrosssections(Node node, quint32* imageX, quint32* imageZ, int bytesPerLine, const WindowingLut& lut);
+    const ProcessingGraph& graph() const { return m_graph; }
+
+    const std::vector<short>& depthMap() const { return m_depthMap; }
+    const std::vector<short>& shadedView() const { return m_shadedView; }
+    const std::vector<Voxel>& markerCentroids() const { return m_markerCentroids; }
+    const std::vector<short>& markerDepthMap() const { return m_markerDepthMap; }
+    const std::vector<short>& markerView() const { return m_markerView; }
+    /// Cross section along x (direction 0) or z (direction 1), width x height
+    const std::vector<short>& worldReslice(int direction) const { return m_worldReslices[direction]; }
+    const std::vector<short>& localReslice(int direction) const { return m_localReslices[direction]; }
+    const AxisDepthMaps& axisDepthMaps() const { return m_axisDepthMaps; }
+    /// Direction of directionalDepthMap() and directionalView()
+    AxisDepthMaps::Direction viewDirection() const { return AxisDepthMaps::Direction(int(m_graph.parameter(m_viewDirection))); }
+    /// Depth map and shaded view of the view direction, AxisDepthMaps::width() x AxisDepthMaps::height()
+    const std::vector<short>& directionalDepthMap() const { return m_directionalDepthMap; }
+    const std::vector<short>& directionalView() const { return m_directionalView; }
+
+private:
+    CTDataset& m_dataset;
+    ProcessingGraph m_graph;
+
+    int m_threshold;
+    int m_markerThreshold;
+    int m_worldParameters[6];
+    int m_localParameters[6];
+    int m_viewDirection;
+    int m_interpolation;
+    int m_slabThickness;
+    int m_slabProjection;
+
+    std::vector<short> m_depthMap;
+    std::vector<short> m_shadedView;
+    std::vector<Voxel> m_markerCentroids;
+    std::vector<short> m_markerDepthMap;
+    std::vector<short> m_markerView;
+    std::vector<short> m_worldReslices[2];
+    std::vector<short> m_localReslices[2];
+    AxisDepthMaps m_axisDepthMaps;
+    std::vector<short> m_directionalDepthMap;
+    std::vector<short> m_directionalView;
+
+    int computeDepthMap();
+    int computeShadedView();
+    int computeMarkers();
+    int computeRegistration();
+    int computeWorldReslices(const CTDataset::LayerPair& images);
+    int computeLocalReslices(const CTDataset::LayerPair& images);
+    int computeDirectionalMaps();
+    int computeDirectionalView();
+    CTDataset::LayerPair crosssectionTarget(std::vector<short> (&reslices)[2], const CTDataset::LayerPair& images);
+};
+
+#endif // CTPIPELINE_H
@@ -0,0 +1,309 @@
+#include "displaycache.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace {
+
+void applyRow(const WindowingLut& lut, const short* values, uchar* pixels, int count)
+{
+    lut.applyIndexed(values, pixels, count);
+}
+
+void applyRow(const WindowingLut& lut, const short* values, quint32* pixels, int count)
+{
+    lut.apply(values, pixels, count);
+}
+
+uchar pixel(const WindowingLut& lut, int value, const uchar*)
+{
+    return lut.code(value);
+}
+
+quint32 pixel(const WindowingLut& lut, int value, const quint32*)
+{
+    return lut.color(value);
+}
+
+/// Codes and grays only grow with the HU value, so all values between low and high get the same pixel if both do.
+/// Colors also need the same code, e.g. a gray overlay color is no gray value.
+bool samePixel(const WindowingLut& lut, int low, int high, const uchar*)
+{
+    return lut.code(low) == lut.code(high);
+}
+
+bool samePixel(const WindowingLut& lut, int low, int high, const quint32*)
+{
+    return lut.code(low) == lut.code(high) && lut.color(low) == lut.color(high);
+}
+
+/**
+ * Windows a layer row by row. Bricks whose minimum and maximum get the same pixel are filled without reading them,
+ * rows without any other brick are not read.
+ */
+template <typename Pixel>
+qint64 windowBricks(const VolumeView& volume, const BrickPyramid* bricks, const WindowingLut& lut, int z, Pixel* pixels,
+                    int bytesPerLine, const std::atomic<bool>* cancel)
+{
+    const int WIDTH = volume.geometry().width();
+    const int HEIGHT = volume.geometry().height();
+    const int BRICK = bricks ? bricks->brickSize() : std::max(HEIGHT, 1);
+    const int COLUMNS = bricks ? bricks->bricksX() : 0;
+    std::vector<short> row(WIDTH);
+    // per brick of the current band of rows: true and its pixel if all voxels get the same one
+    std::vector<char> uniform(COLUMNS, 0);
+    std::vector<Pixel> value(COLUMNS);
+    bool anyMixed = true;
+    qint64 skipped = 0;
+    for (int y = 0; y < HEIGHT; ++y){
+        if (cancel && cancel->load(std::memory_order_relaxed)){
+            break;
+        }
+        Pixel* out = reinterpret_cast<Pixel*>(reinterpret_cast<uchar*>(pixels) + qint64(y)*bytesPerLine);
+        if (!bricks){
+            volume.readRow(y, z, row.data());
+            applyRow(lut, row.data(), out, WIDTH);
+            continue;
+        }
+        if (y % BRICK == 0){
+            anyMixed = false;
+            for (int bx = 0; bx < COLUMNS; ++bx){
+                const short low = bricks->minimum(bx, y/BRICK, z/BRICK);
+                const short high = bricks->maximum(bx, y/BRICK, z/BRICK);
+                uniform[bx] = samePixel(lut, low, high, out);
+                value[bx] = pixel(lut, low, out);
+                anyMixed = anyMixed || !uniform[bx];
+            }
+        }
+        if (anyMixed){
+            volume.readRow(y, z, row.data());
+        }
+        // neighbouring bricks that have to be read are converted at once
+        int bx = 0;
+        while (bx < COLUMNS){
+            const int begin = bx*BRICK;
+            if (uniform[bx]){
+                const int end = std::min(begin + BRICK, WIDTH);
+                std::fill(out + begin, out + end, value[bx]);
+                skipped += end - begin;
+                ++bx;
+                continue;
+            }
+            while (bx < COLUMNS && !uniform[bx]){
+                ++bx;
+            }
+            const int end = std::min(bx*BRICK, WIDTH);
+            applyRow(lut, row.data() + begin, out + begin, end - begin);
+        }
+    }
+    return skipped;
+}
+
+}
+
+DisplayCache::DisplayCache()
+    : m_memoryBudget(256*1024*1024), m_geometry(0, 0, 0, 0, 0, 0), m_bricks(nullptr), m_bytesPerLine(0),
+      m_generation(0), m_layersReady(0), m_nextLayer(0), m_skippedVoxels(0), m_cancel(false)
+{
+}
+
+DisplayCache::~DisplayCache()
+{
+    cancel();
+}
+
+/**
+ * @brief DisplayCache::setMemoryBudget limits the memory of the cache. If the cached volume doesn't fit anymore the
+ * cache is released.
+ * @param bytes largest number of bytes, 0 disables the cache
+ */
+void DisplayCache::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = bytes;
+    if (m_geometry.isValid() && !fits(m_geometry)){
+        release();
+    }
+}
+
+/**
+ * @brief DisplayCache::fits checks whether the 8 bit copy of a volume fits the memory budget
+ * @param geometry the geometry of the volume
+ * @return true if the cache can be used for the volume
+ */
+bool DisplayCache::fits(const VolumeGeometry& geometry) const
+{
+    const qint64 bytesPerLine = (geometry.width() + 3) & ~3;
+    return bytesPerLine*geometry.height()*geometry.layers() <= m_memoryBudget;
+}
+
+/**
+ * @brief DisplayCache::rebuild converts a volume in the background, a running rebuild is cancelled first
+ *
+ * Layers converted with the previous windowing are not shown anymore, isLayerReady() becomes true again for each
+ * layer once it is converted with the new table. The memory is kept if the geometry doesn't change.
+ * @param volume the volume, it must stay valid until the rebuild finished or release() is called
+ * @param lut the windowing table, it is copied
+ * @param currentLayer the layer converted first
+ * @param threadCount number of worker threads, 0 uses all cores
+ * @param bricks the bricks of volume or nullptr, they must stay valid like the volume
+ * @return true if the rebuild started, false if the volume doesn't fit the memory budget
+ */
+bool DisplayCache::rebuild(const VolumeView& volume, const WindowingLut& lut, int currentLayer, int threadCount,
+                           const BrickPyramid* bricks)
+{
+    cancel();
+    const VolumeGeometry& geometry = volume.geometry();
+    if (!volume.isValid() || !fits(geometry)){
+        release();
+        return false;
+    }
+
+    if (geometry != m_geometry || m_planes.empty()){
+        release();
+        m_geometry = geometry;
+        m_bytesPerLine = (geometry.width() + 3) & ~3;
+        m_planes.resize(size_t(qint64(m_bytesPerLine)*geometry.height()*geometry.layers()));
+        m_layerGeneration.reset(new std::atomic<int>[geometry.layers()]);
+        for (int z = 0; z < geometry.layers(); ++z){
+            m_layerGeneration[z] = -1;
+        }
+    }
+    m_volume = volume;
+    m_lut = lut;
+    m_bricks = bricks && bricks->geometry() == geometry ? bricks : nullptr;
+    ++m_generation;
+    m_layersReady = 0;
+    m_skippedVoxels = 0;
+
+    // current layer first, then alternating above and below
+    const int LAYERS = geometry.layers();
+    currentLayer = std::max(0, std::min(currentLayer, LAYERS - 1));
+    m_order.clear();
+    m_order.push_back(currentLayer);
+    for (int d = 1; int(m_order.size()) < LAYERS; ++d){
+        if (currentLayer + d < LAYERS) m_order.push_back(currentLayer + d);
+        if (currentLayer - d >= 0) m_order.push_back(currentLayer - d);
+    }
+    m_nextLayer = 0;
+
+    const int THREADS = std::min(Parallel::threadCount(threadCount), LAYERS);
+    for (int t = 0; t < THREADS; ++t){
+        m_workers.emplace_back(&DisplayCache::work, this);
+    }
+    return true;
+}
+
+/**
+ * @brief DisplayCache::work converts the next layer in order until none is left
+ */
+void DisplayCache::work()
+{
+    const int HEIGHT = m_geometry.height();
+    while (!m_cancel){
+        const int next = m_nextLayer++;
+        if (next >= int(m_order.size())){
+            break;
+        }
+        const int z = m_order[next];
+        uchar* plane = m_planes.data() + qint64(z)*m_bytesPerLine*HEIGHT;
+        m_skippedVoxels += windowLayer(m_volume, m_bricks, m_lut, z, plane, m_bytesPerLine, &m_cancel);
+        if (m_cancel){
+            break;
+        }
+        m_layerGeneration[z].store(m_generation, std::memory_order_release);
+        ++m_layersReady;
+    }
+}
+
+/**
+ * @brief DisplayCache::skipStats tells how much of the converted layers were filled without reading them
+ * @return voxels of the layers converted by the current rebuild and voxels in bricks that were filled
+ */
+BrickPyramid::SkipStats DisplayCache::skipStats() const
+{
+    BrickPyramid::SkipStats stats;
+    stats.voxels = m_layersReady*m_geometry.sliceSize();
+    stats.skippedVoxels = m_skippedVoxels;
+    return stats;
+}
+
+/**
+ * @brief DisplayCache::windowLayer converts a layer to the 8 bit codes of a windowing table
+ *
+ * Bricks whose minimum and maximum get the same code are filled with it without reading them.
+ * @param volume the volume
+ * @param bricks the bricks of volume or nullptr to read every voxel
+ * @param lut the windowing table
+ * @param z the layer
+ * @param codes receives width x height codes
+ * @param bytesPerLine distance of two rows of codes in bytes
+ * @param cancel checked before every row if not nullptr, the layer is incomplete once it is set
+ * @return number of voxels filled without reading them
+ */
+qint64 DisplayCache::windowLayer(const VolumeView& volume, const BrickPyramid* bricks, const WindowingLut& lut, int z,
+                                 uchar* codes, int bytesPerLine, const std::atomic<bool>* cancel)
+{
+    return windowBricks(volume, bricks, lut, z, codes, bytesPerLine, cancel);
+}
+
+/**
+ * @brief DisplayCache::windowLayer converts a layer to the colors of a windowing table, e.g. into a
+ * QImage::Format_RGB32 image, like the codes above
+ */
+qint64 DisplayCache::windowLayer(const VolumeView& volume, const BrickPyramid* bricks, const WindowingLut& lut, int z,
+                                 quint32* pixels, int bytesPerLine, const std::atomic<bool>* cancel)
+{
+    return windowBricks(volume, bricks, lut, z, pixels, bytesPerLine, cancel);
+}
+
+/**
+ * @brief DisplayCache::cancel stops a running rebuild after the current row of each worker and waits for the workers
+ */
+void DisplayCache::cancel()
+{
+    m_cancel = true;
+    for (std::thread& worker : m_workers){
+        worker.join();
+    }
+    m_workers.clear();
+    m_cancel = false;
+}
+
+/**
+ * @brief DisplayCache::wait waits until the running rebuild has converted all layers
+ */
+void DisplayCache::wait()
+{
+    for (std::thread& worker : m_workers){
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+/**
+ * @brief DisplayCache::release stops the workers and frees the converted layers
+ */
+void DisplayCache::release()
+{
+    cancel();
+    std::vector<uchar>().swap(m_planes);
+    m_layerGeneration.reset();
+    m_layersReady = 0;
+    m_geometry = VolumeGeometry(0, 0, 0, 0, 0, 0);
+    m_volume = VolumeView();
+    m_bricks = nullptr;
+    m_skippedVoxels = 0;
+    m_bytesPerLine = 0;
+}
+
+/**
+ * @brief DisplayCache::isLayerReady checks whether a layer can be shown
+ * @param z the layer
+ * @return true if the layer has been converted with the windowing of the last rebuild
+ */
+bool DisplayCache::isLayerReady(int z) const
+{
+    if (!m_layerGeneration || z < 0 || z >= m_geometry.layers()){
+        return false;
+    }
+    return m_layerGeneration[z].load(std::memory_order_acquire) == m_generation;
+}
@@ -0,0 +1,92 @@
+#ifndef DISPLAYCACHE_H
+#define DISPLAYCACHE_H
+
+#include "MyLib_global.h"
+#include "volumeview.h"
+#include "windowinglut.h"
+#include "brickpyramid.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Windowed 8 bit copy of a whole volume for fast layer scrubbing
+ *
+ * Every layer is stored as 8 bit codes of WindowingLut::applyIndexed (gray values and the threshold overlay), with rows
+ * padded to 4 bytes so a layer can be shown directly as a QImage::Format_Indexed8 image. rebuild() converts the volume
+ * on worker threads, starting at the current layer and working outward. Layers can be used as soon as they are ready.
+ *
+ * The cache is only built if it fits the memory budget, otherwise it stays disabled and the caller windows the layers
+ * itself, e.g. with windowLayer(). Given the bricks of the volume, bricks whose minimum and maximum get the same code
+ * (air below the window, bone above the threshold) are filled without reading them.
+ */
+class MYLIB_EXPORT DisplayCache
+{
+public:
+    DisplayCache();
+    ~DisplayCache();
+
+    /// Sets the largest number of bytes the cache may use, 0 disables it
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return m_memoryBudget; }
+    /// Returns true if a volume of this geometry fits the memory budget
+    bool fits(const VolumeGeometry& geometry) const;
+
+    /// Starts converting a volume with a windowing table, returns false if the cache is disabled for it
+    bool rebuild(const VolumeView& volume, const WindowingLut& lut, int currentLayer, int threadCount = 0,
+                 const BrickPyramid* bricks = nullptr);
+    /// Stops a running rebuild and waits for the workers
+    void cancel();
+    /// Waits until all layers are converted
+    void wait();
+    /// Stops the workers and frees the memory
+    void release();
+
+    /// Returns true if layer z has been converted with the current windowing
+    bool isLayerReady(int z) const;
+    /// Number of layers converted with the current windowing
+    int layersReady() const { return m_layersReady; }
+    /// Converted layer z, only valid if isLayerReady(z)
+    const uchar* layer(int z) const { return m_planes.data() + qint64(z)*m_bytesPerLine*m_geometry.height(); }
+    /// Bytes per row of a layer (the width rounded up to 4)
+    int bytesPerLine() const { return m_bytesPerLine; }
+    /// Geometry of the cached volume
+    const VolumeGeometry& geometry() const { return m_geometry; }
+    /// Bytes currently allocated
+    qint64 memoryUsage() const { return qint64(m_planes.capacity()); }
+    /// Voxels of the layers converted by the current rebuild and voxels filled without reading them
+    BrickPyramid::SkipStats skipStats() const;
+
+    /// Converts layer z to 8 bit codes, rows bytesPerLine apart, returns the number of voxels filled without reading
+    static qint64 windowLayer(const VolumeView& volume, const BrickPyramid* bricks, const WindowingLut& lut, int z,
+                              uchar* codes, int bytesPerLine, const std::atomic<bool>* cancel = nullptr);
+    /// Converts layer z to colors, rows bytesPerLine apart, returns the number of voxels filled without reading
+    static qint64 windowLayer(const VolumeView& volume, const BrickPyramid* bricks, const WindowingLut& lut, int z,
+                              quint32* pixels, int bytesPerLine, const std::atomic<bool>* cancel = nullptr);
+
+private:
+    qint64 m_memoryBudget;
+    VolumeView m_volume;
+    VolumeGeometry m_geometry;
+    WindowingLut m_lut;
+    const BrickPyramid* m_bricks;
+    int m_bytesPerLine;
+    std::vector<uchar> m_planes;
+
+    /// Number of the current rebuild, a layer is ready if it was converted in this rebuild
+    int m_generation;
+    std::unique_ptr<std::atomic<int>[]> m_layerGeneration;
+    std::atomic<int> m_layersReady;
+    /// Layers in the order they are converted, outward from the current layer
+    std::vector<int> m_order;
+    std::atomic<int> m_nextLayer;
+    std::atomic<qint64> m_skippedVoxels;
+    std::atomic<bool> m_cancel;
+    std::vector<std::thread> m_workers;
+
+    /// Converts layers until all are done or the rebuild is cancelled
+    void work();
+};
+
+#endif // DISPLAYCACHE_H
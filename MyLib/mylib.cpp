@@ -1,7 +1,121 @@
 #include "mylib.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
 
 
 
 MyLib::MyLib()
 {
 }
+
+/**
+ * @brief shadingTable returns the shading of every squared depth gradient r2 = T_x^2 + T_y^2
+ *
+ * The shading 255 * 4/sqrt((2*T_x)^2 + (2*T_y)^2 + 4^2) only depends on r2. It falls below 1 at r2 = 260096, the table
+ * ends with the first r2 that gives 0, every larger r2 is looked up there. Built on first use.
+ * @return the table
+ */
+static const std::vector<quint8>& shadingTable()
+{
+    static const std::vector<quint8> table = [](){
+        std::vector<quint8> values;
+        for (qint64 r2 = 0; ; ++r2){
+            // the same float rounding as the shading computed per pixel
+            const float incidence_angle = float(4/std::sqrt(double(4*r2 + 16)));
+            const quint8 value = quint8(short(255*incidence_angle));
+            values.push_back(value);
+            if (value == 0){
+                return values;
+            }
+        }
+    }();
+    return table;
+}
+
+/// Gradients at least this large shade to 0, clamping them keeps r2 within int
+static const int GRADIENT_LIMIT = 1024;
+
+/**
+ * @brief shadeRow shades the inner pixels of one row of a depth map
+ * @param above the row above
+ * @param row the row
+ * @param below the row below
+ * @param width columns of the depth map
+ * @param out receives the shading of columns 1 to width-2
+ */
+template <typename T>
+static void shadeRow(const short* above, const short* row, const short* below, int width, T* out)
+{
+    const std::vector<quint8>& table = shadingTable();
+    const quint8* values = table.data();
+    const int last = int(table.size()) - 1;
+    for (int x = 1; x < width - 1; ++x){
+        const int T_x = std::min(std::abs(row[x-1] - row[x+1]), GRADIENT_LIMIT);
+        const int T_y = std::min(std::abs(above[x] - below[x]), GRADIENT_LIMIT);
+        out[x] = T(values[std::min(T_x*T_x + T_y*T_y, last)]);
+    }
+}
+
+/**
+ * @brief MyLib::renderDepthBuffer shades a depth map by the angle of the surface to a light source at the viewer
+ *
+ * The shading is looked up per pixel from the squared depth gradient (see shadingTable()), the rows are split between
+ * the threads.
+ * @param depthBuffer the depth map, width x height values
+ * @param width columns of the depth map
+ * @param height rows of the depth map
+ * @param shadedBuffer receives the shading (0 to 255), the border pixels are not written
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if a buffer is missing
+ */
+int MyLib::renderDepthBuffer(const short* depthBuffer, int width, int height, short* shadedBuffer, int threadCount)
+{
+    if (!depthBuffer || !shadedBuffer){
+        return 1;
+    }
+    Parallel::forChunks(1, height - 1, Parallel::threadCount(threadCount), [&](int firstRow, int lastRow, int){
+        for (int y = firstRow; y < lastRow; ++y){
+            const short* row = depthBuffer + qint64(y)*width;
+            shadeRow(row - width, row, row + width, width, shadedBuffer + qint64(y)*width);
+        }
+    });
+    return 0;
+}
+
+/**
+ * @brief MyLib::renderDepthBuffer shades a depth map into 8 bit gray values, the same values as the short version
+ * @param depthBuffer the depth map, width x height values
+ * @param width columns of the depth map
+ * @param height rows of the depth map
+ * @param image receives the shading, height rows of bytesPerLine bytes (e.g. a QImage::Format_Grayscale8)
+ * @param bytesPerLine distance of two rows of image in bytes
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if a buffer is missing
+ */
+int MyLib::renderDepthBuffer(const short* depthBuffer, int width, int height, quint8* image, int bytesPerLine,
+                             int threadCount)
+{
+    if (!depthBuffer || !image){
+        return 1;
+    }
+    Parallel::forChunks(0, height, Parallel::threadCount(threadCount), [&](int firstRow, int lastRow, int){
+        for (int y = firstRow; y < lastRow; ++y){
+            quint8* out = image + qint64(y)*bytesPerLine;
+            if (y == 0 || y == height - 1){
+                std::memset(out, 0, size_t(width));
+                continue;
+            }
+            const short* row = depthBuffer + qint64(y)*width;
+            shadeRow(row - width, row, row + width, width, out);
+            out[0] = 0;
+            if (width > 1){
+                out[width-1] = 0;
+            }
+        }
+    });
+    return 0;
+}
@@ -9,7 +9,11 @@ class MYLIB_EXPORT MyLib
 {
 public:
     MyLib();
-    static int renderDepthBuffer(const short* depthBuffer, int width, int height, short* shadedBuffer);
+    /// Shades a depth map (width x height), the border pixels are not written; threadCount 0 uses all cores
+    static int renderDepthBuffer(const short* depthBuffer, int width, int height, short* shadedBuffer, int threadCount = 0);
+    /// Shades a depth map into 8 bit gray values, e.g. the scan lines of a QImage; the border pixels become 0
+    static int renderDepthBuffer(const short* depthBuffer, int width, int height, quint8* image, int bytesPerLine,
+                                 int threadCount = 0);
 };
 
 #endif // MYLIB_H
@@ -0,0 +1,55 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "MyLib_global.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Helpers to split a loop over worker threads
+ */
+class Parallel
+{
+public:
+    /// Number of threads to use: requested if positive, otherwise the number of cores
+    static int threadCount(int requested = 0){
+        if (requested > 0){
+            return requested;
+        }
+        int cores = int(std::thread::hardware_concurrency());
+        return cores > 0 ? cores : 1;
+    }
+
+    /**
+     * @brief forChunks splits [begin, end) into at most threads contiguous chunks and calls
+     * f(chunkBegin, chunkEnd, chunkIndex) for each chunk on its own thread. The last chunk runs on the calling thread.
+     * Chunks are numbered in ascending order, so results stored per chunk can be combined deterministically.
+     * @return number of chunks
+     */
+    template <typename Func>
+    static int forChunks(int begin, int end, int threads, Func f){
+        const int count = end - begin;
+        if (count <= 0){
+            return 0;
+        }
+        const int chunks = std::max(1, std::min(threadCount(threads), count));
+        std::vector<std::thread> workers;
+        workers.reserve(size_t(chunks - 1));
+        for (int c = 0; c < chunks; ++c){
+            const int chunkBegin = begin + int(qint64(count)*c/chunks);
+            const int chunkEnd = begin + int(qint64(count)*(c+1)/chunks);
+            if (c == chunks - 1){
+                f(chunkBegin, chunkEnd, c);
+            } else {
+                workers.emplace_back(f, chunkBegin, chunkEnd, c);
+            }
+        }
+        for (std::thread& worker : workers){
+            worker.join();
+        }
+        return chunks;
+    }
+};
+
+#endif // PARALLEL_H
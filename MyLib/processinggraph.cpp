@@ -0,0 +1,166 @@
+#include "processinggraph.h"
+
+ProcessingGraph::ProcessingGraph()
+    : m_clock(0)
+{
+}
+
+/**
+ * @brief ProcessingGraph::addParameter adds a numeric parameter, e.g. a threshold or one coordinate of a position
+ * @param value initial value
+ * @return id of the parameter
+ */
+int ProcessingGraph::addParameter(double value)
+{
+    m_parameters.push_back({value, ++m_clock});
+    return int(m_parameters.size()) - 1;
+}
+
+/**
+ * @brief ProcessingGraph::setParameter changes a parameter, setting the same value again doesn't make any node dirty
+ * @param parameter id returned by addParameter()
+ * @param value the new value
+ * @return true if the value changed
+ */
+bool ProcessingGraph::setParameter(int parameter, double value)
+{
+    Parameter& entry = m_parameters[parameter];
+    if (entry.value == value){
+        return false;
+    }
+    entry.value = value;
+    entry.stamp = ++m_clock;
+    return true;
+}
+
+/**
+ * @brief ProcessingGraph::addSource adds a node whose output is changed from outside with touch()
+ * @return id of the node
+ */
+int ProcessingGraph::addSource()
+{
+    m_nodes.push_back({Compute(), {}, {}, 0, false, 0});
+    return int(m_nodes.size()) - 1;
+}
+
+/**
+ * @brief ProcessingGraph::addNode adds a processing stage, its inputs have to be added before
+ * @param compute computes the output of the node, returns 0 if successful or an error code
+ * @param inputs the nodes whose outputs are read by compute
+ * @param parameters the parameters used by compute
+ * @return id of the node
+ */
+int ProcessingGraph::addNode(Compute compute, const std::vector<int>& inputs, const std::vector<int>& parameters)
+{
+    m_nodes.push_back({compute, inputs, parameters, 0, true, 0});
+    return int(m_nodes.size()) - 1;
+}
+
+/**
+ * @brief ProcessingGraph::touch marks the output of a node as changed, all nodes depending on it become dirty
+ * @param node id of the node
+ */
+void ProcessingGraph::touch(int node)
+{
+    m_nodes[node].stamp = ++m_clock;
+    m_nodes[node].invalid = false;
+}
+
+/**
+ * @brief ProcessingGraph::invalidate marks a node as out of date, e.g. after its output was freed
+ * @param node id of the node
+ */
+void ProcessingGraph::invalidate(int node)
+{
+    if (m_nodes[node].compute){
+        m_nodes[node].invalid = true;
+    }
+}
+
+/**
+ * @brief ProcessingGraph::isOutdated checks a node against its direct inputs and parameters
+ */
+bool ProcessingGraph::isOutdated(const Node& node) const
+{
+    if (!node.compute){
+        return false;
+    }
+    if (node.invalid){
+        return true;
+    }
+    for (int input : node.inputs){
+        if (m_nodes[input].stamp > node.stamp){
+            return true;
+        }
+    }
+    for (int parameter : node.parameters){
+        if (m_parameters[parameter].stamp > node.stamp){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief ProcessingGraph::update computes a node after bringing its inputs up to date
+ *
+ * A node whose compute function fails stays dirty and keeps its old stamp, so the nodes depending on it are not
+ * computed either.
+ * @param node id of the node
+ * @return 0 - if the node is up to date, otherwise the error code of the first node that failed
+ */
+int ProcessingGraph::update(int node)
+{
+    return update(node, m_nodes[node].compute);
+}
+
+/**
+ * @brief ProcessingGraph::update computes a node with another function after bringing its inputs up to date
+ *
+ * The inputs are computed with their own functions, only the node itself uses compute. It counts as a regular
+ * computation of the node, so compute has to produce the same output as the node's own function.
+ * @param node id of the node
+ * @param compute replaces the compute function of the node for this update
+ * @return 0 - if the node is up to date, otherwise the error code of the first node that failed
+ */
+int ProcessingGraph::update(int node, const Compute& compute)
+{
+    for (int input : m_nodes[node].inputs){
+        int errorCode = update(input);
+        if (errorCode != 0){
+            return errorCode;
+        }
+    }
+    Node& entry = m_nodes[node];
+    if (!isOutdated(entry)){
+        return 0;
+    }
+    int errorCode = compute();
+    if (errorCode != 0){
+        entry.invalid = true;
+        return errorCode;
+    }
+    entry.stamp = ++m_clock;
+    entry.invalid = false;
+    ++entry.computeCount;
+    return 0;
+}
+
+/**
+ * @brief ProcessingGraph::isDirty checks whether update() would compute anything for a node
+ * @param node id of the node
+ * @return true if the node or one of the nodes it depends on is out of date
+ */
+bool ProcessingGraph::isDirty(int node) const
+{
+    const Node& entry = m_nodes[node];
+    if (isOutdated(entry)){
+        return true;
+    }
+    for (int input : entry.inputs){
+        if (isDirty(input)){
+            return true;
+        }
+    }
+    return false;
+}
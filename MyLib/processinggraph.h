@@ -0,0 +1,77 @@
+#ifndef PROCESSINGGRAPH_H
+#define PROCESSINGGRAPH_H
+
+#include "MyLib_global.h"
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Dataflow graph that recomputes only the stages whose inputs changed
+ *
+ * A node is a processing stage that keeps its own output (e.g. a depth buffer); the graph only knows when that output
+ * is out of date. Nodes depend on other nodes and on numeric parameters. Every change gets a stamp from a running
+ * clock: a node is dirty if it was never computed or if one of its inputs or parameters changed after its last
+ * computation. update() brings the inputs of a node up to date first and then computes the node if it is dirty.
+ *
+ * Sources are nodes without a compute function whose output is changed from outside (e.g. a loaded volume), they are
+ * marked with touch().
+ */
+class MYLIB_EXPORT ProcessingGraph
+{
+public:
+    /// Computes the output of a node, returns 0 if successful or an error code
+    typedef std::function<int()> Compute;
+
+    ProcessingGraph();
+
+    /// Adds a parameter, returns its id
+    int addParameter(double value = 0);
+    /// Sets a parameter, the nodes using it become dirty if the value changed; returns true if it changed
+    bool setParameter(int parameter, double value);
+    double parameter(int parameter) const { return m_parameters[parameter].value; }
+
+    /// Adds a node whose output is set from outside, returns its id
+    int addSource();
+    /// Adds a node computed from other nodes and parameters, returns its id
+    int addNode(Compute compute, const std::vector<int>& inputs, const std::vector<int>& parameters = std::vector<int>());
+    /// Marks the output of a node as changed, e.g. after loading a new volume into a source
+    void touch(int node);
+    /// Marks a node as out of date, it is computed again on its next update
+    void invalidate(int node);
+
+    /// Computes the node and all dirty nodes it depends on, returns 0 or the error code of the first failing node
+    int update(int node);
+    /// Like update(), but computes the node itself with compute instead of its own function, e.g. to write its output
+    /// somewhere else as well
+    int update(int node, const Compute& compute);
+    /// Returns true if update() would compute the node or one of its inputs
+    bool isDirty(int node) const;
+    /// Stamp of the last change of the output, changes whenever the node is computed or touched
+    qint64 stamp(int node) const { return m_nodes[node].stamp; }
+    /// Number of times the node has been computed successfully
+    int computeCount(int node) const { return m_nodes[node].computeCount; }
+    int nodeCount() const { return int(m_nodes.size()); }
+
+private:
+    struct Parameter {
+        double value;
+        qint64 stamp;
+    };
+    struct Node {
+        Compute compute;
+        std::vector<int> inputs;
+        std::vector<int> parameters;
+        /// Clock at the last change of the output, 0 if there is none
+        qint64 stamp;
+        bool invalid;
+        int computeCount;
+    };
+
+    std::vector<Parameter> m_parameters;
+    std::vector<Node> m_nodes;
+    qint64 m_clock;
+
+    bool isOutdated(const Node& node) const;
+};
+
+#endif // PROCESSINGGRAPH_H
@@ -0,0 +1,313 @@
+#include "raycaster.h"
+#include "parallel.h"
+#include "windowinglut.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <vector>
+
+RayCaster::Settings::Settings()
+    : mode(MaximumIntensity), azimuth(0), elevation(0), zoom(1), threshold(300), windowStart(0), windowWidth(1500),
+      opacityLow(200), opacityHigh(1200), opacity(0.1), stepSize(1)
+{
+}
+
+RayCaster::RayCaster()
+    : m_bricks(nullptr), m_stats()
+{
+}
+
+/**
+ * @brief RayCaster::setVolume sets the volume to render
+ * @param volume the volume, it has to stay loaded while rendering
+ * @param bricks minimum and maximum of the bricks of the volume, ignored if nullptr or built for another volume
+ */
+void RayCaster::setVolume(const VolumeView& volume, const BrickPyramid* bricks)
+{
+    m_volume = volume;
+    m_bricks = bricks && bricks->isValid() && bricks->geometry() == volume.geometry() ? bricks : nullptr;
+}
+
+namespace {
+
+/// A ray in voxel coordinates, position origin + t*step for t in [first, last]
+struct Ray {
+    float origin[3];
+    float step[3];
+    float first;
+    float last;
+};
+
+/// Samples taken by one thread
+struct TileCounts {
+    qint64 samples;
+    qint64 skippedSamples;
+    qint64 terminatedRays;
+};
+
+/**
+ * @brief clipRay limits a ray to the voxels of the volume, voxel i covers [i - 0.5, i + 0.5) along each axis
+ * @return false if the ray misses the volume
+ */
+bool clipRay(Ray& ray, const int size[3])
+{
+    ray.first = 0;
+    ray.last = 1e30f;
+    for (int k = 0; k < 3; ++k){
+        const float low = -0.5f;
+        const float high = size[k] - 0.5f;
+        if (ray.step[k] == 0){
+            if (ray.origin[k] < low || ray.origin[k] >= high){
+                return false;
+            }
+            continue;
+        }
+        float t0 = (low - ray.origin[k])/ray.step[k];
+        float t1 = (high - ray.origin[k])/ray.step[k];
+        if (t0 > t1){
+            std::swap(t0, t1);
+        }
+        ray.first = std::max(ray.first, t0);
+        ray.last = std::min(ray.last, t1);
+    }
+    ray.first = std::ceil(ray.first);
+    return ray.first <= ray.last;
+}
+
+/**
+ * @brief sampleVoxel finds the nearest voxel of sample t, clamped to the volume
+ *
+ * Clipped rays stay above -0.5, so truncating the position + 0.5 rounds like floor wherever the clamp doesn't apply.
+ */
+inline void sampleVoxel(const Ray& ray, float t, const int size[3], int voxel[3])
+{
+    for (int k = 0; k < 3; ++k){
+        voxel[k] = std::min(std::max(int(ray.origin[k] + t*ray.step[k] + 0.5f), 0), size[k] - 1);
+    }
+}
+
+/**
+ * @brief exitSample finds the first sample of a ray behind a box of voxels [low, high)
+ * @return the sample, at least t + 1
+ */
+float exitSample(const Ray& ray, const int low[3], const int high[3], float t)
+{
+    float exit = 1e30f;
+    for (int k = 0; k < 3; ++k){
+        if (ray.step[k] > 0){
+            exit = std::min(exit, (high[k] - 0.5f - ray.origin[k])/ray.step[k]);
+        } else if (ray.step[k] < 0){
+            exit = std::min(exit, (low[k] - 0.5f - ray.origin[k])/ray.step[k]);
+        }
+    }
+    // a little short of the exit, so rounding can't jump over a sample of the next box
+    return std::max(t + 1, std::ceil(exit - 1e-3f));
+}
+
+}
+
+/**
+ * @brief RayCaster::render casts one ray per pixel through the volume
+ *
+ * The tiles of the image are handed out to the threads through an atomic counter, so threads that got cheap tiles
+ * (e.g. air around the patient) take more of them. With bricks a ray is walked brick by brick: the bricks are looked
+ * up once where the ray enters a brick, the samples up to its exit are taken without lookups. Where the brick can't
+ * change the pixel the ray jumps behind the largest brick of the pyramid around it that can't either.
+ * @param settings view, mode and transfer function
+ * @param width columns of the image
+ * @param height rows of the image
+ * @param image receives one gray value per pixel
+ * @param bytesPerLine distance of two rows of image in bytes
+ * @param threadCount number of threads, 0 uses all cores
+ * @param cancel stops rendering when set, may be nullptr
+ * @return 0 - if successful, 1 - if no volume is set or the image is missing, 4 - if cancelled
+ */
+int RayCaster::render(const Settings& settings, int width, int height, quint8* image, int bytesPerLine, int threadCount,
+                      const std::atomic<bool>* cancel)
+{
+    m_stats = Stats();
+    if (!m_volume.isValid() || !image || width <= 0 || height <= 0){
+        return 1;
+    }
+    QElapsedTimer timer;
+    timer.start();
+
+    const VolumeGeometry& geometry = m_volume.geometry();
+    const int size[3] = {geometry.width(), geometry.height(), geometry.layers()};
+    const double spacing[3] = {geometry.spacingX(), geometry.spacingY(), geometry.spacingZ()};
+
+    // camera in mm: viewing direction d, image columns along u and rows along v
+    const double PI = std::acos(-1.0);
+    const double azimuth = settings.azimuth*PI/180;
+    const double elevation = settings.elevation*PI/180;
+    const double d[3] = {std::cos(elevation)*std::sin(azimuth), std::cos(elevation)*std::cos(azimuth), std::sin(elevation)};
+    const double u[3] = {-std::cos(azimuth), std::sin(azimuth), 0};
+    const double v[3] = {d[1]*u[2] - d[2]*u[1], d[2]*u[0] - d[0]*u[2], d[0]*u[1] - d[1]*u[0]};
+    double diagonal = 0;
+    double center[3];
+    for (int k = 0; k < 3; ++k){
+        diagonal += (size[k]*spacing[k])*(size[k]*spacing[k]);
+        center[k] = (size[k] - 1)*spacing[k]/2;
+    }
+    diagonal = std::sqrt(diagonal);
+    const double pixel = diagonal/std::min(width, height)/std::max(settings.zoom, 1e-3);
+    const double stepLength = std::min({spacing[0], spacing[1], spacing[2]})*std::max(settings.stepSize, 0.05);
+
+    WindowingLut lut;
+    lut.update(settings.windowStart, settings.windowWidth);
+    // MaximumIntensity is final once its gray value can't grow any more
+    const int brightest = lut.gray(WindowingLut::MaxHU);
+    const int opacityRange = std::max(1, settings.opacityHigh - settings.opacityLow);
+    const BrickPyramid* bricks = m_bricks;
+    const int BRICK = bricks ? bricks->brickSize() : 1;
+    const int LEVELS = bricks ? bricks->levelCount() : 0;
+
+    const int tilesX = (width + TileSize - 1)/TileSize;
+    const int tilesY = (height + TileSize - 1)/TileSize;
+    const int tileCount = tilesX*tilesY;
+    const int THREADS = std::min(Parallel::threadCount(threadCount), tileCount);
+    std::vector<TileCounts> counts(size_t(THREADS), TileCounts{0, 0, 0});
+    std::atomic<int> nextTile(0);
+    std::atomic<bool> cancelled(false);
+
+    m_volume.visit([&](const auto& voxels){
+        Parallel::forChunks(0, THREADS, THREADS, [&](int, int, int thread){
+            TileCounts& count = counts[thread];
+            int tile;
+            while ((tile = nextTile.fetch_add(1)) < tileCount){
+                if (cancel && cancel->load()){
+                    cancelled = true;
+                    return;
+                }
+                const int tileX = (tile % tilesX)*TileSize;
+                const int tileY = (tile / tilesX)*TileSize;
+                for (int row = tileY; row < std::min(tileY + TileSize, height); ++row){
+                    quint8* out = image + qint64(row)*bytesPerLine;
+                    for (int column = tileX; column < std::min(tileX + TileSize, width); ++column){
+                        // the ray starts in front of the volume and runs through the pixel along d
+                        const double a = (column - width/2.0 + 0.5)*pixel;
+                        const double b = (row - height/2.0 + 0.5)*pixel;
+                        Ray ray;
+                        for (int k = 0; k < 3; ++k){
+                            ray.origin[k] = float((center[k] + a*u[k] + b*v[k] - d[k]*diagonal/2)/spacing[k]);
+                            ray.step[k] = float(d[k]*stepLength/spacing[k]);
+                        }
+                        if (!clipRay(ray, size)){
+                            out[column] = 0;
+                            continue;
+                        }
+
+                        int maximum = SHRT_MIN;
+                        float color = 0;
+                        float alpha = 0;
+                        int hit[3] = {-1, -1, -1};
+                        bool terminated = false;
+                        // samples [t, next) lie in one brick
+                        const float end = std::floor(ray.last) + 1;
+                        float t = ray.first;
+                        while (t < end && !terminated){
+                            float next = end;
+                            int brickMaximum = INT_MAX;
+                            if (bricks){
+                                int voxel[3];
+                                sampleVoxel(ray, t, size, voxel);
+                                const int needed = settings.mode == MaximumIntensity ? maximum + 1
+                                                 : settings.mode == Isosurface ? settings.threshold : settings.opacityLow + 1;
+                                // levels below level can't change the pixel
+                                int level = 0;
+                                while (level < LEVELS && bricks->maximum(voxel[0]/(BRICK << level), voxel[1]/(BRICK << level),
+                                                                         voxel[2]/(BRICK << level), level) < needed){
+                                    ++level;
+                                }
+                                const int side = BRICK << std::max(level - 1, 0);
+                                const int low[3] = {voxel[0]/side*side, voxel[1]/side*side, voxel[2]/side*side};
+                                const int high[3] = {low[0] + side, low[1] + side, low[2] + side};
+                                next = std::min(end, exitSample(ray, low, high, t));
+                                brickMaximum = bricks->maximum(voxel[0]/BRICK, voxel[1]/BRICK, voxel[2]/BRICK);
+                                if (level > 0){
+                                    count.skippedSamples += qint64(next - t);
+                                    t = next;
+                                    continue;
+                                }
+                            }
+                            for (; t < next; t += 1){
+                                int voxel[3];
+                                sampleVoxel(ray, t, size, voxel);
+                                const int value = voxels.at(voxel[0], voxel[1], voxel[2]);
+                                ++count.samples;
+                                if (settings.mode == MaximumIntensity){
+                                    if (value > maximum){
+                                        maximum = value;
+                                        if (lut.gray(maximum) == brightest){
+                                            terminated = true;
+                                            break;
+                                        }
+                                        if (maximum >= brickMaximum){
+                                            // the rest of the brick can't raise the maximum
+                                            count.skippedSamples += qint64(next - t - 1);
+                                            t = next - 1;
+                                        }
+                                    }
+                                } else if (settings.mode == Isosurface){
+                                    if (value >= settings.threshold){
+                                        std::copy(voxel, voxel + 3, hit);
+                                        terminated = true;
+                                        break;
+                                    }
+                                } else {
+                                    const float ramp = std::min(std::max(float(value - settings.opacityLow)/opacityRange, 0.0f), 1.0f);
+                                    const float sampleAlpha = float(settings.opacity)*ramp;
+                                    color += (1 - alpha)*sampleAlpha*lut.gray(value);
+                                    alpha += (1 - alpha)*sampleAlpha;
+                                    if (alpha >= 0.98f){
+                                        terminated = true;
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                        count.terminatedRays += terminated;
+
+                        if (settings.mode == MaximumIntensity){
+                            out[column] = maximum == SHRT_MIN ? 0 : lut.gray(maximum);
+                        } else if (settings.mode == Isosurface){
+                            if (hit[0] < 0){
+                                out[column] = 0;
+                                continue;
+                            }
+                            // head light: brightness is the cosine between the gradient and the ray
+                            double gradient[3];
+                            double length = 0;
+                            for (int k = 0; k < 3; ++k){
+                                int lower[3] = {hit[0], hit[1], hit[2]};
+                                int upper[3] = {hit[0], hit[1], hit[2]};
+                                lower[k] = std::max(lower[k] - 1, 0);
+                                upper[k] = std::min(upper[k] + 1, size[k] - 1);
+                                gradient[k] = (voxels.at(upper[0], upper[1], upper[2]) - voxels.at(lower[0], lower[1], lower[2]))/spacing[k];
+                                length += gradient[k]*gradient[k];
+                            }
+                            double shade = 1;
+                            if (length > 0){
+                                shade = std::fabs(gradient[0]*d[0] + gradient[1]*d[1] + gradient[2]*d[2])/std::sqrt(length);
+                            }
+                            out[column] = quint8(std::lround(40 + 215*shade));
+                        } else {
+                            out[column] = quint8(std::lround(std::min(color, 255.0f)));
+                        }
+                    }
+                }
+            }
+        });
+    });
+
+    for (const TileCounts& count : counts){
+        m_stats.samples += count.samples;
+        m_stats.skippedSamples += count.skippedSamples;
+        m_stats.terminatedRays += count.terminatedRays;
+    }
+    m_stats.tileCount = tileCount;
+    m_stats.threadCount = THREADS;
+    m_stats.elapsedNs = timer.nsecsElapsed();
+    return cancelled ? 4 : 0;
+}
@@ -0,0 +1,76 @@
+#ifndef RAYCASTER_H
+#define RAYCASTER_H
+
+#include "MyLib_global.h"
+#include "volumeview.h"
+#include "brickpyramid.h"
+#include <atomic>
+
+/**
+ * @brief Multithreaded CPU ray caster for views of the volume from any angle
+ *
+ * The camera is orthographic and looks at the center of the volume. Azimuth 0 and elevation 0 look along +y with the
+ * image rows along +z, like the depth buffer of CTDataset; the azimuth turns the camera around the z-axis and the
+ * elevation tilts it towards +z. Distances are measured in mm, so anisotropic voxels keep their shape.
+ *
+ * Rays are sampled at the nearest voxel in fixed steps. The image is split into tiles of TileSize x TileSize pixels
+ * that the threads take one after another. Rays stop early once the pixel can't change any more (opaque compositing,
+ * saturated MIP, first hit of the isosurface). Given a BrickPyramid, rays are walked brick by brick and jump over the
+ * largest bricks that can't contribute.
+ */
+class MYLIB_EXPORT RayCaster
+{
+public:
+    /// Side of a tile in pixels
+    static const int TileSize = 16;
+
+    /// What a ray collects
+    enum Mode {
+        MaximumIntensity,   ///< largest value along the ray, windowed to a gray value
+        Isosurface,         ///< first voxel at or above the threshold, shaded by its gradient
+        Compositing         ///< windowed gray values blended front to back with a ramp of opacities
+    };
+
+    /// View and transfer function of a rendering
+    struct Settings {
+        Mode mode;
+        double azimuth;     ///< rotation around the z-axis in degrees
+        double elevation;   ///< tilt towards +z in degrees
+        double zoom;        ///< 1 fits the whole volume into the image
+        int threshold;      ///< HU value of the isosurface
+        int windowStart;    ///< windowing of MaximumIntensity and Compositing
+        int windowWidth;
+        int opacityLow;     ///< Compositing: values up to opacityLow are transparent
+        int opacityHigh;    ///< Compositing: values from opacityHigh on have opacity
+        double opacity;     ///< Compositing: largest opacity of one sample
+        double stepSize;    ///< distance of two samples in units of the smallest voxel spacing
+
+        Settings();
+    };
+
+    /// Figures of the last rendering
+    struct Stats {
+        qint64 samples;         ///< voxels read
+        qint64 skippedSamples;  ///< samples jumped over in bricks that couldn't contribute
+        qint64 terminatedRays;  ///< rays stopped before leaving the volume
+        qint64 elapsedNs;       ///< run time in nanoseconds
+        int tileCount;
+        int threadCount;
+    };
+
+    RayCaster();
+
+    /// Sets the volume to render and optionally its bricks for skipping empty space
+    void setVolume(const VolumeView& volume, const BrickPyramid* bricks = nullptr);
+    /// Renders an image of width x height gray values, rows are bytesPerLine apart (e.g. a QImage::Format_Grayscale8)
+    int render(const Settings& settings, int width, int height, quint8* image, int bytesPerLine, int threadCount = 0,
+               const std::atomic<bool>* cancel = nullptr);
+    const Stats& stats() const { return m_stats; }
+
+private:
+    VolumeView m_volume;
+    const BrickPyramid* m_bricks;
+    Stats m_stats;
+};
+
+#endif // RAYCASTER_H
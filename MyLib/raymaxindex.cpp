@@ -0,0 +1,198 @@
+#include "raymaxindex.h"
+#include "parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+RayMaxIndex::RayMaxIndex()
+    : m_geometry(0, 0, 0, 0, 0, 0)
+{
+}
+
+/**
+ * @brief RayMaxIndex::build collects the breakpoints of the running maxima of all rays
+ *
+ * Each layer is read row by row, the running maxima of all columns are updated side by side. The layers are split
+ * between the threads and their breakpoints are put together in layer order afterwards. A brick whose maximum is not
+ * above the smallest running maximum of its columns adds no breakpoint and is skipped, rows of a band where every
+ * brick is skipped are not read.
+ * @param volume the volume, it has to be loaded completely
+ * @param threadCount number of threads, 0 uses all cores
+ * @param bricks the bricks of volume or nullptr to read every voxel
+ * @param stats receives the number of voxels and the voxels in skipped bricks if not nullptr
+ */
+void RayMaxIndex::build(const VolumeView& volume, int threadCount, const BrickPyramid* bricks,
+                        BrickPyramid::SkipStats* stats)
+{
+    release();
+    if (stats){
+        *stats = BrickPyramid::SkipStats();
+    }
+    if (!volume.isValid()){
+        return;
+    }
+    const VolumeGeometry& geometry = volume.geometry();
+    const int WIDTH = geometry.width();
+    const int HEIGHT = geometry.height();
+    const int LAYERS = geometry.layers();
+    const int THREADS = std::min(Parallel::threadCount(threadCount), LAYERS);
+    if (bricks && bricks->geometry() != geometry){
+        bricks = nullptr;
+    }
+    const int BRICK = bricks ? bricks->brickSize() : std::max(HEIGHT, 1);
+    const int COLUMNS = bricks ? bricks->bricksX() : 1;
+    std::vector<qint64> skipped(THREADS, 0);
+
+    // per chunk of layers: breakpoints in ray order and the number of breakpoints of each ray
+    std::vector<std::vector<Breakpoint>> chunkBreakpoints(THREADS);
+    std::vector<std::vector<int>> chunkCounts(THREADS);
+    Parallel::forChunks(0, LAYERS, THREADS, [&](int firstLayer, int lastLayer, int chunk){
+        std::vector<Breakpoint>& breakpoints = chunkBreakpoints[chunk];
+        std::vector<int>& counts = chunkCounts[chunk];
+        counts.assign(size_t(lastLayer - firstLayer)*WIDTH, 0);
+        std::vector<short> row(WIDTH);
+        std::vector<int> maximum(WIDTH);
+        std::vector<std::vector<Breakpoint>> rays(WIDTH);
+        // per brick of the current band of rows: true if it can raise a running maximum
+        std::vector<char> open(COLUMNS, 1);
+        bool anyOpen = true;
+        for (int z = firstLayer; z < lastLayer; ++z){
+            std::fill(maximum.begin(), maximum.end(), INT_MIN);
+            for (int y = 0; y < HEIGHT; ++y){
+                if (bricks && y % BRICK == 0){
+                    anyOpen = false;
+                    for (int bx = 0; bx < COLUMNS; ++bx){
+                        const int begin = bx*BRICK;
+                        const int end = std::min(begin + BRICK, WIDTH);
+                        const int lowest = *std::min_element(maximum.begin() + begin, maximum.begin() + end);
+                        open[bx] = bricks->maximum(bx, y/BRICK, z/BRICK) > lowest;
+                        anyOpen = anyOpen || open[bx];
+                        if (!open[bx]){
+                            skipped[chunk] += qint64(end - begin)*std::min(BRICK, HEIGHT - y);
+                        }
+                    }
+                }
+                if (!anyOpen){
+                    continue;
+                }
+                volume.readRow(y, z, row.data());
+                for (int bx = 0; bx < COLUMNS; ++bx){
+                    if (!open[bx]){
+                        continue;
+                    }
+                    const int end = bricks ? std::min((bx + 1)*BRICK, WIDTH) : WIDTH;
+                    for (int x = bx*BRICK; x < end; ++x){
+                        if (row[x] > maximum[x]){
+                            maximum[x] = row[x];
+                            rays[x].push_back({short(y), row[x]});
+                        }
+                    }
+                }
+            }
+            for (int x = 0; x < WIDTH; ++x){
+                counts[size_t(z - firstLayer)*WIDTH + x] = int(rays[x].size());
+                breakpoints.insert(breakpoints.end(), rays[x].begin(), rays[x].end());
+                rays[x].clear();
+            }
+        }
+    });
+
+    qint64 total = 0;
+    for (const std::vector<Breakpoint>& breakpoints : chunkBreakpoints){
+        total += qint64(breakpoints.size());
+    }
+    m_geometry = geometry;
+    m_breakpoints.resize(size_t(total));
+    m_offsets.resize(size_t(qint64(WIDTH)*LAYERS + 1));
+    qint64 offset = 0;
+    size_t ray = 0;
+    for (int chunk = 0; chunk < THREADS; ++chunk){
+        std::memcpy(m_breakpoints.data() + offset, chunkBreakpoints[chunk].data(),
+                    chunkBreakpoints[chunk].size()*sizeof(Breakpoint));
+        for (int count : chunkCounts[chunk]){
+            m_offsets[ray++] = offset;
+            offset += count;
+        }
+        std::vector<Breakpoint>().swap(chunkBreakpoints[chunk]);
+    }
+    m_offsets[ray] = offset;
+    if (stats){
+        *stats = BrickPyramid::SkipStats();
+        stats->voxels = geometry.voxelCount();
+        for (qint64 count : skipped){
+            stats->skippedVoxels += count;
+        }
+    }
+}
+
+/**
+ * @brief RayMaxIndex::release frees the index
+ */
+void RayMaxIndex::release()
+{
+    std::vector<Breakpoint>().swap(m_breakpoints);
+    std::vector<qint64>().swap(m_offsets);
+    m_geometry = VolumeGeometry(0, 0, 0, 0, 0, 0);
+}
+
+/**
+ * @brief RayMaxIndex::depth finds the first voxel of a ray at or above a threshold by binary search
+ * @param x column of the ray in volume coordinates
+ * @param z layer of the ray
+ * @param threshold the HU threshold
+ * @return the y of the first voxel at or above threshold, -1 if the ray has none or the index is not built
+ */
+int RayMaxIndex::depth(int x, int z, int threshold) const
+{
+    if (!isValid() || x < 0 || x >= m_geometry.width() || z < 0 || z >= m_geometry.layers()){
+        return -1;
+    }
+    const size_t ray = size_t(z)*m_geometry.width() + x;
+    const Breakpoint* first = m_breakpoints.data() + m_offsets[ray];
+    const Breakpoint* last = m_breakpoints.data() + m_offsets[ray + 1];
+    const Breakpoint* it = std::lower_bound(first, last, threshold, [](const Breakpoint& breakpoint, int value){
+        return breakpoint.maximum < value;
+    });
+    return it == last ? -1 : it->depth;
+}
+
+/**
+ * @brief RayMaxIndex::fillDepthBuffer writes the depth map of a threshold, the same as
+ * CTDataset::calculateDepthBuffer with the volume
+ *
+ * The depth buffer has one row per layer and is mirrored in x, column 0 and rays without a voxel at or above the
+ * threshold get depth 0.
+ * @param threshold the HU threshold
+ * @param depthBuffer width x layers values
+ * @param threadCount number of threads, 0 uses all cores
+ */
+void RayMaxIndex::fillDepthBuffer(int threshold, short* depthBuffer, int threadCount) const
+{
+    if (!isValid()){
+        return;
+    }
+    const int WIDTH = m_geometry.width();
+    Parallel::forChunks(0, m_geometry.layers(), Parallel::threadCount(threadCount), [&](int firstLayer, int lastLayer, int){
+        for (int z = firstLayer; z < lastLayer; ++z){
+            short* row = depthBuffer + qint64(z)*WIDTH;
+            row[0] = 0; // column 0 would lie outside the volume
+            for (int x = 1; x < WIDTH; ++x){
+                row[x] = short(std::max(0, depth(WIDTH - x, z, threshold)));
+            }
+        }
+    });
+}
+
+int RayMaxIndex::breakpointCount(int x, int z) const
+{
+    if (!isValid()){
+        return 0;
+    }
+    const size_t ray = size_t(z)*m_geometry.width() + x;
+    return int(m_offsets[ray + 1] - m_offsets[ray]);
+}
+
+qint64 RayMaxIndex::memoryUsage() const
+{
+    return qint64(m_breakpoints.capacity()*sizeof(Breakpoint) + m_offsets.capacity()*sizeof(qint64));
+}
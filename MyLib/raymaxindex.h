@@ -0,0 +1,60 @@
+#ifndef RAYMAXINDEX_H
+#define RAYMAXINDEX_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include "volumeview.h"
+#include "brickpyramid.h"
+#include <vector>
+
+/**
+ * @brief Running maxima along the rays of the depth buffer, for depth maps at any threshold without reading the volume
+ *
+ * The rays of CTDataset::calculateDepthBuffer run along y, one ray per column x and layer z. Along a ray the running
+ * maximum of the HU values only grows, so it is stored as the list of breakpoints where it grows: (depth, new maximum).
+ * The first depth with a value at or above a threshold is the first breakpoint whose maximum reaches the threshold, found
+ * by binary search over the few breakpoints of the ray.
+ *
+ * The index is built once per volume in a single pass in memory order. Given the bricks of the volume, bricks whose
+ * maximum can't raise the running maximum of any of their columns are skipped.
+ */
+class MYLIB_EXPORT RayMaxIndex
+{
+public:
+    /// A point where the running maximum of a ray grows
+    struct Breakpoint {
+        short depth;
+        short maximum;
+    };
+
+    RayMaxIndex();
+
+    /// Builds the index of a volume, threadCount 0 uses all cores, stats receives the skipped voxels
+    void build(const VolumeView& volume, int threadCount = 0, const BrickPyramid* bricks = nullptr,
+               BrickPyramid::SkipStats* stats = nullptr);
+    /// Frees the index
+    void release();
+    /// Returns true if the index has been built
+    bool isValid() const { return !m_offsets.empty(); }
+    const VolumeGeometry& geometry() const { return m_geometry; }
+
+    /// First depth along the ray of column x in layer z with a value at or above threshold, -1 if there is none
+    int depth(int x, int z, int threshold) const;
+    /// Fills a depth buffer (width x layers) in the layout of CTDataset::calculateDepthBuffer
+    void fillDepthBuffer(int threshold, short* depthBuffer, int threadCount = 0) const;
+
+    /// Number of breakpoints of the ray of column x in layer z
+    int breakpointCount(int x, int z) const;
+    /// Number of breakpoints of all rays
+    qint64 breakpointCount() const { return qint64(m_breakpoints.size()); }
+    /// Bytes currently allocated
+    qint64 memoryUsage() const;
+
+private:
+    VolumeGeometry m_geometry;
+    /// Breakpoints of all rays, ray z*width + x starts at m_offsets[z*width + x]
+    std::vector<Breakpoint> m_breakpoints;
+    std::vector<qint64> m_offsets;
+};
+
+#endif // RAYMAXINDEX_H
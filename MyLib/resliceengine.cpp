@@ -0,0 +1,819 @@
+#include "resliceengine.h"
+#include "parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESLICEENGINE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/// Rounding of a sum of weighted values
+const qint32 ROUND = 1 << (ResliceEngine::WeightBits - 1);
+/// The weights of the Catmull-Rom spline are tabulated for 1 << SPLINE_BITS fractions of a voxel
+const int SPLINE_BITS = 10;
+
+/// Weights of the neighbours -1, 0, 1 and 2 of the Catmull-Rom spline, each row sums up to 1 << WeightBits
+struct SplineTable {
+    qint32 weights[1 << SPLINE_BITS][4];
+
+    SplineTable(){
+        const double ONE = 1 << ResliceEngine::WeightBits;
+        for (int i = 0; i < (1 << SPLINE_BITS); ++i){
+            const double t = double(i)/(1 << SPLINE_BITS);
+            const double w[4] = {(-t + 2*t*t - t*t*t)/2, (2 - 5*t*t + 3*t*t*t)/2, (t + 4*t*t - 3*t*t*t)/2, (-t*t + t*t*t)/2};
+            qint32 sum = 0;
+            for (int k = 0; k < 4; ++k){
+                weights[i][k] = qint32(std::lround(w[k]*ONE));
+                sum += weights[i][k];
+            }
+            // the rounding error goes to the largest weight, so constant regions stay constant
+            weights[i][t < 0.5 ? 1 : 2] += qint32(ONE) - sum;
+        }
+    }
+};
+
+const SplineTable& splineTable()
+{
+    static const SplineTable table;
+    return table;
+}
+
+/**
+ * @brief combine weights the neighbours of the pixels of a block along the axes from firstAxis on, z last
+ *
+ * Each axis sums up groups of TAPS rows of values, row t of a group weighted with row t of the weights of the axis.
+ * Group g is written to row g, the rows of later groups are not overwritten before they are read. The result is left
+ * in the first row.
+ * @param values TAPS^(3 - firstAxis) rows of Block values, z-major
+ * @param weights TAPS rows of Block weights for x, y and z
+ * @param firstAxis 0 if the neighbours are not combined yet, 1 if they are combined along x already
+ */
+template <int TAPS>
+void combine(qint32* values, const qint32 (*weights)[4*ResliceEngine::Block], int firstAxis)
+{
+    const int BLOCK = ResliceEngine::Block;
+    int groups = firstAxis == 0 ? TAPS*TAPS : TAPS;
+    for (int k = firstAxis; k < 3; ++k, groups /= TAPS){
+        for (int g = 0; g < groups; ++g){
+            for (int i = 0; i < BLOCK; ++i){
+                qint32 sum = ROUND;
+                for (int t = 0; t < TAPS; ++t){
+                    sum += values[(g*TAPS + t)*BLOCK + i]*weights[k][t*BLOCK + i];
+                }
+                values[g*BLOCK + i] = sum >> ResliceEngine::WeightBits;
+            }
+        }
+    }
+}
+
+#ifdef RESLICEENGINE_AVX2
+/**
+ * @brief combineAvx2 is combine() with the 8 pixels of a block in one register
+ */
+template <int TAPS>
+__attribute__((target("avx2")))
+void combineAvx2(qint32* values, const qint32 (*weights)[4*ResliceEngine::Block], int firstAxis)
+{
+    static_assert(ResliceEngine::Block == 8, "a block has to fill one AVX2 register");
+    const __m256i round = _mm256_set1_epi32(ROUND);
+    int groups = firstAxis == 0 ? TAPS*TAPS : TAPS;
+    for (int k = firstAxis; k < 3; ++k, groups /= TAPS){
+        __m256i weight[TAPS];
+        for (int t = 0; t < TAPS; ++t){
+            weight[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights[k] + t*8));
+        }
+        for (int g = 0; g < groups; ++g){
+            __m256i sum = round;
+            for (int t = 0; t < TAPS; ++t){
+                const __m256i value = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + (g*TAPS + t)*8));
+                sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(value, weight[t]));
+            }
+            _mm256_store_si256(reinterpret_cast<__m256i*>(values + g*8), _mm256_srai_epi32(sum, ResliceEngine::WeightBits));
+        }
+    }
+}
+
+/**
+ * @brief gatherAvx2 loads the neighbours of the 8 pixels of a block and combines them along x
+ *
+ * The neighbours x and x + 1 are next to each other in memory (strideX is 1 or -1), so one 32 bit gather reads both
+ * and never reads outside the volume. Both 16 bit halves are multiplied with their weights and added up by one
+ * _mm256_madd_epi16, 16 products per instruction.
+ * @param origin voxel (0, 0, 0)
+ * @param first offsets of the first neighbour of the 8 pixels
+ * @param rows offsets of the TAPS^2 rows of neighbours along x relative to the first neighbour, z-major
+ * @param strideX 1 or -1
+ * @param pairWeights TAPS/2 rows of 8 pairs of 16 bit weights along x, in the order of the voxels in memory
+ * @param values receives TAPS^2 rows of 8 values combined along x
+ */
+template <int TAPS>
+__attribute__((target("avx2")))
+void gatherAvx2(const short* origin, const qint32* first, const qint32* rows, qint64 strideX, const qint32* pairWeights,
+                qint32* values)
+{
+    const __m256i firstOffsets = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    const __m256i round = _mm256_set1_epi32(ROUND);
+    __m256i weights[TAPS/2];
+    for (int pair = 0; pair < TAPS/2; ++pair){
+        weights[pair] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairWeights + pair*8));
+    }
+    // with strideX -1 a pair starts at neighbour x + 1
+    const int pairStart = strideX > 0 ? 0 : -1;
+    for (int row = 0; row < TAPS*TAPS; ++row){
+        __m256i sum = round;
+        for (int pair = 0; pair < TAPS/2; ++pair){
+            const __m256i index = _mm256_add_epi32(firstOffsets, _mm256_set1_epi32(rows[row] + 2*pair*int(strideX) + pairStart));
+            const __m256i voxels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(origin), index, 2);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(voxels, weights[pair]));
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values + row*8), _mm256_srai_epi32(sum, ResliceEngine::WeightBits));
+    }
+}
+
+/**
+ * @brief gatherBricksAvx2 loads the neighbours of the 8 pixels of a block whose offsets add up along the axes
+ *
+ * Used for bricks, where the neighbours x and x + 1 may lie in different bricks. Each 32 bit gather reads a voxel and
+ * the one behind it in memory, the lower half is kept. The voxels of BrickedVolume end with one voxel of padding, so
+ * this never reads outside.
+ * @param origin voxel (0, 0, 0)
+ * @param offsets offsets of the TAPS neighbours of the 8 pixels along x, y and z
+ * @param values receives TAPS^3 rows of 8 values, z-major
+ */
+template <int TAPS>
+__attribute__((target("avx2")))
+void gatherBricksAvx2(const short* origin, const qint32 (*offsets)[TAPS][ResliceEngine::Block], qint32* values)
+{
+    for (int z = 0; z < TAPS; ++z){
+        const __m256i layer = _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets[2][z]));
+        for (int y = 0; y < TAPS; ++y){
+            const __m256i row = _mm256_add_epi32(layer, _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets[1][y])));
+            for (int x = 0; x < TAPS; ++x){
+                const __m256i index = _mm256_add_epi32(row, _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets[0][x])));
+                const __m256i voxels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(origin), index, 2);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(values + ((z*TAPS + y)*TAPS + x)*8),
+                                   _mm256_srai_epi32(_mm256_slli_epi32(voxels, 16), 16));
+            }
+        }
+    }
+}
+
+bool hasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+/**
+ * @brief interpolate interpolates the columns of a row block by block from its TAPS^3 neighbours
+ * @param volume the volume
+ * @param position fixed point position of the first column, rounded down to the voxel at or before it
+ * @param step fixed point step from one column to the next
+ * @param count number of columns
+ * @param out receives count values
+ */
+template <int TAPS>
+void interpolate(const VolumeView& volume, const qint64 position[3], const qint64 step[3], int count, short* out)
+{
+    const int BLOCK = ResliceEngine::Block;
+    const int FRACTION_BITS = ResliceEngine::FractionBits;
+    const int WEIGHT_BITS = ResliceEngine::WeightBits;
+    const qint32 FRACTION_MASK = (1 << WEIGHT_BITS) - 1;
+    // the neighbours start at the voxel at or before the position for Trilinear, one before it for CatmullRom
+    const int FROM = TAPS == 2 ? 0 : -1;
+    const VolumeGeometry& geometry = volume.geometry();
+    const qint64 size[3] = {geometry.width(), geometry.height(), geometry.layers()};
+    // bricks are read with the strides inside a brick when all neighbours of a block lie in the same brick
+    const bool strided = volume.isStrided();
+    const BrickedVoxels bricks = volume.brickedVoxels();
+    const int SHIFT = volume.brickShift();
+    const qint64 MASK = (qint64(1) << SHIFT) - 1;
+    const qint64 brickStride[3] = {bricks.brickOffset(1, 0, 0), bricks.brickOffset(0, 1, 0), bricks.brickOffset(0, 0, 1)};
+    const qint64 stride[3] = {strided ? volume.strideX() : 1, strided ? volume.strideY() : qint64(1) << SHIFT,
+                              strided ? volume.strideZ() : qint64(1) << (2*SHIFT)};
+    const short* origin = volume.pointer(0, 0, 0);
+    const SplineTable& spline = splineTable();
+
+    // offsets of the neighbours relative to the first one, z-major like values
+    qint64 neighbours[TAPS*TAPS*TAPS];
+    qint32 rows[TAPS*TAPS];
+    for (int z = 0; z < TAPS; ++z){
+        for (int y = 0; y < TAPS; ++y){
+            rows[z*TAPS + y] = qint32(y*stride[1] + z*stride[2]);
+            for (int x = 0; x < TAPS; ++x){
+                neighbours[(z*TAPS + y)*TAPS + x] = x*stride[0] + y*stride[1] + z*stride[2];
+            }
+        }
+    }
+    bool avx2 = false;
+    bool gather = false;
+#ifdef RESLICEENGINE_AVX2
+    // gatherAvx2() needs 32 bit offsets and the neighbours along x next to each other in memory
+    avx2 = hasAvx2();
+    const qint64 storedVoxels = strided ? geometry.voxelCount()
+                                        : bricks.brickOffset(0, 0, (geometry.layers() + (1 << SHIFT) - 1) >> SHIFT);
+    gather = avx2 && (stride[0] == 1 || stride[0] == -1) && storedVoxels < (qint64(1) << 30);
+#endif
+
+    alignas(32) qint32 values[TAPS*TAPS*TAPS*BLOCK];
+    alignas(32) qint32 weights[3][4*BLOCK];
+    qint64 bases[3][BLOCK];
+    for (int column = 0; column < count; column += BLOCK){
+        // the lanes behind the end of the row continue it, they are computed but not written
+        for (int k = 0; k < 3; ++k){
+            qint64 p = position[k] + column*step[k];
+            for (int i = 0; i < BLOCK; ++i, p += step[k]){
+                const qint32 fraction = qint32(p >> (FRACTION_BITS - WEIGHT_BITS)) & FRACTION_MASK;
+                bases[k][i] = (p >> FRACTION_BITS) + FROM;
+                if (TAPS == 2){
+                    weights[k][i] = (1 << WEIGHT_BITS) - fraction;
+                    weights[k][BLOCK + i] = fraction;
+                } else {
+                    const qint32* w = spline.weights[fraction >> (WEIGHT_BITS - SPLINE_BITS)];
+                    for (int t = 0; t < TAPS; ++t){
+                        weights[k][t*BLOCK + i] = w[t];
+                    }
+                }
+            }
+        }
+
+        // the positions are linear in the lane, so the first and the last lane bound the neighbours of the block
+        int firstAxis = 0;
+        bool inside = true;
+        bool oneBrick = !strided;
+        qint64 low[3];
+        for (int k = 0; k < 3; ++k){
+            low[k] = std::min(bases[k][0], bases[k][BLOCK - 1]);
+            const qint64 high = std::max(bases[k][0], bases[k][BLOCK - 1]) + TAPS - 1;
+            inside = inside && low[k] >= 0 && high < size[k];
+            oneBrick = oneBrick && (low[k] >> SHIFT) == (high >> SHIFT);
+        }
+        if (inside && (strided || oneBrick)){
+            qint64 first[BLOCK];
+            // inside one brick the voxels lie like in a volume of the size of a brick starting at the brick's origin
+            const qint64 brick = strided ? 0 : bricks.brickOffset(int(low[0] >> SHIFT), int(low[1] >> SHIFT), int(low[2] >> SHIFT))
+                                               - (low[0] >> SHIFT << SHIFT)*stride[0] - (low[1] >> SHIFT << SHIFT)*stride[1]
+                                               - (low[2] >> SHIFT << SHIFT)*stride[2];
+            for (int i = 0; i < BLOCK; ++i){
+                first[i] = brick + bases[0][i]*stride[0] + bases[1][i]*stride[1] + bases[2][i]*stride[2];
+            }
+#ifdef RESLICEENGINE_AVX2
+            if (gather){
+                qint32 firstOffsets[BLOCK];
+                qint32 pairWeights[TAPS/2*BLOCK];
+                std::copy(first, first + BLOCK, firstOffsets);
+                for (int pair = 0; pair < TAPS/2; ++pair){
+                    for (int i = 0; i < BLOCK; ++i){
+                        const qint32 lower = weights[0][(stride[0] > 0 ? 2*pair : 2*pair + 1)*BLOCK + i];
+                        const qint32 upper = weights[0][(stride[0] > 0 ? 2*pair + 1 : 2*pair)*BLOCK + i];
+                        pairWeights[pair*BLOCK + i] = qint32(quint32(lower) & 0xffff) | qint32(quint32(upper) << 16);
+                    }
+                }
+                gatherAvx2<TAPS>(origin, firstOffsets, rows, stride[0], pairWeights, values);
+                firstAxis = 1;
+            }
+#endif
+            if (!gather){
+                for (int i = 0; i < BLOCK; ++i){
+                    for (int n = 0; n < TAPS*TAPS*TAPS; ++n){
+                        values[n*BLOCK + i] = origin[first[i] + neighbours[n]];
+                    }
+                }
+            }
+#ifdef RESLICEENGINE_AVX2
+        } else if (gather && !strided){
+            // the offsets of the bricks add up along the axes, near the border the neighbours outside are replaced by
+            // the nearest ones inside
+            alignas(32) qint32 offsets[3][TAPS][BLOCK];
+            for (int k = 0; k < 3; ++k){
+                for (int t = 0; t < TAPS; ++t){
+                    for (int i = 0; i < BLOCK; ++i){
+                        const qint64 index = inside ? bases[k][i] + t : std::min(std::max(bases[k][i] + t, qint64(0)), size[k] - 1);
+                        offsets[k][t][i] = qint32((index >> SHIFT)*brickStride[k] + ((index & MASK) << (k*SHIFT)));
+                    }
+                }
+            }
+            gatherBricksAvx2<TAPS>(origin, offsets, values);
+#endif
+        } else {
+            // the offsets along each axis add up, near the border the neighbours outside are replaced by the nearest
+            // ones inside
+            qint64 offsets[3][TAPS][BLOCK];
+            for (int k = 0; k < 3; ++k){
+                for (int t = 0; t < TAPS; ++t){
+                    for (int i = 0; i < BLOCK; ++i){
+                        const qint64 index = inside ? bases[k][i] + t : std::min(std::max(bases[k][i] + t, qint64(0)), size[k] - 1);
+                        offsets[k][t][i] = strided ? index*stride[k] : (index >> SHIFT)*brickStride[k] + ((index & MASK) << (k*SHIFT));
+                    }
+                }
+            }
+            for (int z = 0; z < TAPS; ++z){
+                for (int y = 0; y < TAPS; ++y){
+                    for (int x = 0; x < TAPS; ++x){
+                        qint32* row = values + ((z*TAPS + y)*TAPS + x)*BLOCK;
+                        for (int i = 0; i < BLOCK; ++i){
+                            row[i] = origin[offsets[0][x][i] + offsets[1][y][i] + offsets[2][z][i]];
+                        }
+                    }
+                }
+            }
+        }
+
+#ifdef RESLICEENGINE_AVX2
+        if (avx2){
+            combineAvx2<TAPS>(values, weights, firstAxis);
+        }
+#endif
+        if (!avx2){
+            combine<TAPS>(values, weights, firstAxis);
+        }
+        for (int i = 0; i < std::min(BLOCK, count - column); ++i){
+            out[column + i] = short(std::min(std::max(values[i], qint32(SHRT_MIN)), qint32(SHRT_MAX)));
+        }
+    }
+}
+
+/// Rounds a quotient towards minus infinity, divisor != 0
+qint64 floorDiv(qint64 dividend, qint64 divisor)
+{
+    const qint64 quotient = dividend/divisor;
+    return quotient*divisor != dividend && (dividend < 0) != (divisor < 0) ? quotient - 1 : quotient;
+}
+
+/**
+ * @brief clipFixed finds the columns whose fixed point positions lie inside the volume
+ * @param size width, height and layers of the volume
+ * @param position fixed point position of column 0, including the 0.5 of the rounding to the nearest voxel
+ * @param step fixed point step from one column to the next
+ * @param columns number of columns
+ * @param first receives the first column inside
+ * @param last receives the column after the last one inside, first == last if none
+ */
+void clipFixed(const int size[3], const qint64 position[3], const qint64 step[3], int columns, int& first, int& last)
+{
+    qint64 low = 0;
+    qint64 high = columns;
+    for (int k = 0; k < 3; ++k){
+        // 0 <= position + column*step <= end
+        const qint64 end = (qint64(size[k]) << ResliceEngine::FractionBits) - 1;
+        if (step[k] == 0){
+            if (position[k] < 0 || position[k] > end){
+                high = low;
+            }
+        } else if (step[k] > 0){
+            low = std::max(low, -floorDiv(position[k], step[k]));
+            high = std::min(high, floorDiv(end - position[k], step[k]) + 1);
+        } else {
+            low = std::max(low, -floorDiv(end - position[k], -step[k]));
+            high = std::min(high, floorDiv(position[k], -step[k]) + 1);
+        }
+    }
+    first = int(std::min(std::max(low, qint64(0)), qint64(columns)));
+    last = int(std::max(qint64(first), high));
+}
+
+/// Folds of the samples of a slab pixel
+struct MaximumFold {
+    static qint32 initial() { return INT_MIN; }
+    qint32 operator()(qint32 value, qint32 sample) const { return std::max(value, sample); }
+};
+
+struct MinimumFold {
+    static qint32 initial() { return INT_MAX; }
+    qint32 operator()(qint32 value, qint32 sample) const { return std::min(value, sample); }
+};
+
+struct SumFold {
+    static qint32 initial() { return 0; }
+    qint32 operator()(qint32 value, qint32 sample) const { return value + sample; }
+};
+
+/// Value of a slab pixel from its folded samples
+short project(qint32 value, qint32 count, ResliceEngine::SlabProjection projection)
+{
+    if (count == 0){
+        return short(ResliceEngine::Background);
+    }
+    if (projection == ResliceEngine::MeanIntensity){
+        return short(value >= 0 ? (value + count/2)/count : -((-value + count/2)/count));
+    }
+    return short(value);
+}
+
+/**
+ * @brief projectNearest walks the columns of a slab row once, each pixel steps through its planes and folds the
+ * nearest voxels in a register
+ *
+ * Columns in [allFirst, allLast) lie inside the volume in every plane and are walked without any check, the others
+ * check the columns inside of each plane.
+ * @param origin voxel (0, 0, 0)
+ * @param offset offset of the voxel at a fixed point position
+ * @param fold folds a sample into the value of the pixel
+ * @param position fixed point position of column 0 of plane 0
+ * @param step fixed point step from one column to the next
+ * @param planeSteps fixed point steps from each plane to the next, 3 per plane
+ * @param planes number of planes
+ * @param planeColumns first and last column inside of every plane
+ * @param first first column inside in any plane
+ * @param last column after the last one inside in any plane
+ * @param projection how the folded samples become the pixel
+ * @param out the row
+ */
+template <typename Offset, typename Fold>
+void projectNearest(const short* origin, Offset offset, Fold fold, const qint64 position[3], const qint64 step[3],
+                    const qint64* planeSteps, int planes, const int* planeColumns, int first, int last, int allFirst,
+                    int allLast, ResliceEngine::SlabProjection projection, short* out)
+{
+    for (int column = first; column < last; ++column){
+        qint64 x = position[0] + column*step[0];
+        qint64 y = position[1] + column*step[1];
+        qint64 z = position[2] + column*step[2];
+        qint32 value = Fold::initial();
+        qint32 count = planes;
+        if (column >= allFirst && column < allLast){
+            for (int plane = 0; plane < planes; ++plane){
+                value = fold(value, origin[offset(x, y, z)]);
+                x += planeSteps[3*plane];
+                y += planeSteps[3*plane + 1];
+                z += planeSteps[3*plane + 2];
+            }
+        } else {
+            count = 0;
+            for (int plane = 0; plane < planes; ++plane){
+                if (column >= planeColumns[2*plane] && column < planeColumns[2*plane + 1]){
+                    value = fold(value, origin[offset(x, y, z)]);
+                    ++count;
+                }
+                x += planeSteps[3*plane];
+                y += planeSteps[3*plane + 1];
+                z += planeSteps[3*plane + 2];
+            }
+        }
+        out[column] = project(value, count, projection);
+    }
+}
+
+}
+
+ResliceEngine::ResliceEngine()
+    : m_origin(0, 0, 0), m_columnStep(1, 0, 0), m_rowStep(0, 1, 0), m_interpolation(Nearest), m_slabPlanes(1),
+      m_planeStep(0, 0, 1), m_slabProjection(MaximumIntensity)
+{
+}
+
+/**
+ * @brief ResliceEngine::setPlane sets the plane to sample, a voxel (x, y, z) covers [x - 0.5, x + 0.5) along x etc.
+ * @param origin voxel coordinates of pixel (0, 0)
+ * @param columnStep step from one column to the next in voxels
+ * @param rowStep step from one row to the next in voxels
+ */
+void ResliceEngine::setPlane(const Eigen::Vector3d& origin, const Eigen::Vector3d& columnStep, const Eigen::Vector3d& rowStep)
+{
+    m_origin = origin;
+    m_columnStep = columnStep;
+    m_rowStep = rowStep;
+}
+
+/**
+ * @brief ResliceEngine::setSlab projects a slab of parallel planes instead of sampling a single plane
+ *
+ * Plane i is the plane moved by (i - (planes - 1)/2)*planeStep, so the slab is centered on the plane.
+ * @param planes number of planes, limited to [1, MaxSlabPlanes]
+ * @param planeStep step from one plane to the next in voxels, usually along the normal of the plane
+ * @param projection how the samples of a pixel are combined
+ */
+void ResliceEngine::setSlab(int planes, const Eigen::Vector3d& planeStep, SlabProjection projection)
+{
+    m_slabPlanes = std::min(std::max(planes, 1), int(MaxSlabPlanes));
+    m_planeStep = planeStep;
+    m_slabProjection = projection;
+}
+
+/**
+ * @brief ResliceEngine::clipRow finds the columns of a row whose samples lie inside the volume
+ *
+ * Column c samples the fixed point position of column 0 plus c fixed point column steps. The columns inside follow
+ * from these positions exactly in integers, so the range always agrees with the samples.
+ * @param row the row
+ * @param columns number of columns of the image
+ * @param first receives the first column inside
+ * @param last receives the column after the last one inside
+ */
+void ResliceEngine::clipRow(int row, int columns, int& first, int& last) const
+{
+    qint64 position[3];
+    qint64 step[3];
+    clipRow(row, columns, first, last, position, step);
+}
+
+/**
+ * @brief ResliceEngine::clipRow finds the columns of a row inside the volume and the fixed point position of the first
+ * @param position receives the fixed point position of column first, the voxel index is position >> FractionBits
+ * @param step receives the fixed point step from one column to the next
+ */
+void ResliceEngine::clipRow(int row, int columns, int& first, int& last, qint64 position[3], qint64 step[3]) const
+{
+    clipRow(m_origin + row*m_rowStep, columns, first, last, position, step);
+}
+
+/**
+ * @brief ResliceEngine::clipRow clips the row starting at start, e.g. a row of another plane of a slab
+ */
+void ResliceEngine::clipRow(const Eigen::Vector3d& start, int columns, int& first, int& last, qint64 position[3],
+                            qint64 step[3]) const
+{
+    first = 0;
+    last = 0;
+    if (!toFixed(start, columns, position, step)){
+        return;
+    }
+    const VolumeGeometry& geometry = m_volume.geometry();
+    const int size[3] = {geometry.width(), geometry.height(), geometry.layers()};
+    clipFixed(size, position, step, columns, first, last);
+    for (int k = 0; k < 3; ++k){
+        position[k] += first*step[k];
+    }
+}
+
+/**
+ * @brief ResliceEngine::toFixed converts the start of a row and the column step to fixed point
+ *
+ * Rows reaching beyond 2^24 voxels would overflow the fixed point sums, they lie far outside any volume anyway.
+ * @param start voxel coordinates of column 0
+ * @param columns number of columns
+ * @param position receives the fixed point position of column 0, including the 0.5 of the rounding to the nearest voxel
+ * @param step receives the fixed point step from one column to the next
+ * @return false if the row can't be walked in fixed point
+ */
+bool ResliceEngine::toFixed(const Eigen::Vector3d& start, int columns, qint64 position[3], qint64 step[3]) const
+{
+    const double LIMIT = double(1 << 24);
+    const double reach = start.cwiseAbs().maxCoeff() + double(columns)*m_columnStep.cwiseAbs().maxCoeff();
+    if (!(reach < LIMIT)){
+        return false;
+    }
+    const double ONE = double(qint64(1) << FractionBits);
+    for (int k = 0; k < 3; ++k){
+        position[k] = std::llround((start[k] + 0.5)*ONE);
+        step[k] = std::llround(m_columnStep[k]*ONE);
+    }
+    return true;
+}
+
+/**
+ * @brief ResliceEngine::resliceRow samples one row, the columns outside the volume get Background
+ */
+void ResliceEngine::resliceRow(int row, int columns, short* out) const
+{
+    int first;
+    int last;
+    qint64 position[3];
+    qint64 step[3];
+    clipRow(row, columns, first, last, position, step);
+    std::fill(out, out + first, Background);
+    std::fill(out + last, out + columns, Background);
+    if (first < last){
+        sampleRow(first, last, position, step, out);
+    }
+}
+
+/**
+ * @brief ResliceEngine::sampleRow samples the columns [first, last) of a clipped row
+ * @param first first column
+ * @param last column after the last one
+ * @param position fixed point position of column first, see clipRow()
+ * @param step fixed point step from one column to the next
+ * @param out the row
+ */
+void ResliceEngine::sampleRow(int first, int last, const qint64 position[3], const qint64 step[3], short* out) const
+{
+    if (m_interpolation != Nearest){
+        interpolateRow(first, last, position, step, out);
+        return;
+    }
+
+    qint64 x = position[0];
+    qint64 y = position[1];
+    qint64 z = position[2];
+    const qint64 stepX = step[0];
+    const qint64 stepY = step[1];
+    const qint64 stepZ = step[2];
+    const short* origin = m_volume.pointer(0, 0, 0);
+    if (!m_volume.isStrided()){
+        // inside a brick the voxels lie like in a volume of the size of a brick, only its origin changes from brick to brick
+        const BrickedVoxels bricks = m_volume.brickedVoxels();
+        const int SHIFT = m_volume.brickShift();
+        const int BITS = FractionBits + SHIFT;
+        int column = first;
+        while (column < last){
+            const int voxel[3] = {int(x >> FractionBits), int(y >> FractionBits), int(z >> FractionBits)};
+            const qint64 brick = bricks.offset(voxel[0], voxel[1], voxel[2]) - voxel[0] - (qint64(voxel[1]) << SHIFT)
+                                 - (qint64(voxel[2]) << (2*SHIFT));
+            const qint64 startX = x;
+            const qint64 startY = y;
+            const qint64 startZ = z;
+            do {
+                out[column] = origin[brick + (x >> FractionBits) + ((y >> FractionBits) << SHIFT) + ((z >> FractionBits) << (2*SHIFT))];
+                x += stepX;
+                y += stepY;
+                z += stepZ;
+            } while (++column < last && (((x ^ startX) | (y ^ startY) | (z ^ startZ)) >> BITS) == 0);
+        }
+        return;
+    }
+    const qint64 strideX = m_volume.strideX();
+    const qint64 strideY = m_volume.strideY();
+    const qint64 strideZ = m_volume.strideZ();
+    for (int column = first; column < last; ++column){
+        out[column] = origin[(x >> FractionBits)*strideX + (y >> FractionBits)*strideY + (z >> FractionBits)*strideZ];
+        x += stepX;
+        y += stepY;
+        z += stepZ;
+    }
+}
+
+/**
+ * @brief ResliceEngine::slabRow projects one row of all planes of the slab
+ *
+ * The row is clipped once: the start of each plane is converted to fixed point like a row of a single plane, the
+ * columns inside of every plane follow in integers and the planes are the exact fixed point differences of their
+ * starts apart. Nearest pixels are projected in a single pass over the columns, each pixel steps from plane to plane.
+ * Interpolated planes are sampled one after another into samples and folded into the accumulator, so the voxels read
+ * for one plane are still cached for the next one.
+ * @param row the row
+ * @param columns number of columns
+ * @param out the row of the image, Background where no plane lies inside the volume
+ * @param accumulator buffer of columns values
+ * @param counts buffer of columns values
+ * @param samples buffer of columns values
+ * @param planeColumns buffer of 2*slabPlanes() values
+ * @param planePositions buffer of 3*slabPlanes() values
+ */
+void ResliceEngine::slabRow(int row, int columns, short* out, qint32* accumulator, quint16* counts, short* samples,
+                            int* planeColumns, qint64* planePositions) const
+{
+    const VolumeGeometry& geometry = m_volume.geometry();
+    const int size[3] = {geometry.width(), geometry.height(), geometry.layers()};
+    const int PLANES = m_slabPlanes;
+    qint64 step[3] = {0, 0, 0};
+    // columns inside any plane and inside all planes
+    int first = columns;
+    int last = 0;
+    int allFirst = 0;
+    int allLast = columns;
+    bool walkable = true;
+    for (int plane = 0; plane < PLANES; ++plane){
+        // the same start as a plane resliced on its own, see setSlab()
+        const Eigen::Vector3d planeOrigin = m_origin + (plane - (PLANES - 1)/2.0)*m_planeStep;
+        qint64* position = planePositions + 3*plane;
+        int* range = planeColumns + 2*plane;
+        range[0] = 0;
+        range[1] = 0;
+        if (toFixed(planeOrigin + row*m_rowStep, columns, position, step)){
+            clipFixed(size, position, step, columns, range[0], range[1]);
+        } else {
+            walkable = false;
+        }
+        if (range[0] < range[1]){
+            first = std::min(first, range[0]);
+            last = std::max(last, range[1]);
+        }
+        allFirst = std::max(allFirst, range[0]);
+        allLast = std::min(allLast, range[1]);
+    }
+    first = std::min(first, last);
+    allLast = std::max(allFirst, allLast);
+    std::fill(out, out + first, Background);
+    std::fill(out + last, out + columns, Background);
+    if (first == last){
+        return;
+    }
+
+    if (m_interpolation == Nearest && walkable){
+        // planePositions becomes the steps from each plane to the next
+        qint64 position[3] = {planePositions[0], planePositions[1], planePositions[2]};
+        for (int plane = 0; plane + 1 < PLANES; ++plane){
+            for (int k = 0; k < 3; ++k){
+                planePositions[3*plane + k] = planePositions[3*(plane + 1) + k] - planePositions[3*plane + k];
+            }
+        }
+        const short* origin = m_volume.pointer(0, 0, 0);
+        if (m_volume.isStrided()){
+            const qint64 strideX = m_volume.strideX();
+            const qint64 strideY = m_volume.strideY();
+            const qint64 strideZ = m_volume.strideZ();
+            auto offset = [=](qint64 x, qint64 y, qint64 z){
+                return (x >> FractionBits)*strideX + (y >> FractionBits)*strideY + (z >> FractionBits)*strideZ;
+            };
+            if (m_slabProjection == MaximumIntensity){
+                projectNearest(origin, offset, MaximumFold(), position, step, planePositions, PLANES, planeColumns,
+                               first, last, allFirst, allLast, m_slabProjection, out);
+            } else if (m_slabProjection == MinimumIntensity){
+                projectNearest(origin, offset, MinimumFold(), position, step, planePositions, PLANES, planeColumns,
+                               first, last, allFirst, allLast, m_slabProjection, out);
+            } else {
+                projectNearest(origin, offset, SumFold(), position, step, planePositions, PLANES, planeColumns,
+                               first, last, allFirst, allLast, m_slabProjection, out);
+            }
+            return;
+        }
+        const BrickedVoxels bricks = m_volume.brickedVoxels();
+        auto offset = [=](qint64 x, qint64 y, qint64 z){
+            return bricks.offset(int(x >> FractionBits), int(y >> FractionBits), int(z >> FractionBits));
+        };
+        if (m_slabProjection == MaximumIntensity){
+            projectNearest(origin, offset, MaximumFold(), position, step, planePositions, PLANES, planeColumns,
+                           first, last, allFirst, allLast, m_slabProjection, out);
+        } else if (m_slabProjection == MinimumIntensity){
+            projectNearest(origin, offset, MinimumFold(), position, step, planePositions, PLANES, planeColumns,
+                           first, last, allFirst, allLast, m_slabProjection, out);
+        } else {
+            projectNearest(origin, offset, SumFold(), position, step, planePositions, PLANES, planeColumns,
+                           first, last, allFirst, allLast, m_slabProjection, out);
+        }
+        return;
+    }
+
+    const qint32 INITIAL = m_slabProjection == MaximumIntensity ? MaximumFold::initial()
+                         : m_slabProjection == MinimumIntensity ? MinimumFold::initial() : SumFold::initial();
+    std::fill(accumulator + first, accumulator + last, INITIAL);
+    std::fill(counts + first, counts + last, quint16(0));
+    for (int plane = 0; plane < PLANES; ++plane){
+        const int planeFirst = planeColumns[2*plane];
+        const int planeLast = planeColumns[2*plane + 1];
+        if (planeFirst == planeLast){
+            continue;
+        }
+        const qint64* start = planePositions + 3*plane;
+        const qint64 position[3] = {start[0] + planeFirst*step[0], start[1] + planeFirst*step[1],
+                                    start[2] + planeFirst*step[2]};
+        sampleRow(planeFirst, planeLast, position, step, samples);
+        if (m_slabProjection == MaximumIntensity){
+            for (int column = planeFirst; column < planeLast; ++column){
+                accumulator[column] = std::max(accumulator[column], qint32(samples[column]));
+            }
+        } else if (m_slabProjection == MinimumIntensity){
+            for (int column = planeFirst; column < planeLast; ++column){
+                accumulator[column] = std::min(accumulator[column], qint32(samples[column]));
+            }
+        } else {
+            for (int column = planeFirst; column < planeLast; ++column){
+                accumulator[column] += samples[column];
+            }
+        }
+        for (int column = planeFirst; column < planeLast; ++column){
+            ++counts[column];
+        }
+    }
+    for (int column = first; column < last; ++column){
+        out[column] = project(accumulator[column], counts[column], m_slabProjection);
+    }
+}
+
+/**
+ * @brief ResliceEngine::interpolateRow interpolates the columns [first, last) of a row
+ * @param first first column
+ * @param last column after the last one
+ * @param position fixed point position of column first, including the 0.5 of the rounding to the nearest voxel
+ * @param step fixed point step from one column to the next
+ * @param out the row
+ */
+void ResliceEngine::interpolateRow(int first, int last, const qint64 position[3], const qint64 step[3], short* out) const
+{
+    // without the 0.5 the integer part is the voxel at or before the position and the fraction the weight of the next
+    const qint64 HALF = qint64(1) << (FractionBits - 1);
+    const qint64 start[3] = {position[0] - HALF, position[1] - HALF, position[2] - HALF};
+    if (m_interpolation == Trilinear){
+        interpolate<2>(m_volume, start, step, last - first, out + first);
+    } else {
+        interpolate<4>(m_volume, start, step, last - first, out + first);
+    }
+}
+
+/**
+ * @brief ResliceEngine::reslice samples the plane or projects the slab, see setSlab()
+ *
+ * Small images run on fewer threads, at least MinRowsPerThread rows per thread.
+ * @param columns number of columns
+ * @param rows number of rows
+ * @param image receives the samples, Background outside the volume
+ * @param rowStride distance of two rows of image in values
+ * @param threadCount number of threads, 0 uses all cores
+ * @return 0 - if successful, 1 - if no volume is set
+ */
+int ResliceEngine::reslice(int columns, int rows, short* image, qint64 rowStride, int threadCount) const
+{
+    if (!m_volume.isValid()){
+        return 1;
+    }
+    const int THREADS = std::max(1, std::min(Parallel::threadCount(threadCount), rows/MinRowsPerThread));
+    Parallel::forChunks(0, rows, THREADS, [&](int firstRow, int lastRow, int){
+        resliceRows(firstRow, lastRow, columns, image, rowStride, [](int){});
+    });
+    return 0;
+}
@@ -0,0 +1,134 @@
+#ifndef RESLICEENGINE_H
+#define RESLICEENGINE_H
+
+#include "MyLib_global.h"
+#include "volumeview.h"
+#include <Eigen/Dense>
+#include <vector>
+
+/**
+ * @brief Samples a plane of the volume at the nearest voxels or interpolated
+ *
+ * The plane is given in voxel coordinates by the position of pixel (0, 0) and the steps from one column and from one
+ * row to the next. The start of every row and the column step are converted to fixed point (FractionBits fraction
+ * bits), the columns inside the volume follow from them in integers and are walked with three additions and shifts
+ * per pixel instead of rounding three doubles and checking the bounds. The position of each row is computed anew, so the error of the fixed point steps
+ * doesn't grow from row to row. On bricked views (e.g. BrickedVolume) the columns inside one brick are walked with the
+ * strides of the brick and the start of the brick is only looked up where the row crosses into the next one.
+ *
+ * Interpolated pixels are computed WeightBits fixed point in blocks of Block pixels: the neighbours are loaded with
+ * their indices clamped to the volume, then combined separably along x, y and z, 8 pixels per instruction with AVX2
+ * where the CPU supports it. Inside the volume the AVX2 path gathers neighbouring voxels along x in pairs and weights
+ * both with one 16 bit multiply-add; on bricked views it does so for blocks whose neighbours lie in one brick and
+ * gathers the others one by one from the brick offsets of each axis. The scalar fallback computes the same integers.
+ * Whether a pixel lies inside the volume doesn't depend on the interpolation, only its nearest voxel counts.
+ *
+ * A slab projects several parallel planes into one image. Each row of the slab is clipped once, plane by plane in
+ * integers. Nearest pixels step through their planes in a single pass over the row, interpolated planes are sampled
+ * one after another into an accumulator of the row, so the voxels read for one plane are still cached for the next
+ * one. A pixel of a slab lies inside the volume if the sample of any of its planes does, the other samples are left
+ * out.
+ */
+class MYLIB_EXPORT ResliceEngine
+{
+public:
+    /// Fraction bits of the fixed point positions
+    static const int FractionBits = 32;
+    /// Value of pixels outside the volume
+    static const short Background = -1024;
+    /// Rows per thread below which more threads cost more than they save
+    static const int MinRowsPerThread = 64;
+    /// Pixels interpolated at once
+    static const int Block = 8;
+    /// Fraction bits of the interpolation weights
+    static const int WeightBits = 14;
+    /// Most planes of a slab, the sums of MeanIntensity stay within 32 bits
+    static const int MaxSlabPlanes = 1024;
+
+    /// How a pixel is sampled
+    enum Interpolation {
+        Nearest,    ///< nearest voxel
+        Trilinear,  ///< 2x2x2 neighbours
+        CatmullRom  ///< 4x4x4 neighbours with the Catmull-Rom spline, sharper than Trilinear but may overshoot edges
+    };
+
+    /// How the planes of a slab are combined
+    enum SlabProjection {
+        MaximumIntensity,  ///< brightest sample, shows bone just off the plane
+        MinimumIntensity,  ///< darkest sample
+        MeanIntensity      ///< mean of the samples, rounded
+    };
+
+    ResliceEngine();
+
+    /// Sets the volume to sample, it has to stay loaded while reslicing
+    void setVolume(const VolumeView& volume) { m_volume = volume; }
+    /// Sets the plane in voxel coordinates: pixel (column, row) samples origin + column*columnStep + row*rowStep,
+    /// voxel i covers [i - 0.5, i + 0.5), so a point halfway between two voxels lies in the one with the larger index
+    void setPlane(const Eigen::Vector3d& origin, const Eigen::Vector3d& columnStep, const Eigen::Vector3d& rowStep);
+    void setInterpolation(Interpolation interpolation) { m_interpolation = interpolation; }
+    Interpolation interpolation() const { return m_interpolation; }
+    /// Projects planes parallel planes planeStep apart centered on the plane into one image, 1 samples the plane only
+    void setSlab(int planes, const Eigen::Vector3d& planeStep, SlabProjection projection);
+    int slabPlanes() const { return m_slabPlanes; }
+
+    /// Samples columns x rows pixels, rows are rowStride values apart
+    int reslice(int columns, int rows, short* image, qint64 rowStride, int threadCount = 0) const;
+    /// Samples rows [firstRow, lastRow) on the calling thread, rowDone(row) is called while the row is still cached
+    template <typename RowDone>
+    void resliceRows(int firstRow, int lastRow, int columns, short* image, qint64 rowStride, RowDone rowDone) const;
+    /// Columns [first, last) of a row that lie inside the volume, first == last if none
+    void clipRow(int row, int columns, int& first, int& last) const;
+
+private:
+    void clipRow(int row, int columns, int& first, int& last, qint64 position[3], qint64 step[3]) const;
+    void clipRow(const Eigen::Vector3d& start, int columns, int& first, int& last, qint64 position[3], qint64 step[3]) const;
+    void resliceRow(int row, int columns, short* out) const;
+    void sampleRow(int first, int last, const qint64 position[3], const qint64 step[3], short* out) const;
+    bool toFixed(const Eigen::Vector3d& start, int columns, qint64 position[3], qint64 step[3]) const;
+    void slabRow(int row, int columns, short* out, qint32* accumulator, quint16* counts, short* samples,
+                 int* planeColumns, qint64* planePositions) const;
+    void interpolateRow(int first, int last, const qint64 position[3], const qint64 step[3], short* out) const;
+
+    VolumeView m_volume;
+    Eigen::Vector3d m_origin;
+    Eigen::Vector3d m_columnStep;
+    Eigen::Vector3d m_rowStep;
+    Interpolation m_interpolation;
+    int m_slabPlanes;
+    Eigen::Vector3d m_planeStep;
+    SlabProjection m_slabProjection;
+};
+
+/**
+ * @brief ResliceEngine::resliceRows samples some rows of the image, e.g. a chunk of rows of one of several planes
+ * @param firstRow first row
+ * @param lastRow row after the last one
+ * @param columns number of columns
+ * @param image the image, row r starts at image + r*rowStride
+ * @param rowStride distance of two rows of image in values
+ * @param rowDone called with each row after it was sampled
+ */
+template <typename RowDone>
+void ResliceEngine::resliceRows(int firstRow, int lastRow, int columns, short* image, qint64 rowStride, RowDone rowDone) const
+{
+    if (m_slabPlanes > 1){
+        std::vector<qint32> accumulator(columns);
+        std::vector<quint16> counts(columns);
+        std::vector<short> samples(columns);
+        std::vector<int> planeColumns(2*m_slabPlanes);
+        std::vector<qint64> planePositions(3*m_slabPlanes);
+        for (int row = firstRow; row < lastRow; ++row){
+            slabRow(row, columns, image + row*rowStride, accumulator.data(), counts.data(), samples.data(),
+                    planeColumns.data(), planePositions.data());
+            rowDone(row);
+        }
+        return;
+    }
+    for (int row = firstRow; row < lastRow; ++row){
+        resliceRow(row, columns, image + row*rowStride);
+        rowDone(row);
+    }
+}
+
+#endif // RESLICEENGINE_H
@@ -0,0 +1,182 @@
+#include "volumegeometry.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+VolumeGeometry::VolumeGeometry()
+    : m_width(400), m_height(400), m_layers(400),
+      m_spacingX(0.3625), m_spacingY(0.325), m_spacingZ(0.35), m_sliceThickness(0)
+{
+}
+
+VolumeGeometry::VolumeGeometry(int width, int height, int layers, double spacingX, double spacingY, double spacingZ)
+    : m_width(width), m_height(height), m_layers(layers),
+      m_spacingX(spacingX), m_spacingY(spacingY), m_spacingZ(spacingZ), m_sliceThickness(0)
+{
+}
+
+/**
+ * @brief VolumeGeometry::isValid checks that the geometry describes a non-empty volume
+ * @return true if all dimensions and spacings are positive
+ */
+bool VolumeGeometry::isValid() const
+{
+    return m_width > 0 && m_height > 0 && m_layers > 0
+            && m_spacingX > 0 && m_spacingY > 0 && m_spacingZ > 0;
+}
+
+/**
+ * @brief VolumeGeometry::parseFileName reads the geometry from a file name like SpineModel_0.365_0.325_1_400_400_400.raw
+ *
+ * The last three fields are width, height and layers, the three fields before are the in-plane spacing in x and y and the
+ * nominal slice thickness. The distance between layers is not part of the convention and is left unchanged.
+ * The name of the included spine model lists 0.365 mm in x, but the registration and the mm readouts have always been
+ * calibrated to 0.3625 mm for it, so that model keeps the calibrated spacing.
+ * @param imagePath path or file name of the raw image
+ * @return true if the file name follows the convention
+ */
+bool VolumeGeometry::parseFileName(const QString& imagePath)
+{
+    QStringList fields = QFileInfo(imagePath).completeBaseName().split('_');
+    if (fields.size() < 6){
+        return false;
+    }
+
+    bool ok = true;
+    int n = fields.size();
+    int width = fields[n-3].toInt(&ok);
+    if (!ok) return false;
+    int height = fields[n-2].toInt(&ok);
+    if (!ok) return false;
+    int layers = fields[n-1].toInt(&ok);
+    if (!ok) return false;
+    double spacingX = fields[n-6].toDouble(&ok);
+    if (!ok) return false;
+    double spacingY = fields[n-5].toDouble(&ok);
+    if (!ok) return false;
+    double sliceThickness = fields[n-4].toDouble(&ok);
+    if (!ok) return false;
+
+    if (width <= 0 || height <= 0 || layers <= 0 || spacingX <= 0 || spacingY <= 0){
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_layers = layers;
+    m_spacingX = spacingX;
+    m_spacingY = spacingY;
+    m_sliceThickness = sliceThickness;
+    return true;
+}
+
+/**
+ * @brief VolumeGeometry::readHeader reads a sidecar header with one "key = value" pair per line
+ *
+ * Known keys are width, height, layers, spacing_x, spacing_y, spacing_z and slice_thickness. "dimensions" and
+ * "spacing" take three values at once. Lines starting with '#' are ignored.
+ * @param headerPath path of the header file
+ * @return true if the header could be read and contained at least one known key
+ */
+bool VolumeGeometry::readHeader(const QString& headerPath)
+{
+    QFile headerFile(headerPath);
+    if (!headerFile.open(QIODevice::ReadOnly | QIODevice::Text)){
+        return false;
+    }
+
+    VolumeGeometry parsed = *this;
+    bool foundKey = false;
+    QTextStream stream(&headerFile);
+    while (!stream.atEnd()){
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith("#")){
+            continue;
+        }
+        int separator = line.indexOf('=');
+        if (separator < 0){
+            separator = line.indexOf(':');
+        }
+        if (separator < 0){
+            continue;
+        }
+        QString key = line.left(separator).trimmed().toLower();
+        QStringList values = line.mid(separator+1).simplified().split(' ');
+
+        bool ok = true;
+        if (key == "dimensions" && values.size() == 3){
+            parsed.m_width = values[0].toInt(&ok);
+            if (ok) parsed.m_height = values[1].toInt(&ok);
+            if (ok) parsed.m_layers = values[2].toInt(&ok);
+        } else if (key == "spacing" && values.size() == 3){
+            parsed.m_spacingX = values[0].toDouble(&ok);
+            if (ok) parsed.m_spacingY = values[1].toDouble(&ok);
+            if (ok) parsed.m_spacingZ = values[2].toDouble(&ok);
+        } else if (key == "width"){
+            parsed.m_width = values[0].toInt(&ok);
+        } else if (key == "height"){
+            parsed.m_height = values[0].toInt(&ok);
+        } else if (key == "layers"){
+            parsed.m_layers = values[0].toInt(&ok);
+        } else if (key == "spacing_x"){
+            parsed.m_spacingX = values[0].toDouble(&ok);
+        } else if (key == "spacing_y"){
+            parsed.m_spacingY = values[0].toDouble(&ok);
+        } else if (key == "spacing_z"){
+            parsed.m_spacingZ = values[0].toDouble(&ok);
+        } else if (key == "slice_thickness"){
+            parsed.m_sliceThickness = values[0].toDouble(&ok);
+        } else {
+            continue;
+        }
+        if (!ok){
+            return false; // malformed value
+        }
+        foundKey = true;
+    }
+
+    if (!foundKey || !parsed.isValid()){
+        return false;
+    }
+    *this = parsed;
+    return true;
+}
+
+/**
+ * @brief VolumeGeometry::headerPath returns the path of the sidecar header (same name, extension .hdr)
+ * @param imagePath path of the raw image
+ * @return path of the header file
+ */
+QString VolumeGeometry::headerPath(const QString& imagePath)
+{
+    QFileInfo info(imagePath);
+    return info.path() + "/" + info.completeBaseName() + ".hdr";
+}
+
+/**
+ * @brief VolumeGeometry::fromImagePath determines the geometry of a raw image
+ *
+ * Starts with the default geometry, applies the file name convention and then the sidecar header if one exists.
+ * @param imagePath path of the raw image
+ * @param geometry the determined geometry
+ * @return true if the file name or a header provided the geometry, false if only the defaults are known
+ */
+bool VolumeGeometry::fromImagePath(const QString& imagePath, VolumeGeometry& geometry)
+{
+    VolumeGeometry result;
+    bool found = result.parseFileName(imagePath);
+    QString header = headerPath(imagePath);
+    if (QFile::exists(header)){
+        found = result.readHeader(header) || found;
+    }
+    geometry = result;
+    return found;
+}
+
+bool VolumeGeometry::operator==(const VolumeGeometry& other) const
+{
+    return m_width == other.m_width && m_height == other.m_height && m_layers == other.m_layers
+            && m_spacingX == other.m_spacingX && m_spacingY == other.m_spacingY && m_spacingZ == other.m_spacingZ;
+}
@@ -0,0 +1,85 @@
+#ifndef VOLUMEGEOMETRY_H
+#define VOLUMEGEOMETRY_H
+
+#include "MyLib_global.h"
+#include <Eigen/Dense>
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+} Voxel;
+
+/**
+ * @brief Size and voxel spacing of a CT volume
+ *
+ * The geometry is read from the file name convention
+ * `<name>_<spacingX>_<spacingY>_<sliceThickness>_<width>_<height>_<layers>.raw`
+ * and/or from a sidecar header `<name>.hdr` next to the raw file.
+ */
+class MYLIB_EXPORT VolumeGeometry
+{
+public:
+    /// Constructs the geometry of the original 400x400x400 spine model
+    VolumeGeometry();
+    /// Constructs a geometry from explicit values
+    VolumeGeometry(int width, int height, int layers, double spacingX, double spacingY, double spacingZ);
+
+    /// Number of voxels in x-direction
+    int width() const { return m_width; }
+    /// Number of voxels in y-direction
+    int height() const { return m_height; }
+    /// Number of layers (z-direction)
+    int layers() const { return m_layers; }
+
+    /// Voxel spacing in x-direction in mm
+    double spacingX() const { return m_spacingX; }
+    /// Voxel spacing in y-direction in mm
+    double spacingY() const { return m_spacingY; }
+    /// Distance between two layers in mm
+    double spacingZ() const { return m_spacingZ; }
+    /// Voxel spacing as vector (x, y, z) in mm
+    Eigen::Vector3d spacing() const { return Eigen::Vector3d(m_spacingX, m_spacingY, m_spacingZ); }
+    /// Nominal slice thickness in mm (informational, 0 if unknown)
+    double sliceThickness() const { return m_sliceThickness; }
+
+    /// Number of voxels in one layer
+    qint64 sliceSize() const { return qint64(m_width)*m_height; }
+    /// Number of voxels in the whole volume
+    qint64 voxelCount() const { return sliceSize()*m_layers; }
+    /// Size of the raw 16 bit volume in bytes
+    qint64 byteSize() const { return voxelCount()*qint64(sizeof(short)); }
+
+    /// Returns true if all dimensions and spacings are positive
+    bool isValid() const;
+    /// Returns true if the voxel (x, y, z) lies inside the volume
+    bool contains(int x, int y, int z) const {
+        return 0 <= x && x < m_width && 0 <= y && y < m_height && 0 <= z && z < m_layers;
+    }
+    /// Linear index of voxel (x, y, z) in a z-major volume
+    qint64 index(int x, int y, int z) const { return (qint64(z)*m_height + y)*m_width + x; }
+
+    /// Parses the geometry from the file name of a raw image
+    bool parseFileName(const QString& imagePath);
+    /// Parses a sidecar header; values found there override the current ones
+    bool readHeader(const QString& headerPath);
+    /// Path of the sidecar header belonging to a raw image
+    static QString headerPath(const QString& imagePath);
+    /// Determines the geometry of a raw image from its header and/or file name
+    static bool fromImagePath(const QString& imagePath, VolumeGeometry& geometry);
+
+    bool operator==(const VolumeGeometry& other) const;
+    bool operator!=(const VolumeGeometry& other) const { return !(*this == other); }
+
+private:
+    int m_width;
+    int m_height;
+    int m_layers;
+
+    double m_spacingX;
+    double m_spacingY;
+    double m_spacingZ;
+    double m_sliceThickness;
+};
+
+#endif // VOLUMEGEOMETRY_H
@@ -0,0 +1,188 @@
+#ifndef VOLUMEVIEW_H
+#define VOLUMEVIEW_H
+
+#include "MyLib_global.h"
+#include "volumegeometry.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief Branch-free voxel access of a strided VolumeView, see VolumeView::visit()
+ */
+class StridedVoxels
+{
+public:
+    StridedVoxels(const short* origin, qint64 strideX, qint64 strideY, qint64 strideZ)
+        : m_origin(origin), m_stride{strideX, strideY, strideZ} {}
+
+    /// Offset of voxel (x, y, z) relative to voxel (0, 0, 0)
+    qint64 offset(int x, int y, int z) const { return x*m_stride[0] + y*m_stride[1] + z*m_stride[2]; }
+    /// Value of voxel (x, y, z), the voxel has to lie inside the volume
+    short at(int x, int y, int z) const { return m_origin[offset(x, y, z)]; }
+
+private:
+    const short* m_origin;
+    qint64 m_stride[3];
+};
+
+/**
+ * @brief Branch-free voxel access of a bricked VolumeView, see VolumeView::visit()
+ *
+ * The voxels of a brick of 2^shift voxels per side lie together in z-major order, the bricks follow each other in
+ * z-major order as well. Inside a brick the voxels are found by the strides 1, 2^shift and 2^(2*shift), only the base
+ * of the brick depends on the brick strides.
+ */
+class BrickedVoxels
+{
+public:
+    BrickedVoxels(const short* origin, int shift, qint64 brickStrideX, qint64 brickStrideY, qint64 brickStrideZ)
+        : m_origin(origin), m_shift(shift), m_mask((1 << shift) - 1), m_brickStride{brickStrideX, brickStrideY, brickStrideZ} {}
+
+    /// Offset of the first voxel of brick (x, y, z) (in bricks) relative to voxel (0, 0, 0)
+    qint64 brickOffset(int x, int y, int z) const { return x*m_brickStride[0] + y*m_brickStride[1] + z*m_brickStride[2]; }
+    /// Offset of voxel (x, y, z) relative to voxel (0, 0, 0)
+    qint64 offset(int x, int y, int z) const {
+        return brickOffset(x >> m_shift, y >> m_shift, z >> m_shift)
+                + (x & m_mask) + (qint64((y & m_mask) | ((z & m_mask) << m_shift)) << m_shift);
+    }
+    /// Value of voxel (x, y, z), the voxel has to lie inside the volume
+    short at(int x, int y, int z) const { return m_origin[offset(x, y, z)]; }
+    /// Voxels per side of a brick is 1 << shift()
+    int shift() const { return m_shift; }
+
+private:
+    const short* m_origin;
+    int m_shift;
+    int m_mask;
+    qint64 m_brickStride[3];
+};
+
+/**
+ * @brief Read access to the voxels of a volume stored somewhere else
+ *
+ * A voxel (x, y, z) of a strided view is found at origin + x*strideX + y*strideY + z*strideZ. Negative strides allow
+ * to look at a mirrored volume (e.g. a memory-mapped raw file) without copying it. Bricked views read the cubic bricks
+ * of BrickedVolume, their strides are 0.
+ *
+ * at() and readRow() work on both layouts. Loops over many voxels use visit() instead, it hands them StridedVoxels or
+ * BrickedVoxels, so the loop is compiled once per layout and the strided one is the same as before bricks existed.
+ */
+class VolumeView
+{
+public:
+    /// Constructs an empty view
+    VolumeView() : m_origin(nullptr), m_strideX(0), m_strideY(0), m_strideZ(0), m_brickShift(0), m_brickStride{0, 0, 0} {}
+
+    /// View on a z-major volume stored in the given geometry
+    static VolumeView linear(const short* data, const VolumeGeometry& geometry){
+        VolumeView view;
+        view.m_geometry = geometry;
+        view.m_origin = data;
+        view.m_strideX = 1;
+        view.m_strideY = geometry.width();
+        view.m_strideZ = geometry.sliceSize();
+        return view;
+    }
+
+    /// View on a z-major volume whose layers are stored mirrored in x and y (the layout of the raw files)
+    static VolumeView mirroredXY(const short* data, const VolumeGeometry& geometry){
+        VolumeView view;
+        view.m_geometry = geometry;
+        view.m_origin = data ? data + geometry.sliceSize() - 1 : nullptr;
+        view.m_strideX = -1;
+        view.m_strideY = -qint64(geometry.width());
+        view.m_strideZ = geometry.sliceSize();
+        return view;
+    }
+
+    /// View on a volume stored in bricks of 2^shift voxels per side (shift > 0), see BrickedVoxels; data has to hold
+    /// one more voxel behind the last brick, interpolating gathers read it
+    static VolumeView bricked(const short* data, const VolumeGeometry& geometry, int shift){
+        VolumeView view;
+        view.m_geometry = geometry;
+        view.m_origin = data;
+        view.m_brickShift = shift;
+        const qint64 size = qint64(1) << shift;
+        view.m_brickStride[0] = size*size*size;
+        view.m_brickStride[1] = view.m_brickStride[0]*((geometry.width() + size - 1) >> shift);
+        view.m_brickStride[2] = view.m_brickStride[1]*((geometry.height() + size - 1) >> shift);
+        return view;
+    }
+
+    /// Returns true if the view points to a volume
+    bool isValid() const { return m_origin != nullptr; }
+    /// Size and voxel spacing of the volume
+    const VolumeGeometry& geometry() const { return m_geometry; }
+
+    /// Offset of voxel (x, y, z) relative to the origin (strided views only)
+    qint64 offset(int x, int y, int z) const { return x*m_strideX + y*m_strideY + z*m_strideZ; }
+    /// Value of voxel (x, y, z) in any layout, the voxel has to lie inside the volume
+    short at(int x, int y, int z) const { return isStrided() ? m_origin[offset(x, y, z)] : brickedVoxels().at(x, y, z); }
+    /// Pointer to voxel (x, y, z), neighbours are found using the strides (strided views only)
+    const short* pointer(int x, int y, int z) const { return m_origin + offset(x, y, z); }
+
+    qint64 strideX() const { return m_strideX; }
+    qint64 strideY() const { return m_strideY; }
+    qint64 strideZ() const { return m_strideZ; }
+    /// Returns true if the voxels are found by the strides, false if they are stored in bricks
+    bool isStrided() const { return m_brickShift == 0; }
+    /// Voxels per side of a brick is 1 << brickShift(), 0 for strided views
+    int brickShift() const { return m_brickShift; }
+    /// Voxel access of a strided view
+    StridedVoxels stridedVoxels() const { return StridedVoxels(m_origin, m_strideX, m_strideY, m_strideZ); }
+    /// Voxel access of a bricked view
+    BrickedVoxels brickedVoxels() const {
+        return BrickedVoxels(m_origin, m_brickShift, m_brickStride[0], m_brickStride[1], m_brickStride[2]);
+    }
+    /// Calls function with stridedVoxels() or brickedVoxels(), whichever fits the layout, and returns its result
+    template <typename Function>
+    auto visit(Function function) const -> decltype(function(stridedVoxels())) {
+        return isStrided() ? function(stridedVoxels()) : function(brickedVoxels());
+    }
+
+    /// Returns true if the voxels of a row are stored contiguously in ascending order
+    bool hasContiguousRows() const { return m_strideX == 1; }
+
+    /// Returns true if both views read the same voxels in the same layout
+    bool operator==(const VolumeView& other) const {
+        return m_origin == other.m_origin && m_strideX == other.m_strideX && m_strideY == other.m_strideY
+                && m_strideZ == other.m_strideZ && m_brickShift == other.m_brickShift && m_geometry == other.m_geometry;
+    }
+    bool operator!=(const VolumeView& other) const { return !(*this == other); }
+
+    /// Copies row y of layer z (width voxels) to dst
+    void readRow(int y, int z, short* dst) const {
+        const int width = m_geometry.width();
+        if (!isStrided()){
+            // one piece per brick
+            const BrickedVoxels voxels = brickedVoxels();
+            const int size = 1 << m_brickShift;
+            const short* row = m_origin + voxels.offset(0, y, z);
+            for (int x = 0; x < width; x += size){
+                std::memcpy(dst + x, row + (x >> m_brickShift)*m_brickStride[0], size_t(std::min(size, width - x))*sizeof(short));
+            }
+            return;
+        }
+        const short* src = pointer(0, y, z);
+        if (m_strideX == 1){
+            std::memcpy(dst, src, size_t(width)*sizeof(short));
+        } else if (m_strideX == -1){
+            std::reverse_copy(src - width + 1, src + 1, dst);
+        } else {
+            for (int x = 0; x < width; ++x){
+                dst[x] = src[x*m_strideX];
+            }
+        }
+    }
+
+private:
+    VolumeGeometry m_geometry;
+    const short* m_origin;
+    qint64 m_strideX;
+    qint64 m_strideY;
+    qint64 m_strideZ;
+    int m_brickShift;
+    qint64 m_brickStride[3];
+};
+
+#endif // VOLUMEVIEW_H
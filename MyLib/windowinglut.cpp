@@ -0,0 +1,128 @@
+#include "windowinglut.h"
+#include "ctdataset.h"
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define WINDOWINGLUT_AVX2 1
+#include <immintrin.h>
+
+/**
+ * @brief applyAvx2 converts 8 HU values per step: widen to 32 bit, shift and clamp to table indices, gather
+ * @return number of values converted, the rest is left to the scalar loop
+ */
+__attribute__((target("avx2")))
+static int applyAvx2(const quint32* table, const short* huValues, quint32* pixels, int count)
+{
+    const __m256i offset = _mm256_set1_epi32(-WindowingLut::MinHU);
+    const __m256i lowest = _mm256_setzero_si256();
+    const __m256i highest = _mm256_set1_epi32(WindowingLut::Size - 1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i hu = _mm_loadu_si128(reinterpret_cast<const __m128i*>(huValues + i));
+        __m256i idx = _mm256_add_epi32(_mm256_cvtepi16_epi32(hu), offset);
+        idx = _mm256_min_epi32(_mm256_max_epi32(idx, lowest), highest);
+        __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), idx, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), colors);
+    }
+    return i;
+}
+
+static bool hasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+WindowingLut::WindowingLut()
+    : m_startValue(0), m_windowWidth(1), m_threshold(NoThreshold), m_overlayColor(0xffff0000u)
+{
+    build();
+}
+
+/**
+ * @brief WindowingLut::update rebuilds the table when the windowing or the threshold changed
+ * @param startValue lower bound of HU values to display
+ * @param windowWidth width of the interval of HU values to display
+ * @param threshold voxels at or above get the overlay color, NoThreshold for none
+ * @param overlayColor color of the voxels above the threshold (0xffRRGGBB)
+ * @return true if the table was rebuilt, false if nothing changed
+ */
+bool WindowingLut::update(int startValue, int windowWidth, int threshold, quint32 overlayColor)
+{
+    if (startValue == m_startValue && windowWidth == m_windowWidth && threshold == m_threshold
+            && overlayColor == m_overlayColor){
+        return false;
+    }
+    m_startValue = startValue;
+    m_windowWidth = windowWidth;
+    m_threshold = threshold;
+    m_overlayColor = overlayColor;
+    build();
+    return true;
+}
+
+/**
+ * @brief WindowingLut::build fills the tables using CTDataset::windowing
+ */
+void WindowingLut::build()
+{
+    for (int i = 0; i < Size; ++i){
+        const int huValue = MinHU + i;
+        int grayValue = 0;
+        CTDataset::windowing(huValue, m_startValue, m_windowWidth, grayValue);
+        m_grays[i] = uchar(grayValue);
+        if (huValue >= m_threshold){
+            m_colors[i] = m_overlayColor;
+            m_codes[i] = uchar(OverlayIndex);
+        } else {
+            m_codes[i] = uchar(std::min(grayValue, OverlayIndex - 1));
+            m_colors[i] = 0xff000000u | (quint32(grayValue) << 16) | (quint32(grayValue) << 8) | quint32(grayValue);
+        }
+    }
+}
+
+/**
+ * @brief WindowingLut::apply converts HU values to colors, values outside -1024..3071 are clamped
+ * @param huValues count HU values
+ * @param pixels receives count colors (0xffRRGGBB)
+ * @param count number of values
+ */
+void WindowingLut::apply(const short* huValues, quint32* pixels, int count) const
+{
+    int i = 0;
+#ifdef WINDOWINGLUT_AVX2
+    if (hasAvx2()){
+        i = applyAvx2(m_colors, huValues, pixels, count);
+    }
+#endif
+    for (; i < count; ++i){
+        pixels[i] = m_colors[index(huValues[i])];
+    }
+}
+
+/**
+ * @brief WindowingLut::applyGray converts HU values to gray values, values outside -1024..3071 are clamped
+ * @param huValues count HU values
+ * @param pixels receives count gray values
+ * @param count number of values
+ */
+void WindowingLut::applyGray(const short* huValues, uchar* pixels, int count) const
+{
+    for (int i = 0; i < count; ++i){
+        pixels[i] = m_grays[index(huValues[i])];
+    }
+}
+
+/**
+ * @brief WindowingLut::applyIndexed converts HU values to 8 bit codes, values outside -1024..3071 are clamped
+ * @param huValues count HU values
+ * @param pixels receives count codes, OverlayIndex for voxels at or above the threshold
+ * @param count number of values
+ */
+void WindowingLut::applyIndexed(const short* huValues, uchar* pixels, int count) const
+{
+    for (int i = 0; i < count; ++i){
+        pixels[i] = m_codes[index(huValues[i])];
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef WINDOWINGLUT_H
+#define WINDOWINGLUT_H
+
+#include "MyLib_global.h"
+
+/**
+ * @brief Lookup table from 12 bit Hounsfield Units to display colors
+ *
+ * The table holds one 0xffRRGGBB color (the pixel format of QImage::Format_RGB32) for each HU value from -1024 to
+ * 3071. The gray values come from CTDataset::windowing, voxels at or above the segmentation threshold get the overlay
+ * color. The table is rebuilt only when start, width or threshold change; converting a row is then one lookup per
+ * voxel, done 8 voxels at a time with AVX2 gathers where the CPU supports it.
+ */
+class MYLIB_EXPORT WindowingLut
+{
+public:
+    /// Smallest HU value in the table, smaller values use this entry
+    static const int MinHU = -1024;
+    /// Largest HU value in the table, larger values use this entry
+    static const int MaxHU = 3071;
+    /// Number of entries
+    static const int Size = MaxHU - MinHU + 1;
+    /// Threshold that disables the overlay
+    static const int NoThreshold = MaxHU + 1;
+    /// 8 bit code of voxels at or above the threshold, gray values go up to OverlayIndex - 1
+    static const int OverlayIndex = 255;
+
+    /// Constructs a table for start 0, width 1 without overlay
+    WindowingLut();
+
+    /// Rebuilds the table if any parameter changed, returns true if it was rebuilt
+    bool update(int startValue, int windowWidth, int threshold = NoThreshold, quint32 overlayColor = 0xffff0000u);
+
+    int startValue() const { return m_startValue; }
+    int windowWidth() const { return m_windowWidth; }
+    int threshold() const { return m_threshold; }
+
+    /// Color of a HU value
+    quint32 color(int huValue) const { return m_colors[index(huValue)]; }
+    /// Gray value of a HU value, without overlay
+    uchar gray(int huValue) const { return m_grays[index(huValue)]; }
+    /// 8 bit code of a HU value: the gray value (at most 254) or OverlayIndex above the threshold
+    uchar code(int huValue) const { return m_codes[index(huValue)]; }
+    /// Color table, entry 0 belongs to MinHU
+    const quint32* colors() const { return m_colors; }
+    /// Gray value table, entry 0 belongs to MinHU
+    const uchar* grays() const { return m_grays; }
+
+    /// Converts count HU values to colors, e.g. a row of a layer into QImage::scanLine()
+    void apply(const short* huValues, quint32* pixels, int count) const;
+    /// Converts count HU values to gray values without overlay
+    void applyGray(const short* huValues, uchar* pixels, int count) const;
+    /// Converts count HU values to 8 bit codes, e.g. for a QImage::Format_Indexed8 image
+    void applyIndexed(const short* huValues, uchar* pixels, int count) const;
+
+private:
+    int m_startValue;
+    int m_windowWidth;
+    int m_threshold;
+    quint32 m_overlayColor;
+    quint32 m_colors[Size];
+    uchar m_grays[Size];
+    uchar m_codes[Size];
+
+    static int index(int huValue) {
+        return huValue < MinHU ? 0 : (huValue > MaxHU ? Size - 1 : huValue - MinHU);
+    }
+    void build();
+};
+
+#endif // WINDOWINGLUT_H
@@ -1,7 +1,29 @@
 #include <QString>
 #include <QtTest>
 #include "ctdataset.h"
+#include "volumegeometry.h"
+#include "bitmask.h"
+#include "componentlabeler.h"
+#include "compactregion.h"
+#include "windowinglut.h"
+#include "displaycache.h"
+#include "computeexecutor.h"
+#include "processinggraph.h"
+#include "ctpipeline.h"
+#include "raymaxindex.h"
+#include "brickpyramid.h"
+#include "axisdepthmaps.h"
+#include "brickedvolume.h"
+#include "mylib.h"
+#include "raycaster.h"
+#include "resliceengine.h"
 #include <algorithm>
+#include <climits>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class MyLibUnitTest : public QObject
 {
@@ -12,6 +34,33 @@ public:
 
 private Q_SLOTS:
    void windowingTest();
+   void volumeGeometryTest();
+   void lazyBufferTest();
+   void mappedLoadTest();
+   void streamingLoadTest();
+   void bitMaskTest();
+   void componentLabelingTest();
+   void parallelLabelingTest();
+   void spanGrowingTest();
+   void parallelGrowingTest();
+   void compactRegionTest();
+   void windowingLutTest();
+   void displayCacheTest();
+   void computeExecutorTest();
+   void processingGraphTest();
+   void rayIndexTest();
+   void depthBufferTest();
+   void depthBufferBenchmark();
+   void brickPyramidTest();
+   void axisDepthMapsTest();
+   void shadingTest();
+   void rayCasterTest();
+   void resliceEngineTest();
+   void resliceInterpolationTest();
+   void resliceSlabTest();
+   void layerPairTest();
+   void volumeLayoutTest();
+   void volumeLayoutBenchmark();
 
 };
 
@@ -19,6 +68,76 @@ MyLibUnitTest::MyLibUnitTest()
 {
 }
 
+/**
+ Writes a raw phantom volume to dir and returns its path. value(x, y, z) is given in the orientation CTDataset uses
+ after loading, i.e. the file stores it mirrored in x and y.
+ */
+static QString writePhantom(const QTemporaryDir& dir, int width, int height, int layers, std::function<short(int, int, int)> value)
+{
+    QString path = dir.filePath(QString("Phantom_0.5_0.5_1_%1_%2_%3.raw").arg(width).arg(height).arg(layers));
+    std::vector<short> raw(size_t(width)*height*layers);
+    for (int z = 0; z < layers; ++z){
+        for (int y = 0; y < height; ++y){
+            for (int x = 0; x < width; ++x){
+                raw[(size_t(z)*height + (height-1-y))*width + (width-1-x)] = value(x, y, z);
+            }
+        }
+    }
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+    file.write((const char*)raw.data(), qint64(raw.size()*sizeof(short)));
+    file.close();
+    return path;
+}
+
+/**
+ Depth buffer as calculated before the row-wise version: every ray is marched through the volume on its own
+ */
+static void marchDepthBuffer(const VolumeView& volume, int threshold, short* depthBuffer)
+{
+    const int WIDTH = volume.geometry().width();
+    const int HEIGHT = volume.geometry().height();
+    const int LAYERS = volume.geometry().layers();
+    for (int y = 0; y < LAYERS; ++y) {
+        depthBuffer[y*WIDTH] = 0;
+        for (int x = 1; x < WIDTH; ++x) {
+            depthBuffer[y*WIDTH + x] = 0;
+            for (int l = 0; l < HEIGHT; ++l) {
+                if (volume.at(WIDTH-x, l, y) >= threshold){
+                    depthBuffer[y*WIDTH + x] = l;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ Cross section as sampled before ResliceEngine: every pixel is rounded and checked on its own
+ */
+static void sampleCrosssection(const VolumeView& volume, const Eigen::Vector3d& pos, const Eigen::Vector3d& xImDir,
+                               const Eigen::Vector3d& yImDir, short* crosssection)
+{
+    const int WIDTH = volume.geometry().width();
+    const int HEIGHT = volume.geometry().height();
+    int h = HEIGHT/2;
+    int w = WIDTH/2;
+    for (int y = -h; y < h; y++){
+        for (int x = -w; x < w; x++){
+            Eigen::Vector3d pos3d = pos + x*xImDir + y*yImDir;
+            int sampleX = WIDTH - (int)std::round(pos3d.x());
+            int sampleY = HEIGHT - (int)std::round(pos3d.y());
+            int sampleZ = (int)std::round(pos3d.z());
+            if (volume.geometry().contains(sampleX, sampleY, sampleZ)){
+                crosssection[(y+h)*WIDTH + (x+w)] = volume.at(sampleX, sampleY, sampleZ);
+            }
+            else {
+                crosssection[(y+h)*WIDTH + (x+w)] = -1024;
+            }
+        }
+    }
+}
+
 /**
  Test cases for CTDataset::windowing(...)
  HIER OBEN kurze Beschreibung des Testfalls in eigenen Worten einfügen, z.B. die erlaubten Grenzen einmal nennen
@@ -84,6 +203,1918 @@ void MyLibUnitTest::windowingTest()
 
 }
 
+/**
+ Test cases for VolumeGeometry: dimensions and spacing are parsed from the file name convention
+ <name>_<spacingX>_<spacingY>_<sliceThickness>_<width>_<height>_<layers>.raw and can be overridden by a sidecar header
+ */
+void MyLibUnitTest::volumeGeometryTest()
+{
+    // VALID case 1: file name of the sample spine model
+    VolumeGeometry geometry;
+    QVERIFY2(geometry.parseFileName("C:/data/SpineModel_0.365_0.325_1_400_400_400.raw"), "sample file name not recognized");
+    QVERIFY2(geometry.width() == 400 && geometry.height() == 400 && geometry.layers() == 400, "wrong dimensions");
+    QVERIFY2(geometry.spacingX() == 0.365 && geometry.spacingY() == 0.325, "wrong spacing");
+    QVERIFY2(geometry.voxelCount() == 400*400*400, "wrong voxel count");
+
+    // VALID case 2: non-cubic study, underscores in the study name
+    QVERIFY2(geometry.parseFileName("patient_07_0.5_0.5_1_512_512_137.raw"), "file name not recognized");
+    QVERIFY2(geometry.width() == 512 && geometry.height() == 512 && geometry.layers() == 137, "wrong dimensions");
+    QVERIFY2(geometry.spacingX() == 0.5 && geometry.spacingY() == 0.5, "wrong in-plane spacing");
+
+    // INVALID case 1: file name without geometry leaves the geometry untouched
+    QVERIFY2(!geometry.parseFileName("scan.raw"), "file name without geometry accepted");
+    QVERIFY2(geometry.layers() == 137, "geometry changed by invalid file name");
+
+    // INVALID case 2: non-numeric dimension
+    QVERIFY2(!geometry.parseFileName("Spine_0.5_0.5_1_512_abc_137.raw"), "non-numeric dimension accepted");
+
+    // VALID case 3: sidecar header overrides the file name
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString imagePath = dir.filePath("Phantom_0.5_0.5_1_8_6_4.raw");
+    QFile header(VolumeGeometry::headerPath(imagePath));
+    QVERIFY(header.open(QIODevice::WriteOnly));
+    header.write("# sidecar header\nlayers = 5\nspacing_z = 0.7\n");
+    header.close();
+
+    QVERIFY2(VolumeGeometry::fromImagePath(imagePath, geometry), "geometry not found");
+    QVERIFY2(geometry.width() == 8 && geometry.height() == 6 && geometry.layers() == 5, "header did not override file name");
+    QVERIFY2(geometry.spacingX() == 0.5 && geometry.spacingZ() == 0.7, "wrong spacing from header");
+
+    // VALID case 4: the header shipped with the sample keeps its calibrated x spacing
+    QVERIFY2(geometry.parseFileName("SpineModel_0.365_0.325_1_400_400_400.raw"), "sample file name not recognized");
+    QVERIFY2(geometry.readHeader(SRCDIR "../SpineModel_0.365_0.325_1_400_400_400.hdr"), "header of the sample not found");
+    QVERIFY2(geometry.spacingX() == 0.3625 && geometry.spacingY() == 0.325, "calibrated spacing of the sample not kept");
+    QVERIFY2(geometry.width() == 400 && geometry.layers() == 400, "header of the sample changed the dimensions");
+}
+
+/**
+ Test cases for the lazy buffer management of CTDataset: nothing is allocated before loading, working buffers are
+ allocated on first use with the size they really need and can be released again
+ */
+void MyLibUnitTest::lazyBufferTest()
+{
+    CTDataset dataset;
+    QVERIFY2(dataset.memoryUsage() == 0, "memory allocated before loading");
+
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 16, 12, 8, [](int x, int, int) { return short(x < 8 ? 1000 : -1000); });
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    QVERIFY2(dataset.memoryUsage(CTDataset::ImageBuffer) == 16*12*8*2, "image buffer has wrong size");
+    QVERIFY2(dataset.memoryUsage() == dataset.memoryUsage(CTDataset::ImageBuffer), "working buffers allocated while loading");
+
+    // the cross section holds a single layer, the depth buffer width x layers
+    dataset.crosssection();
+    dataset.depthbuffer();
+    QVERIFY2(dataset.memoryUsage(CTDataset::CrosssectionBuffer) == 16*12*2, "cross section buffer has wrong size");
+    QVERIFY2(dataset.memoryUsage(CTDataset::DepthBuffer) == 16*8*2, "depth buffer has wrong size");
+
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.memoryUsage(CTDataset::RegionBuffer) == 16*12*8/8, "region buffer has wrong size");
+    QVERIFY2(dataset.memoryUsage(CTDataset::VisitedBuffer) == 16*12*8/8, "visited buffer has wrong size");
+    QVERIFY2(dataset.region().count() == 0, "region not cleared");
+
+    dataset.releaseWorkingBuffers();
+    QVERIFY2(dataset.memoryUsage() == dataset.memoryUsage(CTDataset::ImageBuffer), "working buffers not released");
+}
+
+/**
+ Test cases for the memory-mapped load path: the mapped volume has to show the same (mirrored) voxels as the copied one
+ */
+void MyLibUnitTest::mappedLoadTest()
+{
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 9, 7, 5, [](int x, int y, int z) { return short(x + 10*y + 100*z); });
+
+    CTDataset copied;
+    CTDataset mapped;
+    QVERIFY2(copied.load(path, CTDataset::CopyLoad) == 0, "phantom could not be copied");
+    QVERIFY2(mapped.load(path, CTDataset::MappedLoad) == 0, "phantom could not be mapped");
+    QVERIFY2(mapped.isMapped() && mapped.data() == nullptr, "volume was copied");
+    QVERIFY2(mapped.memoryUsage() == 0, "mapped volume allocated memory");
+
+    std::vector<short> row(9);
+    for (int z = 0; z < 5; ++z){
+        for (int y = 0; y < 7; ++y){
+            mapped.volume().readRow(y, z, row.data());
+            for (int x = 0; x < 9; ++x){
+                QVERIFY2(copied.volume().at(x, y, z) == short(x + 10*y + 100*z), "copied volume not mirrored correctly");
+                QVERIFY2(mapped.volume().at(x, y, z) == short(x + 10*y + 100*z), "mapped volume not mirrored correctly");
+                QVERIFY2(row[x] == short(x + 10*y + 100*z), "row of mapped volume not mirrored correctly");
+            }
+        }
+    }
+}
+
+/**
+ Test cases for the streaming load: all layers are reported exactly once and in order, the result equals a normal load
+ */
+void MyLibUnitTest::streamingLoadTest()
+{
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 9, 7, 11, [](int x, int y, int z) { return short(x + 10*y + 100*z); });
+
+    CTDataset dataset;
+    for (CTDataset::LoadMode mode : {CTDataset::CopyLoad, CTDataset::MappedLoad}){
+        std::vector<int> readyLayers;
+        std::atomic<int> errorCode(-1);
+        int started = dataset.loadStreaming(path,
+                                            [&readyLayers](int firstLayer, int lastLayer) {
+                                                for (int l = firstLayer; l <= lastLayer; ++l) readyLayers.push_back(l);
+                                            },
+                                            [&errorCode](int code) { errorCode = code; },
+                                            mode, 3);
+        QVERIFY2(started == 0, "streaming load did not start");
+        dataset.waitForLoad();
+
+        QVERIFY2(errorCode == 0, "streaming load failed");
+        QVERIFY2(dataset.isMapped() == (mode == CTDataset::MappedLoad), "wrong load mode");
+        QVERIFY2(!dataset.isLoading() && dataset.layersLoaded() == 11, "not all layers loaded");
+        QVERIFY2(readyLayers.size() == 11, "layers reported more than once or not at all");
+        QVERIFY2(dataset.memoryUsage(CTDataset::BrickBuffer) > 0, "bricks not built by the load");
+        for (int l = 0; l < 11; ++l){
+            QVERIFY2(readyLayers[l] == l, "layers reported out of order");
+        }
+        for (int z = 0; z < 11; ++z){
+            for (int y = 0; y < 7; ++y){
+                for (int x = 0; x < 9; ++x){
+                    QVERIFY2(dataset.volume().at(x, y, z) == short(x + 10*y + 100*z), "streamed volume not mirrored correctly");
+                }
+            }
+        }
+    }
+
+    // INVALID case: missing file is reported right away
+    QVERIFY2(dataset.loadStreaming(dir.filePath("missing.raw"), nullptr, nullptr) == 1, "missing file not reported");
+}
+
+/**
+ Test cases for the bit-packed mask and region growing on it
+ */
+void MyLibUnitTest::bitMaskTest()
+{
+    BitMask mask(200);
+    QVERIFY2(mask.size() == 200 && mask.wordCount() == 4 && mask.count() == 0, "new mask not empty");
+
+    // VALID cases: single bits and ranges across word borders
+    QVERIFY2(!mask.testAndSet(63), "bit set before");
+    QVERIFY2(mask.testAndSet(63), "bit not set");
+    mask.set(64);
+    QVERIFY2(mask.test(63) && mask.test(64) && !mask.test(62) && !mask.test(65), "wrong bits set");
+    mask.reset(64);
+    QVERIFY2(!mask.test(64) && mask.count() == 1, "bit not reset");
+    mask.setRange(70, 190);
+    QVERIFY2(mask.count() == 121, "range not set");
+    QVERIFY2(!mask.test(69) && mask.test(70) && mask.test(189) && !mask.test(190), "range borders wrong");
+    QVERIFY2(mask.anyInRange(0, 64) && !mask.anyInRange(64, 70) && !mask.anyInRange(190, 200), "range test wrong");
+    mask.clear();
+    QVERIFY2(mask.count() == 0 && !mask.anyInRange(0, 200), "mask not cleared");
+    mask.setRange(3, 5);
+    QVERIFY2(mask.count() == 2 && mask.word(0) == 0x18, "range inside one word wrong");
+
+    // region growing writes its result to the mask, the visited flags are reset for the next run
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 12, 10, 6, [](int x, int y, int z) {
+        return short(x >= 2 && x < 6 && y >= 2 && y < 5 && z >= 1 && z < 4 ? 1500 : 0);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    std::vector<Voxel> region;
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowing({3, 3, 2}, 1000, region) == 0, "region growing failed");
+    QVERIFY2(dataset.region().count() == 4*3*3, "region has wrong size");
+    QVERIFY2(dataset.region().test(dataset.geometry().index(3, 3, 2)), "seed not in region");
+    QVERIFY2(!dataset.region().test(dataset.geometry().index(7, 3, 2)), "background in region");
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.region().count() == 0 && dataset.visited().count() == 0, "region growing not reset");
+    QVERIFY2(dataset.memoryUsage(CTDataset::VisitedBuffer) == (12*10*6 + 63)/64*8, "visited flags not bit-packed");
+
+    // INVALID case: seed below threshold
+    QVERIFY2(dataset.regionGrowing({8, 8, 2}, 1000, region) == 2, "seed below threshold not reported");
+}
+
+/**
+ Test cases for the connected-component labeling and the marker detection based on it
+ */
+void MyLibUnitTest::componentLabelingTest()
+{
+    // two marker-sized cubes (8x8x8 voxels, width 7), a U-shaped bar that is joined only in its last layer and a
+    // single voxel touching a cube diagonally (not connected with 6-connectivity)
+    auto phantom = [](int x, int y, int z) {
+        bool cubeA = x >= 2 && x < 10 && y >= 2 && y < 10 && z >= 2 && z < 10;
+        bool cubeB = x >= 20 && x < 28 && y >= 12 && y < 20 && z >= 4 && z < 12;
+        bool bar = (x == 32 || x == 36) && y < 4 && z < 14;
+        bool bridge = x >= 32 && x <= 36 && y < 4 && z == 13;
+        bool single = x == 10 && y == 10 && z == 10;
+        return short(cubeA || cubeB || bar || bridge || single ? 2000 : 0);
+    };
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 40, 24, 14, phantom);
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+
+    ComponentLabeler labeler;
+    QVERIFY2(labeler.label(dataset.volume(), 1500) == 4, "wrong number of components");
+    const std::vector<ComponentLabeler::Component>& components = labeler.components();
+    // components are ordered by their first voxel
+    QVERIFY2(labeler.componentAt(32, 0, 0) == 0 && labeler.componentAt(36, 3, 13) == 0, "bar not joined");
+    QVERIFY2(labeler.componentAt(2, 2, 2) == 1 && labeler.componentAt(20, 12, 4) == 2, "components out of order");
+    QVERIFY2(labeler.componentAt(10, 10, 10) == 3, "diagonal voxel joined");
+    QVERIFY2(labeler.componentAt(11, 10, 10) == -1, "background labeled");
+    QVERIFY2(components[0].voxelCount == 2*4*14 + 3*4, "wrong voxel count of bar");
+    QVERIFY2(components[1].voxelCount == 512 && components[1].width() == 7, "wrong statistics of cube");
+    QVERIFY2(components[2].minX == 20 && components[2].maxY == 19 && components[2].minZ == 4 && components[2].maxZ == 11, "wrong bounding box");
+    QVERIFY2((components[2].centroid() - Eigen::Vector3d(23.5, 15.5, 7.5)).norm() < 1e-9, "wrong centroid");
+
+    long voxels = 0;
+    for (int z = 0; z < 14; ++z)
+        for (int y = 0; y < 24; ++y)
+            for (int x = 0; x < 40; ++x)
+                voxels += labeler.componentAt(x, y, z) >= 0;
+    QVERIFY2(voxels == 512 + 512 + 2*4*14 + 3*4 + 1, "labels don't cover the volume");
+
+    // marker detection keeps both cubes only
+    CTDataset::MarkerStats markerStats;
+    dataset.getRegistrationMarkers(1500, &markerStats);
+    QVERIFY2(dataset.markerCentroids.size() == 2, "wrong number of markers");
+    QVERIFY2(markerStats.markerCount == 2 && markerStats.componentCount == 4, "wrong marker statistics");
+    QVERIFY2(dataset.markerCentroids[0].x == 5 && dataset.markerCentroids[0].y == 5 && dataset.markerCentroids[0].z == 5, "wrong marker centroid");
+    QVERIFY2(dataset.region().count() == 1024, "markers not written to region");
+    QVERIFY2(dataset.region().test(dataset.geometry().index(27, 19, 11)), "marker voxel missing in region");
+
+    // INVALID case: nothing above the threshold
+    QVERIFY2(labeler.label(dataset.volume(), 3000) == 0 && labeler.runs().empty(), "components found above maximum");
+}
+
+/**
+ Test cases for the slab-parallel labeling: the component table must not depend on the number of threads
+ */
+void MyLibUnitTest::parallelLabelingTest()
+{
+    // many small components and some that cross all slab borders
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 37, 23, 29, [](int x, int y, int z) {
+        bool pattern = (x*7 + y*13 + z*29) % 11 < 3 || (x*x + y*5 + z*z*3) % 17 == 0;
+        bool pillar = x >= 30 && x < 33 && (y == 4 || y == 18);
+        return short(pattern || pillar ? 2000 : 0);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+
+    ComponentLabeler serial;
+    int componentCount = serial.label(dataset.volume(), 1500, 1);
+    QVERIFY2(componentCount > 10, "phantom too simple");
+    for (int threads : {2, 3, 4, 7, 29, 64}){
+        ComponentLabeler parallel;
+        QVERIFY2(parallel.label(dataset.volume(), 1500, threads) == componentCount, "parallel labeling found other components");
+        QVERIFY2(parallel.runs().size() == serial.runs().size(), "parallel labeling found other runs");
+        for (size_t i = 0; i < serial.runs().size(); ++i){
+            QVERIFY2(parallel.runs()[i].begin == serial.runs()[i].begin && parallel.runs()[i].component == serial.runs()[i].component, "runs labeled differently");
+        }
+        for (int c = 0; c < componentCount; ++c){
+            const ComponentLabeler::Component& a = serial.components()[c];
+            const ComponentLabeler::Component& b = parallel.components()[c];
+            QVERIFY2(a.voxelCount == b.voxelCount && a.sumX == b.sumX && a.sumY == b.sumY && a.sumZ == b.sumZ, "component sums differ");
+            QVERIFY2(a.minX == b.minX && a.minY == b.minY && a.minZ == b.minZ && a.maxX == b.maxX && a.maxY == b.maxY && a.maxZ == b.maxZ, "bounding boxes differ");
+        }
+    }
+}
+
+/**
+ Test cases for the span-based region growing: same region as the voxel-based growing, far fewer stack entries
+ */
+void MyLibUnitTest::spanGrowingTest()
+{
+    // a hollow box with a hole in one wall and a bar leading out of it, plus a separate block
+    auto phantom = [](int x, int y, int z) {
+        bool box = x >= 3 && x < 30 && y >= 3 && y < 20 && z >= 2 && z < 15;
+        bool inside = x >= 5 && x < 28 && y >= 5 && y < 18 && z >= 4 && z < 13;
+        bool hole = x >= 10 && x < 12 && y >= 5 && y < 7 && z >= 3 && z < 4;
+        bool bar = x >= 14 && x < 16 && y == 11 && z >= 4 && z < 13;
+        bool block = x >= 33 && x < 38 && y >= 2 && y < 8 && z >= 2 && z < 8;
+        return short((box && (!inside || bar) && !hole) || block ? 1200 : -500);
+    };
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 40, 24, 17, phantom);
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+
+    std::vector<Voxel> region;
+    CTDataset::GrowingStats voxelStats;
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowing({3, 3, 2}, 1000, region, &voxelStats) == 0, "voxel growing failed");
+    BitMask voxelRegion = dataset.region();
+
+    CTDataset::GrowingStats spanStats;
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingSpans({3, 3, 2}, 1000, &spanStats) == 0, "span growing failed");
+    const BitMask& spanRegion = dataset.region();
+
+    // both fills reach the whole box, the bar through it and nothing of the block
+    QVERIFY2(spanStats.voxelCount == spanRegion.count(), "span growing counted wrong");
+    QVERIFY2(spanRegion.count() == voxelRegion.count(), "span growing found another region");
+    for (qint64 i = 0; i < spanRegion.size(); ++i){
+        QVERIFY2(spanRegion.test(i) == voxelRegion.test(i), "span growing found another region");
+    }
+    QVERIFY2(spanRegion.test(dataset.geometry().index(15, 11, 8)), "bar inside the box not reached");
+    QVERIFY2(!spanRegion.test(dataset.geometry().index(35, 4, 4)), "separate block reached");
+    QVERIFY2(spanStats.peakFrontier < voxelStats.peakFrontier, "span stack not smaller");
+    QVERIFY2(spanStats.peakFrontierBytes == spanStats.peakFrontier*qint64(sizeof(Voxel)), "wrong stack size");
+
+    // INVALID cases
+    QVERIFY2(dataset.regionGrowingSpans({40, 0, 0}, 1000) == 1, "seed outside not reported");
+    QVERIFY2(dataset.regionGrowingSpans({0, 0, 0}, 1000) == 2, "seed below threshold not reported");
+}
+
+/**
+ Test cases for the parallel region growing: same region as the serial fill for every thread count, and faster than the
+ serial fill on as many threads as there are cores
+ */
+void MyLibUnitTest::parallelGrowingTest()
+{
+    // a 3D grid of bars, a large and branchy region, that touches the border of the volume. A layer is no multiple of
+    // 64 voxels, so neighbouring slabs share words of the masks
+    auto grid = [](int x, int y, int z) {
+        int bars = (x % 6 < 2) + (y % 6 < 2) + (z % 6 < 2);
+        return short(bars >= 2 || (x + 2*y + 3*z) % 29 == 0 ? 1300 : -200);
+    };
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 97, 81, 71, grid);
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+
+    CTDataset::GrowingStats serialStats;
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingSpans({0, 0, 0}, 1000, &serialStats) == 0, "serial growing failed");
+    BitMask serialRegion = dataset.region();
+
+    for (int threads : {1, 2, 3, 4, 7, 8}){
+        CTDataset::GrowingStats stats;
+        dataset.resetRegionGrowing();
+        QVERIFY2(dataset.regionGrowingParallel({0, 0, 0}, 1000, threads, &stats) == 0, "parallel growing failed");
+        QVERIFY2(stats.threadCount == threads, "wrong thread count");
+        QVERIFY2(stats.voxelCount == serialStats.voxelCount, "parallel growing counted another region");
+        QVERIFY2(dataset.region().count() == serialRegion.count(), "parallel growing found another region");
+        for (qint64 w = 0; w < serialRegion.wordCount(); ++w){
+            QVERIFY2(dataset.region().word(w) == serialRegion.word(w), "parallel growing found another region");
+        }
+    }
+    // the seed in the middle of the volume, the slabs before and after it get their pieces from the seed's slab
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingParallel({48, 48, 36}, 1000, 5) == 0, "parallel growing failed");
+    QVERIFY2(dataset.region().count() == serialRegion.count(), "parallel growing found another region");
+    // the reset after a parallel run has to clear everything it set
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.region().count() == 0 && dataset.visited().count() == 0, "parallel growing not reset");
+
+    // INVALID cases
+    QVERIFY2(dataset.regionGrowingParallel({-1, 0, 0}, 1000) == 1, "seed outside not reported");
+    QVERIFY2(dataset.regionGrowingParallel({3, 3, 3}, 1000) == 2, "seed below threshold not reported");
+
+    // time of the whole grid of a 256x256x160 volume, best of 3 runs. Several threads have to beat the serial fill as long
+    // as each of them gets a core
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 256, 256, 160, grid);
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    qint64 serialNs = LLONG_MAX;
+    for (int i = 0; i < 3; ++i){
+        big.resetRegionGrowing();
+        big.regionGrowingSpans({0, 0, 0}, 1000, &serialStats);
+        serialNs = std::min(serialNs, serialStats.elapsedNs);
+    }
+    const int CORES = int(std::thread::hardware_concurrency());
+    for (int threads : {1, 2, 4, 8}){
+        qint64 parallelNs = LLONG_MAX;
+        CTDataset::GrowingStats stats;
+        for (int i = 0; i < 3; ++i){
+            big.resetRegionGrowing();
+            QVERIFY2(big.regionGrowingParallel({0, 0, 0}, 1000, threads, &stats) == 0, "parallel growing failed");
+            QVERIFY2(stats.voxelCount == serialStats.voxelCount, "parallel growing counted another region");
+            parallelNs = std::min(parallelNs, stats.elapsedNs);
+        }
+        const double speedup = double(serialNs)/parallelNs;
+        qDebug() << threads << "threads:" << serialStats.voxelCount*1e3/parallelNs << "Mvoxels/s, speedup over serial span fill"
+                 << speedup << (threads > 1 && threads > CORES ? "(not checked, more threads than cores)" : "");
+        if (threads > 1 && threads <= CORES){
+            QVERIFY2(speedup > 1, "parallel growing not faster than the serial fill");
+        }
+    }
+}
+
+/**
+ Test cases for the run-length encoded region
+ */
+void MyLibUnitTest::compactRegionTest()
+{
+    VolumeGeometry geometry(10, 6, 4, 1, 1, 1);
+    // an L-shaped region and a voxel at the end of a row, given unsorted and with duplicates
+    std::vector<Voxel> voxels = {{9, 5, 3}, {2, 1, 1}, {3, 1, 1}, {4, 1, 1}, {2, 2, 1}, {3, 1, 1}, {2, 3, 2}, {0, 2, 1}};
+    CompactRegion region = CompactRegion::fromVoxels(voxels, geometry);
+    QVERIFY2(region.voxelCount() == 7 && region.spans().size() == 5, "wrong runs");
+    QVERIFY2(region.spans()[0].begin == 2 && region.spans()[0].end == 5, "neighbouring voxels not joined");
+    QVERIFY2(region.contains(3, 1, 1) && region.contains(9, 5, 3) && !region.contains(5, 1, 1) && !region.contains(1, 2, 1), "wrong lookup");
+    QVERIFY2(region.minimum().x == 0 && region.minimum().y == 1 && region.minimum().z == 1, "wrong minimum");
+    QVERIFY2(region.maximum().x == 9 && region.maximum().y == 5 && region.maximum().z == 3, "wrong maximum");
+    Eigen::Vector3d expected(2+3+4+2+2+0+9, 1+1+1+2+3+2+5, 1+1+1+1+2+1+3);
+    QVERIFY2((region.centroid() - expected/7).norm() < 1e-9, "wrong centroid");
+
+    // iterating gives every voxel once in scan order
+    std::vector<qint64> visited;
+    for (Voxel voxel : region){
+        visited.push_back(geometry.index(voxel.x, voxel.y, voxel.z));
+    }
+    QVERIFY2(visited.size() == 7 && std::is_sorted(visited.begin(), visited.end()), "wrong iteration");
+
+    // mask -> runs -> mask gives the same mask
+    BitMask mask(geometry.voxelCount());
+    region.rasterize(mask);
+    QVERIFY2(mask.count() == 7 && mask.test(geometry.index(4, 1, 1)), "wrong rasterisation");
+    CompactRegion copy = CompactRegion::fromMask(mask, geometry);
+    QVERIFY2(copy.spans().size() == region.spans().size(), "runs changed");
+    for (size_t i = 0; i < copy.spans().size(); ++i){
+        QVERIFY2(copy.spans()[i].begin == region.spans()[i].begin && copy.spans()[i].end == region.spans()[i].end
+                 && copy.spans()[i].y == region.spans()[i].y && copy.spans()[i].z == region.spans()[i].z, "runs changed");
+    }
+
+    // markers are kept as runs
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 30, 20, 16, [](int x, int y, int z) {
+        return short(x >= 2 && x < 10 && y >= 2 && y < 10 && z >= 3 && z < 11 ? 2000 : 0);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    dataset.getRegistrationMarkers(1500);
+    QVERIFY2(dataset.markerRegions.size() == 1 && dataset.markerRegions[0].voxelCount() == 512, "marker not kept");
+    QVERIFY2(dataset.markerRegions[0].memoryUsage() <= 64*qint64(sizeof(CompactRegion::Span)), "marker not stored as runs");
+    QVERIFY2(dataset.compactRegion().voxelCount() == 512, "region not converted");
+
+    // INVALID case: empty region
+    CompactRegion empty;
+    QVERIFY2(empty.isEmpty() && empty.begin() == empty.end() && !empty.contains(0, 0, 0), "empty region not empty");
+}
+
+/**
+ Test cases for the windowing lookup table: same gray values as CTDataset::windowing, overlay above the threshold
+ */
+void MyLibUnitTest::windowingLutTest()
+{
+    WindowingLut lut;
+    QVERIFY2(lut.update(-200, 800, 1200, 0xffff0000u), "table not rebuilt");
+    QVERIFY2(!lut.update(-200, 800, 1200, 0xffff0000u), "table rebuilt without change");
+
+    for (int hu = WindowingLut::MinHU; hu <= WindowingLut::MaxHU; ++hu){
+        int grayValue = 0;
+        CTDataset::windowing(hu, -200, 800, grayValue);
+        QVERIFY2(lut.gray(hu) == grayValue, "gray value differs from windowing");
+        quint32 expected = hu >= 1200 ? 0xffff0000u : 0xff000000u | quint32(grayValue)*0x010101u;
+        QVERIFY2(lut.color(hu) == expected, "wrong color");
+    }
+
+    // a row that is not a multiple of the vector width, with values outside the HU range
+    std::vector<short> row(203);
+    for (size_t i = 0; i < row.size(); ++i){
+        row[i] = short(int(i)*37 % 5000 - 1500);
+    }
+    std::vector<quint32> pixels(row.size());
+    std::vector<uchar> grays(row.size());
+    lut.apply(row.data(), pixels.data(), int(row.size()));
+    lut.applyGray(row.data(), grays.data(), int(row.size()));
+    for (size_t i = 0; i < row.size(); ++i){
+        QVERIFY2(pixels[i] == lut.color(row[i]) && grays[i] == lut.gray(row[i]), "converted row differs from table");
+    }
+    QVERIFY2(lut.color(-3000) == lut.color(-1024) && lut.color(5000) == lut.color(3071), "values outside not clamped");
+
+    // without threshold nothing is red
+    lut.update(0, 255);
+    QVERIFY2(lut.color(3071) == 0xffffffffu && lut.color(100) == 0xff646464u, "overlay without threshold");
+}
+
+/**
+ Test cases for DisplayCache: all layers hold the 8 bit codes of the table, a new windowing invalidates them and a
+ volume that exceeds the memory budget is not cached
+ */
+void MyLibUnitTest::displayCacheTest()
+{
+    const int WIDTH = 21;
+    const int HEIGHT = 9;
+    const int LAYERS = 13;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) { return short((x*97 + y*31 + z*211) % 4000 - 1200); });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+
+    WindowingLut lut;
+    lut.update(-100, 600, 1500);
+    DisplayCache cache;
+    QVERIFY2(cache.rebuild(dataset.volume(), lut, 6, 3), "rebuild not started");
+    QVERIFY2(cache.bytesPerLine() == 24, "rows not padded to 4 bytes");
+    cache.wait();
+    QVERIFY2(cache.layersReady() == LAYERS, "not all layers converted");
+    for (int z = 0; z < LAYERS; ++z){
+        QVERIFY2(cache.isLayerReady(z), "layer not ready");
+        const uchar* layer = cache.layer(z);
+        for (int y = 0; y < HEIGHT; ++y){
+            for (int x = 0; x < WIDTH; ++x){
+                QVERIFY2(layer[y*cache.bytesPerLine() + x] == lut.code(dataset.volume().at(x, y, z)), "wrong code");
+            }
+        }
+    }
+    QVERIFY2(!cache.isLayerReady(-1) && !cache.isLayerReady(LAYERS), "layer outside the volume ready");
+
+    // a new windowing invalidates all layers until they are converted again, the memory is kept
+    const qint64 bytes = cache.memoryUsage();
+    lut.update(200, 100);
+    QVERIFY2(cache.rebuild(dataset.volume(), lut, 0, 1), "rebuild not started");
+    cache.cancel();
+    int ready = 0;
+    for (int z = 0; z < LAYERS; ++z){
+        ready += cache.isLayerReady(z) ? 1 : 0;
+    }
+    QVERIFY2(ready == cache.layersReady(), "layers of the old windowing shown");
+    QVERIFY2(cache.rebuild(dataset.volume(), lut, 12), "rebuild not started");
+    cache.wait();
+    QVERIFY2(cache.memoryUsage() == bytes, "memory reallocated for the same volume");
+    QVERIFY2(cache.layer(12)[0] == lut.code(dataset.volume().at(0, 0, 12)), "layer converted with the old windowing");
+
+    // 24 bytes x 9 rows x 13 layers don't fit 2000 bytes
+    cache.setMemoryBudget(2000);
+    QVERIFY2(cache.memoryUsage() == 0 && !cache.isLayerReady(0), "cache not released by the budget");
+    QVERIFY2(!cache.rebuild(dataset.volume(), lut, 0), "volume cached beyond the budget");
+    cache.setMemoryBudget(24*HEIGHT*LAYERS);
+    QVERIFY2(cache.rebuild(dataset.volume(), lut, 0), "volume fitting the budget not cached");
+    cache.release();
+    QVERIFY2(cache.memoryUsage() == 0 && cache.layersReady() == 0, "cache not released");
+}
+
+/**
+ Test cases for ComputeExecutor: newer requests replace pending ones of the same key, cancel running ones and make the
+ older versions stale; jobs of other keys are not affected
+ */
+void MyLibUnitTest::computeExecutorTest()
+{
+    ComputeExecutor executor;
+    std::atomic<bool> started(false);
+    std::atomic<bool> sawCancel(false);
+    std::vector<int> finished;
+    std::mutex finishedMutex;
+    auto record = [&](int value){
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.push_back(value);
+    };
+
+    // a long job of key 0 that only stops when it is cancelled
+    qint64 first = executor.submit(0, [&](const ComputeExecutor::CancelToken& token){
+        started = true;
+        while (!token.isCancelled()){
+            std::this_thread::yield();
+        }
+        sawCancel = true;
+    });
+    while (!started){
+        std::this_thread::yield();
+    }
+    QVERIFY2(executor.isCurrent(0, first), "running request not current");
+
+    // three requests of key 1 while the worker is busy, only the last one runs
+    qint64 last = 0;
+    for (int i = 1; i <= 3; ++i){
+        last = executor.submit(1, [&, i](const ComputeExecutor::CancelToken&){ record(i); });
+    }
+    QVERIFY2(executor.pendingCount() == 1, "stale requests not dropped");
+
+    // a new request of key 0 cancels the running one
+    qint64 second = executor.submit(0, [&](const ComputeExecutor::CancelToken& token){ record(10 + int(token.isCancelled())); });
+    QVERIFY2(!executor.isCurrent(0, first) && executor.isCurrent(0, second), "versions not replaced");
+    executor.waitForIdle();
+    QVERIFY2(sawCancel, "running job not cancelled");
+    QVERIFY2(finished == std::vector<int>({3, 10}), "wrong jobs ran");
+
+    ComputeExecutor::Stats stats = executor.stats();
+    QVERIFY2(stats.submitted == 5 && stats.dropped == 2 && stats.cancelled == 1 && stats.completed == 2, "wrong counts");
+
+    // cancelling makes the results of the last version stale
+    QVERIFY2(executor.isCurrent(1, last), "finished request not current");
+    executor.cancel(1);
+    QVERIFY2(!executor.isCurrent(1, last), "cancelled request still current");
+
+    // region growing stops when the flag is set
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, 24, 24, 24, [](int, int, int) { return short(500); });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    std::atomic<bool> cancel(true);
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingParallel({12, 12, 12}, 100, 2, nullptr, &cancel) == 4, "region growing not cancelled");
+    QVERIFY2(dataset.region().count() < 24*24*24, "region grown completely");
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingSpans({12, 12, 12}, 100, nullptr, &cancel) == 4, "span growing not cancelled");
+    QVERIFY2(dataset.region().count() < 24*24*24, "region grown completely");
+    cancel = false;
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingParallel({12, 12, 12}, 100, 2, nullptr, &cancel) == 0, "region growing failed");
+    QVERIFY2(dataset.region().count() == 24*24*24, "region incomplete");
+}
+
+/**
+ Test cases for ProcessingGraph and CTPipeline: only stages whose inputs or parameters changed are computed again, and
+ the cached outputs equal a direct computation
+ */
+void MyLibUnitTest::processingGraphTest()
+{
+    // a -> b -> c with parameter p on b, d fails as long as p is negative
+    ProcessingGraph graph;
+    int p = graph.addParameter(1);
+    int a = graph.addSource();
+    int b = graph.addNode([](){ return 0; }, {a}, {p});
+    int c = graph.addNode([](){ return 0; }, {b});
+    int d = graph.addNode([&](){ return graph.parameter(p) < 0 ? 5 : 0; }, {a}, {p});
+    graph.touch(a);
+    QVERIFY2(graph.isDirty(c) && graph.update(c) == 0, "first update failed");
+    QVERIFY2(!graph.isDirty(c) && graph.update(c) == 0 && graph.computeCount(c) == 1, "clean node computed");
+    QVERIFY2(!graph.setParameter(p, 1) && !graph.isDirty(c), "same value made nodes dirty");
+    QVERIFY2(graph.setParameter(p, 2) && graph.isDirty(c), "parameter change not seen downstream");
+    graph.update(c);
+    QVERIFY2(graph.computeCount(b) == 2 && graph.computeCount(c) == 2, "dirty nodes not computed");
+    graph.setParameter(p, -1);
+    QVERIFY2(graph.update(d) == 5 && graph.isDirty(d), "failed node not kept dirty");
+    graph.setParameter(p, 3);
+    QVERIFY2(graph.update(d) == 0 && graph.computeCount(d) == 1, "failed node not computed again");
+    graph.invalidate(b);
+    graph.update(c);
+    QVERIFY2(graph.computeCount(b) == 3 && graph.computeCount(c) == 3, "invalidated node not computed");
+
+    // the pipeline on a phantom with a step in y
+    const int WIDTH = 20;
+    const int HEIGHT = 16;
+    const int LAYERS = 10;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) { return short(y > 4 + (x + z) % 5 ? 800 : -500); });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    CTPipeline pipeline(dataset);
+    pipeline.volumeChanged();
+    pipeline.setThreshold(300);
+    QVERIFY2(pipeline.update(CTPipeline::ShadedView) == 0, "3D view failed");
+
+    // same depth map as directly from the volume
+    dataset.calculateDepthBuffer(300, dataset.volume());
+    QVERIFY2(std::equal(pipeline.depthMap().begin(), pipeline.depthMap().end(), dataset.depthbuffer()), "depth map differs");
+    std::vector<short> shaded(WIDTH*LAYERS, 0);
+    dataset.renderDepthBuffer(shaded.data());
+    QVERIFY2(shaded == pipeline.shadedView(), "shaded view differs");
+
+    // a new windowing of the reslices doesn't touch the 3D view, the same threshold neither
+    pipeline.setLocalReslice({10, 8, 5}, {1, 5, 1});
+    QVERIFY2(pipeline.update(CTPipeline::LocalReslices) == 0, "reslices failed");
+    dataset.reconstructLayer({10, 8, 5}, {1, 5, 1}, {0, 0, 1});
+    QVERIFY2(std::equal(pipeline.localReslice(1).begin(), pipeline.localReslice(1).end(), dataset.crosssection()), "reslice differs");
+    const ProcessingGraph& stages = pipeline.graph();
+    pipeline.setThreshold(300);
+    pipeline.setLocalReslice({10, 8, 5}, {1, 5, 1});
+    QVERIFY2(!pipeline.isDirty(CTPipeline::ShadedView) && !pipeline.isDirty(CTPipeline::LocalReslices), "unchanged stages dirty");
+
+    // a new threshold computes the 3D view again but not the reslices, moving the position the other way round
+    pipeline.setThreshold(900);
+    QVERIFY2(pipeline.isDirty(CTPipeline::ShadedView) && !pipeline.isDirty(CTPipeline::LocalReslices), "wrong stages dirty");
+    pipeline.update(CTPipeline::ShadedView);
+    QVERIFY2(std::count(pipeline.depthMap().begin(), pipeline.depthMap().end(), 0) == WIDTH*LAYERS, "depth map not updated");
+    pipeline.setLocalReslice({11, 8, 5}, {1, 5, 1});
+    pipeline.update(CTPipeline::LocalReslices);
+    QVERIFY2(stages.computeCount(CTPipeline::ShadedView) == 2 && stages.computeCount(CTPipeline::LocalReslices) == 2, "wrong number of computations");
+
+    // new reslices are windowed into the images while they are sampled, a new windowing converts the cached ones
+    const int COLUMNS = dataset.geometry().width();
+    const int ROWS = dataset.geometry().height();
+    std::vector<quint32> images[2] = {std::vector<quint32>(COLUMNS*ROWS, 0), std::vector<quint32>(COLUMNS*ROWS, 0)};
+    std::vector<quint32> expected(COLUMNS*ROWS, 0);
+    WindowingLut lut;
+    for (int windowStart : {-200, 400}){
+        lut.update(windowStart, 1000);
+        if (windowStart == -200){
+            pipeline.setLocalReslice({12, 8, 5}, {1, 5, 1});
+        }
+        QVERIFY2(pipeline.updateCrosssections(CTPipeline::LocalReslices, images[0].data(), images[1].data(),
+                                              COLUMNS*int(sizeof(quint32)), lut) == 0, "cross sections failed");
+        for (int d = 0; d < 2; ++d){
+            CTDataset::windowLayer(pipeline.localReslice(d).data(), COLUMNS, ROWS, lut, expected.data(), COLUMNS*int(sizeof(quint32)));
+            QVERIFY2(images[d] == expected, "cross section image differs");
+        }
+    }
+    QVERIFY2(stages.computeCount(CTPipeline::LocalReslices) == 3, "reslices computed again for a new windowing");
+
+    // a new volume makes everything dirty
+    pipeline.volumeChanged();
+    QVERIFY2(pipeline.isDirty(CTPipeline::ShadedView) && pipeline.isDirty(CTPipeline::WorldReslices), "stages clean after loading");
+}
+
+/**
+ Test cases for RayMaxIndex: depth buffers from the running maxima equal the ones marched through the volume for all
+ thresholds, independent of the number of threads
+ */
+void MyLibUnitTest::rayIndexTest()
+{
+    const int WIDTH = 23;
+    const int HEIGHT = 31;
+    const int LAYERS = 11;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*7919 + y*104729 + z*1299709) % 2600 - 1100 + y*20);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    QVERIFY2(dataset.memoryUsage(CTDataset::RayIndexBuffer) == 0, "index built while loading");
+
+    const RayMaxIndex& index = dataset.rayIndex();
+    QVERIFY2(index.isValid() && dataset.memoryUsage(CTDataset::RayIndexBuffer) > 0, "index not built");
+    QVERIFY2(index.breakpointCount() <= qint64(WIDTH)*HEIGHT*LAYERS, "too many breakpoints");
+
+    RayMaxIndex serial;
+    serial.build(dataset.volume(), 1);
+    QVERIFY2(serial.breakpointCount() == index.breakpointCount(), "index depends on the number of threads");
+
+    std::vector<short> marched(WIDTH*LAYERS);
+    for (int threshold : {-3000, -1100, -200, 0, 450, 1200, 2100, 3000}){
+        dataset.calculateDepthBuffer(threshold, dataset.volume());
+        std::copy(dataset.depthbuffer(), dataset.depthbuffer() + WIDTH*LAYERS, marched.begin());
+        QVERIFY2(dataset.calculateDepthBuffer(threshold, index) == 0, "depth buffer from index failed");
+        QVERIFY2(std::equal(marched.begin(), marched.end(), dataset.depthbuffer()), "depth buffer differs");
+
+        // single rays against a linear search
+        for (int z = 0; z < LAYERS; ++z){
+            for (int x = 0; x < WIDTH; ++x){
+                int expected = -1;
+                for (int y = 0; y < HEIGHT && expected < 0; ++y){
+                    expected = dataset.volume().at(x, y, z) >= threshold ? y : -1;
+                }
+                QVERIFY2(serial.depth(x, z, threshold) == expected, "wrong depth of a ray");
+            }
+        }
+    }
+
+    dataset.releaseWorkingBuffers();
+    QVERIFY2(dataset.memoryUsage(CTDataset::RayIndexBuffer) == 0, "index not released");
+    RayMaxIndex empty;
+    QVERIFY2(dataset.calculateDepthBuffer(0, empty) == 1 && empty.depth(0, 0, 0) == -1, "empty index used");
+}
+
+/**
+ Test cases for the row-wise depth buffer: equal to marching each ray, for copied and memory-mapped volumes, widths that
+ are no multiple of 16 and any number of threads
+ */
+void MyLibUnitTest::depthBufferTest()
+{
+    const int WIDTH = 37;
+    const int HEIGHT = 29;
+    const int LAYERS = 9;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*7919 + y*104729 + z*1299709) % 3000 - 1500 + y*40);
+    });
+    std::vector<short> expected(WIDTH*LAYERS);
+    for (CTDataset::LoadMode mode : {CTDataset::CopyLoad, CTDataset::MappedLoad}){
+        CTDataset dataset;
+        QVERIFY2(dataset.load(path, mode) == 0, "phantom could not be loaded");
+        for (int threshold : {-40000, -32768, -1500, 0, 700, 1900, 2600, 32767, 40000}){
+            marchDepthBuffer(dataset.volume(), threshold, expected.data());
+            for (int threads : {1, 3, 0}){
+                std::fill(dataset.depthbuffer(), dataset.depthbuffer() + WIDTH*LAYERS, short(-1));
+                QVERIFY2(dataset.calculateDepthBuffer(threshold, dataset.volume(), threads) == 0, "depth buffer failed");
+                QVERIFY2(std::equal(expected.begin(), expected.end(), dataset.depthbuffer()), "depth buffer differs");
+            }
+        }
+    }
+}
+
+/**
+ Benchmark of the depth buffer on a synthetic spine phantom of 256^3 voxels: marching each ray against the row-wise
+ version
+ */
+void MyLibUnitTest::depthBufferBenchmark()
+{
+    // air around an elliptic body of soft tissue with a column of bone in it, like the sample spine model
+    const int SIZE = 256;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, SIZE, SIZE, SIZE, [](int x, int y, int z) {
+        const double bodyX = (x - SIZE/2)/(0.45*SIZE);
+        const double bodyY = (y - SIZE/2)/(0.3*SIZE);
+        const double boneX = (x - SIZE/2)/(0.1*SIZE);
+        const double boneY = (y - 0.6*SIZE)/(0.08*SIZE);
+        const int noise = (x*7 + y*13 + z*29) % 40;
+        if (boneX*boneX + boneY*boneY < 1 && z % 32 < 26){
+            return short(700 + (x*y + z) % 600);
+        }
+        return short(bodyX*bodyX + bodyY*bodyY < 1 ? 20 + noise : -1000 + noise);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeGeometry& geometry = dataset.geometry();
+    const int threshold = 300;
+    std::vector<short> expected(size_t(geometry.width())*geometry.layers());
+
+    QElapsedTimer timer;
+    timer.start();
+    marchDepthBuffer(dataset.volume(), threshold, expected.data());
+    const qint64 marchNs = timer.nsecsElapsed();
+    timer.restart();
+    dataset.calculateDepthBuffer(threshold, dataset.volume(), 1);
+    const qint64 rowsNs = timer.nsecsElapsed();
+    QVERIFY2(std::equal(expected.begin(), expected.end(), dataset.depthbuffer()), "depth buffer differs");
+    qDebug() << "depth buffer: marching" << marchNs/1e6 << "ms, row-wise on 1 thread" << rowsNs/1e6 << "ms";
+
+    QBENCHMARK {
+        dataset.calculateDepthBuffer(threshold, dataset.volume());
+    }
+}
+
+/**
+ Test cases for the brick pyramid: minimum and maximum of every brick, boxes never skip a voxel at the threshold and the
+ passes that skip bricks give the same results as reading every voxel
+ */
+void MyLibUnitTest::brickPyramidTest()
+{
+    // air with a few bone blocks, the size is no multiple of the brick size
+    const int WIDTH = 37;
+    const int HEIGHT = 29;
+    const int LAYERS = 21;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        bool block = (x >= 3 && x < 9 && y >= 18 && y < 25 && z >= 2 && z < 8) || (x >= 25 && x < 34 && y >= 5 && z >= 12);
+        bool speck = (x*7 + y*13 + z*29) % 1999 == 0;
+        return short(block ? 1200 + (x*y + z) % 900 : (speck ? 1800 : -1000 + (x + y + z) % 50));
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    QVERIFY2(dataset.memoryUsage(CTDataset::BrickBuffer) == 0, "bricks built while loading");
+    const VolumeView& volume = dataset.volume();
+
+    const BrickPyramid& bricks = dataset.bricks();
+    QVERIFY2(bricks.isValid() && dataset.memoryUsage(CTDataset::BrickBuffer) > 0, "bricks not built");
+    QVERIFY2(bricks.bricksX() == 5 && bricks.bricksY() == 4 && bricks.bricksZ() == 3, "wrong number of bricks");
+    const int top = bricks.levelCount() - 1;
+    QVERIFY2(bricks.bricksX(top) == 1 && bricks.bricksY(top) == 1 && bricks.bricksZ(top) == 1, "top level is not one brick");
+    short lowest = SHRT_MAX;
+    short highest = SHRT_MIN;
+    for (int bz = 0; bz < bricks.bricksZ(); ++bz){
+        for (int by = 0; by < bricks.bricksY(); ++by){
+            for (int bx = 0; bx < bricks.bricksX(); ++bx){
+                short minimum = SHRT_MAX;
+                short maximum = SHRT_MIN;
+                for (int z = bz*8; z < std::min(bz*8 + 8, LAYERS); ++z){
+                    for (int y = by*8; y < std::min(by*8 + 8, HEIGHT); ++y){
+                        for (int x = bx*8; x < std::min(bx*8 + 8, WIDTH); ++x){
+                            minimum = std::min(minimum, volume.at(x, y, z));
+                            maximum = std::max(maximum, volume.at(x, y, z));
+                        }
+                    }
+                }
+                QVERIFY2(bricks.minimum(bx, by, bz) == minimum && bricks.maximum(bx, by, bz) == maximum, "wrong brick range");
+                lowest = std::min(lowest, minimum);
+                highest = std::max(highest, maximum);
+            }
+        }
+    }
+    QVERIFY2(bricks.minimum(0, 0, 0, top) == lowest && bricks.maximum(0, 0, 0, top) == highest, "wrong top level range");
+    BrickPyramid serial;
+    serial.build(volume, 8, 1);
+    QVERIFY2(serial.maximum(4, 3, 2) == bricks.maximum(4, 3, 2), "bricks depend on the number of threads");
+
+    // boxes: mayReach is false only if no voxel reaches the threshold, allReach only if all voxels do
+    for (int i = 0; i < 300; ++i){
+        const int x0 = (i*7) % WIDTH, y0 = (i*11) % HEIGHT, z0 = (i*13) % LAYERS;
+        const int x1 = std::min(WIDTH, x0 + 1 + (i*5) % 20), y1 = std::min(HEIGHT, y0 + 1 + (i*3) % 15), z1 = std::min(LAYERS, z0 + 1 + i % 9);
+        const int threshold = 1000 + (i*37) % 1200;
+        short minimum = SHRT_MAX;
+        short maximum = SHRT_MIN;
+        for (int z = z0; z < z1; ++z){
+            for (int y = y0; y < y1; ++y){
+                for (int x = x0; x < x1; ++x){
+                    minimum = std::min(minimum, volume.at(x, y, z));
+                    maximum = std::max(maximum, volume.at(x, y, z));
+                }
+            }
+        }
+        QVERIFY2(maximum < threshold || bricks.mayReach(x0, y0, z0, x1, y1, z1, threshold), "box skipped a voxel");
+        QVERIFY2(minimum >= threshold || !bricks.allReach(x0, y0, z0, x1, y1, z1, threshold), "box has a voxel below");
+    }
+
+    // depth buffers with and without skipping
+    std::vector<short> expected(WIDTH*LAYERS);
+    for (int threshold : {-1000, 500, 1200, 1700, 2500}){
+        marchDepthBuffer(volume, threshold, expected.data());
+        for (int threads : {1, 3}){
+            QVERIFY2(dataset.calculateDepthBuffer(threshold, volume, threads) == 0, "depth buffer failed");
+            QVERIFY2(std::equal(expected.begin(), expected.end(), dataset.depthbuffer()), "depth buffer differs with bricks");
+        }
+        if (threshold >= 1200){
+            QVERIFY2(dataset.skipStats(CTDataset::DepthBufferPass).skippedVoxels > 0, "no brick skipped");
+        }
+        BitMask all(volume.geometry().voxelCount());
+        all.setRange(0, all.size());
+        QVERIFY2(dataset.calculateDepthBuffer(threshold, all) == 0, "depth buffer of a mask failed");
+        QVERIFY2(std::equal(expected.begin(), expected.end(), dataset.depthbuffer()), "depth buffer of a mask differs");
+    }
+
+    // windowed layers and the display cache with and without skipping, air below the window and bone above the
+    // threshold are filled from the bricks
+    WindowingLut lut;
+    lut.update(-500, 1000, 1500, 0xff00ff00u);
+    DisplayCache cache;
+    QVERIFY2(cache.rebuild(volume, lut, 0, 2, &bricks), "rebuild not started");
+    cache.wait();
+    QVERIFY2(cache.skipStats().voxels == volume.geometry().voxelCount(), "wrong number of converted voxels");
+    QVERIFY2(cache.skipStats().skippedFraction() > 0.3, "too few voxels filled from the bricks");
+    const int BYTES = (WIDTH + 3)/4*4;
+    std::vector<uchar> codes(size_t(BYTES)*HEIGHT);
+    std::vector<quint32> colors(size_t(WIDTH)*HEIGHT);
+    std::vector<quint32> expectedColors(colors.size());
+    std::vector<short> row(WIDTH);
+    for (int z = 0; z < LAYERS; ++z){
+        QVERIFY2(DisplayCache::windowLayer(volume, nullptr, lut, z, codes.data(), BYTES) == 0, "skipped without bricks");
+        QVERIFY2(std::equal(codes.begin(), codes.end(), cache.layer(z)), "cached layer differs with bricks");
+        DisplayCache::windowLayer(volume, &bricks, lut, z, colors.data(), WIDTH*4);
+        for (int y = 0; y < HEIGHT; ++y){
+            volume.readRow(y, z, row.data());
+            lut.apply(row.data(), expectedColors.data() + y*WIDTH, WIDTH);
+        }
+        QVERIFY2(colors == expectedColors, "colors differ with bricks");
+    }
+
+    // running maxima with and without skipping
+    RayMaxIndex plainIndex;
+    RayMaxIndex skippingIndex;
+    BrickPyramid::SkipStats indexStats;
+    plainIndex.build(volume, 2);
+    skippingIndex.build(volume, 2, &bricks, &indexStats);
+    QVERIFY2(skippingIndex.breakpointCount() == plainIndex.breakpointCount(), "breakpoints differ with bricks");
+    for (int threshold : {-1000, -970, 1200, 1800, 2100}){
+        for (int z = 0; z < LAYERS; ++z){
+            for (int x = 0; x < WIDTH; ++x){
+                QVERIFY2(skippingIndex.depth(x, z, threshold) == plainIndex.depth(x, z, threshold), "depth differs with bricks");
+            }
+        }
+    }
+    // the noise of the air raises the running maxima for a while, only bricks behind a block are skipped
+    QVERIFY2(indexStats.skippedFraction() > 0.05, "too few voxels skipped by the index");
+    dataset.rayIndex();
+    QVERIFY2(dataset.skipStats(CTDataset::RayIndexPass).skippedVoxels == indexStats.skippedVoxels, "rayIndex skipped other bricks");
+    qDebug() << "Bricks filled by the display cache:" << cache.skipStats().skippedFraction()
+             << "skipped by the ray index:" << indexStats.skippedFraction();
+
+    // labeling with and without skipping
+    for (int threshold : {-990, 1200, 1800, 2000}){
+        ComponentLabeler plain;
+        ComponentLabeler skipping;
+        BrickPyramid::SkipStats stats;
+        const int componentCount = plain.label(volume, threshold, 2);
+        QVERIFY2(skipping.label(volume, threshold, 2, &bricks, &stats) == componentCount, "labeling with bricks found other components");
+        QVERIFY2(skipping.runs().size() == plain.runs().size(), "labeling with bricks found other runs");
+        for (size_t i = 0; i < plain.runs().size(); ++i){
+            QVERIFY2(skipping.runs()[i].begin == plain.runs()[i].begin && skipping.runs()[i].end == plain.runs()[i].end
+                     && skipping.runs()[i].component == plain.runs()[i].component, "runs labeled differently");
+        }
+        QVERIFY2(stats.voxels == volume.geometry().voxelCount(), "wrong number of voxels");
+        QVERIFY2(threshold < 0 || stats.skippedFraction() > 0.2, "too few voxels skipped");
+    }
+    dataset.getRegistrationMarkers(1500);
+    QVERIFY2(dataset.skipStats(CTDataset::MarkerPass).skippedVoxels > 0, "marker detection skipped nothing");
+
+    dataset.releaseWorkingBuffers();
+    QVERIFY2(dataset.memoryUsage(CTDataset::BrickBuffer) == 0, "bricks not released");
+}
+
+/**
+ Test cases for the depth maps of all six axis directions: every pixel against marching its ray, the same maps for any
+ number of threads, picking gives the voxel that was hit and a new direction doesn't sweep the volume again
+ */
+void MyLibUnitTest::axisDepthMapsTest()
+{
+    const int WIDTH = 19;
+    const int HEIGHT = 23;
+    const int LAYERS = 13;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*7919 + y*104729 + z*1299709) % 3000 - 1500 + (x - 9)*(x - 9)*5 + y*10);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeView& volume = dataset.volume();
+    const VolumeGeometry& geometry = volume.geometry();
+    const AxisDepthMaps::Direction directions[6] = {AxisDepthMaps::PositiveY, AxisDepthMaps::NegativeY,
+                                                    AxisDepthMaps::PositiveX, AxisDepthMaps::NegativeX,
+                                                    AxisDepthMaps::PositiveZ, AxisDepthMaps::NegativeZ};
+    QVERIFY2(AxisDepthMaps::width(geometry, AxisDepthMaps::NegativeX) == HEIGHT && AxisDepthMaps::height(geometry, AxisDepthMaps::NegativeX) == LAYERS, "wrong size of the x maps");
+    QVERIFY2(AxisDepthMaps::width(geometry, AxisDepthMaps::PositiveZ) == WIDTH && AxisDepthMaps::height(geometry, AxisDepthMaps::PositiveZ) == HEIGHT, "wrong size of the z maps");
+
+    std::vector<short> expected(WIDTH*LAYERS);
+    for (int threshold : {-40000, -1500, 0, 1200, 2400, 40000}){
+        AxisDepthMaps serial;
+        serial.compute(volume, threshold, 1);
+        QVERIFY2(serial.isValid() && serial.threshold() == threshold, "maps not computed");
+
+        // the default direction is the depth buffer of the dataset
+        marchDepthBuffer(volume, threshold, expected.data());
+        std::vector<short> depthMap(WIDTH*LAYERS);
+        serial.fillDepthMap(AxisDepthMaps::PositiveY, depthMap.data());
+        QVERIFY2(depthMap == expected, "PositiveY map differs from the depth buffer");
+
+        for (AxisDepthMaps::Direction direction : directions){
+            const int columns = AxisDepthMaps::width(geometry, direction);
+            const int rows = AxisDepthMaps::height(geometry, direction);
+            for (int row = 0; row < rows; ++row){
+                for (int column = 0; column < columns; ++column){
+                    // march the ray of the pixel from where it enters the volume
+                    int depth = -1;
+                    Voxel voxel;
+                    for (int d = 0; depth < 0 && AxisDepthMaps::voxelAt(geometry, direction, column, row, d, voxel); ++d){
+                        depth = volume.at(voxel.x, voxel.y, voxel.z) >= threshold ? d : -1;
+                    }
+                    QVERIFY2(serial.depth(direction, column, row) == depth, "wrong depth of a ray");
+                }
+            }
+        }
+
+        for (int threads : {3, 0}){
+            AxisDepthMaps parallel;
+            parallel.compute(volume, threshold, threads);
+            for (AxisDepthMaps::Direction direction : directions){
+                std::vector<short> a(size_t(AxisDepthMaps::width(geometry, direction))*AxisDepthMaps::height(geometry, direction));
+                std::vector<short> b(a.size());
+                serial.fillDepthMap(direction, a.data());
+                parallel.fillDepthMap(direction, b.data());
+                QVERIFY2(a == b, "maps depend on the number of threads");
+            }
+        }
+    }
+
+    // picking in a map lands on a voxel at the threshold
+    AxisDepthMaps maps;
+    maps.compute(volume, 1200);
+    for (AxisDepthMaps::Direction direction : directions){
+        for (int row = 0; row < AxisDepthMaps::height(geometry, direction); ++row){
+            const int depth = maps.depth(direction, 5, row);
+            Voxel voxel;
+            if (depth >= 0){
+                QVERIFY2(AxisDepthMaps::voxelAt(geometry, direction, 5, row, depth, voxel), "hit outside the volume");
+                QVERIFY2(volume.at(voxel.x, voxel.y, voxel.z) >= 1200, "picked voxel below the threshold");
+            }
+        }
+    }
+    Voxel outside;
+    QVERIFY2(!AxisDepthMaps::voxelAt(geometry, AxisDepthMaps::PositiveY, 0, 0, 0, outside), "column 0 has a voxel");
+    QVERIFY2(!AxisDepthMaps::voxelAt(geometry, AxisDepthMaps::NegativeZ, WIDTH, 0, 0, outside), "pixel outside the map");
+
+    // the pipeline sweeps once per threshold, other directions only take their map
+    CTPipeline pipeline(dataset);
+    pipeline.setThreshold(1200);
+    for (AxisDepthMaps::Direction direction : directions){
+        pipeline.setViewDirection(direction);
+        QVERIFY2(pipeline.update(CTPipeline::DirectionalView) == 0, "directional view failed");
+        QVERIFY2(pipeline.directionalDepthMap().size() == size_t(AxisDepthMaps::width(geometry, direction))*AxisDepthMaps::height(geometry, direction), "wrong size of the view");
+        QVERIFY2(pipeline.directionalDepthMap()[AxisDepthMaps::width(geometry, direction) + 5] == std::max(0, maps.depth(direction, 5, 1)), "wrong view");
+    }
+    QVERIFY2(pipeline.graph().computeCount(CTPipeline::DirectionalMaps) == 1, "volume swept again for a new direction");
+    QVERIFY2(pipeline.graph().computeCount(CTPipeline::DirectionalView) == 6, "views not shaded");
+}
+
+/**
+ Test cases for the shading of depth maps: the looked up shading equals the shading computed per pixel, also for
+ steep edges, for any number of threads and as 8 bit rows with padding
+ */
+void MyLibUnitTest::shadingTest()
+{
+    for (int width : {1, 2, 3, 17, 400}){
+        const int height = width == 400 ? 400 : 9;
+        std::vector<short> depth(size_t(width)*height);
+        for (size_t i = 0; i < depth.size(); ++i){
+            // smooth surfaces, steps and edges of the background (depth 0) to the far end of the volume
+            depth[i] = short(i % 7 == 0 ? 0 : (i % 13 == 0 ? 32000 : (i*i) % 400));
+        }
+
+        // shading as it was computed per pixel
+        std::vector<short> expected(depth.size(), 0);
+        QElapsedTimer timer;
+        timer.start();
+        for (int y = 1; y < height-1; ++y){
+            for (int x = 1; x < width-1; ++x){
+                float T_x = depth[y*width + (x-1)] - depth[y*width + (x+1)];
+                float T_y = depth[(y-1)*width + x] - depth[(y+1)*width + x];
+                float incidence_angle = (2*2)/(sqrt(pow(2*T_x, 2) + pow(2*T_y, 2) + pow(2*2, 2) ));
+                expected[y*width + x] = 255 * incidence_angle;
+            }
+        }
+        const qint64 perPixel = timer.nsecsElapsed();
+
+        for (int threads : {1, 3, 0}){
+            std::vector<short> shaded(depth.size(), 0);
+            timer.restart();
+            QVERIFY2(MyLib::renderDepthBuffer(depth.data(), width, height, shaded.data(), threads) == 0, "shading failed");
+            const qint64 lookedUp = timer.nsecsElapsed();
+            QVERIFY2(shaded == expected, "shading differs");
+            if (width == 400 && threads == 1){
+                qDebug() << "shading 400x400: per-pixel loop" << perPixel/1000 << "us, lookup table" << lookedUp/1000 << "us";
+            }
+
+            // 8 bit rows with padding, the border becomes 0
+            const int bytesPerLine = width + 5;
+            std::vector<quint8> image(size_t(bytesPerLine)*height, 77);
+            QVERIFY2(MyLib::renderDepthBuffer(depth.data(), width, height, image.data(), bytesPerLine, threads) == 0, "8 bit shading failed");
+            for (int y = 0; y < height; ++y){
+                for (int x = 0; x < width; ++x){
+                    QVERIFY2(image[y*bytesPerLine + x] == expected[y*width + x], "8 bit shading differs");
+                }
+                QVERIFY2(image[y*bytesPerLine + width] == 77, "padding written");
+            }
+        }
+    }
+    QVERIFY2(MyLib::renderDepthBuffer(nullptr, 3, 3, (short*)nullptr) == 1, "missing buffer accepted");
+}
+
+void MyLibUnitTest::rayCasterTest()
+{
+    const int WIDTH = 37;
+    const int HEIGHT = 29;
+    const int LAYERS = 21;
+    QTemporaryDir dir;
+    // air around a block of tissue with bone inside and a few bright specks
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        if ((x*7919 + y*104729 + z*1299709) % 1999 == 0){
+            return short(2500);
+        }
+        if (x < 10 || x > 27 || y < 8 || y > 22 || z < 4 || z > 16){
+            return short(-1000);
+        }
+        return short((x - 18)*(x - 18) + (y - 15)*(y - 15) + (z - 10)*(z - 10) < 20 ? 1200 + x*10 : 40 + y);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeView& volume = dataset.volume();
+    const VolumeGeometry& geometry = volume.geometry();
+    RayCaster caster;
+    RayCaster::Settings settings;
+    quint8 background;
+    QVERIFY2(caster.render(settings, 1, 1, &background, 1) == 1, "rendered without a volume");
+    caster.setVolume(volume);
+
+    // looking along +y with a pixel as wide as a voxel, column c shows x = width - 1 - c and the rows run along +z
+    // through the center of the volume
+    const int ROWS = 2*LAYERS;
+    std::vector<quint8> image(WIDTH*ROWS);
+    const double diagonal = std::sqrt(std::pow(WIDTH*geometry.spacingX(), 2) + std::pow(HEIGHT*geometry.spacingY(), 2)
+                                      + std::pow(LAYERS*geometry.spacingZ(), 2));
+    settings.zoom = diagonal/(WIDTH*geometry.spacingX());
+    WindowingLut lut;
+    lut.update(settings.windowStart, settings.windowWidth);
+    for (RayCaster::Mode mode : {RayCaster::MaximumIntensity, RayCaster::Isosurface}){
+        settings.mode = mode;
+        QVERIFY2(caster.render(settings, WIDTH, ROWS, image.data(), WIDTH, 1) == 0, "axis view not rendered");
+        for (int row = 0; row < ROWS; ++row){
+            const double z = (LAYERS - 1)/2.0 + (row - ROWS/2.0 + 0.5)*geometry.spacingX()/geometry.spacingZ();
+            const int layer = int(std::floor(z + 0.5));
+            if (layer < 0 || layer >= LAYERS || std::fabs(z + 0.5 - std::round(z + 0.5)) < 1e-3){
+                continue; // outside the volume or on the border of two layers
+            }
+            for (int column = 0; column < WIDTH; ++column){
+                int maximum = SHRT_MIN;
+                for (int y = 0; y < HEIGHT; ++y){
+                    maximum = std::max(maximum, int(volume.at(WIDTH - 1 - column, y, layer)));
+                }
+                const int pixel = image[row*WIDTH + column];
+                if (mode == RayCaster::MaximumIntensity){
+                    QVERIFY2(pixel == lut.gray(maximum), "MIP differs from the brightest voxel of the ray");
+                } else {
+                    QVERIFY2((pixel > 0) == (maximum >= settings.threshold), "isosurface hit differs from the ray");
+                }
+            }
+        }
+    }
+
+    // skipping bricks, stopping rays early and the threads don't change the image
+    const int SIZE = 64;
+    std::vector<quint8> expected(SIZE*SIZE);
+    std::vector<quint8> result(SIZE*SIZE);
+    settings.zoom = 1.3;
+    for (RayCaster::Mode mode : {RayCaster::MaximumIntensity, RayCaster::Isosurface, RayCaster::Compositing}){
+        settings.mode = mode;
+        for (double azimuth : {0.0, 37.0, 145.0, -100.0}){
+            for (double elevation : {0.0, 25.0, -60.0, 90.0}){
+                settings.azimuth = azimuth;
+                settings.elevation = elevation;
+                caster.setVolume(volume);
+                caster.render(settings, SIZE, SIZE, expected.data(), SIZE, 1);
+                QVERIFY2(caster.stats().skippedSamples == 0 && caster.stats().samples > 0, "samples without bricks");
+                QVERIFY2(std::count(expected.begin(), expected.end(), 0) < SIZE*SIZE, "empty image");
+                caster.setVolume(volume, &dataset.bricks());
+                for (int threads : {1, 3, 0}){
+                    QVERIFY2(caster.render(settings, SIZE, SIZE, result.data(), SIZE, threads) == 0, "view not rendered");
+                    QVERIFY2(result == expected, "bricks or threads change the image");
+                }
+                QVERIFY2(caster.stats().skippedSamples > 0, "no air skipped");
+                QVERIFY2(caster.stats().tileCount == 16, "wrong number of tiles");
+            }
+        }
+    }
+
+    // a cancelled rendering stops
+    std::atomic<bool> cancel(true);
+    QVERIFY2(caster.render(settings, SIZE, SIZE, result.data(), SIZE, 0, &cancel) == 4, "rendering not cancelled");
+
+    // time of a 400x400 view of a 400x400x200 volume
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 400, 400, 200, [](int x, int y, int z) {
+        const int r2 = (x - 200)*(x - 200) + (y - 200)*(y - 200);
+        return short(r2 > 150*150 ? -1000 : r2 > 140*140 ? 1300 : (x + z) % 97 == 0 ? 1500 : 30 + (y + z) % 40);
+    });
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    caster.setVolume(big.volume(), &big.bricks());
+    std::vector<quint8> view(400*400);
+    settings.azimuth = 30;
+    settings.elevation = 20;
+    settings.zoom = 1;
+    for (RayCaster::Mode mode : {RayCaster::MaximumIntensity, RayCaster::Isosurface, RayCaster::Compositing}){
+        settings.mode = mode;
+        QVERIFY2(caster.render(settings, 400, 400, view.data(), 400) == 0, "view not rendered");
+        const RayCaster::Stats& stats = caster.stats();
+        qDebug() << "ray casting 400x400, mode" << mode << ":" << stats.elapsedNs/1000000 << "ms on" << stats.threadCount
+                 << "threads," << stats.samples << "samples," << stats.skippedSamples << "skipped,"
+                 << stats.terminatedRays << "rays stopped early";
+    }
+}
+
+/**
+ Test cases for ResliceEngine: the cross sections equal the ones sampled pixel by pixel, rows are clipped to the volume
+ and the threads don't change the result
+ */
+void MyLibUnitTest::resliceEngineTest()
+{
+    const int WIDTH = 41;
+    const int HEIGHT = 36;
+    const int LAYERS = 27;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*7919 + y*104729 + z*1299709) % 3000 - 1000);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeView& volume = dataset.volume();
+
+    ResliceEngine engine;
+    std::vector<short> image(size_t(WIDTH)*HEIGHT, 7);
+    QVERIFY2(engine.reslice(WIDTH, HEIGHT, image.data(), WIDTH) == 1, "resliced without a volume");
+    engine.setVolume(volume);
+
+    // an axial plane is a layer, columns beyond the volume are background
+    engine.setPlane(Eigen::Vector3d(0, 0, 6), Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 1, 0));
+    std::vector<short> wide(size_t(WIDTH + 5)*HEIGHT);
+    QVERIFY2(engine.reslice(WIDTH + 5, HEIGHT, wide.data(), WIDTH + 5) == 0, "layer not resliced");
+    for (int y = 0; y < HEIGHT; ++y){
+        for (int x = 0; x < WIDTH + 5; ++x){
+            const short expected = x < WIDTH ? volume.at(x, y, 6) : ResliceEngine::Background;
+            QVERIFY2(wide[y*(WIDTH + 5) + x] == expected, "axial plane differs from the layer");
+        }
+    }
+    int first;
+    int last;
+    engine.clipRow(3, WIDTH + 5, first, last);
+    QVERIFY2(first == 0 && last == WIDTH, "wrong columns inside the volume");
+
+    // planes outside the volume and degenerate planes are background
+    engine.setPlane(Eigen::Vector3d(0, 0, LAYERS + 3), Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 1, 0));
+    engine.reslice(WIDTH, HEIGHT, image.data(), WIDTH);
+    QVERIFY2(std::count(image.begin(), image.end(), short(ResliceEngine::Background)) == WIDTH*HEIGHT, "plane outside the volume");
+    const double nan = std::nan("");
+    engine.setPlane(Eigen::Vector3d(5, 5, 5), Eigen::Vector3d(nan, nan, nan), Eigen::Vector3d(0, 1, 0));
+    engine.reslice(WIDTH, HEIGHT, image.data(), WIDTH);
+    QVERIFY2(std::count(image.begin(), image.end(), short(ResliceEngine::Background)) == WIDTH*HEIGHT, "undefined plane");
+
+    // a sample halfway between two voxels lies in the one with the larger index, the volume covers
+    // [-0.5, size - 0.5) along each axis, so z = -0.5 is in layer 0 and x = WIDTH - 0.5 is outside
+    engine.setPlane(Eigen::Vector3d(-0.5, 2.5, -0.5), Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 0, 1));
+    std::vector<short> ties(size_t(WIDTH + 1)*2);
+    engine.reslice(WIDTH + 1, 2, ties.data(), WIDTH + 1);
+    for (int x = 0; x <= WIDTH; ++x){
+        QVERIFY2(ties[x] == (x < WIDTH ? volume.at(x, 3, 0) : short(ResliceEngine::Background)), "wrong voxel at a tie");
+        QVERIFY2(ties[WIDTH + 1 + x] == (x < WIDTH ? volume.at(x, 3, 1) : short(ResliceEngine::Background)), "wrong layer at a tie");
+    }
+    engine.clipRow(0, WIDTH + 1, first, last);
+    QVERIFY2(first == 0 && last == WIDTH, "wrong columns inside at a tie");
+
+    // oblique cross sections of the dataset equal the ones sampled pixel by pixel
+    std::vector<short> expected(size_t(WIDTH)*HEIGHT);
+    const Voxel axes[5] = {{1, 5, 1}, {0, 1, 0}, {2, -1, 3}, {-4, 1, 1}, {1, 1, 7}};
+    const Voxel positions[3] = {{10, 8, 5}, {20, 18, 13}, {-6, 40, 30}};
+    const Voxel directions[2] = {{1, 0, 0}, {0, 0, 1}};
+    for (const Voxel& axisVoxel : axes){
+        for (const Voxel& position : positions){
+            for (const Voxel& xdirVoxel : directions){
+                dataset.reconstructLayer(position, axisVoxel, xdirVoxel);
+                Eigen::Vector3d axis = Eigen::Vector3d(axisVoxel.x, axisVoxel.y, axisVoxel.z).normalized();
+                Eigen::Vector3d xImDir = axis.cross(Eigen::Vector3d(xdirVoxel.x, xdirVoxel.y, xdirVoxel.z)).cross(axis).normalized();
+                std::fill(expected.begin(), expected.end(), 0);
+                sampleCrosssection(volume, Eigen::Vector3d(position.x, position.y, position.z), xImDir, axis, expected.data());
+                // the last column and row of odd sizes are not part of the cross section
+                for (int y = 0; y < HEIGHT/2*2; ++y){
+                    QVERIFY2(std::equal(expected.begin() + y*WIDTH, expected.begin() + y*WIDTH + WIDTH/2*2,
+                                        dataset.crosssection() + y*WIDTH), "cross section differs");
+                }
+            }
+        }
+    }
+
+    // the threads don't change the result
+    engine.setPlane(Eigen::Vector3d(-30, 10.3, -4.7), Eigen::Vector3d(0.31, 0.05, 0.12), Eigen::Vector3d(0.02, -0.11, 0.09));
+    std::vector<short> serial(300*300);
+    std::vector<short> parallel(300*300);
+    engine.reslice(300, 300, serial.data(), 300, 1);
+    QVERIFY2(std::count(serial.begin(), serial.end(), short(ResliceEngine::Background)) < 300*300, "plane misses the volume");
+    for (int threads : {3, 0}){
+        engine.reslice(300, 300, parallel.data(), 300, threads);
+        QVERIFY2(parallel == serial, "reslice depends on the number of threads");
+    }
+
+    // time of an oblique 400x400 cross section of a 400x400x200 volume
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 400, 400, 200, [](int x, int y, int z) { return short((x + 3*y + 7*z) % 2000); });
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    engine.setVolume(big.volume());
+    engine.setPlane(Eigen::Vector3d(20, -10, 30), Eigen::Vector3d(0.9, 0.3, 0.1), Eigen::Vector3d(-0.1, 0.2, 0.45));
+    std::vector<short> view(400*400);
+    QElapsedTimer timer;
+    timer.start();
+    const int REPEAT = 20;
+    for (int i = 0; i < REPEAT; ++i){
+        engine.reslice(400, 400, view.data(), 400);
+    }
+    qDebug() << "reslicing 400x400:" << timer.nsecsElapsed()/REPEAT/1000 << "us";
+    QVERIFY2(std::count(view.begin(), view.end(), short(ResliceEngine::Background)) < 400*400, "plane misses the volume");
+}
+
+/**
+ Test cases for the interpolation of ResliceEngine: samples at voxel centers are the voxels, trilinear samples equal
+ the interpolation in floating point and the error on a smooth volume goes down from nearest over trilinear to
+ Catmull-Rom
+ */
+void MyLibUnitTest::resliceInterpolationTest()
+{
+    const int WIDTH = 48;
+    const int HEIGHT = 44;
+    const int LAYERS = 40;
+    auto smooth = [](double x, double y, double z) {
+        return 600*std::sin(0.35*x) + 500*std::cos(0.3*y) + 400*std::sin(0.25*z + 0.5);
+    };
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [&](int x, int y, int z) {
+        return short(std::lround(smooth(x, y, z)));
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeView& volume = dataset.volume();
+    const ResliceEngine::Interpolation modes[3] = {ResliceEngine::Nearest, ResliceEngine::Trilinear, ResliceEngine::CatmullRom};
+    ResliceEngine engine;
+    engine.setVolume(volume);
+
+    // at the voxel centers every mode returns the voxels, also at the border of the volume
+    std::vector<short> image(size_t(WIDTH)*HEIGHT);
+    engine.setPlane(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 1, 0));
+    for (ResliceEngine::Interpolation mode : modes){
+        engine.setInterpolation(mode);
+        engine.reslice(WIDTH, HEIGHT, image.data(), WIDTH);
+        for (int y = 0; y < HEIGHT; ++y){
+            for (int x = 0; x < WIDTH; ++x){
+                QVERIFY2(image[y*WIDTH + x] == volume.at(x, y, 0), "sample at a voxel center differs from the voxel");
+            }
+        }
+    }
+
+    // an oblique plane inside the volume, compared with the smooth function the phantom was made of
+    const int SIZE = 60;
+    const Eigen::Vector3d origin(8.3, 3.7, 5.2);
+    const Eigen::Vector3d columnStep(0.53, 0.21, 0.17);
+    const Eigen::Vector3d rowStep(-0.09, 0.4, 0.3);
+    engine.setPlane(origin, columnStep, rowStep);
+    image.resize(SIZE*SIZE);
+    double error[3];
+    for (int m = 0; m < 3; ++m){
+        engine.setInterpolation(modes[m]);
+        engine.reslice(SIZE, SIZE, image.data(), SIZE, 1);
+        std::vector<short> parallel(image.size());
+        engine.reslice(SIZE, SIZE, parallel.data(), SIZE, 3);
+        QVERIFY2(std::equal(image.begin(), image.begin() + SIZE*SIZE, parallel.begin()), "interpolation depends on the threads");
+        double squares = 0;
+        for (int row = 0; row < SIZE; ++row){
+            for (int column = 0; column < SIZE; ++column){
+                const Eigen::Vector3d p = origin + column*columnStep + row*rowStep;
+                const short value = image[row*SIZE + column];
+                squares += std::pow(value - smooth(p.x(), p.y(), p.z()), 2);
+                if (modes[m] == ResliceEngine::Trilinear){
+                    const int x0 = int(std::floor(p.x()));
+                    const int y0 = int(std::floor(p.y()));
+                    const int z0 = int(std::floor(p.z()));
+                    double expected = 0;
+                    for (int corner = 0; corner < 8; ++corner){
+                        const int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+                        expected += volume.at(x0 + dx, y0 + dy, z0 + dz)*(dx ? p.x() - x0 : 1 - p.x() + x0)
+                                *(dy ? p.y() - y0 : 1 - p.y() + y0)*(dz ? p.z() - z0 : 1 - p.z() + z0);
+                    }
+                    QVERIFY2(std::fabs(value - expected) <= 1.5, "trilinear sample differs from floating point");
+                }
+            }
+        }
+        error[m] = std::sqrt(squares/(SIZE*SIZE));
+    }
+    QVERIFY2(error[2] < error[1] && error[1] < error[0], "interpolation doesn't lower the error");
+
+    // quality and time side by side on an oblique 400x400 cross section of a 400x400x200 volume
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 400, 400, 200, [&](int x, int y, int z) {
+        return short(std::lround(smooth(x, y, z)));
+    });
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    engine.setVolume(big.volume());
+    engine.setPlane(Eigen::Vector3d(20, -10, 30), Eigen::Vector3d(0.9, 0.3, 0.1), Eigen::Vector3d(-0.1, 0.2, 0.45));
+    std::vector<short> view(400*400);
+    const char* names[3] = {"nearest", "trilinear", "Catmull-Rom"};
+    for (int m = 0; m < 3; ++m){
+        engine.setInterpolation(modes[m]);
+        QElapsedTimer timer;
+        timer.start();
+        const int REPEAT = 10;
+        for (int i = 0; i < REPEAT; ++i){
+            engine.reslice(400, 400, view.data(), 400);
+        }
+        qDebug() << "reslicing 400x400" << names[m] << ":" << timer.nsecsElapsed()/REPEAT/1000 << "us, RMS error"
+                 << error[m] << "HU";
+    }
+}
+
+/**
+ Test cases for the slabs of ResliceEngine: an axis aligned slab projects the voxels of its layers, planes outside the
+ volume are left out and an oblique slab equals the planes resliced one by one and combined
+ */
+void MyLibUnitTest::resliceSlabTest()
+{
+    const int WIDTH = 40;
+    const int HEIGHT = 36;
+    const int LAYERS = 30;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*7919 + y*104729 + z*1299709) % 3001 - 1000);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    const VolumeView& volume = dataset.volume();
+    const ResliceEngine::SlabProjection projections[3] = {ResliceEngine::MaximumIntensity, ResliceEngine::MinimumIntensity,
+                                                          ResliceEngine::MeanIntensity};
+    ResliceEngine engine;
+    engine.setVolume(volume);
+    std::vector<short> image(size_t(WIDTH)*HEIGHT);
+
+    // 5 layers around layer 10, around layer 1 (layers -1 and 0 lie outside) and around layer -5 (all outside)
+    for (int center : {10, 1, -5}){
+        engine.setPlane(Eigen::Vector3d(0, 0, center), Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 1, 0));
+        for (ResliceEngine::SlabProjection projection : projections){
+            engine.setSlab(5, Eigen::Vector3d(0, 0, 1), projection);
+            engine.reslice(WIDTH, HEIGHT, image.data(), WIDTH);
+            for (int y = 0; y < HEIGHT; ++y){
+                for (int x = 0; x < WIDTH; ++x){
+                    int maximum = INT_MIN;
+                    int minimum = INT_MAX;
+                    int sum = 0;
+                    int count = 0;
+                    for (int z = std::max(center - 2, 0); z <= std::min(center + 2, LAYERS - 1); ++z){
+                        maximum = std::max(maximum, int(volume.at(x, y, z)));
+                        minimum = std::min(minimum, int(volume.at(x, y, z)));
+                        sum += volume.at(x, y, z);
+                        ++count;
+                    }
+                    int expected = ResliceEngine::Background;
+                    if (count > 0){
+                        expected = projection == ResliceEngine::MaximumIntensity ? maximum
+                                 : projection == ResliceEngine::MinimumIntensity ? minimum
+                                 : int(std::lround(double(sum)/count));
+                    }
+                    QVERIFY2(image[y*WIDTH + x] == expected, "slab differs from its layers");
+                }
+            }
+        }
+    }
+
+    // one plane is the plane itself
+    const int SIZE = 50;
+    const Eigen::Vector3d origin(-3.2, 2.9, 4.1);
+    const Eigen::Vector3d columnStep(0.71, 0.2, 0.15);
+    const Eigen::Vector3d rowStep(-0.12, 0.63, 0.33);
+    const Eigen::Vector3d planeStep = columnStep.cross(rowStep).normalized()*0.8;
+    std::vector<short> slab(SIZE*SIZE);
+    std::vector<short> plane(SIZE*SIZE);
+    engine.setPlane(origin, columnStep, rowStep);
+    engine.setSlab(1, planeStep, ResliceEngine::MeanIntensity);
+    engine.reslice(SIZE, SIZE, slab.data(), SIZE);
+    ResliceEngine single;
+    single.setVolume(volume);
+    single.setPlane(origin, columnStep, rowStep);
+    single.reslice(SIZE, SIZE, plane.data(), SIZE);
+    QVERIFY2(slab == plane, "a slab of one plane differs from the plane");
+
+    // an oblique slab cut by the border of the volume equals its planes resliced one by one
+    const int PLANES = 9;
+    for (ResliceEngine::Interpolation interpolation : {ResliceEngine::Nearest, ResliceEngine::Trilinear}){
+        engine.setInterpolation(interpolation);
+        single.setInterpolation(interpolation);
+        for (ResliceEngine::SlabProjection projection : projections){
+            engine.setSlab(PLANES, planeStep, projection);
+            engine.reslice(SIZE, SIZE, slab.data(), SIZE, 1);
+            std::vector<int> maximum(SIZE*SIZE, INT_MIN);
+            std::vector<int> minimum(SIZE*SIZE, INT_MAX);
+            std::vector<int> sum(SIZE*SIZE, 0);
+            std::vector<int> count(SIZE*SIZE, 0);
+            for (int p = 0; p < PLANES; ++p){
+                single.setPlane(origin + (p - (PLANES - 1)/2.0)*planeStep, columnStep, rowStep);
+                single.reslice(SIZE, SIZE, plane.data(), SIZE);
+                for (int row = 0; row < SIZE; ++row){
+                    int first;
+                    int last;
+                    single.clipRow(row, SIZE, first, last);
+                    for (int i = row*SIZE + first; i < row*SIZE + last; ++i){
+                        maximum[i] = std::max(maximum[i], int(plane[i]));
+                        minimum[i] = std::min(minimum[i], int(plane[i]));
+                        sum[i] += plane[i];
+                        ++count[i];
+                    }
+                }
+            }
+            int inside = 0;
+            for (int i = 0; i < SIZE*SIZE; ++i){
+                int expected = ResliceEngine::Background;
+                if (count[i] > 0){
+                    ++inside;
+                    expected = projection == ResliceEngine::MaximumIntensity ? maximum[i]
+                             : projection == ResliceEngine::MinimumIntensity ? minimum[i]
+                             : int(std::lround(double(sum[i])/count[i]));
+                }
+                QVERIFY2(slab[i] == expected, "slab differs from its planes");
+            }
+            QVERIFY2(inside > 0 && inside < SIZE*SIZE, "slab isn't cut by the border of the volume");
+            std::vector<short> parallel(SIZE*SIZE);
+            engine.reslice(SIZE, SIZE, parallel.data(), SIZE, 3);
+            QVERIFY2(parallel == slab, "slab depends on the number of threads");
+        }
+    }
+
+    // walking the bricks gives the same slabs
+    CTDataset bricked;
+    QVERIFY2(bricked.load(path) == 0 && bricked.setVolumeLayout(CTDataset::BrickedLayout, 8) == 0, "volume could not be bricked");
+    ResliceEngine brickedEngine;
+    brickedEngine.setVolume(bricked.volume());
+    brickedEngine.setPlane(origin, columnStep, rowStep);
+    std::vector<short> brickedSlab(SIZE*SIZE);
+    for (ResliceEngine::Interpolation interpolation : {ResliceEngine::Nearest, ResliceEngine::Trilinear}){
+        engine.setInterpolation(interpolation);
+        brickedEngine.setInterpolation(interpolation);
+        for (ResliceEngine::SlabProjection projection : projections){
+            engine.setSlab(PLANES, planeStep, projection);
+            brickedEngine.setSlab(PLANES, planeStep, projection);
+            engine.reslice(SIZE, SIZE, slab.data(), SIZE, 1);
+            brickedEngine.reslice(SIZE, SIZE, brickedSlab.data(), SIZE, 1);
+            QVERIFY2(brickedSlab == slab, "slab differs on the bricks");
+        }
+    }
+
+    // time of a 10 mm slab (21 planes of 0.5 mm) through a 400x400 cross section of a 400x400x200 volume
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 400, 400, 200, [](int x, int y, int z) { return short((x + 3*y + 7*z) % 2000); });
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    engine.setVolume(big.volume());
+    const Eigen::Vector3d bigColumnStep(0.9, 0.3, 0.1);
+    const Eigen::Vector3d bigRowStep(-0.1, 0.2, 0.45);
+    engine.setPlane(Eigen::Vector3d(20, -10, 30), bigColumnStep, bigRowStep);
+    std::vector<short> view(400*400);
+    const char* names[3] = {"nearest", "trilinear", "Catmull-Rom"};
+    const ResliceEngine::Interpolation modes[3] = {ResliceEngine::Nearest, ResliceEngine::Trilinear, ResliceEngine::CatmullRom};
+    for (int m = 0; m < 3; ++m){
+        engine.setInterpolation(modes[m]);
+        engine.setSlab(21, bigColumnStep.cross(bigRowStep).normalized(), ResliceEngine::MaximumIntensity);
+        QElapsedTimer timer;
+        timer.start();
+        const int REPEAT = 5;
+        for (int i = 0; i < REPEAT; ++i){
+            engine.reslice(400, 400, view.data(), 400);
+        }
+        qDebug() << "slab of 21 planes 400x400" << names[m] << ":" << timer.nsecsElapsed()/REPEAT/1000 << "us";
+    }
+    QVERIFY2(std::count(view.begin(), view.end(), short(ResliceEngine::Background)) < 400*400, "slab misses the volume");
+}
+
+/**
+ Test cases for CTDataset::reconstructLayers: both layers equal reconstructLayer along x and z, the images windowed
+ while reslicing equal the layers windowed afterwards, and the instrument overlay is drawn
+ */
+void MyLibUnitTest::layerPairTest()
+{
+    // odd sizes, the last column and row are not part of the layers; 3 threads get chunks of rows of both layers
+    const int WIDTH = 201;
+    const int HEIGHT = 97;
+    const int LAYERS = 30;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short((x*37 + y*101 + z*211) % 1500 - 200);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    WindowingLut lut;
+    lut.update(100, 900);
+    const qint64 SIZE = qint64(WIDTH)*HEIGHT;
+    std::vector<short> layers[2] = {std::vector<short>(SIZE), std::vector<short>(SIZE)};
+    std::vector<quint32> images[2] = {std::vector<quint32>(SIZE + WIDTH), std::vector<quint32>(SIZE + WIDTH)};
+    std::vector<quint32> expectedImage(SIZE + WIDTH);
+    CTDataset::LayerPair target;
+    QVERIFY2(dataset.reconstructLayers({20, 18, 13}, {1, 5, 1}, target) == 1, "missing layers accepted");
+    for (int d = 0; d < 2; ++d){
+        target.layers[d] = layers[d].data();
+        target.images[d] = images[d].data();
+    }
+    // one padding pixel per row like a QImage with a wider scan line
+    target.bytesPerLine = (WIDTH + 1)*4;
+    target.lut = &lut;
+
+    const Voxel directions[2] = {{1, 0, 0}, {0, 0, 1}};
+    for (ResliceEngine::Interpolation interpolation : {ResliceEngine::Nearest, ResliceEngine::Trilinear}){
+        dataset.setInterpolation(interpolation);
+        for (const Voxel& axis : {Voxel{1, 5, 1}, Voxel{2, -1, 3}, Voxel{0, 1, 0}}){
+            const Voxel position = {20, 18, 13};
+            QVERIFY2(dataset.reconstructLayers(position, axis, target, 1) == 0, "layers could not be reconstructed");
+            for (int d = 0; d < 2; ++d){
+                dataset.reconstructLayer(position, axis, directions[d]);
+                for (int y = 0; y < HEIGHT; ++y){
+                    for (int x = 0; x < WIDTH; ++x){
+                        const short expected = x < WIDTH/2*2 && y < HEIGHT/2*2 ? dataset.crosssection()[y*WIDTH + x]
+                                                                               : short(ResliceEngine::Background);
+                        QVERIFY2(layers[d][y*WIDTH + x] == expected, "layer differs from reconstructLayer");
+                    }
+                }
+                CTDataset::windowLayer(layers[d].data(), WIDTH, HEIGHT, lut, expectedImage.data(), target.bytesPerLine);
+                for (int y = 0; y < HEIGHT; ++y){
+                    QVERIFY2(std::equal(expectedImage.begin() + y*(WIDTH + 1), expectedImage.begin() + y*(WIDTH + 1) + WIDTH,
+                                        images[d].begin() + y*(WIDTH + 1)), "windowed image differs from the layer");
+                }
+            }
+            // the rows of both layers are shared by the threads
+            const std::vector<short> serial[2] = {layers[0], layers[1]};
+            QVERIFY2(dataset.reconstructLayers(position, axis, target, 3) == 0, "layers could not be reconstructed");
+            QVERIFY2(layers[0] == serial[0] && layers[1] == serial[1], "layers depend on the number of threads");
+        }
+    }
+
+    // the instrument: a solid line 5 pixels wide above the center, a dashed line 3 pixels wide below it
+    std::fill(layers[0].begin(), layers[0].end(), short(-1000));
+    CTDataset::windowLayer(layers[0].data(), WIDTH, HEIGHT, lut, expectedImage.data(), WIDTH*4);
+    const quint32 RED = 0xffff0000u;
+    for (int y = 0; y < HEIGHT; ++y){
+        for (int x = 0; x < WIDTH; ++x){
+            const bool above = y < HEIGHT/2 && std::abs(x - WIDTH/2) <= 2;
+            const bool below = y >= HEIGHT/2 && (y/8) % 2 == 0 && std::abs(x - WIDTH/2) <= 1;
+            QVERIFY2((expectedImage[y*WIDTH + x] == RED) == (above || below), "instrument overlay differs");
+        }
+    }
+
+    // time of both 400x400 layers of a 400x400x200 volume with windowing: one after the other and fused
+    QTemporaryDir bigDir;
+    QString bigPath = writePhantom(bigDir, 400, 400, 200, [](int x, int y, int z) { return short((x + 3*y + 7*z) % 2000); });
+    CTDataset big;
+    QVERIFY2(big.load(bigPath) == 0, "volume could not be loaded");
+    for (int d = 0; d < 2; ++d){
+        layers[d].resize(400*400);
+        images[d].resize(400*400);
+        target.layers[d] = layers[d].data();
+        target.images[d] = images[d].data();
+    }
+    target.bytesPerLine = 400*4;
+    const int REPEAT = 10;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < REPEAT; ++i){
+        for (int d = 0; d < 2; ++d){
+            big.reconstructLayer({200, 180, 100}, {1, 5, 1}, directions[d]);
+            std::copy(big.crosssection(), big.crosssection() + 400*400, layers[d].begin());
+            CTDataset::windowLayer(layers[d].data(), 400, 400, lut, images[d].data(), 400*4);
+        }
+    }
+    const qint64 separate = timer.nsecsElapsed()/REPEAT/1000;
+    timer.restart();
+    for (int i = 0; i < REPEAT; ++i){
+        big.reconstructLayers({200, 180, 100}, {1, 5, 1}, target);
+    }
+    qDebug() << "two windowed 400x400 layers:" << separate << "us one after the other," << timer.nsecsElapsed()/REPEAT/1000
+             << "us fused";
+}
+
+void MyLibUnitTest::volumeLayoutTest()
+{
+    // odd sizes, so the border bricks are padded in every direction
+    const int WIDTH = 37;
+    const int HEIGHT = 29;
+    const int LAYERS = 21;
+    QTemporaryDir dir;
+    QString path = writePhantom(dir, WIDTH, HEIGHT, LAYERS, [](int x, int y, int z) {
+        return short(y > 6 + (x*3 + z*5) % 11 ? 600 + (x*37 + y*101 + z*211) % 900 : -500 + (x + y + z) % 50);
+    });
+    CTDataset dataset;
+    QVERIFY2(dataset.setVolumeLayout(CTDataset::BrickedLayout) == 1, "layout of a missing volume changed");
+    QVERIFY2(dataset.load(path) == 0, "phantom could not be loaded");
+    // own copy, the volume of the dataset is freed while bricked
+    std::vector<short> voxels(size_t(WIDTH)*HEIGHT*LAYERS);
+    for (int z = 0; z < LAYERS; ++z){
+        for (int y = 0; y < HEIGHT; ++y){
+            dataset.volume().readRow(y, z, voxels.data() + (size_t(z)*HEIGHT + y)*WIDTH);
+        }
+    }
+    const VolumeView linear = VolumeView::linear(voxels.data(), dataset.geometry());
+    std::vector<short> row(WIDTH);
+    for (int brickSize : {8, 16}){
+        BrickedVolume bricked;
+        bricked.build(linear, brickSize, 3);
+        const VolumeView view = bricked.view();
+        QVERIFY2(view.geometry() == linear.geometry() && !view.isStrided(), "bricked view has wrong geometry");
+        for (int z = 0; z < LAYERS; ++z){
+            for (int y = 0; y < HEIGHT; ++y){
+                view.readRow(y, z, row.data());
+                for (int x = 0; x < WIDTH; ++x){
+                    QVERIFY2(view.at(x, y, z) == linear.at(x, y, z), "bricked voxel differs");
+                    QVERIFY2(row[x] == linear.at(x, y, z), "bricked row differs");
+                }
+            }
+        }
+        const qint64 bricks = qint64((WIDTH + brickSize - 1)/brickSize)*((HEIGHT + brickSize - 1)/brickSize)
+                              *((LAYERS + brickSize - 1)/brickSize);
+        QVERIFY2(bricked.memoryUsage() >= bricks*brickSize*brickSize*brickSize*qint64(sizeof(short)), "bricks not counted");
+    }
+
+    // results of the linear layout
+    const int THRESHOLD = 300;
+    const qint64 DEPTH_SIZE = qint64(WIDTH)*LAYERS;
+    QVERIFY2(dataset.calculateDepthBuffer(THRESHOLD, dataset.volume(), 1) == 0, "depth buffer failed");
+    const std::vector<short> depth(dataset.depthbuffer(), dataset.depthbuffer() + DEPTH_SIZE);
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingSpans({WIDTH/2, HEIGHT - 2, LAYERS/2}, THRESHOLD) == 0, "region growing failed");
+    const BitMask region = dataset.region();
+    QVERIFY2(dataset.calculateDepthBuffer(THRESHOLD, region) == 0, "depth buffer of the region failed");
+    const std::vector<short> regionDepth(dataset.depthbuffer(), dataset.depthbuffer() + DEPTH_SIZE);
+    RayCaster caster;
+    RayCaster::Settings settings;
+    settings.threshold = THRESHOLD;
+    settings.azimuth = 30;
+    settings.elevation = 20;
+    std::vector<quint8> rendered[2] = {std::vector<quint8>(48*40), std::vector<quint8>(48*40)};
+    for (int mode = 0; mode < 2; ++mode){
+        settings.mode = mode == 0 ? RayCaster::MaximumIntensity : RayCaster::Isosurface;
+        caster.setVolume(dataset.volume());
+        QVERIFY2(caster.render(settings, 48, 40, rendered[mode].data(), 48, 1) == 0, "ray casting failed");
+    }
+    const ResliceEngine::Interpolation interpolations[3] = {ResliceEngine::Nearest, ResliceEngine::Trilinear,
+                                                             ResliceEngine::CatmullRom};
+    const Voxel axes[3] = {{0, 1, 0}, {1, 5, 1}, {2, -1, 3}};
+    std::vector<short> reslices[3][3];
+    for (int i = 0; i < 3; ++i){
+        dataset.setInterpolation(interpolations[i]);
+        for (int a = 0; a < 3; ++a){
+            dataset.reconstructLayer({18, 14, 10}, axes[a], {1, 0, 0});
+            reslices[i][a].assign(dataset.crosssection(), dataset.crosssection() + qint64(WIDTH)*HEIGHT);
+        }
+    }
+
+    // the same results from the bricks; a copied volume is freed while bricked
+    const qint64 linearMemory = dataset.memoryUsage(CTDataset::ImageBuffer);
+    QVERIFY2(dataset.setVolumeLayout(CTDataset::BrickedLayout, 8, 3) == 0, "volume could not be bricked");
+    QVERIFY2(dataset.volumeLayout() == CTDataset::BrickedLayout && dataset.data() == nullptr, "volume not bricked");
+    QVERIFY2(dataset.memoryUsage(CTDataset::ImageBuffer) > linearMemory, "padded bricks not counted");
+    QVERIFY2(dataset.calculateDepthBuffer(THRESHOLD, dataset.volume(), 1) == 0, "depth buffer failed");
+    QVERIFY2(std::equal(depth.begin(), depth.end(), dataset.depthbuffer()), "depth buffer differs on the bricks");
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingSpans({WIDTH/2, HEIGHT - 2, LAYERS/2}, THRESHOLD) == 0, "region growing failed");
+    QVERIFY2(dataset.region().count() == region.count(), "region differs on the bricks");
+    for (qint64 i = 0; i < region.size(); ++i){
+        QVERIFY2(dataset.region().test(i) == region.test(i), "region differs on the bricks");
+    }
+    dataset.resetRegionGrowing();
+    QVERIFY2(dataset.regionGrowingParallel({WIDTH/2, HEIGHT - 2, LAYERS/2}, THRESHOLD, 3) == 0, "parallel region growing failed");
+    QVERIFY2(dataset.region().count() == region.count(), "parallel region differs on the bricks");
+    QVERIFY2(dataset.calculateDepthBuffer(THRESHOLD, region) == 0, "depth buffer of the region failed");
+    QVERIFY2(std::equal(regionDepth.begin(), regionDepth.end(), dataset.depthbuffer()), "depth buffer of the region differs on the bricks");
+    for (int mode = 0; mode < 2; ++mode){
+        std::vector<quint8> image(rendered[mode].size());
+        settings.mode = mode == 0 ? RayCaster::MaximumIntensity : RayCaster::Isosurface;
+        caster.setVolume(dataset.volume());
+        QVERIFY2(caster.render(settings, 48, 40, image.data(), 48, 1) == 0, "ray casting failed");
+        QVERIFY2(image == rendered[mode], "ray casting differs on the bricks");
+    }
+    for (int i = 0; i < 3; ++i){
+        dataset.setInterpolation(interpolations[i]);
+        for (int a = 0; a < 3; ++a){
+            dataset.reconstructLayer({18, 14, 10}, axes[a], {1, 0, 0});
+            QVERIFY2(std::equal(reslices[i][a].begin(), reslices[i][a].end(), dataset.crosssection()),
+                     "reslice differs on the bricks");
+        }
+    }
+
+    // back to rows of voxels
+    QVERIFY2(dataset.setVolumeLayout(CTDataset::LinearLayout, 8, 3) == 0, "volume could not be restored");
+    QVERIFY2(dataset.volumeLayout() == CTDataset::LinearLayout && dataset.data() != nullptr, "volume not restored");
+    QVERIFY2(dataset.memoryUsage(CTDataset::ImageBuffer) == linearMemory, "bricks not freed");
+    for (int z = 0; z < LAYERS; ++z){
+        for (int y = 0; y < HEIGHT; ++y){
+            for (int x = 0; x < WIDTH; ++x){
+                QVERIFY2(dataset.volume().at(x, y, z) == linear.at(x, y, z), "restored voxel differs");
+            }
+        }
+    }
+
+    // a mapped volume stays mapped
+    CTDataset mapped;
+    QVERIFY2(mapped.load(path, CTDataset::MappedLoad) == 0, "phantom could not be mapped");
+    QVERIFY2(mapped.setVolumeLayout(CTDataset::BrickedLayout, 16) == 0, "mapped volume could not be bricked");
+    QVERIFY2(mapped.isMapped() && mapped.volume().at(5, 20, 7) == linear.at(5, 20, 7), "mapped volume not bricked");
+    QVERIFY2(mapped.setVolumeLayout(CTDataset::LinearLayout) == 0 && mapped.volume().isStrided(), "mapping not restored");
+}
+
+/**
+ Benchmark of the volume layouts: nearest reslices through the center in five orientations should take about the same
+ time on the bricks, on rows of voxels they depend on how often a row of the image leaves a row of the volume.
+ Interpolated reslices are timed for both layouts as well. Only the images are checked, the times are logged. By default
+ the volume has 128^3 voxels; set MYLIB_LARGE_BENCHMARK to use 512^3 voxels (about 512 MB for both layouts), more than
+ the caches hold, which is where the layouts differ.
+ */
+void MyLibUnitTest::volumeLayoutBenchmark()
+{
+    const int SIZE = qEnvironmentVariableIsSet("MYLIB_LARGE_BENCHMARK") ? 512 : 128;
+    const VolumeGeometry geometry(SIZE, SIZE, SIZE, 0.5, 0.5, 0.5);
+    std::vector<short> voxels(size_t(geometry.voxelCount()));
+    for (size_t i = 0; i < voxels.size(); ++i){
+        voxels[i] = short((i*7919) % 3000 - 1000);
+    }
+    const VolumeView linear = VolumeView::linear(voxels.data(), geometry);
+    BrickedVolume bricked;
+    bricked.build(linear, 8);
+
+    // orthonormal steps, the images lie inside the volume in every orientation
+    const int IMAGE = SIZE*45/64;
+    const int REPEAT = 5;
+    const char* names[5] = {"axial", "coronal", "sagittal", "columns along z", "oblique"};
+    const Eigen::Vector3d columnSteps[5] = {{1, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0.6, 0.48, 0.64}};
+    const Eigen::Vector3d rowSteps[5] = {{0, 1, 0}, {0, 0, 1}, {0, 0, 1}, {0, 1, 0}, {-0.8, 0.36, 0.48}};
+    const Eigen::Vector3d center = Eigen::Vector3d::Constant((SIZE - 1)/2.0);
+    std::vector<short> images[2] = {std::vector<short>(IMAGE*IMAGE), std::vector<short>(IMAGE*IMAGE)};
+    ResliceEngine engines[2];
+    engines[0].setVolume(linear);
+    engines[1].setVolume(bricked.view());
+    QElapsedTimer timer;
+    auto fastest = [&](const ResliceEngine& engine, short* image){
+        qint64 best = LLONG_MAX;
+        for (int i = 0; i < REPEAT; ++i){
+            timer.restart();
+            engine.reslice(IMAGE, IMAGE, image, IMAGE, 1);
+            best = std::min(best, timer.nsecsElapsed()/1000);
+        }
+        return best;
+    };
+
+    double spread[2];
+    for (int layout = 0; layout < 2; ++layout){
+        qint64 times[5];
+        QString line;
+        for (int p = 0; p < 5; ++p){
+            for (ResliceEngine& engine : engines){
+                engine.setPlane(center - IMAGE/2.0*(columnSteps[p] + rowSteps[p]), columnSteps[p], rowSteps[p]);
+            }
+            times[p] = fastest(engines[layout], images[layout].data());
+            line += QString("%1 %2 us, ").arg(names[p]).arg(times[p]);
+        }
+        spread[layout] = double(*std::max_element(times, times + 5))/std::max<qint64>(1, *std::min_element(times, times + 5));
+        qDebug() << (layout == 0 ? "linear: " : "bricked:") << qPrintable(line) << "spread" << spread[layout];
+    }
+    QVERIFY2(images[0] == images[1], "reslice differs on the bricks");
+
+    const ResliceEngine::Interpolation interpolations[2] = {ResliceEngine::Trilinear, ResliceEngine::CatmullRom};
+    for (ResliceEngine::Interpolation interpolation : interpolations){
+        qint64 times[2][2];
+        for (int p = 0; p < 2; ++p){
+            const int orientation = p == 0 ? 0 : 4;
+            for (int layout = 0; layout < 2; ++layout){
+                engines[layout].setInterpolation(interpolation);
+                engines[layout].setPlane(center - IMAGE/2.0*(columnSteps[orientation] + rowSteps[orientation]),
+                                         columnSteps[orientation], rowSteps[orientation]);
+                times[layout][p] = fastest(engines[layout], images[layout].data());
+            }
+            QVERIFY2(images[0] == images[1], "interpolated reslice differs on the bricks");
+        }
+        qDebug() << (interpolation == ResliceEngine::Trilinear ? "trilinear:" : "Catmull-Rom:") << "axial" << times[0][0]
+                 << "us linear," << times[1][0] << "us bricked; oblique" << times[0][1] << "us linear," << times[1][1]
+                 << "us bricked";
+    }
+}
 
 QTEST_APPLESS_MAIN(MyLibUnitTest)
 
@@ -1,13 +1,16 @@
 #include "widget.h"
 #include "ui_widget.h"
 #include "ctdataset.h"
+#include "mylib.h"
 #include <QFile>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QElapsedTimer>
 #include <QDebug>
 #include <QMouseEvent>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 #include "Eigen/Core"
 #include "Eigen/Dense"
 
@@ -15,6 +18,7 @@
 Widget::Widget(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::Widget)
+    , pipeline(dataset)
 {
     ui->setupUi(this);
     // Buttons
@@ -30,7 +34,14 @@ Widget::Widget(QWidget *parent)
     connect(ui->horizontalSlider_layerNumber, SIGNAL(valueChanged(int)), this, SLOT(updatedLayerNumber(int)));
     connect(ui->horizontalSlider_thresholdValue, SIGNAL(valueChanged(int)), this, SLOT(updatedThresholdValue(int)));
 
+    // Combo boxes
+    connect(ui->comboBox_view3D, SIGNAL(currentIndexChanged(int)), this, SLOT(updatedViewDirection(int)));
+    connect(ui->comboBox_renderMode, SIGNAL(currentIndexChanged(int)), this, SLOT(updatedRenderMode(int)));
+    connect(ui->comboBox_interpolation, SIGNAL(currentIndexChanged(int)), this, SLOT(updatedInterpolation(int)));
+    connect(ui->comboBox_slabProjection, SIGNAL(currentIndexChanged(int)), this, SLOT(updatedSlab()));
+
     // Spin boxes
+    connect(ui->doubleSpinBox_slabThickness, SIGNAL(valueChanged(double)), this, SLOT(updatedSlab()));
     connect(ui->spinBox_LocalX, SIGNAL(valueChanged(int)), this, SLOT(performLayerReconstruction()));
     connect(ui->spinBox_LocalY, SIGNAL(valueChanged(int)), this, SLOT(performLayerReconstruction()));
     connect(ui->spinBox_LocalZ, SIGNAL(valueChanged(int)), this, SLOT(performLayerReconstruction()));
@@ -38,8 +49,21 @@ Widget::Widget(QWidget *parent)
     connect(ui->spinBox_WorldY, SIGNAL(valueChanged(int)), this, SLOT(performWorldLayerReconstruction()));
     connect(ui->spinBox_WorldZ, SIGNAL(valueChanged(int)), this, SLOT(performWorldLayerReconstruction()));
 
+    // colors of the display cache codes: gray values, the last code marks voxels above the threshold
+    for (int i = 0; i < WindowingLut::OverlayIndex; ++i){
+        displayColors.append(qRgb(i, i, i));
+    }
+    displayColors.append(qRgb(255, 0, 0));
+    // the cache takes 64 MB at 400x400x400 and is skipped for volumes above this budget
+    displayCache.setMemoryBudget(256*1024*1024);
+
     imageLoaded = false;
+    imageLoading = false;
+    loadGeneration = 0;
     depthBufferCreated = false;
+    depthMapDirection = AxisDepthMaps::PositiveY;
+    viewAzimuth = 0;
+    viewElevation = 0;
     validVoxelSelected = false;
     markersLocated = false;
 }
@@ -48,6 +72,13 @@ Widget::Widget(QWidget *parent)
 
 Widget::~Widget()
 {
+    // neither the loading thread nor a background job may call back into a deleted widget
+    viewExecutor.cancelAll();
+    computeExecutor.cancelAll();
+    viewExecutor.waitForIdle();
+    computeExecutor.waitForIdle();
+    displayCache.release();
+    dataset.cancelLoad();
     delete ui;
 }
 
@@ -55,57 +86,140 @@ void Widget::loadImage()
 {
     // open File Dialog to select dataset
     QString imagePath = QFileDialog::getOpenFileName(this, "Open Image", "./", "Raw Image Files (*.raw)");
+    if (imagePath.isEmpty()){
+        return; // cancelled, keep the current volume
+    }
 
-    // try to load dataset
-    int iErrorCode = dataset.load(imagePath);
+    imageLoaded = false;
+    depthBufferCreated = false;
+    validVoxelSelected = false;
+    markersLocated = false;
+    // the cached layers and running jobs belong to the previous volume
+    displayCache.release();
+    viewExecutor.cancelAll();
+    computeExecutor.cancelAll();
+    viewExecutor.waitForIdle();
+    computeExecutor.waitForIdle();
+    depthMap.clear();
+    // nothing runs on the compute thread now, all cached stages become out of date
+    pipeline.volumeChanged();
+
+    // try to load dataset on a background thread; the file is mapped so only the pages of the visible slices are read.
+    // The callbacks run on the loading thread and hand over to the GUI thread, notifications of an older load are dropped.
+    int generation = ++loadGeneration;
+    int iErrorCode = dataset.loadStreaming(imagePath,
+        [this, generation](int firstLayer, int lastLayer){
+            QMetaObject::invokeMethod(this, [this, generation, firstLayer, lastLayer](){
+                if (generation == loadGeneration) layersReady(firstLayer, lastLayer);
+            }, Qt::QueuedConnection);
+        },
+        [this, generation](int errorCode){
+            QMetaObject::invokeMethod(this, [this, generation, errorCode](){
+                if (generation == loadGeneration) loadFinished(errorCode);
+            }, Qt::QueuedConnection);
+        },
+        CTDataset::MappedLoad);
     if (iErrorCode == 0){
+        imageLoading = true;
+        // adapt controls to the size of the loaded volume
+        const VolumeGeometry& geometry = dataset.geometry();
+        ui->horizontalSlider_layerNumber->setMaximum(geometry.layers()-1);
+        ui->spinBox_LocalX->setMaximum(geometry.width());
+        ui->spinBox_LocalY->setMaximum(geometry.height());
+        ui->spinBox_LocalZ->setMaximum(geometry.layers());
+    }
+    else {
+        showLoadError(iErrorCode);
+    }
+}
+
+void Widget::layersReady(int firstLayer, int lastLayer){
+    // show the current layer as soon as its bytes arrived
+    int layer = ui->horizontalSlider_layerNumber->value();
+    if (firstLayer <= layer && layer <= lastLayer){
+        updateSliceView();
+    }
+}
+
+void Widget::loadFinished(int errorCode){
+    dataset.waitForLoad();
+    imageLoading = false;
+    if (errorCode == 0){
         imageLoaded = true;
+        rebuildDisplayCache();
         updateSliceView();
+        // the heavy stages run in the background once the whole volume is available, the markers update the cross sections
         getMarkers();
-        performWorldLayerReconstruction();
         Render3D();
     }
     else {
-        if (iErrorCode == 1){
-            QMessageBox::critical(this, "Warning", "File could not be opened.");
-        } else if (iErrorCode == 2){
-            QMessageBox::critical(this, "Warning", "There is an issue with your image. Please make sure it has the correct format.");
-        } else if (iErrorCode == 3){
-            QMessageBox::critical(this, "Warning", "Unexpected count of read bytes.");
-        }
+        showLoadError(errorCode);
+    }
+}
 
+void Widget::showLoadError(int errorCode){
+    if (errorCode == 1){
+        QMessageBox::critical(this, "Warning", "File could not be opened.");
+    } else if (errorCode == 2){
+        QMessageBox::critical(this, "Warning", "There is an issue with your image. Please make sure it has the correct format.");
+    } else if (errorCode == 3){
+        QMessageBox::critical(this, "Warning", "Unexpected count of read bytes.");
     }
 }
 
 void Widget::Render3D(){
-    if (imageLoaded){
-        QImage image(width, height, QImage::Format_RGB32);
-        image.fill(qRgb(255, 255, 255));
-
-        short shadedBuffer[width*height];
-
+    if (imageLoaded && ui->comboBox_renderMode->currentIndex() > 0){
+        // ray cast views from any angle, the modes follow "Depth map" in comboBox_renderMode
+        RayCaster::Settings settings;
+        settings.mode = RayCaster::Mode(ui->comboBox_renderMode->currentIndex() - 1);
+        settings.azimuth = viewAzimuth;
+        settings.elevation = viewElevation;
+        settings.threshold = ui->horizontalSlider_thresholdValue->value();
+        settings.windowStart = ui->horizontalSlider_startValue->value();
+        settings.windowWidth = ui->horizontalSlider_windowWidth->value();
+        const int width = ui->label_image3D->width();
+        const int height = ui->label_image3D->height();
+        runAsync(computeExecutor, Render3DRequest, [this, settings, width, height](const ComputeExecutor::CancelToken& token) -> std::function<void()> {
+            QImage image(width, height, QImage::Format_Grayscale8);
+            rayCaster.setVolume(dataset.volume(), &dataset.bricks());
+            if (rayCaster.render(settings, width, height, image.bits(), image.bytesPerLine(), 0, token.flag()) != 0){
+                return nullptr;
+            }
+            const RayCaster::Stats stats = rayCaster.stats();
+            const QString figures = QString("Ray casting: %1 ms, %2 samples, %3 skipped")
+                    .arg(stats.elapsedNs/1000000).arg(stats.samples).arg(stats.skippedSamples);
+            return [this, image, figures](){
+                // the ray cast views have no depth map, so clicking them picks no voxel
+                showDepthMap(image, std::vector<short>());
+                ui->label_image3D->setToolTip(figures);
+            };
+        });
+    }
+    else if (imageLoaded){
         int threshold = ui->horizontalSlider_thresholdValue->value();
-
-        // Calculate depthBuffer and set depthBufferCreated to true if successful
-        if (dataset.calculateDepthBuffer(threshold, dataset.data()) == 0){
-            depthBufferCreated = true;
-        }
-        else {
-            QMessageBox::critical(this, "Warning", "Depth buffer couldn't be calculated.");
-        }
-
-        dataset.renderDepthBuffer(shadedBuffer);
-
-        //draw shadedBuffer to image
-        int color;
-        for (int y=0; y < height; ++y){
-            for(int x=0; x < width; ++x){
-                color = shadedBuffer[y*width + x];
-                image.setPixel(x, y, qRgb(color, color, color));
+        AxisDepthMaps::Direction direction = AxisDepthMaps::Direction(ui->comboBox_view3D->currentIndex());
+        runAsync(computeExecutor, Render3DRequest, [this, threshold, direction](const ComputeExecutor::CancelToken&) -> std::function<void()> {
+            const int width = AxisDepthMaps::width(dataset.geometry(), direction);
+            const int height = AxisDepthMaps::height(dataset.geometry(), direction);
+
+            // Calculate depthBuffer if the threshold changed, depthBufferCreated is set when the result is shown.
+            // The default view comes from the running maxima of the rays, the other views share one sweep per threshold
+            // and switching between them only shades the cached map
+            pipeline.setThreshold(threshold);
+            pipeline.setViewDirection(direction);
+            const CTPipeline::Node node = direction == AxisDepthMaps::PositiveY ? CTPipeline::DepthMap : CTPipeline::DirectionalView;
+            if (pipeline.update(node) != 0){
+                return [this](){ QMessageBox::critical(this, "Warning", "Depth buffer couldn't be calculated."); };
             }
-        }
 
-        ui->label_image3D->setPixmap(QPixmap::fromImage(image));
+            std::vector<short> depth = node == CTPipeline::DepthMap ? pipeline.depthMap() : pipeline.directionalDepthMap();
+            QImage image = shadedImage(depth, width, height);
+            return [this, image, depth, direction](){
+                depthBufferCreated = true;
+                showDepthMap(image, depth, direction);
+                ui->label_image3D->setToolTip(QString());
+            };
+        });
     }
     else {
         QMessageBox::critical(this, "Warning", "No image loaded yet.");
@@ -113,17 +227,52 @@ void Widget::Render3D(){
 
 }
 
+void Widget::updatedViewDirection(int index){
+    // the ray cast views start from the same direction, dragging turns them from there
+    static const double ANGLES[6][2] = {{0, 0}, {180, 0}, {90, 0}, {-90, 0}, {0, 90}, {0, -90}};
+    viewAzimuth = ANGLES[index][0];
+    viewElevation = ANGLES[index][1];
+    // the views of the current threshold are ready after the first one, switching just shows another one
+    if (imageLoaded){
+        Render3D();
+    }
+}
+
+void Widget::updatedInterpolation(int){
+    // the cross sections shown are the ones at the instrument tip once the markers are registered
+    if (markersLocated){
+        performWorldLayerReconstruction();
+    } else {
+        performLayerReconstruction();
+    }
+}
+
+void Widget::updatedSlab(){
+    // only the cross sections at the instrument tip are projected as slabs
+    if (markersLocated){
+        performWorldLayerReconstruction();
+    }
+}
+
+void Widget::updatedRenderMode(int){
+    if (imageLoaded){
+        Render3D();
+    }
+}
+
 //--------------------------------------------------------------
 //  Slider updates
 //--------------------------------------------------------------
 
 void Widget::updatedWindowingStart(int value){
     ui->label_startValue->setText("Start Value: " + QString::number(value));
+    rebuildDisplayCache();
     updateSliceView();
 }
 
 void Widget::updatedWindowingWidth(int value){
     ui->label_windowWidth->setText("Window Width: " + QString::number(value));
+    rebuildDisplayCache();
     updateSliceView();
 }
 
@@ -134,47 +283,60 @@ void Widget::updatedLayerNumber(int value){
 
 void Widget::updatedThresholdValue(int value){
     ui->label_thresholdValue->setText("Threshold: " + QString::number(value));
+    rebuildDisplayCache();
     updateSliceView();
 }
 
 //--------------------------------------------------------------
 
 void Widget::updateSliceView(){
+    // while streaming, only layers that have already arrived can be shown
+    int layer = ui->horizontalSlider_layerNumber->value();
+    if (!imageLoaded && !(imageLoading && layer < dataset.layersLoaded())){
+        return;
+    }
+    const int width = dataset.geometry().width();
+    const int height = dataset.geometry().height();
+
     //Initialize performance check
     QElapsedTimer timer;
     timer.start();
 
-    //Variable vom Typ QImage der Größe 512*512 erzeugen und schwarz füllen
-    QImage image(width, height, QImage::Format_RGB32);
-    image.fill(qRgb(0, 0, 0));
-
-    int errorCode = 0;
-    int iGrayvalue = 0;
-
-    int layerconstant = height*width * ui->horizontalSlider_layerNumber->value();
-    int startValueValue = ui->horizontalSlider_startValue->value();
-    int windowWidthValue = ui->horizontalSlider_windowWidth->value();
-    int thresholdValueValue = ui->horizontalSlider_thresholdValue->value();    
-
-    //In einer Doppelschleife über y und x jeweils den zugehörigen index des Speichers berechnen
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            //read Grayvalue at index from m_pImageData/dataset.data()
-            errorCode = CTDataset::windowing(dataset.data()[layerconstant + y*width + x], startValueValue, windowWidthValue, iGrayvalue);
-            // if HU Value exceeds segmenting threshold
-            if (dataset.data()[layerconstant + y*width + x] >= thresholdValueValue){
-                image.setPixel(x, y, qRgb(255, 0, 0));
-            }
-            else {
-                //set pixel at (x,y) to Grayvalue
-                image.setPixel(x, y, qRgb(iGrayvalue, iGrayvalue, iGrayvalue));
+    if (displayCache.isLayerReady(layer)){
+        // the layer is already windowed, wrap it without touching the pixels; a slower view still on its way is dropped
+        viewExecutor.cancel(SliceViewRequest);
+        QImage image(displayCache.layer(layer), width, height, displayCache.bytesPerLine(), QImage::Format_Indexed8);
+        image.setColorTable(displayColors);
+        ui->label_image->setPixmap(QPixmap::fromImage(image));
+        const BrickPyramid::SkipStats skipped = displayCache.skipStats();
+        ui->label_image->setToolTip(QString("%1 % of the windowed voxels filled from bricks")
+                                    .arg(100*skipped.skippedFraction(), 0, 'f', 1));
+    }
+    else {
+        // the table is only rebuilt when a slider changed; voxels above the segmenting threshold are red
+        int startValueValue = ui->horizontalSlider_startValue->value();
+        int windowWidthValue = ui->horizontalSlider_windowWidth->value();
+        int thresholdValueValue = ui->horizontalSlider_thresholdValue->value();
+        sliceLut.update(startValueValue, windowWidthValue, thresholdValueValue, qRgb(255, 0, 0));
+
+        // window the layer in the background, only the view of the last slider position is shown
+        WindowingLut lut = sliceLut;
+        VolumeView volume = dataset.volume();
+        // the bricks only exist once the whole volume arrived, bricks that get a single color are not read
+        const BrickPyramid* bricks = imageLoaded ? &dataset.bricks() : nullptr;
+        runAsync(viewExecutor, SliceViewRequest, [this, lut, volume, bricks, layer, width, height](const ComputeExecutor::CancelToken& token) -> std::function<void()> {
+            //Variable vom Typ QImage der Größe width*height erzeugen, jede Zeile wird vollständig beschrieben
+            QImage image(width, height, QImage::Format_RGB32);
+            DisplayCache::windowLayer(volume, bricks, lut, layer, reinterpret_cast<quint32*>(image.bits()),
+                                      image.bytesPerLine(), token.flag());
+            if (token.isCancelled()){
+                return nullptr;
             }
-        }
+            //Abschließend das image als Pixmap in das Label setzen
+            return [this, image](){ ui->label_image->setPixmap(QPixmap::fromImage(image)); };
+        });
     }
 
-    //Abschließend das image als Pixmap in das Label setzen
-    ui->label_image->setPixmap(QPixmap::fromImage(image));
-
     if (markersLocated && ui->checkBox_autoUpdateCrosssections->isChecked()){
         performWorldLayerReconstruction();
     }
@@ -182,22 +344,35 @@ void Widget::updateSliceView(){
     //qDebug() << timer.nsecsElapsed();
 }
 
+void Widget::rebuildDisplayCache(){
+    if (!imageLoaded){
+        return;
+    }
+    // convert the volume with the new windowing in the background, starting at the visible layer
+    sliceLut.update(ui->horizontalSlider_startValue->value(), ui->horizontalSlider_windowWidth->value(),
+                    ui->horizontalSlider_thresholdValue->value(), qRgb(255, 0, 0));
+    displayCache.rebuild(dataset.volume(), sliceLut, ui->horizontalSlider_layerNumber->value(), 0, &dataset.bricks());
+}
+
 void Widget::mousePressEvent(QMouseEvent *event){
+    const VolumeGeometry& geometry = dataset.geometry();
+    const int width = geometry.width();
     QPoint globalPos = event->pos();
     QPoint imagePos = (ui->label_image->mapFromParent(globalPos));
     QPoint image3DPos = (ui->label_image3D->mapFromParent(globalPos));
+    dragStart = globalPos;
 
     // if clicked in image
-    if (ui->label_image->rect().contains(imagePos)){
+    if (ui->label_image->rect().contains(imagePos) && imagePos.x() < width && imagePos.y() < geometry.height()){
         ui->label_X->setText("X: " + QString::number(width - imagePos.x()));
-        ui->label_X_real->setText("X: " + QString::number((width - imagePos.x())*0.3625) + "mm"); //real
+        ui->label_X_real->setText("X: " + QString::number((width - imagePos.x())*geometry.spacingX()) + "mm"); //real
         voxel.x = width - imagePos.x();
-        ui->label_Y->setText("Y: " + QString::number(height - imagePos.y()));
-        ui->label_Y_real->setText("Y: " + QString::number((height - imagePos.y())*0.325) + "mm"); //real
-        voxel.y = height - imagePos.y();
+        ui->label_Y->setText("Y: " + QString::number(geometry.height() - imagePos.y()));
+        ui->label_Y_real->setText("Y: " + QString::number((geometry.height() - imagePos.y())*geometry.spacingY()) + "mm"); //real
+        voxel.y = geometry.height() - imagePos.y();
         if (depthBufferCreated){
             ui->label_Z->setText("Z: " + QString::number(ui->horizontalSlider_layerNumber->value()));
-            ui->label_Z_real->setText("Z: " + QString::number(ui->horizontalSlider_layerNumber->value()*0.35) + "mm");
+            ui->label_Z_real->setText("Z: " + QString::number(ui->horizontalSlider_layerNumber->value()*geometry.spacingZ()) + "mm");
             voxel.z = ui->horizontalSlider_layerNumber->value();
             validVoxelSelected = true;
         }
@@ -206,115 +381,104 @@ void Widget::mousePressEvent(QMouseEvent *event){
         }
     }
 
-    // if clicked in image3D
-    if (ui->label_image3D->rect().contains(image3DPos)){
-        ui->label_X->setText("X: " + QString::number(image3DPos.x()));
-        ui->label_X_real->setText("X: " + QString::number(image3DPos.x()*0.3625) + "mm");
-        voxel.x = width - image3DPos.x();
-        ui->label_Z->setText("Z: " + QString::number(image3DPos.y()));
-        ui->label_Z_real->setText("Z: " + QString::number(image3DPos.y()*0.35) + "mm");
-        voxel.z = image3DPos.y();
-        if (depthBufferCreated){
-            ui->label_Y->setText("Y: " + QString::number(dataset.depthbuffer()[image3DPos.y()*width + image3DPos.x()]));
-            ui->label_Y_real->setText("Y: " + QString::number((dataset.depthbuffer()[image3DPos.y()*width + image3DPos.x()])*0.325) + "mm");
-            voxel.y = dataset.depthbuffer()[image3DPos.y()*width + image3DPos.x()];
+    // if clicked in image3D, the depth map of the shown direction gives the missing coordinate
+    const int width3D = AxisDepthMaps::width(geometry, depthMapDirection);
+    const int height3D = AxisDepthMaps::height(geometry, depthMapDirection);
+    if (ui->label_image3D->rect().contains(image3DPos) && image3DPos.x() < width3D && image3DPos.y() < height3D){
+        Voxel picked;
+        if (depthBufferCreated && !depthMap.empty()
+                && AxisDepthMaps::voxelAt(geometry, depthMapDirection, image3DPos.x(), image3DPos.y(),
+                                          depthMap[image3DPos.y()*width3D + image3DPos.x()], picked)){
+            voxel = picked;
+            ui->label_X->setText("X: " + QString::number(voxel.x));
+            ui->label_X_real->setText("X: " + QString::number(voxel.x*geometry.spacingX()) + "mm");
+            ui->label_Y->setText("Y: " + QString::number(voxel.y));
+            ui->label_Y_real->setText("Y: " + QString::number(voxel.y*geometry.spacingY()) + "mm");
+            ui->label_Z->setText("Z: " + QString::number(voxel.z));
+            ui->label_Z_real->setText("Z: " + QString::number(voxel.z*geometry.spacingZ()) + "mm");
             validVoxelSelected = true;
         }
         else {
+            ui->label_X->setText("X: -");
             ui->label_Y->setText("Y: -");
+            ui->label_Z->setText("Z: -");
         }
     }
 
 }
 
 void Widget::startRegionGrowing(){
-    QImage image(width, height, QImage::Format_RGB32);
-    image.fill(qRgb(255, 255, 255));
-    short shadedBuffer[width*height];
-
-    std::vector <Voxel> region;
-    int errorCode;
-
     if (!validVoxelSelected){
-        errorCode = 3;
         QMessageBox::critical(this, "Error", "No valid seed selected");
+        return;
     }
-    else{
+
+    // a new seed cancels a region growing that is still running
+    Voxel seed = voxel;
+    int threshold = ui->horizontalSlider_thresholdValue->value();
+    runAsync(computeExecutor, RegionGrowingRequest, [this, seed, threshold](const ComputeExecutor::CancelToken& token) -> std::function<void()> {
         // Clear region storage and visited_voxel list
-        for (int i=0; i < width*height*layers; i++){
-            dataset.region()[i] = 0;
-            dataset.visited_voxel[i] = false;
-        }
+        dataset.resetRegionGrowing();
 
         // Perform region growing
-        int threshold = ui->horizontalSlider_thresholdValue->value();
-        if (voxel.x >= 0 && voxel.y >= 0 && voxel.z >= 0){
-            errorCode = dataset.regionGrowing(voxel, threshold, region);
+        int errorCode;
+        if (seed.x >= 0 && seed.y >= 0 && seed.z >= 0){
+            errorCode = dataset.regionGrowingSpans(seed, threshold, nullptr, token.flag());
         } else {
             errorCode = 1; // Voxel invalid
         }
 
-        if (errorCode == 0){ // Everything OK
-            dataset.calculateDepthBuffer(threshold, dataset.region());
+        if (errorCode == 1) { return [this](){ QMessageBox::critical(this, "Error", "Invalid seed"); }; }
+        else if (errorCode == 2) { return [this](){ QMessageBox::critical(this, "Error", "Seed below threshold"); }; }
+        else if (errorCode != 0) { return nullptr; } // cancelled
 
-            dataset.renderDepthBuffer(shadedBuffer);
-
-            //draw depthbuffer to image
-            int color;
-            for (int y=0; y < height; ++y){
-                for(int x=0; x < width; ++x){
-                    color = shadedBuffer[y*width + x];
-                    image.setPixel(x,y,qRgb(color, color, color));
-                }
-            }
+        // the depth buffer has one row per layer
+        const int width = dataset.geometry().width();
+        const int height = dataset.geometry().layers();
+        dataset.calculateDepthBuffer(threshold, dataset.region());
+        std::vector<short> depth(dataset.depthbuffer(), dataset.depthbuffer() + width*height);
+        QImage image = shadedImage(depth, width, height);
 
-            ui->label_image3D->setPixmap(QPixmap::fromImage(image));
-        }
-        else if (errorCode == 1) { QMessageBox::critical(this, "Error", "Invalid seed"); }
-        else if (errorCode == 2) { QMessageBox::critical(this, "Error", "Seed below threshold"); }
-    }
+        // Region and visited flags are kept (one bit per voxel), the next reset only clears what this run touched
+        return [this, image, depth](){ showDepthMap(image, depth); };
+    });
 }
 
 void Widget::getMarkers(){
     if (imageLoaded){
-        QImage image(width, height, QImage::Format_RGB32);
-        image.fill(qRgb(255, 255, 255));
-
-        Voxel centroid;
-        short shadedBuffer[width*height];
-
-        dataset.getRegistrationMarkers(1500);
-
-        // get depth map of marker regions
-        dataset.calculateDepthBuffer(1500, dataset.region());
-        dataset.renderDepthBuffer(shadedBuffer);
-
-        dataset.registerMarkers();
-
-        // draw shadedBuffer to image
-        int color;
-        for (int y=0; y < height; ++y){
-            for(int x=0; x < width; ++x){
-                color = shadedBuffer[y*width + x];
-                image.setPixel(x, y, qRgb(color, color, color));
+        runAsync(computeExecutor, MarkerRequest, [this](const ComputeExecutor::CancelToken& token) -> std::function<void()> {
+            // the depth buffer has one row per layer
+            const int width = dataset.geometry().width();
+            const int height = dataset.geometry().layers();
+
+            // markers and registration are only computed again for a new volume
+            pipeline.setMarkerThreshold(1500);
+            if (pipeline.update(CTPipeline::Markers) != 0 || token.isCancelled()){
+                return nullptr;
             }
-        }
-
-        // draw marker centroids to image
-        while (!dataset.markerCentroids.empty()){
-            centroid = dataset.markerCentroids.back();
-            dataset.markerCentroids.pop_back();
-
-            // draw cross on centroid position
-            for (int i=-2; i<=2; i++){
-                for (int j=-2; j<=2; j++){
-                    image.setPixel((width-centroid.x)+i, centroid.z+j, qRgb(255, 0, 0));
+            pipeline.update(CTPipeline::Registration);
+
+            // draw shaded depth map of the marker regions to image, in color for the centroids
+            std::vector<short> depth = pipeline.markerDepthMap();
+            QImage image = shadedImage(depth, width, height).convertToFormat(QImage::Format_RGB32);
+
+            // draw marker centroids to image
+            for (const Voxel& centroid : pipeline.markerCentroids()){
+                // draw cross on centroid position
+                for (int i=-2; i<=2; i++){
+                    for (int j=-2; j<=2; j++){
+                        image.setPixel((width-centroid.x)+i, centroid.z+j, qRgb(255, 0, 0));
+                    }
                 }
             }
-        }
 
-        ui->label_image3D->setPixmap(QPixmap::fromImage(image));
-        markersLocated = true;
+            return [this, image, depth](){
+                showDepthMap(image, depth);
+                markersLocated = true;
+                // the cross sections depend on the registration
+                performWorldLayerReconstruction();
+            };
+        });
     }
     else {
         QMessageBox::critical(this, "Warning", "Can't calculate registration markers.");
@@ -322,105 +486,137 @@ void Widget::getMarkers(){
 }
 
 void Widget::performLayerReconstruction(){
+    if (!imageLoaded){
+        return;
+    }
     Voxel pos = {108, 194, 129};
     Voxel axis = {1, 5, 1};
-    Voxel xdir = {1, 0, 0};
 
     int x = ui->spinBox_LocalX->value();
     int y = ui->spinBox_LocalY->value();
     int z = ui->spinBox_LocalZ->value();
     pos = {x, y, z};
 
-    dataset.reconstructLayer(pos, axis, xdir);
-
-    // loop over crosssectionImageData to create image_Xdir
-    int iGrayvalue = 0;
-    int startValueValue = ui->horizontalSlider_startValue->value();
-    int windowWidthValue = ui->horizontalSlider_windowWidth->value();
-    QImage image(width, height, QImage::Format_RGB32);
-    image.fill(qRgb(255, 255, 255));
-    for (int y=0; y < height; ++y){
-        for(int x=0; x < width; ++x){
-            CTDataset::windowing(dataset.crosssectionImageData[y*width + x], startValueValue, windowWidthValue, iGrayvalue);
-            image.setPixel(x, y, qRgb(iGrayvalue, iGrayvalue, iGrayvalue));
+    crosssectionLut.update(ui->horizontalSlider_startValue->value(), ui->horizontalSlider_windowWidth->value());
+    WindowingLut lut = crosssectionLut;
+    ResliceEngine::Interpolation interpolation = ResliceEngine::Interpolation(ui->comboBox_interpolation->currentIndex());
+    runAsync(computeExecutor, ResliceRequest, [this, pos, axis, lut, interpolation](const ComputeExecutor::CancelToken&) -> std::function<void()> {
+        // the layers are only reconstructed again if the position or the sampling changed, a new windowing just converts them
+        pipeline.setLocalReslice(pos, axis);
+        pipeline.setInterpolation(interpolation);
+        // create image_Xdir and image_Zdir
+        QImage imageX;
+        QImage imageZ;
+        if (!crosssectionImages(CTPipeline::LocalReslices, lut, imageX, imageZ)){
+            return nullptr;
         }
-    }
-    drawInstrumentOverlay(image);
-    ui->label_image_Xdir->setPixmap(QPixmap::fromImage(image));
-
-    // loop over crosssectionImageData to create image_Zdir
-    xdir = {0, 0, 1};
-    dataset.reconstructLayer(pos, axis, xdir);
-    image.fill(qRgb(255, 255, 255));
-    for (int y=0; y < height; ++y){
-        for(int x=0; x < width; ++x){
-            CTDataset::windowing(dataset.crosssectionImageData[y*width + x], startValueValue, windowWidthValue, iGrayvalue);
-            image.setPixel(x, y, qRgb(iGrayvalue, iGrayvalue, iGrayvalue));
-        }
-    }
-    drawInstrumentOverlay(image);
-    ui->label_image_Zdir->setPixmap(QPixmap::fromImage(image));
+        return [this, imageX, imageZ](){
+            ui->label_image_Xdir->setPixmap(QPixmap::fromImage(imageX));
+            ui->label_image_Zdir->setPixmap(QPixmap::fromImage(imageZ));
+        };
+    });
 }
 
 void Widget::performWorldLayerReconstruction(){
     if (markersLocated){
-        int iGrayvalue = 0;
-        int startValueValue = ui->horizontalSlider_startValue->value();
-        int windowWidthValue = ui->horizontalSlider_windowWidth->value();
-        QImage image(width, height, QImage::Format_RGB32);
         Eigen::Vector3d worldPos = {-15, -65, -57};
         Eigen::Vector3d worldAxis = {0.688, -0.688, 0.23};
-        Voxel xdir = {1, 0, 0};
 
         int x = ui->spinBox_WorldX->value();
         int y = ui->spinBox_WorldY->value();
         int z = ui->spinBox_WorldZ->value();
         worldPos = {x, y, z};
 
-
-        // loop over crosssectionImageData to create image_Xdir
-        dataset.reconstructLayer_world(worldPos, worldAxis, xdir);
-        image.fill(qRgb(255, 255, 255));
-        for (int y=0; y < height; ++y){
-            for(int x=0; x < width; ++x){
-                CTDataset::windowing(dataset.crosssectionImageData[y*width + x], startValueValue, windowWidthValue, iGrayvalue);
-                image.setPixel(x, y, qRgb(iGrayvalue, iGrayvalue, iGrayvalue));
-            }
-        }
-        drawInstrumentOverlay(image);
-        ui->label_image_Xdir->setPixmap(QPixmap::fromImage(image));
-
-        // loop over crosssectionImageData to create image_Zdir
-        xdir = {0, 0, 1};
-        dataset.reconstructLayer_world(worldPos, worldAxis, xdir);
-        image.fill(qRgb(255, 255, 255));
-        for (int y=0; y < height; ++y){
-            for(int x=0; x < width; ++x){
-                CTDataset::windowing(dataset.crosssectionImageData[y*width + x], startValueValue, windowWidthValue, iGrayvalue);
-                image.setPixel(x, y, qRgb(iGrayvalue, iGrayvalue, iGrayvalue));
+        // slider drags request many cross sections, only the last one is computed
+        crosssectionLut.update(ui->horizontalSlider_startValue->value(), ui->horizontalSlider_windowWidth->value());
+        WindowingLut lut = crosssectionLut;
+        ResliceEngine::Interpolation interpolation = ResliceEngine::Interpolation(ui->comboBox_interpolation->currentIndex());
+        double slabThickness = ui->doubleSpinBox_slabThickness->value();
+        ResliceEngine::SlabProjection projection = ResliceEngine::SlabProjection(ui->comboBox_slabProjection->currentIndex());
+        runAsync(computeExecutor, ResliceRequest, [this, worldPos, worldAxis, lut, interpolation, slabThickness, projection](const ComputeExecutor::CancelToken&) -> std::function<void()> {
+            // the layers are only reconstructed again if the tip, the sampling or the slab changed, a new windowing just converts them
+            pipeline.setWorldReslice(worldPos, worldAxis);
+            pipeline.setInterpolation(interpolation);
+            pipeline.setSlab(slabThickness, projection);
+            // create image_Xdir and image_Zdir
+            QImage imageX;
+            QImage imageZ;
+            if (!crosssectionImages(CTPipeline::WorldReslices, lut, imageX, imageZ)){
+                return nullptr;
             }
-        }
-        drawInstrumentOverlay(image);
-        ui->label_image_Zdir->setPixmap(QPixmap::fromImage(image));
+            return [this, imageX, imageZ](){
+                ui->label_image_Xdir->setPixmap(QPixmap::fromImage(imageX));
+                ui->label_image_Zdir->setPixmap(QPixmap::fromImage(imageZ));
+            };
+        });
     }
     else {
          QMessageBox::critical(this, "Warning", "Markers not registered yet.");
     }
 }
 
-void Widget::drawInstrumentOverlay(QImage &image){
-    for (int y=0; y< height/2; y++){
-        for (int x=(width/2)-2; x<=(width/2)+2; x++){
-            image.setPixel(x, y, qRgb(255, 0, 0));
-        }
+void Widget::mouseMoveEvent(QMouseEvent *event){
+    // dragging label_image3D turns the ray cast views, half a degree per pixel
+    if (!imageLoaded || ui->comboBox_renderMode->currentIndex() == 0 || !(event->buttons() & Qt::LeftButton)
+            || !ui->label_image3D->rect().contains(ui->label_image3D->mapFromParent(dragStart))){
+        return;
     }
-    for (int y=height/2; y< height; y++){
-        for (int x=(width/2)-1; x<=(width/2)+1; x++){
-            if ((y/8)%2 == 0){
-                image.setPixel(x, y, qRgb(255, 0, 0));
-            }
+    const QPoint delta = event->pos() - dragStart;
+    dragStart = event->pos();
+    viewAzimuth = std::fmod(viewAzimuth + 0.5*delta.x(), 360.0);
+    viewElevation = std::max(-90.0, std::min(90.0, viewElevation - 0.5*delta.y()));
+    Render3D();
+}
 
-        }
-    }
+/**
+ * @brief Widget::crosssectionImages updates the world or local reslices and shows them in two images
+ * @param node CTPipeline::WorldReslices or CTPipeline::LocalReslices
+ * @param lut windowing
+ * @param imageX receives the layer along x
+ * @param imageZ receives the layer along z
+ * @return false if the reslices could not be computed
+ */
+bool Widget::crosssectionImages(CTPipeline::Node node, const WindowingLut& lut, QImage& imageX, QImage& imageZ){
+    const int width = dataset.geometry().width();
+    const int height = dataset.geometry().height();
+    imageX = QImage(width, height, QImage::Format_RGB32);
+    imageZ = QImage(width, height, QImage::Format_RGB32);
+    return pipeline.updateCrosssections(node, reinterpret_cast<quint32*>(imageX.bits()), reinterpret_cast<quint32*>(imageZ.bits()),
+                                        imageX.bytesPerLine(), lut) == 0;
+}
+
+/**
+ * @brief Widget::shadedImage shades a depth map straight into a gray image
+ */
+QImage Widget::shadedImage(const std::vector<short>& depthMap, int width, int height){
+    QImage image(width, height, QImage::Format_Grayscale8);
+    MyLib::renderDepthBuffer(depthMap.data(), width, height, image.bits(), image.bytesPerLine());
+    return image;
+}
 
+void Widget::showDepthMap(const QImage& image, const std::vector<short>& depth, AxisDepthMaps::Direction direction){
+    ui->label_image3D->setPixmap(QPixmap::fromImage(image));
+    depthMap = depth;
+    depthMapDirection = direction;
+}
+
+/**
+ * @brief Widget::runAsync runs a job on a background thread and hands its result to the GUI thread
+ *
+ * The result is dropped if the job was cancelled or a newer request of the same kind was submitted in the meantime.
+ * @param executor viewExecutor for jobs that only read the volume, computeExecutor for jobs using the dataset
+ * @param request the kind of request
+ * @param job the work, returns the function that shows the result
+ */
+void Widget::runAsync(ComputeExecutor& executor, Request request, AsyncJob job){
+    ComputeExecutor* target = &executor;
+    executor.submit(request, [this, target, job](const ComputeExecutor::CancelToken& token){
+        std::function<void()> show = job(token);
+        if (!show || token.isCancelled()){
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, target, token, show](){
+            if (target->isCurrent(token.key(), token.version())) show();
+        }, Qt::QueuedConnection);
+    });
 }
@@ -3,6 +3,15 @@
 
 #include <QWidget>
 #include "ctdataset.h"
+#include "windowinglut.h"
+#include "displaycache.h"
+#include "computeexecutor.h"
+#include "ctpipeline.h"
+#include "raycaster.h"
+#include <QImage>
+#include <QVector>
+#include <functional>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class Widget; }
@@ -19,18 +28,53 @@ public:
 private:
     Ui::Widget *ui;
 
+    /// Kinds of background requests, a newer request replaces an older one of the same kind
+    enum Request { SliceViewRequest, Render3DRequest, ResliceRequest, RegionGrowingRequest, MarkerRequest };
+    /// A background job returns the function that shows its result on the GUI thread, or nullptr if there is none
+    typedef std::function<std::function<void()>(const ComputeExecutor::CancelToken&)> AsyncJob;
+    void runAsync(ComputeExecutor& executor, Request request, AsyncJob job);
+
     void updateSliceView();
+    void rebuildDisplayCache();
+
+    bool crosssectionImages(CTPipeline::Node node, const WindowingLut& lut, QImage& imageX, QImage& imageZ);
+    static QImage shadedImage(const std::vector<short>& depthMap, int width, int height);
+    void showDepthMap(const QImage& image, const std::vector<short>& depth,
+                      AxisDepthMaps::Direction direction = AxisDepthMaps::PositiveY);
 
-    void drawInstrumentOverlay(QImage &image);
+    void layersReady(int firstLayer, int lastLayer);
+    void loadFinished(int errorCode);
+    void showLoadError(int errorCode);
 
     CTDataset dataset;
+    /// Cached processing stages of dataset, only used on the compute thread
+    CTPipeline pipeline;
     Voxel voxel;
 
-    int width = 400;
-    int height = 400;
-    int layers = 400;
+    /// HU to color tables of the slice view (with threshold overlay) and the cross sections
+    WindowingLut sliceLut;
+    WindowingLut crosssectionLut;
+    /// Windowed 8 bit copy of the volume for layer scrubbing, and its colors (gray values, red overlay)
+    DisplayCache displayCache;
+    QVector<QRgb> displayColors;
+
+    /// Slice views only read the volume and run beside the jobs that use the working buffers of the dataset
+    ComputeExecutor viewExecutor;
+    ComputeExecutor computeExecutor;
+    /// Copy of the depth buffer behind label_image3D, the dataset's buffer belongs to the compute thread
+    std::vector<short> depthMap;
+    /// Direction of depthMap, see AxisDepthMaps for the layout
+    AxisDepthMaps::Direction depthMapDirection;
+    /// Renders the views of comboBox_renderMode other than the depth map, only used on the compute thread
+    RayCaster rayCaster;
+    /// Camera of the ray cast views in degrees, set by comboBox_view3D and by dragging label_image3D
+    double viewAzimuth;
+    double viewElevation;
+    QPoint dragStart;
 
     bool imageLoaded;
+    bool imageLoading;
+    int loadGeneration;
     bool depthBufferCreated;
     bool validVoxelSelected;
     bool markersLocated;
@@ -42,11 +86,16 @@ private slots:
     void updatedWindowingWidth(int value);
     void updatedLayerNumber(int value);
     void updatedThresholdValue(int value);
+    void updatedViewDirection(int index);
+    void updatedRenderMode(int index);
+    void updatedInterpolation(int index);
+    void updatedSlab();
 
     void Render3D();
     void startRegionGrowing();
 
     void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
 
     void getMarkers();
     void performLayerReconstruction();